@@ -0,0 +1,422 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "AdaptiveHuffman.h"
+#include "Huffman.h"
+#include "Benchmark.h"
+#include "Varint.h"
+
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+
+namespace { //Avoid contaminating global namespace
+
+const uint32_t adaptive_first_interval = 16;
+const uint32_t adaptive_max_interval = 4096;
+
+/**
+  * Halving the counts when they sum to 2^16 bounds the code lengths: a code 
+  * of length L needs a total count of at least Fibonacci(L+2), and 
+  * Fibonacci(25) > 2^16 gives codes of at most 22 bits. It also lets a count 
+  * and a symbol share one integer when sorting.
+  */
+const uint32_t adaptive_max_total = 1 << 16;
+const unsigned int adaptive_longest_code = 22;
+
+/**
+  * Reverses the lowest length_ bits of code_
+  */
+inline uint32_t reverseBits(uint32_t code_, unsigned int length_) {
+    code_ = ((code_ >> 1) & 0x55555555) | ((code_ & 0x55555555) << 1);
+    code_ = ((code_ >> 2) & 0x33333333) | ((code_ & 0x33333333) << 2);
+    code_ = ((code_ >> 4) & 0x0F0F0F0F) | ((code_ & 0x0F0F0F0F) << 4);
+    code_ = ((code_ >> 8) & 0x00FF00FF) | ((code_ & 0x00FF00FF) << 8);
+    code_ = (code_ >> 16) | (code_ << 16);
+    return code_ >> (32 - length_);
+}
+
+} // Namespace
+
+AdaptiveHuffmanModel::AdaptiveHuffmanModel() {
+    std::fill(m_counts, m_counts+num_symbols, 1);
+    m_total = num_symbols;
+    m_interval = adaptive_first_interval;
+    m_until_rebuild = m_interval;
+    rebuild();
+}
+
+/**
+  * Halves the counts if needed, doubles the rebuild interval up to its 
+  * bound, and rebuilds the codes
+  */
+void AdaptiveHuffmanModel::endInterval() {
+    m_total += m_interval;
+    if (m_total >= adaptive_max_total) {
+        m_total = 0;
+        for (unsigned int i=0; i<num_symbols; ++i) {
+            m_counts[i] = (m_counts[i] + 1) >> 1;
+            m_total += m_counts[i];
+        }
+    }
+    m_interval = std::min(2*m_interval, adaptive_max_interval);
+    m_until_rebuild = m_interval;
+    rebuild();
+}
+
+/**
+  * Builds Huffman code lengths with the two queue method over the symbols 
+  * sorted by count, and then assigns canonical codes. Ties are broken by 
+  * symbol value, so that the encoder and decoder get identical codes.
+  */
+void AdaptiveHuffmanModel::rebuild() {
+    //Leaves are nodes [0, num_symbols) in sorted order, internal nodes follow
+    uint32_t order[num_symbols];
+    for (unsigned int i=0; i<num_symbols; ++i) {
+        order[i] = (m_counts[i] << 9) | i;
+    }
+    std::sort(order, order+num_symbols);
+
+    uint32_t weight[2*num_symbols];
+    uint16_t parent[2*num_symbols];
+    for (unsigned int i=0; i<num_symbols; ++i) {
+        weight[i] = order[i] >> 9;
+    }
+    unsigned int leaf = 0;
+    unsigned int node = num_symbols;
+    unsigned int num_nodes = num_symbols;
+    auto takeSmallest = [&]() {
+        if (leaf < num_symbols && (node == num_nodes || weight[leaf] <= weight[node])) {
+            return leaf++;
+        }
+        return node++;
+    };
+    while (num_nodes < 2*num_symbols-1) {
+        unsigned int a = takeSmallest();
+        unsigned int b = takeSmallest();
+        weight[num_nodes] = weight[a] + weight[b];
+        parent[a] = num_nodes;
+        parent[b] = num_nodes;
+        ++num_nodes;
+    }
+
+    //Parents always come after their children, so depths follow in reverse order
+    unsigned char depth[2*num_symbols];
+    depth[num_nodes-1] = 0;
+    for (unsigned int i=num_nodes-1; i-- > 0; ) {
+        depth[i] = depth[parent[i]] + 1;
+    }
+    for (unsigned int i=0; i<num_symbols; ++i) {
+        m_length[order[i] & 0x1FF] = depth[i];
+    }
+
+    //Canonical codes, sorted by length and then symbol
+    std::fill(m_length_count, m_length_count+max_code_length+1, 0);
+    for (unsigned int i=0; i<num_symbols; ++i) {
+        assert(m_length[i] <= adaptive_longest_code);
+        m_length_count[m_length[i]] += 1;
+    }
+    uint32_t code = 0;
+    uint16_t index = 0;
+    uint16_t next_index[max_code_length+1];
+    for (unsigned int length=1; length<=max_code_length; ++length) {
+        m_first_code[length] = code;
+        m_first_index[length] = index;
+        next_index[length] = index;
+        code = (code + m_length_count[length]) << 1;
+        index += m_length_count[length];
+    }
+    for (unsigned int i=0; i<num_symbols; ++i) {
+        unsigned int length = m_length[i];
+        uint16_t position = next_index[length]++;
+        m_sorted[position] = i;
+        m_code[i] = reverseBits(m_first_code[length] + position - m_first_index[length], length);
+    }
+
+    //Table for codes of up to fast_bits bits
+    std::fill(m_fast, m_fast+(1 << fast_bits), 0);
+    for (unsigned int i=0; i<num_symbols; ++i) {
+        unsigned int length = m_length[i];
+        if (length <= fast_bits) {
+            for (uint32_t j=m_code[i]; j<(1u << fast_bits); j+=(1u << length)) {
+                m_fast[j] = static_cast<uint16_t>((i << 5) | length);
+            }
+        }
+    }
+}
+
+AdaptiveHuffmanEncoder::AdaptiveHuffmanEncoder() : m_bits(0), m_num_bits(0) {}
+
+size_t AdaptiveHuffmanEncoder::encodeBound(size_t size_) const {
+    return (m_num_bits + adaptive_longest_code*size_)/8 + 1;
+}
+
+size_t AdaptiveHuffmanEncoder::encode(const unsigned char* input_, size_t size_, unsigned char* output_) {
+    unsigned char* out = output_;
+    uint64_t bits = m_bits;
+    unsigned int num_bits = m_num_bits;
+    for (size_t i=0; i<size_; ++i) {
+        unsigned int symbol = input_[i];
+        bits |= static_cast<uint64_t>(m_model.m_code[symbol]) << num_bits;
+        num_bits += m_model.m_length[symbol];
+        if (num_bits >= 32) {
+            uint32_t word = static_cast<uint32_t>(bits);
+            memcpy(out, &word, 4);
+            out += 4;
+            bits >>= 32;
+            num_bits -= 32;
+        }
+        m_model.update(symbol);
+    }
+
+    //Write all whole bytes, so that no output is held back
+    while (num_bits >= 8) {
+        *out++ = static_cast<unsigned char>(bits);
+        bits >>= 8;
+        num_bits -= 8;
+    }
+    m_bits = bits;
+    m_num_bits = num_bits;
+    return out - output_;
+}
+
+size_t AdaptiveHuffmanEncoder::finish(unsigned char* output_) {
+    unsigned int symbol = AdaptiveHuffmanModel::end_of_stream;
+    m_bits |= static_cast<uint64_t>(m_model.m_code[symbol]) << m_num_bits;
+    m_num_bits += m_model.m_length[symbol];
+    size_t num_bytes = (m_num_bits + 7)/8;
+    for (size_t i=0; i<num_bytes; ++i) {
+        output_[i] = static_cast<unsigned char>(m_bits >> (8*i));
+    }
+    m_bits = 0;
+    m_num_bits = 0;
+    return num_bytes;
+}
+
+void AdaptiveHuffmanEncoder::encode(const unsigned char* input_, size_t size_, std::vector<unsigned char>& output_) {
+    size_t offset = output_.size();
+    output_.resize(offset + encodeBound(size_));
+    output_.resize(offset + encode(input_, size_, output_.data()+offset));
+}
+
+void AdaptiveHuffmanEncoder::finish(std::vector<unsigned char>& output_) {
+    size_t offset = output_.size();
+    output_.resize(offset + encodeBound(1));
+    output_.resize(offset + finish(output_.data()+offset));
+}
+
+AdaptiveHuffmanDecoder::AdaptiveHuffmanDecoder() : m_bits(0), m_num_bits(0), m_finished(false) {}
+
+/**
+  * Decodes symbols while the bits buffered are enough to hold the next code.
+  * The remaining bits are kept until more input arrives.
+  */
+size_t AdaptiveHuffmanDecoder::decode(const unsigned char* input_, size_t size_, unsigned char* output_, size_t capacity_) {
+    size_t in = 0;
+    size_t out = 0;
+    uint64_t bits = m_bits;
+    unsigned int num_bits = m_num_bits;
+    while (!m_finished) {
+        while (num_bits <= 56 && in < size_) {
+            bits |= static_cast<uint64_t>(input_[in++]) << num_bits;
+            num_bits += 8;
+        }
+
+        unsigned int symbol;
+        unsigned int length;
+        uint16_t entry = m_model.m_fast[bits & ((1 << AdaptiveHuffmanModel::fast_bits)-1)];
+        if (entry != 0) {
+            symbol = entry >> 5;
+            length = entry & 0x1F;
+        }
+        else {
+            //Walk the canonical code one bit at a time
+            uint32_t code = static_cast<uint32_t>(bits) & ((1 << AdaptiveHuffmanModel::fast_bits)-1);
+            code = reverseBits(code, AdaptiveHuffmanModel::fast_bits);
+            length = AdaptiveHuffmanModel::fast_bits;
+            while (code - m_model.m_first_code[length] >= m_model.m_length_count[length]) {
+                if (++length > adaptive_longest_code) {
+                    throw std::runtime_error("Adaptive Huffman: invalid code");
+                }
+                code = (code << 1) | ((bits >> (length-1)) & 1);
+            }
+            symbol = m_model.m_sorted[m_model.m_first_index[length] + code - m_model.m_first_code[length]];
+        }
+        if (length > num_bits) {
+            break;
+        }
+        bits >>= length;
+        num_bits -= length;
+
+        if (symbol == AdaptiveHuffmanModel::end_of_stream) {
+            m_finished = true;
+            break;
+        }
+        if (out == capacity_) {
+            throw std::runtime_error("Adaptive Huffman: data exceeds stored length");
+        }
+        output_[out++] = static_cast<unsigned char>(symbol);
+        m_model.update(symbol);
+    }
+
+    //Input after the end of the stream is ignored
+    m_bits = bits;
+    m_num_bits = num_bits;
+    return out;
+}
+
+void AdaptiveHuffmanDecoder::decode(const unsigned char* input_, size_t size_, std::vector<unsigned char>& output_) {
+    //Every code is at least one bit long
+    size_t offset = output_.size();
+    output_.resize(offset + m_num_bits + 8*size_);
+    output_.resize(offset + decode(input_, size_, output_.data()+offset, m_num_bits + 8*size_));
+}
+
+/**
+  * Function which returns the maximum size of an adaptive Huffman encoded buffer
+  */
+size_t adaptive_huffman_compress_bound(size_t size_) {
+    return varintSize(size_) + (adaptive_longest_code*(size_+1) + 7)/8;
+}
+
+/**
+  * Function which compresses a character stream using one pass adaptive 
+  * Huffman coding
+  */
+size_t adaptive_huffman_compress(const unsigned char* input_, size_t size_, unsigned char* output_) {
+    size_t out = writeVarint(size_, output_);
+    AdaptiveHuffmanEncoder encoder;
+    out += encoder.encode(input_, size_, output_+out);
+    out += encoder.finish(output_+out);
+    return out;
+}
+
+void adaptive_huffman_compress(const unsigned char* input_, size_t size_, std::vector<unsigned char>& output_) {
+    size_t offset = output_.size();
+    output_.resize(offset + adaptive_huffman_compress_bound(size_));
+    output_.resize(offset + adaptive_huffman_compress(input_, size_, output_.data()+offset));
+}
+
+std::vector<unsigned char> adaptive_huffman_compress(const std::vector<unsigned char>& input_) {
+    std::vector<unsigned char> output;
+    adaptive_huffman_compress(input_.data(), input_.size(), output);
+    return output;
+}
+
+/**
+  * Function which returns the number of bytes an adaptive Huffman encoded buffer decompresses to
+  */
+size_t adaptive_huffman_decompressed_size(const unsigned char* input_, size_t size_) {
+    size_t offset = 0;
+    uint64_t num_bytes;
+    if (!readVarint(input_, size_, offset, num_bytes)) {
+        throw std::runtime_error("Adaptive Huffman: invalid header");
+    }
+    if (num_bytes > std::numeric_limits<size_t>::max()) {
+        throw std::length_error("Adaptive Huffman: stored length does not fit in memory");
+    }
+    //Every code is at least one bit long
+    if (num_bytes/8 >= size_-offset+1) {
+        throw std::runtime_error("Adaptive Huffman: data shorter than stored length");
+    }
+    return static_cast<size_t>(num_bytes);
+}
+
+/**
+  * Function which decompresses a character stream using one pass adaptive 
+  * Huffman coding
+  */
+size_t adaptive_huffman_decompress(const unsigned char* input_, size_t size_, unsigned char* output_, size_t capacity_) {
+    size_t in = 0;
+    size_t num_bytes = adaptive_huffman_decompressed_size(input_, size_);
+    uint64_t dummy;
+    readVarint(input_, size_, in, dummy);
+    if (num_bytes > capacity_) {
+        throw std::length_error("Adaptive Huffman: output buffer too small");
+    }
+
+    AdaptiveHuffmanDecoder decoder;
+    size_t out = decoder.decode(input_+in, size_-in, output_, num_bytes);
+    if (!decoder.finished() || out != num_bytes) {
+        throw std::runtime_error("Adaptive Huffman: data shorter than stored length");
+    }
+    return num_bytes;
+}
+
+void adaptive_huffman_decompress(const unsigned char* input_, size_t size_, std::vector<unsigned char>& output_) {
+    size_t offset = output_.size();
+    size_t num_bytes = adaptive_huffman_decompressed_size(input_, size_);
+    output_.resize(offset + num_bytes);
+    adaptive_huffman_decompress(input_, size_, output_.data()+offset, num_bytes);
+}
+
+std::vector<unsigned char> adaptive_huffman_decompress(const std::vector<unsigned char>& input_) {
+    std::vector<unsigned char> output;
+    adaptive_huffman_decompress(input_.data(), input_.size(), output);
+    return output;
+}
+
+void adaptive_huffman_benchmark(const std::vector<unsigned char>& input_, std::vector<BenchmarkResult>& results_) {
+    const unsigned char* data = input_.data();
+    const size_t size = input_.size();
+
+    std::vector<unsigned char> compressed(adaptive_huffman_compress_bound(size));
+    size_t compressed_size = 0;
+    results_.push_back(runBenchmark("AdaptiveHuffmanEncoder::encode", size, [&]() {
+        compressed_size = adaptive_huffman_compress(data, size, compressed.data());
+        benchmarkKeep(compressed_size);
+    }));
+
+    std::vector<unsigned char> decompressed(size);
+    results_.push_back(runBenchmark("AdaptiveHuffmanDecoder::decode", size, [&]() {
+        benchmarkKeep(adaptive_huffman_decompress(compressed.data(), compressed_size, decompressed.data(), size));
+    }));
+
+    //Time to the first byte of output when data arrives in pieces of a telemetry record
+    const size_t piece_size = 64;
+    std::vector<unsigned char> first;
+    results_.push_back(runBenchmark("Adaptive Huffman encode TTFB", 0, [&]() {
+        AdaptiveHuffmanEncoder encoder;
+        first.clear();
+        for (size_t i=0; i<size && first.empty(); i+=piece_size) {
+            encoder.encode(data+i, std::min(piece_size, size-i), first);
+        }
+        benchmarkKeep(first);
+    }));
+    results_.push_back(runBenchmark("Adaptive Huffman decode TTFB", 0, [&]() {
+        AdaptiveHuffmanDecoder decoder;
+        first.clear();
+        size_t offset = 0;
+        uint64_t num_bytes;
+        readVarint(compressed.data(), compressed_size, offset, num_bytes);
+        for (size_t i=offset; i<compressed_size && first.empty(); i+=piece_size) {
+            decoder.decode(compressed.data()+i, std::min(piece_size, compressed_size-i), first);
+        }
+        benchmarkKeep(first);
+    }));
+
+    //The static coder needs all data for its table before it outputs anything
+    std::vector<unsigned char> huffman_output(huffman_compress_bound(size));
+    results_.push_back(runBenchmark("Huffman encode TTFB", 0, [&]() {
+        benchmarkKeep(huffman_compress(data, size, huffman_output.data()));
+    }));
+}
\ No newline at end of file
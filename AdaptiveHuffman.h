@@ -0,0 +1,173 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct BenchmarkResult;
+
+/**
+  * Model shared by the adaptive Huffman encoder and decoder. Both start with
+  * equal counts for all characters and an end of stream symbol, count every
+  * symbol they code, and rebuild the canonical Huffman codes from the counts
+  * at the same points in the stream. Rebuilds happen after 16 symbols at 
+  * first, and the interval doubles up to every 4096 symbols. The counts are
+  * halved when their sum reaches 2^16, which lets the model follow changes in
+  * the data and keeps codes at most 22 bits long.
+  */
+class AdaptiveHuffmanModel {
+public:
+    static const unsigned int num_symbols = 257;
+    static const unsigned int end_of_stream = 256;
+    static const unsigned int max_code_length = 24;
+    static const unsigned int fast_bits = 11;
+
+    AdaptiveHuffmanModel();
+
+    /**
+      * Counts symbol_, and rebuilds the codes when it is time to
+      */
+    inline void update(unsigned int symbol_) {
+        m_counts[symbol_] += 1;
+        if (--m_until_rebuild == 0) {
+            endInterval();
+        }
+    }
+
+    /**
+      * Codes are stored bit reversed, so that they can be written least 
+      * significant bit first
+      */
+    uint32_t m_code[num_symbols];
+    unsigned char m_length[num_symbols];
+
+    /**
+      * Decoding table indexed by the next fast_bits bits, holding 
+      * symbol << 5 | length, or zero for codes longer than fast_bits
+      */
+    uint16_t m_fast[1 << fast_bits];
+
+    /**
+      * Canonical decoding of longer codes: the first code and the index of the
+      * first symbol of every length, and the symbols sorted by code
+      */
+    uint32_t m_first_code[max_code_length+1];
+    uint32_t m_length_count[max_code_length+1];
+    uint16_t m_first_index[max_code_length+1];
+    uint16_t m_sorted[num_symbols];
+
+private:
+    void endInterval();
+    void rebuild();
+
+    uint32_t m_counts[num_symbols];
+    uint32_t m_total;
+    uint32_t m_interval;
+    uint32_t m_until_rebuild;
+};
+
+/**
+  * One pass Huffman encoder for streams. Every call to encode writes all
+  * whole bytes of output produced so far, so output is available as soon
+  * as input arrives. finish() ends the stream.
+  */
+class AdaptiveHuffmanEncoder {
+public:
+    AdaptiveHuffmanEncoder();
+
+    /**
+      * Encodes size_ bytes from input_, and appends the output to output_
+      */
+    void encode(const unsigned char* input_, size_t size_, std::vector<unsigned char>& output_);
+
+    /**
+      * Writes the end of stream symbol and the last partial byte
+      */
+    void finish(std::vector<unsigned char>& output_);
+
+    /**
+      * Versions which write to caller owned memory with room for 
+      * encodeBound(size_) bytes, and return the number of bytes written
+      */
+    size_t encodeBound(size_t size_) const;
+    size_t encode(const unsigned char* input_, size_t size_, unsigned char* output_);
+    size_t finish(unsigned char* output_);
+
+private:
+    AdaptiveHuffmanModel m_model;
+    uint64_t m_bits;
+    unsigned int m_num_bits;
+};
+
+/**
+  * One pass Huffman decoder for streams. Input can be given in pieces of
+  * any size, and every character that can be decoded is output right away.
+  */
+class AdaptiveHuffmanDecoder {
+public:
+    AdaptiveHuffmanDecoder();
+
+    /**
+      * Decodes size_ bytes from input_, and appends the output to output_
+      */
+    void decode(const unsigned char* input_, size_t size_, std::vector<unsigned char>& output_);
+
+    /**
+      * Version which writes to caller owned memory, and returns the number of
+      * bytes written. Throws if more than capacity_ bytes are decoded.
+      */
+    size_t decode(const unsigned char* input_, size_t size_, unsigned char* output_, size_t capacity_);
+
+    /**
+      * Returns true once the end of the stream has been decoded
+      */
+    inline bool finished() const {
+        return m_finished;
+    }
+
+private:
+    AdaptiveHuffmanModel m_model;
+    uint64_t m_bits;
+    unsigned int m_num_bits;
+    bool m_finished;
+};
+
+/**
+  * Buffer versions, which store the number of bytes in front of the stream
+  */
+std::vector<unsigned char> adaptive_huffman_compress(const std::vector<unsigned char>& input_);
+std::vector<unsigned char> adaptive_huffman_decompress(const std::vector<unsigned char>& input_);
+
+void adaptive_huffman_compress(const unsigned char* input_, size_t size_, std::vector<unsigned char>& output_);
+void adaptive_huffman_decompress(const unsigned char* input_, size_t size_, std::vector<unsigned char>& output_);
+
+size_t adaptive_huffman_compress_bound(size_t size_);
+size_t adaptive_huffman_compress(const unsigned char* input_, size_t size_, unsigned char* output_);
+size_t adaptive_huffman_decompressed_size(const unsigned char* input_, size_t size_);
+size_t adaptive_huffman_decompress(const unsigned char* input_, size_t size_, unsigned char* output_, size_t capacity_);
+
+/**
+  * Benchmarks the adaptive encoder and decoder on input_, and the time to the
+  * first byte of output when input_ arrives in small pieces, and appends the results
+  */
+void adaptive_huffman_benchmark(const std::vector<unsigned char>& input_, std::vector<BenchmarkResult>& results_);
\ No newline at end of file
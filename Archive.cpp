@@ -0,0 +1,450 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "Archive.h"
+#include "ThreadPool.h"
+#include "Varint.h"
+
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+
+namespace fs = std::filesystem;
+
+namespace { //Avoid contaminating global namespace
+
+/**
+  * The archive starts with a magic and version, then holds the compressed 
+  * blocks back to back, then the central directory. It ends with the offset
+  * of the central directory as an eight byte little endian integer, followed
+  * by the magic again.
+  */
+const char archive_magic[4] = { 'C', 'D', 'A', 'R' };
+const unsigned char archive_version = 1;
+const size_t archive_header_size = 5;
+const size_t archive_trailer_size = 12;
+
+/**
+  * Location of a compressed block in the archive
+  */
+struct ArchiveBlock {
+    uint64_t m_offset;
+    uint64_t m_compressed_size;
+    uint64_t m_size;
+};
+
+/**
+  * Contents of the central directory
+  */
+struct ArchiveDirectory {
+    std::vector<Compress_t> m_compress_ops;
+    std::vector<ArchiveBlock> m_blocks;
+    std::vector<ArchiveEntry> m_entries;
+};
+
+inline void writeValue(uint64_t value_, std::vector<unsigned char>& output_) {
+    unsigned char buffer[10];
+    output_.insert(output_.end(), buffer, buffer + writeVarint(value_, buffer));
+}
+
+inline uint64_t readValue(const std::vector<unsigned char>& data_, size_t& offset_) {
+    uint64_t value;
+    if (!readVarint(data_.data(), data_.size(), offset_, value)) {
+        throw std::runtime_error("Archive: corrupt central directory");
+    }
+    return value;
+}
+
+std::vector<unsigned char> writeDirectory(const ArchiveDirectory& directory_) {
+    std::vector<unsigned char> output;
+    writeValue(directory_.m_compress_ops.size(), output);
+    for (size_t i=0; i<directory_.m_compress_ops.size(); ++i) {
+        writeValue(directory_.m_compress_ops[i], output);
+    }
+    writeValue(directory_.m_blocks.size(), output);
+    for (size_t i=0; i<directory_.m_blocks.size(); ++i) {
+        writeValue(directory_.m_blocks[i].m_offset, output);
+        writeValue(directory_.m_blocks[i].m_compressed_size, output);
+        writeValue(directory_.m_blocks[i].m_size, output);
+    }
+    writeValue(directory_.m_entries.size(), output);
+    for (size_t i=0; i<directory_.m_entries.size(); ++i) {
+        const ArchiveEntry& entry = directory_.m_entries[i];
+        writeValue(entry.m_name.size(), output);
+        output.insert(output.end(), entry.m_name.begin(), entry.m_name.end());
+        writeValue(entry.m_block, output);
+        writeValue(entry.m_offset, output);
+        writeValue(entry.m_size, output);
+    }
+    return output;
+}
+
+/**
+  * Parses the central directory, and checks that every block lies before
+  * directory_offset_ and every file lies within its block
+  */
+ArchiveDirectory readDirectory(const std::vector<unsigned char>& data_, uint64_t directory_offset_) {
+    ArchiveDirectory directory;
+    size_t offset = 0;
+
+    uint64_t num_ops = readValue(data_, offset);
+    if (num_ops > data_.size()) {
+        throw std::runtime_error("Archive: corrupt central directory");
+    }
+    for (uint64_t i=0; i<num_ops; ++i) {
+        uint64_t op = readValue(data_, offset);
+        if (op > LZW_HUFFMAN) {
+            throw std::runtime_error("Archive: unknown compression algorithm");
+        }
+        directory.m_compress_ops.push_back(static_cast<Compress_t>(op));
+    }
+
+    uint64_t num_blocks = readValue(data_, offset);
+    if (num_blocks > data_.size()) {
+        throw std::runtime_error("Archive: corrupt central directory");
+    }
+    for (uint64_t i=0; i<num_blocks; ++i) {
+        ArchiveBlock block;
+        block.m_offset = readValue(data_, offset);
+        block.m_compressed_size = readValue(data_, offset);
+        block.m_size = readValue(data_, offset);
+        if (block.m_offset < archive_header_size || block.m_offset > directory_offset_ 
+                || block.m_compressed_size > directory_offset_ - block.m_offset
+                || block.m_size > std::numeric_limits<size_t>::max()) {
+            throw std::runtime_error("Archive: block outside archive");
+        }
+        directory.m_blocks.push_back(block);
+    }
+
+    uint64_t num_entries = readValue(data_, offset);
+    if (num_entries > data_.size()) {
+        throw std::runtime_error("Archive: corrupt central directory");
+    }
+    for (uint64_t i=0; i<num_entries; ++i) {
+        ArchiveEntry entry;
+        uint64_t name_size = readValue(data_, offset);
+        if (name_size > data_.size()-offset) {
+            throw std::runtime_error("Archive: corrupt central directory");
+        }
+        entry.m_name.assign(data_.begin()+offset, data_.begin()+offset+static_cast<size_t>(name_size));
+        offset += static_cast<size_t>(name_size);
+        uint64_t block = readValue(data_, offset);
+        entry.m_offset = readValue(data_, offset);
+        entry.m_size = readValue(data_, offset);
+        if (block >= directory.m_blocks.size() 
+                || entry.m_offset > directory.m_blocks[block].m_size
+                || entry.m_size > directory.m_blocks[block].m_size - entry.m_offset) {
+            throw std::runtime_error("Archive: file outside its block");
+        }
+        entry.m_block = static_cast<size_t>(block);
+        directory.m_entries.push_back(entry);
+    }
+    return directory;
+}
+
+inline void writeUint64(uint64_t value_, unsigned char* output_) {
+    for (unsigned int i=0; i<8; ++i) {
+        output_[i] = static_cast<unsigned char>(value_ >> (8*i));
+    }
+}
+
+inline uint64_t readUint64(const unsigned char* data_) {
+    uint64_t value = 0;
+    for (unsigned int i=0; i<8; ++i) {
+        value |= static_cast<uint64_t>(data_[i]) << (8*i);
+    }
+    return value;
+}
+
+/**
+  * Reads size_ bytes at offset_ from an open file
+  */
+void readAt(std::ifstream& file_, uint64_t offset_, size_t size_, std::vector<unsigned char>& output_) {
+    output_.resize(size_);
+    file_.seekg(static_cast<std::streamoff>(offset_), std::ios::beg);
+    file_.read(reinterpret_cast<char*>(output_.data()), static_cast<std::streamsize>(size_));
+    if (!file_ || static_cast<size_t>(file_.gcount()) != size_) {
+        throw std::runtime_error("Archive: truncated archive");
+    }
+}
+
+void readFileInto(const fs::path& path_, uint64_t size_, std::vector<unsigned char>& output_) {
+    std::ifstream file(path_, std::ios::binary);
+    if (!file.good()) {
+        throw std::runtime_error("Archive: could not open '" + path_.string() + "'");
+    }
+    size_t offset = output_.size();
+    output_.resize(offset + static_cast<size_t>(size_));
+    file.read(reinterpret_cast<char*>(output_.data()+offset), static_cast<std::streamsize>(size_));
+    if (static_cast<uint64_t>(file.gcount()) != size_) {
+        throw std::runtime_error("Archive: could not read '" + path_.string() + "'");
+    }
+}
+
+/**
+  * Opens an archive and reads its central directory
+  */
+ArchiveDirectory openArchive(const std::string& archive_, std::ifstream& file_) {
+    file_.open(archive_, std::ios::binary);
+    if (!file_.good()) {
+        throw std::runtime_error("Archive: could not open '" + archive_ + "'");
+    }
+    file_.seekg(0, std::ios::end);
+    uint64_t file_size = static_cast<uint64_t>(file_.tellg());
+    if (file_size < archive_header_size + archive_trailer_size) {
+        throw std::runtime_error("Archive: not an archive");
+    }
+
+    std::vector<unsigned char> header;
+    std::vector<unsigned char> trailer;
+    readAt(file_, 0, archive_header_size, header);
+    readAt(file_, file_size - archive_trailer_size, archive_trailer_size, trailer);
+    if (!std::equal(archive_magic, archive_magic+4, header.begin()) || !std::equal(archive_magic, archive_magic+4, trailer.begin()+8)) {
+        throw std::runtime_error("Archive: not an archive");
+    }
+    if (header[4] != archive_version) {
+        throw std::runtime_error("Archive: unsupported version");
+    }
+
+    uint64_t directory_offset = readUint64(trailer.data());
+    if (directory_offset < archive_header_size || directory_offset > file_size - archive_trailer_size) {
+        throw std::runtime_error("Archive: corrupt trailer");
+    }
+    std::vector<unsigned char> directory;
+    readAt(file_, directory_offset, static_cast<size_t>(file_size - archive_trailer_size - directory_offset), directory);
+    return readDirectory(directory, directory_offset);
+}
+
+/**
+  * Reads and decompresses block_ by running the compression algorithms in reverse
+  */
+std::vector<unsigned char> readBlock(std::ifstream& file_, const ArchiveDirectory& directory_, const ArchiveBlock& block_) {
+    std::vector<unsigned char> data;
+    std::vector<unsigned char> output;
+    readAt(file_, block_.m_offset, static_cast<size_t>(block_.m_compressed_size), data);
+    for (size_t i=directory_.m_compress_ops.size(); i>0; --i) {
+        output.clear();
+        decompress(directory_.m_compress_ops[i-1], data.data(), data.size(), output);
+        data.swap(output);
+    }
+    if (data.size() != block_.m_size) {
+        throw std::runtime_error("Archive: block does not match its stored size");
+    }
+    return data;
+}
+
+/**
+  * Returns the path of name_ below directory_, refusing names which would 
+  * end up outside it
+  */
+fs::path entryPath(const fs::path& directory_, const std::string& name_) {
+    fs::path name = fs::path(name_).lexically_normal();
+    if (name.empty() || name.is_absolute() || name.has_root_name() || *name.begin() == "..") {
+        throw std::runtime_error("Archive: invalid file name '" + name_ + "'");
+    }
+    return directory_ / name;
+}
+
+/**
+  * Files of a block, in the order they are stored in it
+  */
+struct BlockPlan {
+    std::vector<size_t> m_entries;
+    std::vector<fs::path> m_paths;
+    uint64_t m_size;
+};
+
+} // Namespace
+
+std::vector<ArchiveEntry> archive_create(const std::string& directory_, const std::string& archive_, 
+        const std::vector<Compress_t>& compress_ops_, const ArchiveOptions& options_) {
+    //Find all regular files, in a deterministic order
+    fs::path root(directory_);
+    if (!fs::is_directory(root)) {
+        throw std::runtime_error("Archive: '" + directory_ + "' is not a directory");
+    }
+    std::vector<fs::path> paths;
+    for (fs::recursive_directory_iterator it(root), end; it != end; ++it) {
+        if (it->is_regular_file()) {
+            paths.push_back(it->path());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    //Put small files in solid blocks, and every other file in its own block
+    ArchiveDirectory directory;
+    directory.m_compress_ops = compress_ops_;
+    std::vector<BlockPlan> plans;
+    const size_t solid_size = options_.m_solid_block_size;
+    bool solid_block_open = false;
+    for (size_t i=0; i<paths.size(); ++i) {
+        ArchiveEntry entry;
+        entry.m_name = paths[i].lexically_relative(root).generic_string();
+        entry.m_size = fs::file_size(paths[i]);
+
+        bool solid = entry.m_size < solid_size;
+        if (!solid || !solid_block_open || plans.back().m_size + entry.m_size > solid_size) {
+            BlockPlan plan;
+            plan.m_size = 0;
+            plans.push_back(plan);
+        }
+        solid_block_open = solid;
+
+        BlockPlan& plan = plans.back();
+        entry.m_block = plans.size()-1;
+        entry.m_offset = plan.m_size;
+        plan.m_size += entry.m_size;
+        plan.m_entries.push_back(directory.m_entries.size());
+        plan.m_paths.push_back(paths[i]);
+        directory.m_entries.push_back(entry);
+    }
+
+    std::ofstream file(archive_, std::ios::binary);
+    if (!file.good()) {
+        throw std::runtime_error("Archive: could not create '" + archive_ + "'");
+    }
+    unsigned char header[archive_header_size] = { 'C', 'D', 'A', 'R', archive_version };
+    file.write(reinterpret_cast<const char*>(header), archive_header_size);
+    uint64_t offset = archive_header_size;
+
+    //Compress blocks on the pool, but write them in order. At most two blocks 
+    //per thread are in flight, which bounds the memory used.
+    const unsigned int num_threads = std::max(options_.m_num_threads, 1u);
+    const size_t max_in_flight = 2*num_threads;
+    std::vector<std::future<std::vector<unsigned char> > > results(plans.size());
+    ThreadPool pool(num_threads, max_in_flight);
+    size_t num_submitted = 0;
+    for (size_t i=0; i<plans.size(); ++i) {
+        while (num_submitted < plans.size() && num_submitted < i + max_in_flight) {
+            const BlockPlan* plan = &plans[num_submitted];
+            std::shared_ptr<std::promise<std::vector<unsigned char> > > promise = std::make_shared<std::promise<std::vector<unsigned char> > >();
+            results[num_submitted] = promise->get_future();
+            pool.submit([=, &directory]() {
+                try {
+                    std::vector<unsigned char> data;
+                    std::vector<unsigned char> output;
+                    for (size_t j=0; j<plan->m_paths.size(); ++j) {
+                        readFileInto(plan->m_paths[j], directory.m_entries[plan->m_entries[j]].m_size, data);
+                    }
+                    for (size_t j=0; j<compress_ops_.size(); ++j) {
+                        output.clear();
+                        compress(compress_ops_[j], data.data(), data.size(), output);
+                        data.swap(output);
+                    }
+                    promise->set_value(std::move(data));
+                }
+                catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            });
+            ++num_submitted;
+        }
+
+        std::vector<unsigned char> block = results[i].get();
+        file.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(block.size()));
+
+        ArchiveBlock location;
+        location.m_offset = offset;
+        location.m_compressed_size = block.size();
+        location.m_size = plans[i].m_size;
+        directory.m_blocks.push_back(location);
+        offset += block.size();
+    }
+
+    std::vector<unsigned char> central_directory = writeDirectory(directory);
+    file.write(reinterpret_cast<const char*>(central_directory.data()), static_cast<std::streamsize>(central_directory.size()));
+    unsigned char trailer[archive_trailer_size];
+    writeUint64(offset, trailer);
+    std::copy(archive_magic, archive_magic+4, trailer+8);
+    file.write(reinterpret_cast<const char*>(trailer), archive_trailer_size);
+    if (!file.good()) {
+        throw std::runtime_error("Archive: could not write '" + archive_ + "'");
+    }
+
+    return directory.m_entries;
+}
+
+std::vector<ArchiveEntry> archive_list(const std::string& archive_) {
+    std::ifstream file;
+    return openArchive(archive_, file).m_entries;
+}
+
+void archive_extract(const std::string& archive_, const std::string& directory_, unsigned int num_threads_) {
+    std::ifstream file;
+    ArchiveDirectory directory = openArchive(archive_, file);
+    file.close();
+
+    //Create all directories up front, so the threads only write files
+    fs::path root(directory_);
+    std::vector<std::vector<size_t> > block_entries(directory.m_blocks.size());
+    for (size_t i=0; i<directory.m_entries.size(); ++i) {
+        fs::create_directories(entryPath(root, directory.m_entries[i].m_name).parent_path());
+        block_entries[directory.m_entries[i].m_block].push_back(i);
+    }
+
+    const unsigned int num_threads = std::max(num_threads_, 1u);
+    std::vector<std::future<void> > results;
+    {
+        ThreadPool pool(num_threads, 2*num_threads);
+        for (size_t i=0; i<directory.m_blocks.size(); ++i) {
+            std::shared_ptr<std::promise<void> > promise = std::make_shared<std::promise<void> >();
+            results.push_back(promise->get_future());
+            pool.submit([=, &directory, &block_entries, &root, &archive_]() {
+                try {
+                    std::ifstream file(archive_, std::ios::binary);
+                    std::vector<unsigned char> block = readBlock(file, directory, directory.m_blocks[i]);
+                    for (size_t j=0; j<block_entries[i].size(); ++j) {
+                        const ArchiveEntry& entry = directory.m_entries[block_entries[i][j]];
+                        fs::path path = entryPath(root, entry.m_name);
+                        std::ofstream output(path, std::ios::binary);
+                        output.write(reinterpret_cast<const char*>(block.data() + entry.m_offset), static_cast<std::streamsize>(entry.m_size));
+                        if (!output.good()) {
+                            throw std::runtime_error("Archive: could not write '" + path.string() + "'");
+                        }
+                    }
+                    promise->set_value();
+                }
+                catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            });
+        }
+    }
+    for (size_t i=0; i<results.size(); ++i) {
+        results[i].get();
+    }
+}
+
+std::vector<unsigned char> archive_extract_file(const std::string& archive_, const std::string& name_) {
+    std::ifstream file;
+    ArchiveDirectory directory = openArchive(archive_, file);
+    for (size_t i=0; i<directory.m_entries.size(); ++i) {
+        const ArchiveEntry& entry = directory.m_entries[i];
+        if (entry.m_name == name_) {
+            std::vector<unsigned char> block = readBlock(file, directory, directory.m_blocks[entry.m_block]);
+            return std::vector<unsigned char>(block.begin() + entry.m_offset, block.begin() + entry.m_offset + entry.m_size);
+        }
+    }
+    throw std::runtime_error("Archive: no file called '" + name_ + "'");
+}
\ No newline at end of file
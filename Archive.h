@@ -0,0 +1,80 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#pragma once
+
+#include "Codec.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/**
+  * Archives hold every regular file below a directory. Files are compressed
+  * in blocks by running compress_ops_ in order, and blocks are compressed and
+  * extracted in parallel. A central directory at the end of the archive lists
+  * every block and file, so single files can be extracted by reading only 
+  * their own block.
+  */
+struct ArchiveOptions {
+    ArchiveOptions() : m_num_threads(1), m_solid_block_size(0) {}
+
+    unsigned int m_num_threads;
+
+    /**
+      * Files smaller than this are grouped into solid blocks of up to this
+      * many bytes, which compress better than each file on its own. 
+      * Zero puts every file in its own block.
+      */
+    size_t m_solid_block_size;
+};
+
+/**
+  * One file in an archive, named by its path relative to the archived
+  * directory with '/' as separator
+  */
+struct ArchiveEntry {
+    std::string m_name;
+    uint64_t m_size;
+    size_t m_block;
+    uint64_t m_offset;
+};
+
+/**
+  * Compresses all files below directory_ into a new archive file, and returns its entries
+  */
+std::vector<ArchiveEntry> archive_create(const std::string& directory_, const std::string& archive_, 
+        const std::vector<Compress_t>& compress_ops_, const ArchiveOptions& options_);
+
+/**
+  * Reads the entries from the central directory of archive_
+  */
+std::vector<ArchiveEntry> archive_list(const std::string& archive_);
+
+/**
+  * Extracts all files into directory_ using num_threads_ threads
+  */
+void archive_extract(const std::string& archive_, const std::string& directory_, unsigned int num_threads_);
+
+/**
+  * Extracts the single file called name_
+  */
+std::vector<unsigned char> archive_extract_file(const std::string& archive_, const std::string& name_);
\ No newline at end of file
@@ -0,0 +1,647 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "AsyncIO.h"
+
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <io.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace { //Avoid contaminating global namespace
+
+#ifdef _WIN32
+typedef FILE* FileHandle;
+#else
+typedef int FileHandle;
+#endif
+
+FileHandle openFile(const std::string& path_, bool write_, bool direct_) {
+#ifdef _WIN32
+    (void) direct_;
+    FILE* file = fopen(path_.c_str(), (write_) ? "w+b" : "rb");
+    if (file == NULL) {
+        throw std::runtime_error("AsyncIO: could not open '" + path_ + "'");
+    }
+    return file;
+#else
+    int flags = (write_) ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY;
+#ifdef O_DIRECT
+    if (direct_) {
+        flags |= O_DIRECT;
+    }
+#else
+    (void) direct_;
+#endif
+    int fd = open(path_.c_str(), flags, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("AsyncIO: could not open '" + path_ + "': " + std::strerror(errno));
+    }
+    return fd;
+#endif
+}
+
+void closeFile(FileHandle file_) {
+#ifdef _WIN32
+    fclose(file_);
+#else
+    close(file_);
+#endif
+}
+
+/**
+  * Blocking read or write at an offset. Returns the number of bytes 
+  * transferred, or a negative errno on failure.
+  */
+long long transferAt(FileHandle file_, bool write_, unsigned char* buffer_, size_t size_, uint64_t offset_) {
+#ifdef _WIN32
+    if (_fseeki64(file_, offset_, SEEK_SET) != 0) {
+        return -EIO;
+    }
+    size_t transferred = (write_) ? fwrite(buffer_, 1, size_, file_) : fread(buffer_, 1, size_, file_);
+    if (transferred == 0 && ferror(file_)) {
+        return -EIO;
+    }
+    return transferred;
+#else
+    ssize_t transferred;
+    do {
+        transferred = (write_) ? pwrite(file_, buffer_, size_, offset_) : pread(file_, buffer_, size_, offset_);
+    } while (transferred < 0 && errno == EINTR);
+    return (transferred < 0) ? -errno : transferred;
+#endif
+}
+
+/**
+  * Checks the options, and rounds the block size up to the alignment 
+  * needed for direct I/O
+  */
+AsyncIOOptions checkOptions(AsyncIOOptions options_) {
+    if (options_.m_block_size == 0 || options_.m_block_size > (1u << 30)) {
+        throw std::invalid_argument("AsyncIO: block size must be between 1 byte and 1 GiB");
+    }
+    if (options_.m_queue_depth == 0 || options_.m_queue_depth > 1024) {
+        throw std::invalid_argument("AsyncIO: queue depth must be between 1 and 1024");
+    }
+    if (options_.m_direct) {
+        options_.m_block_size = (options_.m_block_size + async_io_alignment - 1) / async_io_alignment * async_io_alignment;
+    }
+    return options_;
+}
+
+} // Namespace
+
+/**
+  * Performs the I/O of an AsyncIOQueue, and owns its file
+  */
+struct AsyncIOQueue::Backend {
+    Backend(FileHandle file_) : m_file(file_) {}
+    virtual ~Backend() {
+        closeFile(m_file);
+    }
+
+    virtual void submit(size_t slot_, bool write_, unsigned char* buffer_, size_t size_, uint64_t offset_) = 0;
+
+    /**
+      * Waits for any request to complete, and returns its slot. result_ is the
+      * number of bytes transferred, or a negative errno.
+      */
+    virtual size_t wait(long long& result_) = 0;
+
+    virtual bool usesIOUring() const = 0;
+
+    FileHandle m_file;
+};
+
+namespace { //Avoid contaminating global namespace
+
+/**
+  * Backend that does blocking I/O on a background thread
+  */
+class ThreadBackend : public AsyncIOQueue::Backend {
+public:
+    ThreadBackend(FileHandle file_) : Backend(file_), m_stopping(false) {
+        m_thread = std::thread([this]() { run(); });
+    }
+
+    ~ThreadBackend() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_submitted_cv.notify_all();
+        m_thread.join();
+    }
+
+    void submit(size_t slot_, bool write_, unsigned char* buffer_, size_t size_, uint64_t offset_) {
+        Operation operation = { slot_, write_, buffer_, size_, offset_, 0 };
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_submitted.push_back(operation);
+        }
+        m_submitted_cv.notify_one();
+    }
+
+    size_t wait(long long& result_) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_completed_cv.wait(lock, [this]() { return !m_completed.empty(); });
+        Operation operation = m_completed.front();
+        m_completed.pop_front();
+        result_ = operation.m_result;
+        return operation.m_slot;
+    }
+
+    bool usesIOUring() const {
+        return false;
+    }
+
+private:
+    struct Operation {
+        size_t m_slot;
+        bool m_write;
+        unsigned char* m_buffer;
+        size_t m_size;
+        uint64_t m_offset;
+        long long m_result;
+    };
+
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_submitted_cv.wait(lock, [this]() { return m_stopping || !m_submitted.empty(); });
+            if (m_submitted.empty()) {
+                return;
+            }
+            Operation operation = m_submitted.front();
+            m_submitted.pop_front();
+
+            lock.unlock();
+            operation.m_result = transferAt(m_file, operation.m_write, operation.m_buffer, operation.m_size, operation.m_offset);
+            lock.lock();
+
+            m_completed.push_back(operation);
+            m_completed_cv.notify_one();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_submitted_cv;
+    std::condition_variable m_completed_cv;
+    std::deque<Operation> m_submitted;
+    std::deque<Operation> m_completed;
+    bool m_stopping;
+    std::thread m_thread;
+};
+
+#ifdef __linux__
+/**
+  * Backend that submits reads and writes to the kernel through io_uring, using
+  * the raw system calls so that liburing is not needed. Requires the single
+  * ring mapping (Linux 5.4) and IORING_OP_READ/WRITE (Linux 5.6), and 
+  * create() returns an empty pointer on older kernels.
+  */
+class IOUringBackend : public AsyncIOQueue::Backend {
+public:
+    static std::unique_ptr<AsyncIOQueue::Backend> create(FileHandle file_, unsigned int entries_) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        int ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries_, &params));
+        if (ring_fd < 0) {
+            return std::unique_ptr<AsyncIOQueue::Backend>();
+        }
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_RW_CUR_POS)) {
+            close(ring_fd);
+            return std::unique_ptr<AsyncIOQueue::Backend>();
+        }
+
+        size_t sq_size = params.sq_off.array + params.sq_entries*sizeof(unsigned int);
+        size_t cq_size = params.cq_off.cqes + params.cq_entries*sizeof(io_uring_cqe);
+        size_t ring_size = std::max(sq_size, cq_size);
+        void* ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (ring == MAP_FAILED) {
+            close(ring_fd);
+            return std::unique_ptr<AsyncIOQueue::Backend>();
+        }
+        size_t sqes_size = params.sq_entries*sizeof(io_uring_sqe);
+        void* sqes = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            munmap(ring, ring_size);
+            close(ring_fd);
+            return std::unique_ptr<AsyncIOQueue::Backend>();
+        }
+
+        return std::unique_ptr<AsyncIOQueue::Backend>(new IOUringBackend(file_, ring_fd, params, ring, ring_size, sqes, sqes_size));
+    }
+
+    ~IOUringBackend() {
+        munmap(m_sqes, m_sqes_size);
+        munmap(m_ring, m_ring_size);
+        close(m_ring_fd);
+    }
+
+    void submit(size_t slot_, bool write_, unsigned char* buffer_, size_t size_, uint64_t offset_) {
+        //We are the only producer, so the tail can be read without ordering
+        unsigned int tail = *m_sq_tail;
+        unsigned int index = tail & *m_sq_mask;
+        io_uring_sqe* sqe = &m_sqes[index];
+        std::memset(sqe, 0, sizeof(io_uring_sqe));
+        sqe->opcode = (write_) ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd = m_file;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer_);
+        sqe->len = static_cast<uint32_t>(size_);
+        sqe->off = offset_;
+        sqe->user_data = slot_;
+        m_sq_array[index] = index;
+        __atomic_store_n(m_sq_tail, tail+1, __ATOMIC_RELEASE);
+
+        int result;
+        do {
+            result = static_cast<int>(syscall(__NR_io_uring_enter, m_ring_fd, 1, 0, 0, NULL, 0));
+        } while (result < 0 && (errno == EINTR || errno == EAGAIN));
+        if (result < 0) {
+            throw std::runtime_error(std::string("AsyncIO: io_uring submission failed: ") + std::strerror(errno));
+        }
+    }
+
+    size_t wait(long long& result_) {
+        while (true) {
+            //We are the only consumer, so the head can be read without ordering
+            unsigned int head = *m_cq_head;
+            if (head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe& cqe = m_cqes[head & *m_cq_mask];
+                size_t slot = static_cast<size_t>(cqe.user_data);
+                result_ = cqe.res;
+                __atomic_store_n(m_cq_head, head+1, __ATOMIC_RELEASE);
+                return slot;
+            }
+            int result = static_cast<int>(syscall(__NR_io_uring_enter, m_ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0));
+            if (result < 0 && errno != EINTR) {
+                throw std::runtime_error(std::string("AsyncIO: io_uring wait failed: ") + std::strerror(errno));
+            }
+        }
+    }
+
+    bool usesIOUring() const {
+        return true;
+    }
+
+private:
+    IOUringBackend(FileHandle file_, int ring_fd_, const io_uring_params& params_, 
+            void* ring_, size_t ring_size_, void* sqes_, size_t sqes_size_) : Backend(file_),
+        m_ring_fd(ring_fd_), m_ring(ring_), m_ring_size(ring_size_), 
+        m_sqes(static_cast<io_uring_sqe*>(sqes_)), m_sqes_size(sqes_size_) {
+        unsigned char* ring = static_cast<unsigned char*>(ring_);
+        m_sq_tail = reinterpret_cast<unsigned int*>(ring + params_.sq_off.tail);
+        m_sq_mask = reinterpret_cast<unsigned int*>(ring + params_.sq_off.ring_mask);
+        m_sq_array = reinterpret_cast<unsigned int*>(ring + params_.sq_off.array);
+        m_cq_head = reinterpret_cast<unsigned int*>(ring + params_.cq_off.head);
+        m_cq_tail = reinterpret_cast<unsigned int*>(ring + params_.cq_off.tail);
+        m_cq_mask = reinterpret_cast<unsigned int*>(ring + params_.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(ring + params_.cq_off.cqes);
+    }
+
+    int m_ring_fd;
+    void* m_ring;
+    size_t m_ring_size;
+    io_uring_sqe* m_sqes;
+    size_t m_sqes_size;
+    unsigned int* m_sq_tail;
+    unsigned int* m_sq_mask;
+    unsigned int* m_sq_array;
+    unsigned int* m_cq_head;
+    unsigned int* m_cq_tail;
+    unsigned int* m_cq_mask;
+    io_uring_cqe* m_cqes;
+};
+#endif
+
+} // Namespace
+
+
+
+
+AlignedBuffer::AlignedBuffer(size_t capacity_) : m_data(NULL), m_capacity(capacity_) {
+    size_t size = std::max<size_t>(capacity_, 1);
+#ifdef _WIN32
+    m_data = static_cast<unsigned char*>(_aligned_malloc(size, async_io_alignment));
+#else
+    void* data = NULL;
+    if (posix_memalign(&data, async_io_alignment, size) == 0) {
+        m_data = static_cast<unsigned char*>(data);
+    }
+#endif
+    if (m_data == NULL) {
+        throw std::bad_alloc();
+    }
+}
+
+AlignedBuffer::~AlignedBuffer() {
+#ifdef _WIN32
+    _aligned_free(m_data);
+#else
+    free(m_data);
+#endif
+}
+
+
+
+
+AsyncIOQueue::AsyncIOQueue(const std::string& path_, bool write_, const AsyncIOOptions& options_) : m_num_pending(0) {
+    FileHandle file = openFile(path_, write_, options_.m_direct);
+#ifdef __linux__
+    if (options_.m_use_io_uring) {
+        try {
+            //Room for a resubmission of every request after a short transfer
+            m_backend = IOUringBackend::create(file, 2*options_.m_queue_depth);
+        }
+        catch (...) {
+            closeFile(file);
+            throw;
+        }
+    }
+#endif
+    if (!m_backend) {
+        try {
+            m_backend.reset(new ThreadBackend(file));
+        }
+        catch (...) {
+            closeFile(file);
+            throw;
+        }
+    }
+}
+
+AsyncIOQueue::~AsyncIOQueue() {
+    //The kernel or the thread may still use the buffers, so wait for them
+    while (m_num_pending > 0) {
+        try {
+            size_t bytes;
+            wait(bytes);
+        }
+        catch (...) {
+        }
+    }
+}
+
+void AsyncIOQueue::submitRead(unsigned char* buffer_, size_t size_, uint64_t offset_, uint64_t tag_) {
+    Request request = { false, buffer_, size_, offset_, tag_, 0, true };
+    submit(addRequest(request));
+}
+
+void AsyncIOQueue::submitWrite(const unsigned char* buffer_, size_t size_, uint64_t offset_, uint64_t tag_) {
+    //The buffer is only read from, but shares the request type with reads
+    Request request = { true, const_cast<unsigned char*>(buffer_), size_, offset_, tag_, 0, true };
+    submit(addRequest(request));
+}
+
+size_t AsyncIOQueue::addRequest(const Request& request_) {
+    size_t slot = 0;
+    while (slot < m_requests.size() && m_requests[slot].m_active) {
+        ++slot;
+    }
+    if (slot == m_requests.size()) {
+        m_requests.push_back(request_);
+    }
+    else {
+        m_requests[slot] = request_;
+    }
+    ++m_num_pending;
+    return slot;
+}
+
+void AsyncIOQueue::submit(size_t slot_) {
+    Request& request = m_requests[slot_];
+    m_backend->submit(slot_, request.m_write, request.m_buffer + request.m_done, 
+        request.m_size - request.m_done, request.m_offset + request.m_done);
+}
+
+uint64_t AsyncIOQueue::wait(size_t& bytes_) {
+    if (m_num_pending == 0) {
+        throw std::logic_error("AsyncIO: no pending requests to wait for");
+    }
+    while (true) {
+        long long result;
+        size_t slot = m_backend->wait(result);
+        Request& request = m_requests[slot];
+
+        //A write that makes no progress would otherwise be retried forever
+        if (result < 0 || (result == 0 && request.m_write)) {
+            request.m_active = false;
+            --m_num_pending;
+            std::string message = (result < 0) ? std::strerror(static_cast<int>(-result)) : "no progress";
+            throw std::runtime_error(std::string("AsyncIO: ") + ((request.m_write) ? "write" : "read") + " failed: " + message);
+        }
+
+        //Short transfers are continued, except reads that hit the end of the file
+        request.m_done += static_cast<size_t>(result);
+        if (result == 0 || request.m_done == request.m_size) {
+            request.m_active = false;
+            --m_num_pending;
+            bytes_ = request.m_done;
+            return request.m_tag;
+        }
+        submit(slot);
+    }
+}
+
+void AsyncIOQueue::truncate(uint64_t size_) {
+#ifdef _WIN32
+    fflush(m_backend->m_file);
+    bool failed = (_chsize_s(_fileno(m_backend->m_file), size_) != 0);
+#else
+    bool failed = (ftruncate(m_backend->m_file, size_) != 0);
+#endif
+    if (failed) {
+        throw std::runtime_error("AsyncIO: could not set the file size");
+    }
+}
+
+bool AsyncIOQueue::usesIOUring() const {
+    return m_backend->usesIOUring();
+}
+
+
+
+
+AsyncFileReader::AsyncFileReader(const std::string& path_, const AsyncIOOptions& options_) : 
+        m_options(checkOptions(options_)), 
+        m_file_size(0),
+        m_sizes(m_options.m_queue_depth, 0),
+        m_ready(m_options.m_queue_depth, false),
+        m_queue(path_, false, m_options),
+        m_next_offset(0),
+        m_num_blocks_read(0),
+        m_current(0) {
+    std::error_code error;
+    m_file_size = std::filesystem::file_size(path_, error);
+    if (error) {
+        throw std::runtime_error("AsyncIO: could not get the size of '" + path_ + "'");
+    }
+
+    for (unsigned int i=0; i<m_options.m_queue_depth; ++i) {
+        m_buffers.emplace_back(new AlignedBuffer(m_options.m_block_size));
+    }
+    for (unsigned int i=0; i<m_options.m_queue_depth; ++i) {
+        submitNext(i);
+    }
+}
+
+void AsyncFileReader::submitNext(size_t buffer_) {
+    m_ready[buffer_] = false;
+    if (m_next_offset >= m_file_size) {
+        return;
+    }
+    m_queue.submitRead(m_buffers[buffer_]->data(), m_options.m_block_size, m_next_offset, buffer_);
+    m_next_offset += m_options.m_block_size;
+}
+
+bool AsyncFileReader::next(const unsigned char*& data_, size_t& size_) {
+    //Blocks are submitted round robin, so block i is always in buffer i % depth,
+    //and the buffer returned last time can now be refilled
+    if (m_num_blocks_read > 0) {
+        submitNext(m_current);
+        m_current = (m_current + 1) % m_buffers.size();
+    }
+
+    uint64_t offset = m_num_blocks_read*m_options.m_block_size;
+    if (offset >= m_file_size) {
+        return false;
+    }
+
+    while (!m_ready[m_current]) {
+        size_t bytes;
+        uint64_t tag = m_queue.wait(bytes);
+        m_ready[tag] = true;
+        m_sizes[tag] = bytes;
+    }
+
+    size_t expected = static_cast<size_t>(std::min<uint64_t>(m_options.m_block_size, m_file_size - offset));
+    if (m_sizes[m_current] < expected) {
+        throw std::runtime_error("AsyncIO: file ended before its expected size");
+    }
+
+    data_ = m_buffers[m_current]->data();
+    size_ = expected;
+    ++m_num_blocks_read;
+    return true;
+}
+
+
+
+
+AsyncFileWriter::AsyncFileWriter(const std::string& path_, const AsyncIOOptions& options_) : 
+        m_options(checkOptions(options_)), 
+        m_queue(path_, true, m_options),
+        m_current(0),
+        m_current_size(0),
+        m_size(0),
+        m_closed(false) {
+    for (unsigned int i=0; i<m_options.m_queue_depth; ++i) {
+        m_buffers.emplace_back(new AlignedBuffer(m_options.m_block_size));
+    }
+    for (unsigned int i=1; i<m_options.m_queue_depth; ++i) {
+        m_free.push_back(i);
+    }
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+    try {
+        close();
+    }
+    catch (...) {
+    }
+}
+
+void AsyncFileWriter::write(const unsigned char* data_, size_t size_) {
+    if (m_closed) {
+        throw std::logic_error("AsyncIO: write to a closed file");
+    }
+    while (size_ > 0) {
+        size_t num_bytes = std::min(size_, m_options.m_block_size - m_current_size);
+        std::memcpy(m_buffers[m_current]->data() + m_current_size, data_, num_bytes);
+        m_current_size += num_bytes;
+        m_size += num_bytes;
+        data_ += num_bytes;
+        size_ -= num_bytes;
+        if (m_current_size == m_options.m_block_size) {
+            flush();
+        }
+    }
+}
+
+void AsyncFileWriter::flush() {
+    if (m_current_size == 0) {
+        return;
+    }
+
+    //Only the last block can be partial, and with direct I/O it is padded
+    //to the alignment and the padding truncated away when closing
+    size_t write_size = m_current_size;
+    if (m_options.m_direct) {
+        write_size = (write_size + async_io_alignment - 1) / async_io_alignment * async_io_alignment;
+        std::memset(m_buffers[m_current]->data() + m_current_size, 0, write_size - m_current_size);
+    }
+    m_queue.submitWrite(m_buffers[m_current]->data(), write_size, m_size - m_current_size, m_current);
+    m_current_size = 0;
+
+    if (m_free.empty()) {
+        size_t bytes;
+        m_free.push_back(static_cast<size_t>(m_queue.wait(bytes)));
+    }
+    m_current = m_free.back();
+    m_free.pop_back();
+}
+
+void AsyncFileWriter::close() {
+    if (m_closed) {
+        return;
+    }
+    m_closed = true;
+    flush();
+    while (m_queue.numPending() > 0) {
+        size_t bytes;
+        m_free.push_back(static_cast<size_t>(m_queue.wait(bytes)));
+    }
+    if (m_options.m_direct && m_size % async_io_alignment != 0) {
+        m_queue.truncate(m_size);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,214 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+/**
+  * Options for asynchronous file I/O. Files are read and written in blocks
+  * of m_block_size bytes, with up to m_queue_depth blocks in flight, so that
+  * the disk is kept busy while the codecs run.
+  */
+struct AsyncIOOptions {
+    AsyncIOOptions() : m_block_size(1 << 20), m_queue_depth(4), m_direct(false), m_use_io_uring(true) {}
+
+    size_t m_block_size;
+    unsigned int m_queue_depth;
+
+    /**
+      * Bypass the page cache with O_DIRECT on Linux. Buffers, offsets and 
+      * sizes are then aligned to async_io_alignment bytes.
+      */
+    bool m_direct;
+
+    /**
+      * Use io_uring on Linux when the kernel supports it, rather than
+      * a background thread
+      */
+    bool m_use_io_uring;
+};
+
+const size_t async_io_alignment = 4096;
+
+/**
+  * Buffer aligned to async_io_alignment bytes, as O_DIRECT requires
+  */
+class AlignedBuffer {
+public:
+    AlignedBuffer(size_t capacity_);
+    ~AlignedBuffer();
+
+    inline unsigned char* data() {
+        return m_data;
+    }
+
+    inline const unsigned char* data() const {
+        return m_data;
+    }
+
+    inline size_t capacity() const {
+        return m_capacity;
+    }
+
+private:
+    AlignedBuffer(const AlignedBuffer&);
+    AlignedBuffer& operator=(const AlignedBuffer&);
+
+    unsigned char* m_data;
+    size_t m_capacity;
+};
+
+/**
+  * Queue of asynchronous reads and writes on one file. Uses io_uring on Linux
+  * when available, and a background thread doing the I/O otherwise. Requests
+  * may complete in any order, and are identified by a tag given on submission.
+  */
+class AsyncIOQueue {
+public:
+    AsyncIOQueue(const std::string& path_, bool write_, const AsyncIOOptions& options_);
+    ~AsyncIOQueue();
+
+    void submitRead(unsigned char* buffer_, size_t size_, uint64_t offset_, uint64_t tag_);
+    void submitWrite(const unsigned char* buffer_, size_t size_, uint64_t offset_, uint64_t tag_);
+
+    /**
+      * Waits for the next request to complete, and returns its tag. bytes_ is 
+      * the number of bytes transferred, which is only less than requested when
+      * a read reaches the end of the file. Throws if the I/O failed.
+      */
+    uint64_t wait(size_t& bytes_);
+
+    inline size_t numPending() const {
+        return m_num_pending;
+    }
+
+    /**
+      * Sets the size of the file, e.g. to drop the padding of aligned writes
+      */
+    void truncate(uint64_t size_);
+
+    /**
+      * Returns true if requests go through io_uring
+      */
+    bool usesIOUring() const;
+
+    struct Backend;
+
+private:
+    AsyncIOQueue(const AsyncIOQueue&);
+    AsyncIOQueue& operator=(const AsyncIOQueue&);
+
+    struct Request {
+        bool m_write;
+        unsigned char* m_buffer;
+        size_t m_size;
+        uint64_t m_offset;
+        uint64_t m_tag;
+        size_t m_done;
+        bool m_active;
+    };
+
+    size_t addRequest(const Request& request_);
+    void submit(size_t slot_);
+
+    std::unique_ptr<Backend> m_backend;
+    std::vector<Request> m_requests;
+    size_t m_num_pending;
+};
+
+/**
+  * Reads a file from start to end in blocks, with the next blocks read ahead
+  * asynchronously while the current one is used
+  */
+class AsyncFileReader {
+public:
+    AsyncFileReader(const std::string& path_, const AsyncIOOptions& options_=AsyncIOOptions());
+
+    /**
+      * Returns the next block in data_ and size_, or false at the end of the
+      * file. The block stays valid until the next call.
+      */
+    bool next(const unsigned char*& data_, size_t& size_);
+
+    inline uint64_t size() const {
+        return m_file_size;
+    }
+
+    inline bool usesIOUring() const {
+        return m_queue.usesIOUring();
+    }
+
+private:
+    void submitNext(size_t buffer_);
+
+    //The buffers are declared before the queue, so that the queue is
+    //destroyed, and waits for pending reads, before the buffers are freed
+    AsyncIOOptions m_options;
+    uint64_t m_file_size;
+    std::vector<std::unique_ptr<AlignedBuffer> > m_buffers;
+    std::vector<size_t> m_sizes;
+    std::vector<bool> m_ready;
+    AsyncIOQueue m_queue;
+    uint64_t m_next_offset;
+    uint64_t m_num_blocks_read;
+    size_t m_current;
+};
+
+/**
+  * Writes a file from start to end. Data is collected into blocks, which are
+  * written asynchronously while the caller produces more.
+  */
+class AsyncFileWriter {
+public:
+    AsyncFileWriter(const std::string& path_, const AsyncIOOptions& options_=AsyncIOOptions());
+
+    /**
+      * Calls close(), but ignores errors. Call close() to see them.
+      */
+    ~AsyncFileWriter();
+
+    void write(const unsigned char* data_, size_t size_);
+
+    /**
+      * Writes the last block and waits for all writes to finish
+      */
+    void close();
+
+    inline uint64_t size() const {
+        return m_size;
+    }
+
+private:
+    void flush();
+
+    AsyncIOOptions m_options;
+    std::vector<std::unique_ptr<AlignedBuffer> > m_buffers;
+    std::vector<size_t> m_free;
+    AsyncIOQueue m_queue;
+    size_t m_current;
+    size_t m_current_size;
+    uint64_t m_size;
+    bool m_closed;
+};
\ No newline at end of file
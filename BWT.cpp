@@ -0,0 +1,547 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "BWT.h"
+#include "Varint.h"
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <limits>
+#include <thread>
+#include <exception>
+
+namespace { //Avoid contaminating global namespace
+
+/**
+  * Suffix array indices are 32 bit, which limits the block size
+  */
+const size_t bwt_max_block_size = size_t(1) << 30;
+
+/**
+  * Finds the start (or end if end_ is true) of the bucket of every character
+  */
+void getBuckets(const int32_t* s_, int32_t n_, int32_t k_, std::vector<int32_t>& buckets_, bool end_) {
+    std::fill(buckets_.begin(), buckets_.end(), 0);
+    for (int32_t i=0; i<n_; ++i) {
+        buckets_[s_[i]] += 1;
+    }
+    int32_t sum = 0;
+    for (int32_t i=0; i<k_; ++i) {
+        sum += buckets_[i];
+        buckets_[i] = end_ ? sum : sum - buckets_[i];
+    }
+}
+
+/**
+  * Induces the order of the L-type suffixes from the sorted LMS suffixes, and
+  * then the order of the S-type suffixes from the L-type suffixes
+  */
+void induceSort(const int32_t* s_, int32_t* sa_, const std::vector<unsigned char>& s_type_, 
+        int32_t n_, int32_t k_, std::vector<int32_t>& buckets_) {
+    getBuckets(s_, n_, k_, buckets_, false);
+    for (int32_t i=0; i<n_; ++i) {
+        int32_t j = sa_[i]-1;
+        if (sa_[i] > 0 && !s_type_[j]) {
+            sa_[buckets_[s_[j]]++] = j;
+        }
+    }
+    getBuckets(s_, n_, k_, buckets_, true);
+    for (int32_t i=n_-1; i>=0; --i) {
+        int32_t j = sa_[i]-1;
+        if (sa_[i] > 0 && s_type_[j]) {
+            sa_[--buckets_[s_[j]]] = j;
+        }
+    }
+}
+
+/**
+  * Computes the suffix array of s_ in linear time using induced sorting (SA-IS).
+  * s_ holds n_ characters in [0, k_), and the last character must be a 
+  * unique zero which sorts before all others.
+  */
+void suffixArray(const int32_t* s_, int32_t* sa_, int32_t n_, int32_t k_) {
+    //Classify suffixes as S-type (smaller than the next suffix) or L-type
+    std::vector<unsigned char> s_type(n_);
+    s_type[n_-1] = 1;
+    for (int32_t i=n_-2; i>=0; --i) {
+        s_type[i] = (s_[i] < s_[i+1] || (s_[i] == s_[i+1] && s_type[i+1])) ? 1 : 0;
+    }
+    auto isLMS = [&](int32_t i) { 
+        return i > 0 && s_type[i] && !s_type[i-1]; 
+    };
+
+    //Sort the LMS substrings by placing the LMS suffixes at the ends of their buckets and inducing
+    std::vector<int32_t> buckets(k_);
+    getBuckets(s_, n_, k_, buckets, true);
+    std::fill(sa_, sa_+n_, -1);
+    for (int32_t i=1; i<n_; ++i) {
+        if (isLMS(i)) {
+            sa_[--buckets[s_[i]]] = i;
+        }
+    }
+    induceSort(s_, sa_, s_type, n_, k_, buckets);
+
+    //Move the sorted LMS substrings to the front, and name them so that
+    //equal substrings get equal names
+    int32_t n1 = 0;
+    for (int32_t i=0; i<n_; ++i) {
+        if (isLMS(sa_[i])) {
+            sa_[n1++] = sa_[i];
+        }
+    }
+    std::fill(sa_+n1, sa_+n_, -1);
+    int32_t name = 0;
+    int32_t prev = -1;
+    for (int32_t i=0; i<n1; ++i) {
+        int32_t pos = sa_[i];
+        bool diff = false;
+        for (int32_t d=0; d<n_; ++d) {
+            if (prev == -1 || s_[pos+d] != s_[prev+d] || s_type[pos+d] != s_type[prev+d]) {
+                diff = true;
+                break;
+            }
+            else if (d > 0 && (isLMS(pos+d) || isLMS(prev+d))) {
+                break;
+            }
+        }
+        if (diff) {
+            name += 1;
+            prev = pos;
+        }
+        sa_[n1 + pos/2] = name-1;
+    }
+    for (int32_t i=n_-1, j=n_-1; i>=n1; --i) {
+        if (sa_[i] >= 0) {
+            sa_[j--] = sa_[i];
+        }
+    }
+
+    //Sort the reduced string, recursing if the names are not unique
+    int32_t* s1 = sa_ + n_ - n1;
+    if (name < n1) {
+        suffixArray(s1, sa_, n1, name);
+    }
+    else {
+        for (int32_t i=0; i<n1; ++i) {
+            sa_[s1[i]] = i;
+        }
+    }
+
+    //Place the LMS suffixes in sorted order, and induce the rest from them
+    getBuckets(s_, n_, k_, buckets, true);
+    for (int32_t i=1, j=0; i<n_; ++i) {
+        if (isLMS(i)) {
+            s1[j++] = i;
+        }
+    }
+    for (int32_t i=0; i<n1; ++i) {
+        sa_[i] = s1[sa_[i]];
+    }
+    std::fill(sa_+n1, sa_+n_, -1);
+    for (int32_t i=n1-1; i>=0; --i) {
+        int32_t j = sa_[i];
+        sa_[i] = -1;
+        sa_[--buckets[s_[j]]] = j;
+    }
+    induceSort(s_, sa_, s_type, n_, k_, buckets);
+}
+
+/**
+  * Computes the Burrows-Wheeler transform of size_ bytes from data_ into output_.
+  * The string is terminated by a virtual end of string character, and the
+  * returned primary index is the row of the transform where it would be.
+  */
+size_t forwardTransform(const unsigned char* data_, size_t size_, unsigned char* output_) {
+    int32_t n = static_cast<int32_t>(size_+1);
+    std::vector<int32_t> s(n);
+    for (size_t i=0; i<size_; ++i) {
+        s[i] = data_[i]+1;
+    }
+    s[size_] = 0;
+    std::vector<int32_t> sa(n);
+    suffixArray(s.data(), sa.data(), n, 257);
+
+    size_t primary = 0;
+    for (int32_t i=0, j=0; i<n; ++i) {
+        if (sa[i] == 0) {
+            primary = i;
+        }
+        else {
+            output_[j++] = data_[sa[i]-1];
+        }
+    }
+    return primary;
+}
+
+/**
+  * Inverts the Burrows-Wheeler transform in linear time by following the 
+  * last-to-first mapping from the end of the string towards its start
+  */
+void inverseTransform(const unsigned char* data_, size_t size_, size_t primary_, unsigned char* output_) {
+    if (primary_ == 0 || primary_ > size_) {
+        throw std::runtime_error("BWT: invalid primary index");
+    }
+
+    //Number of characters smaller than each character, where the end of string is smallest
+    size_t counts[256] = { 0 };
+    for (size_t i=0; i<size_; ++i) {
+        counts[data_[i]] += 1;
+    }
+    size_t first[256];
+    size_t sum = 1;
+    for (unsigned int c=0; c<256; ++c) {
+        first[c] = sum;
+        sum += counts[c];
+    }
+
+    //Row i of the transform holds data_[i] before the primary index, and data_[i-1] after it
+    std::vector<uint32_t> lf(size_+1);
+    lf[primary_] = 0;
+    for (size_t i=0; i<size_; ++i) {
+        unsigned char c = data_[i];
+        lf[i + (i >= primary_ ? 1 : 0)] = static_cast<uint32_t>(first[c]++);
+    }
+
+    size_t row = 0;
+    for (size_t k=size_; k>0; --k) {
+        if (row == primary_) {
+            throw std::runtime_error("BWT: invalid primary index");
+        }
+        output_[k-1] = data_[row - (row > primary_ ? 1 : 0)];
+        row = lf[row];
+    }
+}
+
+/**
+  * Writes a run of length_ zeros using the bijective base two digits 0 and 1
+  */
+inline size_t writeZeroRun(size_t length_, unsigned char* output_) {
+    size_t out = 0;
+    while (length_ > 0) {
+        if (length_ & 1) {
+            output_[out++] = 0;
+            length_ = (length_-1)/2;
+        }
+        else {
+            output_[out++] = 1;
+            length_ = (length_-2)/2;
+        }
+    }
+    return out;
+}
+
+/**
+  * Move-to-front encodes size_ bytes, and replaces runs of zeros with zero runs.
+  * Other values v are stored as v+1, except 254 and 255 which are stored as 255 
+  * followed by v-254. Writes at most 2*size_ bytes and returns the number written.
+  */
+size_t encodeMTF(const unsigned char* data_, size_t size_, unsigned char* output_) {
+    unsigned char order[256];
+    std::iota(order, order+256, 0);
+
+    size_t out = 0;
+    size_t run = 0;
+    for (size_t i=0; i<size_; ++i) {
+        unsigned char c = data_[i];
+        if (order[0] == c) {
+            run += 1;
+            continue;
+        }
+        if (run > 0) {
+            out += writeZeroRun(run, output_+out);
+            run = 0;
+        }
+
+        unsigned int v = 1;
+        while (order[v] != c) {
+            v += 1;
+        }
+        memmove(order+1, order, v);
+        order[0] = c;
+
+        if (v < 254) {
+            output_[out++] = static_cast<unsigned char>(v+1);
+        }
+        else {
+            output_[out++] = 255;
+            output_[out++] = static_cast<unsigned char>(v-254);
+        }
+    }
+    out += writeZeroRun(run, output_+out);
+    return out;
+}
+
+/**
+  * Inverse of encodeMTF, which must produce exactly size_ bytes
+  */
+void decodeMTF(const unsigned char* data_, size_t data_size_, unsigned char* output_, size_t size_) {
+    unsigned char order[256];
+    std::iota(order, order+256, 0);
+
+    size_t out = 0;
+    size_t run = 0;
+    size_t weight = 1;
+    for (size_t i=0; i<data_size_; ++i) {
+        unsigned char symbol = data_[i];
+        if (symbol <= 1) {
+            if (weight > size_) {
+                throw std::runtime_error("BWT: data exceeds stored length");
+            }
+            run += weight << symbol;
+            weight <<= 1;
+            continue;
+        }
+        if (run > size_-out) {
+            throw std::runtime_error("BWT: data exceeds stored length");
+        }
+        memset(output_+out, order[0], run);
+        out += run;
+        run = 0;
+        weight = 1;
+
+        unsigned int v = symbol-1;
+        if (symbol == 255) {
+            if (i+1 == data_size_ || data_[i+1] > 1) {
+                throw std::runtime_error("BWT: invalid symbol");
+            }
+            v = 254 + data_[++i];
+        }
+        if (out == size_) {
+            throw std::runtime_error("BWT: data exceeds stored length");
+        }
+        unsigned char c = order[v];
+        memmove(order+1, order, v);
+        order[0] = c;
+        output_[out++] = c;
+    }
+    if (run != size_-out) {
+        throw std::runtime_error("BWT: data does not match stored length");
+    }
+    memset(output_+out, order[0], run);
+}
+
+/**
+  * Runs function_(i) for every block i using num_threads_ threads, which
+  * each take every num_threads_'th block. Rethrows the first exception.
+  */
+template <typename F>
+void forEachBlock(size_t num_blocks_, unsigned int num_threads_, F function_) {
+    size_t num_threads = std::min<size_t>(std::max(num_threads_, 1u), num_blocks_);
+    if (num_threads <= 1) {
+        for (size_t i=0; i<num_blocks_; ++i) {
+            function_(i);
+        }
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(num_threads);
+    std::vector<std::thread> threads;
+    for (size_t t=0; t<num_threads; ++t) {
+        threads.push_back(std::thread([&, t]() {
+            try {
+                for (size_t i=t; i<num_blocks_; i+=num_threads) {
+                    function_(i);
+                }
+            }
+            catch (...) {
+                errors[t] = std::current_exception();
+            }
+        }));
+    }
+    for (size_t t=0; t<num_threads; ++t) {
+        threads[t].join();
+    }
+    for (size_t t=0; t<num_threads; ++t) {
+        if (errors[t]) {
+            std::rethrow_exception(errors[t]);
+        }
+    }
+}
+
+/**
+  * Location of a block in a transformed buffer
+  */
+struct BWTBlock {
+    size_t m_offset;
+    size_t m_size;
+};
+
+/**
+  * The header holds the number of bytes and the block size. Every block then 
+  * holds its size and primary index, followed by the move-to-front encoded transform.
+  */
+struct BWTHeader {
+    size_t m_num_bytes;
+    size_t m_block_size;
+    std::vector<BWTBlock> m_blocks;
+};
+
+inline uint64_t readHeaderValue(const unsigned char* data_, size_t size_, size_t& offset_) {
+    uint64_t value;
+    if (!readVarint(data_, size_, offset_, value)) {
+        throw std::runtime_error("BWT: invalid header");
+    }
+    return value;
+}
+
+/**
+  * Reads the header, and locates the blocks if blocks_ is true
+  */
+BWTHeader readBWTHeader(const unsigned char* data_, size_t size_, bool blocks_) {
+    BWTHeader header;
+    size_t offset = 0;
+    uint64_t num_bytes = readHeaderValue(data_, size_, offset);
+    uint64_t block_size = readHeaderValue(data_, size_, offset);
+    if (num_bytes > std::numeric_limits<size_t>::max()) {
+        throw std::length_error("BWT: stored length does not fit in memory");
+    }
+    if (block_size == 0 || block_size > bwt_max_block_size) {
+        throw std::runtime_error("BWT: invalid block size");
+    }
+    header.m_num_bytes = static_cast<size_t>(num_bytes);
+    header.m_block_size = static_cast<size_t>(block_size);
+
+    //Every block takes up at least one byte
+    size_t num_blocks = header.m_num_bytes / header.m_block_size + (header.m_num_bytes % header.m_block_size != 0 ? 1 : 0);
+    if (num_blocks > size_-offset) {
+        throw std::runtime_error("BWT: stored length exceeds data");
+    }
+
+    if (blocks_) {
+        for (size_t i=0; i<num_blocks; ++i) {
+            uint64_t block_bytes = readHeaderValue(data_, size_, offset);
+            if (block_bytes > size_-offset) {
+                throw std::runtime_error("BWT: block exceeds data");
+            }
+            BWTBlock block = { offset, static_cast<size_t>(block_bytes) };
+            header.m_blocks.push_back(block);
+            offset += block.m_size;
+        }
+    }
+    return header;
+}
+
+} // Namespace
+
+/**
+  * Every block stores its size and primary index, and the move-to-front 
+  * encoding writes at most two bytes per character
+  */
+size_t bwt_compress_bound(size_t size_, size_t block_size_) {
+    size_t num_blocks = (size_ + block_size_ - 1) / block_size_;
+    return 20 + num_blocks*20 + 2*size_;
+}
+
+/**
+  * Function which transforms a character stream using the Burrows-Wheeler 
+  * transform and move-to-front encoding
+  */
+size_t bwt_compress(const unsigned char* data_, size_t size_, unsigned char* output_, size_t block_size_, unsigned int num_threads_) {
+    if (block_size_ == 0 || block_size_ > bwt_max_block_size) {
+        throw std::invalid_argument("BWT: block size must be between 1 and 2^30");
+    }
+    size_t out = writeVarint(size_, output_);
+    out += writeVarint(block_size_, output_+out);
+
+    //Transform every block into its own buffer, and concatenate them afterwards
+    size_t num_blocks = (size_ + block_size_ - 1) / block_size_;
+    std::vector<std::vector<unsigned char> > blocks(num_blocks);
+    forEachBlock(num_blocks, num_threads_, [&](size_t i) {
+        size_t begin = i*block_size_;
+        size_t size = std::min(block_size_, size_-begin);
+        std::vector<unsigned char> transformed(size);
+        size_t primary = forwardTransform(data_+begin, size, transformed.data());
+
+        std::vector<unsigned char>& block = blocks[i];
+        block.resize(10 + 2*size);
+        size_t block_size = writeVarint(primary, block.data());
+        block_size += encodeMTF(transformed.data(), size, block.data()+block_size);
+        block.resize(block_size);
+    });
+
+    for (size_t i=0; i<num_blocks; ++i) {
+        out += writeVarint(blocks[i].size(), output_+out);
+        memcpy(output_+out, blocks[i].data(), blocks[i].size());
+        out += blocks[i].size();
+    }
+    return out;
+}
+
+void bwt_compress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_, size_t block_size_, unsigned int num_threads_) {
+    size_t offset = output_.size();
+    output_.resize(offset + bwt_compress_bound(size_, std::max<size_t>(block_size_, 1)));
+    output_.resize(offset + bwt_compress(data_, size_, output_.data()+offset, block_size_, num_threads_));
+}
+
+std::vector<unsigned char> bwt_compress(const std::vector<unsigned char>& data_, size_t block_size_, unsigned int num_threads_) {
+    std::vector<unsigned char> output;
+    bwt_compress(data_.data(), data_.size(), output, block_size_, num_threads_);
+    return output;
+}
+
+/**
+  * Function which returns the number of bytes a transformed buffer decompresses to
+  */
+size_t bwt_decompressed_size(const unsigned char* data_, size_t size_) {
+    return readBWTHeader(data_, size_, false).m_num_bytes;
+}
+
+/**
+  * Function which inverts the move-to-front encoding and Burrows-Wheeler transform.
+  * Blocks are independent, and num_threads_ threads decode different blocks.
+  */
+size_t bwt_decompress(const unsigned char* data_, size_t size_, unsigned char* output_, size_t capacity_, unsigned int num_threads_) {
+    BWTHeader header = readBWTHeader(data_, size_, true);
+    if (header.m_num_bytes > capacity_) {
+        throw std::length_error("BWT: output buffer too small");
+    }
+
+    forEachBlock(header.m_blocks.size(), num_threads_, [&](size_t i) {
+        const BWTBlock& block = header.m_blocks[i];
+        size_t begin = i*header.m_block_size;
+        size_t size = std::min(header.m_block_size, header.m_num_bytes-begin);
+
+        size_t offset = block.m_offset;
+        size_t end = block.m_offset + block.m_size;
+        uint64_t primary = readHeaderValue(data_, end, offset);
+
+        std::vector<unsigned char> transformed(size);
+        decodeMTF(data_+offset, end-offset, transformed.data(), size);
+        inverseTransform(transformed.data(), size, static_cast<size_t>(std::min<uint64_t>(primary, size+1)), output_+begin);
+    });
+
+    return header.m_num_bytes;
+}
+
+void bwt_decompress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_, unsigned int num_threads_) {
+    size_t offset = output_.size();
+    size_t num_bytes = bwt_decompressed_size(data_, size_);
+    output_.resize(offset + num_bytes);
+    bwt_decompress(data_, size_, output_.data()+offset, num_bytes, num_threads_);
+}
+
+std::vector<unsigned char> bwt_decompress(const std::vector<unsigned char>& data_, unsigned int num_threads_) {
+    std::vector<unsigned char> output;
+    bwt_decompress(data_.data(), data_.size(), output, num_threads_);
+    return output;
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+/**
+  * Burrows-Wheeler transform followed by move-to-front and zero run length
+  * encoding. This does not compress much by itself, but turns the context 
+  * redundancy of text into skewed byte frequencies, which huffman_compress 
+  * then compresses well. The input is transformed in independent blocks of 
+  * block_size_ bytes, and num_threads_ threads work on different blocks.
+  */
+const size_t bwt_default_block_size = 900*1024;
+
+std::vector<unsigned char> bwt_compress(const std::vector<unsigned char>& data_, 
+        size_t block_size_=bwt_default_block_size, unsigned int num_threads_=1);
+std::vector<unsigned char> bwt_decompress(const std::vector<unsigned char>& data_, unsigned int num_threads_=1);
+
+/**
+  * Versions which read size_ bytes from data_, and append the result to the end of output_
+  */
+void bwt_compress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_, 
+        size_t block_size_=bwt_default_block_size, unsigned int num_threads_=1);
+void bwt_decompress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_, unsigned int num_threads_=1);
+
+/**
+  * Versions which work on caller owned memory. bwt_compress requires room for
+  * bwt_compress_bound(size_, block_size_) bytes in output_, and bwt_decompress requires room for
+  * bwt_decompressed_size(data_, size_) bytes. Both return the number of bytes written.
+  */
+size_t bwt_compress_bound(size_t size_, size_t block_size_=bwt_default_block_size);
+size_t bwt_compress(const unsigned char* data_, size_t size_, unsigned char* output_, 
+        size_t block_size_=bwt_default_block_size, unsigned int num_threads_=1);
+size_t bwt_decompressed_size(const unsigned char* data_, size_t size_);
+size_t bwt_decompress(const unsigned char* data_, size_t size_, unsigned char* output_, size_t capacity_, unsigned int num_threads_=1);
\ No newline at end of file
@@ -0,0 +1,132 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "Batch.h"
+
+#include <thread>
+#include <exception>
+#include <algorithm>
+
+namespace { //Avoid contaminating global namespace
+
+typedef void (*codec_function)(Compress_t, const unsigned char*, size_t, std::vector<unsigned char>&);
+
+/**
+  * Runs function_ on inputs_[begin_, end_), appending the results to arena_
+  * and the offset where each result ends to offsets_
+  */
+void processRange(codec_function function_, Compress_t type_, 
+        const std::vector<BatchInput>& inputs_, size_t begin_, size_t end_,
+        std::vector<unsigned char>& arena_, std::vector<size_t>& offsets_) {
+    for (size_t i=begin_; i<end_; ++i) {
+        function_(type_, inputs_[i].m_data, inputs_[i].m_size, arena_);
+        offsets_.push_back(arena_.size());
+    }
+}
+
+/**
+  * Runs function_ on every input, splitting the batch into one contiguous
+  * range of roughly equally many bytes per thread
+  */
+BatchOutput processBatch(codec_function function_, Compress_t type_, const std::vector<BatchInput>& inputs_, unsigned int num_threads_) {
+    BatchOutput output;
+    output.m_offsets.reserve(inputs_.size()+1);
+    output.m_offsets.push_back(0);
+
+    size_t num_threads = std::min<size_t>(std::max(num_threads_, 1u), inputs_.size());
+    if (num_threads <= 1) {
+        processRange(function_, type_, inputs_, 0, inputs_.size(), output.m_arena, output.m_offsets);
+        return output;
+    }
+
+    //Find the range of each thread
+    size_t total_size = 0;
+    for (size_t i=0; i<inputs_.size(); ++i) {
+        total_size += inputs_[i].m_size;
+    }
+    std::vector<size_t> range_begin(num_threads+1, inputs_.size());
+    range_begin[0] = 0;
+    size_t bytes = 0;
+    for (size_t i=0, t=1; i<inputs_.size() && t<num_threads; ++i) {
+        bytes += inputs_[i].m_size;
+        if (bytes*num_threads >= total_size*t) {
+            range_begin[t++] = i+1;
+        }
+    }
+
+    //Process each range into its own arena
+    std::vector<std::vector<unsigned char> > arenas(num_threads);
+    std::vector<std::vector<size_t> > offsets(num_threads);
+    std::vector<std::exception_ptr> errors(num_threads);
+    std::vector<std::thread> threads;
+    for (size_t t=0; t<num_threads; ++t) {
+        threads.push_back(std::thread([&, t]() {
+            try {
+                processRange(function_, type_, inputs_, range_begin[t], range_begin[t+1], arenas[t], offsets[t]);
+            }
+            catch (...) {
+                errors[t] = std::current_exception();
+            }
+        }));
+    }
+    for (size_t t=0; t<num_threads; ++t) {
+        threads[t].join();
+    }
+    for (size_t t=0; t<num_threads; ++t) {
+        if (errors[t]) {
+            std::rethrow_exception(errors[t]);
+        }
+    }
+
+    //Stitch the arenas together
+    size_t arena_size = 0;
+    for (size_t t=0; t<num_threads; ++t) {
+        arena_size += arenas[t].size();
+    }
+    output.m_arena.reserve(arena_size);
+    for (size_t t=0; t<num_threads; ++t) {
+        size_t base = output.m_arena.size();
+        output.m_arena.insert(output.m_arena.end(), arenas[t].begin(), arenas[t].end());
+        for (size_t i=0; i<offsets[t].size(); ++i) {
+            output.m_offsets.push_back(base + offsets[t][i]);
+        }
+    }
+
+    return output;
+}
+
+} // Namespace
+
+std::vector<BatchInput> BatchOutput::records() const {
+    std::vector<BatchInput> records;
+    records.reserve(size());
+    for (size_t i=0; i<size(); ++i) {
+        records.push_back(record(i));
+    }
+    return records;
+}
+
+BatchOutput batch_compress(Compress_t type_, const std::vector<BatchInput>& inputs_, unsigned int num_threads_) {
+    return processBatch(compress, type_, inputs_, num_threads_);
+}
+
+BatchOutput batch_decompress(Compress_t type_, const std::vector<BatchInput>& inputs_, unsigned int num_threads_) {
+    return processBatch(decompress, type_, inputs_, num_threads_);
+}
\ No newline at end of file
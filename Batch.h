@@ -0,0 +1,67 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#pragma once
+
+#include "Codec.h"
+
+#include <vector>
+#include <cstddef>
+
+/**
+  * One independent input buffer of a batch
+  */
+struct BatchInput {
+    BatchInput() : m_data(nullptr), m_size(0) {}
+    BatchInput(const unsigned char* data_, size_t size_) : m_data(data_), m_size(size_) {}
+
+    const unsigned char* m_data;
+    size_t m_size;
+};
+
+/**
+  * The result of a batch. All records are stored back to back in one arena,
+  * and record i occupies [m_offsets[i], m_offsets[i+1]) of m_arena.
+  */
+struct BatchOutput {
+    inline size_t size() const {
+        return m_offsets.empty() ? 0 : m_offsets.size()-1;
+    }
+
+    inline BatchInput record(size_t i_) const {
+        return BatchInput(m_arena.data() + m_offsets[i_], m_offsets[i_+1] - m_offsets[i_]);
+    }
+
+    /**
+      * Returns all records, e.g., to feed the batch back into batch_decompress
+      */
+    std::vector<BatchInput> records() const;
+
+    std::vector<unsigned char> m_arena;
+    std::vector<size_t> m_offsets;
+};
+
+/**
+  * Functions which compress or decompress many independent buffers in one call.
+  * Scratch state is shared between the records, and the batch is split over
+  * num_threads_ threads.
+  */
+BatchOutput batch_compress(Compress_t type_, const std::vector<BatchInput>& inputs_, unsigned int num_threads_=1);
+BatchOutput batch_decompress(Compress_t type_, const std::vector<BatchInput>& inputs_, unsigned int num_threads_=1);
\ No newline at end of file
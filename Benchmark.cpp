@@ -0,0 +1,224 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "Benchmark.h"
+#include "Huffman.h"
+#include "LZW.h"
+#include "AdaptiveHuffman.h"
+
+#include <ostream>
+#include <iomanip>
+#include <sstream>
+#include <random>
+#include <algorithm>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+namespace { //Avoid contaminating global namespace
+
+#ifdef __linux__
+/**
+  * Opens one hardware counter for the calling thread in user space. The
+  * first counter leads the group, so that all counters cover the same time.
+  */
+inline int openPerfCounter(uint64_t config_, int group_fd_) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config_;
+    attr.disabled = (group_fd_ == -1) ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd_, 0));
+}
+#endif
+
+/**
+  * Writes value_ divided by divisor_ to a column, or a dash if it is unknown
+  */
+inline void printColumn(std::ostream& os_, bool valid_, double value_, double divisor_, int width_, int precision_) {
+    std::ostringstream column;
+    if (valid_ && divisor_ > 0.0) {
+        column << std::fixed << std::setprecision(precision_) << value_/divisor_;
+    }
+    else {
+        column << "-";
+    }
+    os_ << std::setw(width_) << column.str();
+}
+
+} // Namespace
+
+PerfCounters::PerfCounters() : m_valid(false) {
+    std::fill(m_fd, m_fd+num_counters, -1);
+#ifdef __linux__
+    const uint64_t configs[num_counters] = {
+        PERF_COUNT_HW_CPU_CYCLES, 
+        PERF_COUNT_HW_INSTRUCTIONS, 
+        PERF_COUNT_HW_BRANCH_MISSES, 
+        PERF_COUNT_HW_CACHE_MISSES 
+    };
+    m_valid = true;
+    for (unsigned int i=0; i<num_counters && m_valid; ++i) {
+        m_fd[i] = openPerfCounter(configs[i], m_fd[0]);
+        m_valid = (m_fd[i] != -1);
+    }
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+    for (unsigned int i=0; i<num_counters; ++i) {
+        if (m_fd[i] != -1) {
+            close(m_fd[i]);
+        }
+    }
+#endif
+}
+
+void PerfCounters::start() {
+#ifdef __linux__
+    if (m_valid) {
+        ioctl(m_fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(m_fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+}
+
+BenchmarkCounters PerfCounters::stop(size_t num_calls_) {
+    BenchmarkCounters counters;
+#ifdef __linux__
+    if (m_valid) {
+        ioctl(m_fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        uint64_t values[num_counters];
+        counters.m_valid = true;
+        for (unsigned int i=0; i<num_counters; ++i) {
+            counters.m_valid = counters.m_valid && (read(m_fd[i], &values[i], sizeof(uint64_t)) == sizeof(uint64_t));
+        }
+        if (counters.m_valid) {
+            double calls = static_cast<double>(num_calls_);
+            counters.m_cycles = values[0] / calls;
+            counters.m_instructions = values[1] / calls;
+            counters.m_branch_misses = values[2] / calls;
+            counters.m_cache_misses = values[3] / calls;
+        }
+    }
+#endif
+    return counters;
+}
+
+/**
+  * Function which creates synthetic input with controlled entropy and repetitiveness
+  */
+std::vector<unsigned char> benchmark_input(size_t size_, unsigned int alphabet_bits_, double repeat_fraction_, uint32_t seed_) {
+    std::mt19937 random(seed_);
+    std::uniform_int_distribution<unsigned int> character(0, (1u << std::min(alphabet_bits_, 8u)) - 1);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::uniform_int_distribution<size_t> run_length(16, 80);
+
+    //Runs average 48 characters, so start one with the probability which 
+    //makes them cover repeat_fraction_ of the output
+    double run_probability = repeat_fraction_ / (48.0*(1.0 - repeat_fraction_) + repeat_fraction_);
+
+    std::vector<unsigned char> output;
+    output.reserve(size_);
+    while (output.size() < size_) {
+        if (output.size() > 4096 && uniform(random) < run_probability) {
+            size_t length = std::min(run_length(random), size_ - output.size());
+            size_t start = std::uniform_int_distribution<size_t>(output.size()-4096, output.size()-length)(random);
+            for (size_t i=0; i<length; ++i) {
+                output.push_back(output[start+i]);
+            }
+        }
+        else {
+            output.push_back(static_cast<unsigned char>(character(random)));
+        }
+    }
+    return output;
+}
+
+/**
+  * Function which prints benchmark results
+  */
+void print_benchmark_results(std::ostream& os_, const std::vector<BenchmarkResult>& results_) {
+    os_ << std::left << std::setw(40) << "Kernel" << std::right 
+        << std::setw(12) << "us/call" << std::setw(10) << "MB/s" 
+        << std::setw(10) << "cycles" << std::setw(10) << "instr" 
+        << std::setw(10) << "br-miss" << std::setw(12) << "cache-miss" << std::setw(8) << "ratio" << std::endl;
+    for (size_t i=0; i<results_.size(); ++i) {
+        const BenchmarkResult& result = results_[i];
+        const BenchmarkCounters& counters = result.m_counters;
+
+        //Counters are per byte, or per call for work that does not scale with the input
+        double per = (result.m_bytes > 0) ? static_cast<double>(result.m_bytes) : 1.0;
+        os_ << std::left << std::setw(40) << (result.m_bytes > 0 ? result.m_name : result.m_name + " (per call)") << std::right;
+        printColumn(os_, true, result.m_seconds*1.0e6, 1.0, 12, 2);
+        printColumn(os_, result.m_bytes > 0, static_cast<double>(result.m_bytes)*1.0e-6, result.m_seconds, 10, 0);
+        printColumn(os_, counters.m_valid, counters.m_cycles, per, 10, 2);
+        printColumn(os_, counters.m_valid, counters.m_instructions, per, 10, 2);
+        printColumn(os_, counters.m_valid, counters.m_branch_misses, per, 10, 4);
+        printColumn(os_, counters.m_valid, counters.m_cache_misses, per, 12, 4);
+        printColumn(os_, result.m_ratio > 0.0, result.m_ratio, 1.0, 8, 3);
+        os_ << std::endl;
+    }
+}
+
+/**
+  * Function which runs all kernel benchmarks
+  */
+void run_benchmarks(std::ostream& os_, size_t size_, const std::vector<unsigned char>& file_input_) {
+    struct Input {
+        std::string m_name;
+        std::vector<unsigned char> m_data;
+    };
+    std::vector<Input> inputs;
+    const unsigned int alphabet_bits[] = { 2, 5, 8 };
+    const double repeat_fractions[] = { 0.0, 0.75 };
+    for (unsigned int bits : alphabet_bits) {
+        for (double repeat : repeat_fractions) {
+            std::ostringstream name;
+            name << bits << " bits/char, " << static_cast<int>(repeat*100) << "% repeats";
+            inputs.push_back({ name.str(), benchmark_input(size_, bits, repeat) });
+        }
+    }
+    if (!file_input_.empty()) {
+        inputs.push_back({ "file", file_input_ });
+    }
+
+    if (!PerfCounters().valid()) {
+        os_ << "Hardware counters are unavailable, only timing is reported" << std::endl << std::endl;
+    }
+    for (size_t i=0; i<inputs.size(); ++i) {
+        std::vector<BenchmarkResult> results;
+        huffman_benchmark(inputs[i].m_data, results);
+        adaptive_huffman_benchmark(inputs[i].m_data, results);
+        lzw_benchmark(inputs[i].m_data, results);
+        os_ << "Input: " << inputs[i].m_name << " (" << inputs[i].m_data.size() << " bytes)" << std::endl;
+        print_benchmark_results(os_, results);
+        os_ << std::endl;
+    }
+}
\ No newline at end of file
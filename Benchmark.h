@@ -0,0 +1,157 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <iosfwd>
+#include <cstdint>
+#include <cstddef>
+
+/**
+  * Hardware counters for one call of a benchmarked kernel. m_valid is false
+  * when the counters could not be read, e.g. outside Linux or when perf
+  * events are not permitted.
+  */
+struct BenchmarkCounters {
+    BenchmarkCounters() : m_valid(false), m_cycles(0), m_instructions(0), m_branch_misses(0), m_cache_misses(0) {}
+
+    bool m_valid;
+    double m_cycles;
+    double m_instructions;
+    double m_branch_misses;
+    double m_cache_misses;
+};
+
+/**
+  * Reads cycles, instructions, branch misses and cache misses of the calling
+  * thread using perf_event_open on Linux
+  */
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    void start();
+
+    /**
+      * Stops counting, and returns the counts divided by num_calls_
+      */
+    BenchmarkCounters stop(size_t num_calls_);
+
+    inline bool valid() const {
+        return m_valid;
+    }
+
+private:
+    PerfCounters(const PerfCounters&);
+    PerfCounters& operator=(const PerfCounters&);
+
+    static const unsigned int num_counters = 4;
+    int m_fd[num_counters];
+    bool m_valid;
+};
+
+/**
+  * Result of benchmarking one kernel on one input. m_bytes is the number of
+  * bytes processed per call, or zero if the work does not scale with the input.
+  * m_ratio is the compressed size over the input size for whole codecs, and
+  * zero for other kernels.
+  */
+struct BenchmarkResult {
+    std::string m_name;
+    size_t m_bytes;
+    double m_seconds;
+    double m_ratio;
+    BenchmarkCounters m_counters;
+};
+
+/**
+  * Makes the compiler assume value_ is used, so that benchmarked work is not
+  * optimized away
+  */
+template <typename T>
+inline void benchmarkKeep(const T& value_) {
+#if defined(__GNUC__)
+    asm volatile("" : : "g"(&value_) : "memory");
+#else
+    static const void* volatile sink;
+    sink = &value_;
+#endif
+}
+
+/**
+  * Calls kernel_ once to warm up, and then repeatedly for at least 
+  * benchmark_min_seconds. Reports the fastest call, and the hardware counters
+  * averaged over all calls.
+  */
+const double benchmark_min_seconds = 0.05;
+const size_t benchmark_min_calls = 5;
+
+template <typename Kernel>
+BenchmarkResult runBenchmark(const std::string& name_, size_t bytes_, Kernel kernel_) {
+    typedef std::chrono::steady_clock Clock;
+    BenchmarkResult result;
+    result.m_name = name_;
+    result.m_bytes = bytes_;
+    result.m_seconds = 0.0;
+    result.m_ratio = 0.0;
+
+    kernel_();
+
+    PerfCounters counters;
+    double total_seconds = 0.0;
+    size_t num_calls = 0;
+    counters.start();
+    while (num_calls < benchmark_min_calls || total_seconds < benchmark_min_seconds) {
+        Clock::time_point start = Clock::now();
+        kernel_();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (num_calls == 0 || seconds < result.m_seconds) {
+            result.m_seconds = seconds;
+        }
+        total_seconds += seconds;
+        ++num_calls;
+    }
+    result.m_counters = counters.stop(num_calls);
+    return result;
+}
+
+/**
+  * Synthetic input of size_ bytes. Characters are drawn uniformly from
+  * 2^alphabet_bits_ values, which gives alphabet_bits_ bits of entropy per
+  * character. A fraction repeat_fraction_ of the input is instead copies of
+  * earlier runs, which makes it repetitive the way text is.
+  */
+std::vector<unsigned char> benchmark_input(size_t size_, unsigned int alphabet_bits_, double repeat_fraction_, uint32_t seed_=1);
+
+/**
+  * Prints results as a table of time, throughput and counters per byte
+  */
+void print_benchmark_results(std::ostream& os_, const std::vector<BenchmarkResult>& results_);
+
+/**
+  * Benchmarks the Huffman, adaptive Huffman and LZW kernels on synthetic inputs of size_ bytes
+  * of varying entropy and repetitiveness, and on file_input_ unless it is empty
+  */
+const size_t benchmark_default_size = 1 << 20;
+void run_benchmarks(std::ostream& os_, size_t size_, const std::vector<unsigned char>& file_input_);
\ No newline at end of file
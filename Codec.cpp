@@ -0,0 +1,150 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "Codec.h"
+#include "LZW.h"
+#include "Huffman.h"
+#include "LZ77.h"
+#include "BWT.h"
+#include "Filter.h"
+#include "AdaptiveHuffman.h"
+
+#include <ostream>
+#include <algorithm>
+#include <stdexcept>
+
+std::ostream& operator<<(std::ostream& os_, const Compress_t& t_) {
+    switch (t_) {
+    case LZW: os_ << "LZW"; break;
+    case HUFFMAN: os_ << "Huffman"; break;
+    case LZ77: os_ << "LZ77"; break;
+    case BWT: os_ << "BWT"; break;
+    case SHUFFLE: os_ << "Shuffle"; break;
+    case DELTA: os_ << "Delta"; break;
+    case XOR_DELTA: os_ << "XOR delta"; break;
+    case ADAPTIVE_HUFFMAN: os_ << "Adaptive Huffman"; break;
+    case HUFFMAN_BLOCKS: os_ << "Block Huffman"; break;
+    case LZW_HUFFMAN: os_ << "LZW+Huffman"; break;
+    default: os_ << "UNKNOWN_COMPRESS_T"; break;
+    }
+    return os_;
+}
+
+bool is_filter(Compress_t type_, Filter_t& filter_) {
+    switch (type_) {
+    case SHUFFLE: filter_ = FILTER_SHUFFLE; return true;
+    case DELTA: filter_ = FILTER_DELTA; return true;
+    case XOR_DELTA: filter_ = FILTER_XOR_DELTA; return true;
+    default: return false;
+    }
+}
+
+void compress(Compress_t type_, const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_) {
+    switch (type_) {
+    case LZW: lzw_compress(data_, size_, output_); break;
+    case HUFFMAN: huffman_compress(data_, size_, output_); break;
+    case LZ77: lz77_compress(data_, size_, output_); break;
+    case BWT: bwt_compress(data_, size_, output_); break;
+    case SHUFFLE: filter_encode(FILTER_SHUFFLE, filter_default_width, data_, size_, output_); break;
+    case DELTA: filter_encode(FILTER_DELTA, filter_default_width, data_, size_, output_); break;
+    case XOR_DELTA: filter_encode(FILTER_XOR_DELTA, filter_default_width, data_, size_, output_); break;
+    case ADAPTIVE_HUFFMAN: adaptive_huffman_compress(data_, size_, output_); break;
+    case HUFFMAN_BLOCKS: huffman_block_compress(data_, size_, output_); break;
+    case LZW_HUFFMAN: lzw_huffman_compress(data_, size_, output_); break;
+    default: output_.insert(output_.end(), data_, data_+size_); break;
+    }
+}
+
+void decompress(Compress_t type_, const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_) {
+    switch (type_) {
+    case LZW: lzw_decompress(data_, size_, output_); break;
+    case HUFFMAN: huffman_decompress(data_, size_, output_); break;
+    case LZ77: lz77_decompress(data_, size_, output_); break;
+    case BWT: bwt_decompress(data_, size_, output_); break;
+    case SHUFFLE: case DELTA: case XOR_DELTA: filter_decode(data_, size_, output_); break;
+    case ADAPTIVE_HUFFMAN: adaptive_huffman_decompress(data_, size_, output_); break;
+    case HUFFMAN_BLOCKS: huffman_block_decompress(data_, size_, output_); break;
+    case LZW_HUFFMAN: lzw_huffman_decompress(data_, size_, output_); break;
+    default: output_.insert(output_.end(), data_, data_+size_); break;
+    }
+}
+
+size_t compress_bound(Compress_t type_, size_t size_) {
+    switch (type_) {
+    case LZW: return lzw_compress_bound(size_);
+    case HUFFMAN: return huffman_compress_bound(size_);
+    case LZ77: return lz77_compress_bound(size_);
+    case BWT: return bwt_compress_bound(size_);
+    case SHUFFLE: case DELTA: case XOR_DELTA: return filter_encode_bound(size_);
+    case ADAPTIVE_HUFFMAN: return adaptive_huffman_compress_bound(size_);
+    case HUFFMAN_BLOCKS: return huffman_block_compress_bound(size_);
+    case LZW_HUFFMAN: return lzw_huffman_compress_bound(size_);
+    default: return size_;
+    }
+}
+
+size_t compress(Compress_t type_, const unsigned char* data_, size_t size_, unsigned char* output_) {
+    switch (type_) {
+    case LZW: return lzw_compress(data_, size_, output_);
+    case HUFFMAN: return huffman_compress(data_, size_, output_);
+    case LZ77: return lz77_compress(data_, size_, output_);
+    case BWT: return bwt_compress(data_, size_, output_);
+    case SHUFFLE: return filter_encode(FILTER_SHUFFLE, filter_default_width, data_, size_, output_);
+    case DELTA: return filter_encode(FILTER_DELTA, filter_default_width, data_, size_, output_);
+    case XOR_DELTA: return filter_encode(FILTER_XOR_DELTA, filter_default_width, data_, size_, output_);
+    case ADAPTIVE_HUFFMAN: return adaptive_huffman_compress(data_, size_, output_);
+    case HUFFMAN_BLOCKS: return huffman_block_compress(data_, size_, output_);
+    case LZW_HUFFMAN: return lzw_huffman_compress(data_, size_, output_);
+    default: std::copy(data_, data_+size_, output_); return size_;
+    }
+}
+
+size_t decompressed_size(Compress_t type_, const unsigned char* data_, size_t size_) {
+    switch (type_) {
+    case LZW: return lzw_decompressed_size(data_, size_);
+    case HUFFMAN: return huffman_decompressed_size(data_, size_);
+    case LZ77: return lz77_decompressed_size(data_, size_);
+    case BWT: return bwt_decompressed_size(data_, size_);
+    case SHUFFLE: case DELTA: case XOR_DELTA: return filter_decoded_size(data_, size_);
+    case ADAPTIVE_HUFFMAN: return adaptive_huffman_decompressed_size(data_, size_);
+    case HUFFMAN_BLOCKS: return huffman_block_decompressed_size(data_, size_);
+    case LZW_HUFFMAN: return lzw_huffman_decompressed_size(data_, size_);
+    default: return size_;
+    }
+}
+
+size_t decompress(Compress_t type_, const unsigned char* data_, size_t size_, unsigned char* output_, size_t capacity_) {
+    switch (type_) {
+    case LZW: return lzw_decompress(data_, size_, output_, capacity_);
+    case HUFFMAN: return huffman_decompress(data_, size_, output_, capacity_);
+    case LZ77: return lz77_decompress(data_, size_, output_, capacity_);
+    case BWT: return bwt_decompress(data_, size_, output_, capacity_);
+    case SHUFFLE: case DELTA: case XOR_DELTA: return filter_decode(data_, size_, output_, capacity_);
+    case ADAPTIVE_HUFFMAN: return adaptive_huffman_decompress(data_, size_, output_, capacity_);
+    case HUFFMAN_BLOCKS: return huffman_block_decompress(data_, size_, output_, capacity_);
+    case LZW_HUFFMAN: return lzw_huffman_decompress(data_, size_, output_, capacity_);
+    default: 
+        if (size_ > capacity_) {
+            throw std::length_error("Output buffer too small");
+        }
+        std::copy(data_, data_+size_, output_); 
+        return size_;
+    }
+}
\ No newline at end of file
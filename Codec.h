@@ -0,0 +1,67 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#pragma once
+
+#include "Filter.h"
+
+#include <vector>
+#include <iosfwd>
+#include <cstddef>
+
+/**
+  * Enum to keep track of which algorithms to perform
+  */
+enum Compress_t {
+    LZW,
+    HUFFMAN,
+    LZ77,
+    BWT,
+    SHUFFLE,
+    DELTA,
+    XOR_DELTA,
+    ADAPTIVE_HUFFMAN,
+    HUFFMAN_BLOCKS,
+    LZW_HUFFMAN
+};
+
+std::ostream& operator<<(std::ostream& os_, const Compress_t& t_);
+
+/**
+  * Returns true if type_ is one of the filters in Filter.h, and which filter it is
+  */
+bool is_filter(Compress_t type_, Filter_t& filter_);
+
+/**
+  * Functions which compress or decompress size_ bytes from data_ using the 
+  * given algorithm, and append the result to the end of output_
+  */
+void compress(Compress_t type_, const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_);
+void decompress(Compress_t type_, const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_);
+
+/**
+  * Functions which work on caller owned memory. compress requires room for
+  * compress_bound(type_, size_) bytes in output_, and decompress requires room for
+  * decompressed_size(type_, data_, size_) bytes. Both return the number of bytes written.
+  */
+size_t compress_bound(Compress_t type_, size_t size_);
+size_t compress(Compress_t type_, const unsigned char* data_, size_t size_, unsigned char* output_);
+size_t decompressed_size(Compress_t type_, const unsigned char* data_, size_t size_);
+size_t decompress(Compress_t type_, const unsigned char* data_, size_t size_, unsigned char* output_, size_t capacity_);
\ No newline at end of file
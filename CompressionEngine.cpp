@@ -0,0 +1,81 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "CompressionEngine.h"
+
+#include <memory>
+
+CompressionEngine::CompressionEngine(unsigned int num_threads_, size_t max_queued_jobs_) 
+    : m_pool(num_threads_, max_queued_jobs_) {
+}
+
+std::future<std::vector<unsigned char> > CompressionEngine::compress(Compress_t type_, std::vector<unsigned char> data_, int priority_) {
+    return submit(::compress, type_, data_, priority_);
+}
+
+std::future<std::vector<unsigned char> > CompressionEngine::decompress(Compress_t type_, std::vector<unsigned char> data_, int priority_) {
+    return submit(::decompress, type_, data_, priority_);
+}
+
+void CompressionEngine::compress(Compress_t type_, std::vector<unsigned char> data_, Callback callback_, int priority_) {
+    submit(::compress, type_, data_, callback_, priority_);
+}
+
+void CompressionEngine::decompress(Compress_t type_, std::vector<unsigned char> data_, Callback callback_, int priority_) {
+    submit(::decompress, type_, data_, callback_, priority_);
+}
+
+std::future<std::vector<unsigned char> > CompressionEngine::submit(codec_function function_, Compress_t type_, std::vector<unsigned char>& data_, int priority_) {
+    //The pool needs copyable tasks, so the input and promise are shared with the task
+    std::shared_ptr<std::vector<unsigned char> > data = std::make_shared<std::vector<unsigned char> >();
+    data->swap(data_);
+    std::shared_ptr<std::promise<std::vector<unsigned char> > > promise = std::make_shared<std::promise<std::vector<unsigned char> > >();
+    std::future<std::vector<unsigned char> > future = promise->get_future();
+
+    m_pool.submit([=]() {
+        try {
+            std::vector<unsigned char> output;
+            function_(type_, data->data(), data->size(), output);
+            promise->set_value(std::move(output));
+        }
+        catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    }, priority_);
+
+    return future;
+}
+
+void CompressionEngine::submit(codec_function function_, Compress_t type_, std::vector<unsigned char>& data_, Callback callback_, int priority_) {
+    std::shared_ptr<std::vector<unsigned char> > data = std::make_shared<std::vector<unsigned char> >();
+    data->swap(data_);
+
+    m_pool.submit([=]() {
+        std::vector<unsigned char> output;
+        std::exception_ptr error;
+        try {
+            function_(type_, data->data(), data->size(), output);
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        callback_(output, error);
+    }, priority_);
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#pragma once
+
+#include "Codec.h"
+#include "ThreadPool.h"
+
+#include <vector>
+#include <future>
+#include <functional>
+#include <exception>
+
+/**
+  * Asynchronous compression service. Jobs run on a work stealing thread pool,
+  * and complete either through a future or by invoking a callback on the 
+  * worker thread. Submitting blocks while max_queued_jobs_ jobs are waiting.
+  * Jobs with a higher priority_ run first, per worker as in ThreadPool::submit.
+  */
+class CompressionEngine {
+public:
+    /**
+      * Callback invoked with the result of a job, or with the exception it failed with
+      */
+    typedef std::function<void(std::vector<unsigned char>& result_, std::exception_ptr error_)> Callback;
+
+    CompressionEngine(unsigned int num_threads_, size_t max_queued_jobs_);
+
+    std::future<std::vector<unsigned char> > compress(Compress_t type_, std::vector<unsigned char> data_, int priority_=0);
+    std::future<std::vector<unsigned char> > decompress(Compress_t type_, std::vector<unsigned char> data_, int priority_=0);
+
+    void compress(Compress_t type_, std::vector<unsigned char> data_, Callback callback_, int priority_=0);
+    void decompress(Compress_t type_, std::vector<unsigned char> data_, Callback callback_, int priority_=0);
+
+    /**
+      * Blocks until every submitted job has finished
+      */
+    inline void wait() {
+        m_pool.wait();
+    }
+
+private:
+    typedef void (*codec_function)(Compress_t, const unsigned char*, size_t, std::vector<unsigned char>&);
+
+    std::future<std::vector<unsigned char> > submit(codec_function function_, Compress_t type_, std::vector<unsigned char>& data_, int priority_);
+    void submit(codec_function function_, Compress_t type_, std::vector<unsigned char>& data_, Callback callback_, int priority_);
+
+    ThreadPool m_pool;
+};
\ No newline at end of file
@@ -0,0 +1,989 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "Daemon.h"
+#include "ThreadPool.h"
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define DAEMON_HAS_UNIX_SOCKETS
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace { //Avoid contaminating global namespace
+
+/**
+  * Types of the messages sent over the socket
+  */
+enum DaemonMessage_t {
+    DAEMON_HELLO,
+    DAEMON_COMPRESS,
+    DAEMON_DECOMPRESS,
+    DAEMON_RELEASE,
+    DAEMON_STATS,
+    DAEMON_RESULT,
+    DAEMON_ERROR
+};
+
+const uint32_t daemon_protocol_version = 1;
+
+/**
+  * Every message has the same size. Requests refer to their input in the 
+  * request ring, and results to their output in the result ring, by offset
+  * and size. A hello carries the protocol version in m_codec, the ring size 
+  * in m_size, and the shared memory as a file descriptor.
+  */
+struct DaemonMessage {
+    uint32_t m_type;
+    uint32_t m_codec;
+    uint64_t m_id;
+    uint64_t m_offset;
+    uint64_t m_size;
+    DaemonStats m_stats;
+    char m_error[128];
+};
+
+inline DaemonMessage makeMessage(DaemonMessage_t type_, uint64_t id_) {
+    DaemonMessage message = DaemonMessage();
+    message.m_type = type_;
+    message.m_id = id_;
+    return message;
+}
+
+inline void setError(DaemonMessage& message_, const char* error_) {
+    message_.m_type = DAEMON_ERROR;
+    strncpy(message_.m_error, error_, sizeof(message_.m_error)-1);
+    message_.m_error[sizeof(message_.m_error)-1] = '\0';
+}
+
+/**
+  * Allocator of blocks in a ring. Blocks are allocated at the head, and the
+  * space of released blocks is reused once every older block is released 
+  * too, so blocks may be released in any order.
+  */
+class RingAllocator {
+public:
+    RingAllocator(size_t capacity_) : m_capacity(capacity_), m_head(0) {}
+
+    /**
+      * Allocates size_ bytes, and returns false if they do not fit right now
+      */
+    bool allocate(size_t size_, size_t& offset_) {
+        //Blocks are aligned, and never empty, so that offsets are unique
+        const size_t alignment = 64;
+        if (size_ > m_capacity - alignment) {
+            return false;
+        }
+        size_t size = std::max<size_t>((size_ + alignment - 1) & ~(alignment - 1), alignment);
+
+        if (m_blocks.empty()) {
+            m_head = 0;
+        }
+        const size_t tail = m_blocks.empty() ? 0 : m_blocks.front().m_offset;
+        const bool wrapped = !m_blocks.empty() && m_blocks.back().m_offset < tail;
+        if (wrapped) {
+            if (size > tail - m_head) {
+                return false;
+            }
+            offset_ = m_head;
+        }
+        else if (size <= m_capacity - m_head) {
+            offset_ = m_head;
+        }
+        else if (size <= tail) {
+            offset_ = 0;
+        }
+        else {
+            return false;
+        }
+
+        Block block = { offset_, false };
+        m_blocks.push_back(block);
+        m_head = offset_ + size;
+        return true;
+    }
+
+    /**
+      * Releases the block at offset_, and returns false if there is none
+      */
+    bool release(size_t offset_) {
+        for (size_t i=0; i<m_blocks.size(); ++i) {
+            if (m_blocks[i].m_offset == offset_ && !m_blocks[i].m_released) {
+                m_blocks[i].m_released = true;
+                while (!m_blocks.empty() && m_blocks.front().m_released) {
+                    m_blocks.pop_front();
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline bool empty() const {
+        return m_blocks.empty();
+    }
+
+private:
+    struct Block {
+        size_t m_offset;
+        bool m_released;
+    };
+
+    size_t m_capacity;
+    size_t m_head;
+    std::deque<Block> m_blocks;
+};
+
+/**
+  * Adds the counters of one request to stats_
+  */
+inline void addRequest(DaemonStats& stats_, bool failed_, uint64_t bytes_in_, uint64_t bytes_out_, uint64_t latency_us_) {
+    stats_.m_num_requests += 1;
+    stats_.m_num_failed += failed_ ? 1 : 0;
+    stats_.m_bytes_in += bytes_in_;
+    stats_.m_bytes_out += bytes_out_;
+    stats_.m_total_latency_us += latency_us_;
+    stats_.m_max_latency_us = std::max(stats_.m_max_latency_us, latency_us_);
+}
+
+#ifdef DAEMON_HAS_UNIX_SOCKETS
+
+inline sockaddr_un socketAddress(const std::string& path_) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path_.empty() || path_.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Daemon: invalid socket path '" + path_ + "'");
+    }
+    memcpy(address.sun_path, path_.c_str(), path_.size());
+    return address;
+}
+
+inline int createSocket() {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Daemon: could not create socket: ") + std::strerror(errno));
+    }
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    return fd;
+}
+
+/**
+  * Returns true if the shared memory of fd_ cannot shrink, so that the 
+  * mapping of a client never loses pages while the daemon uses it
+  */
+inline bool sealedAgainstShrinking(int fd_) {
+#ifdef F_SEAL_SHRINK
+    int seals = fcntl(fd_, F_GET_SEALS);
+    return seals >= 0 && (seals & F_SEAL_SHRINK) != 0;
+#else
+    (void)fd_;
+    return false;
+#endif
+}
+
+/**
+  * Sends a message, with the file descriptor fd_ attached unless it is -1.
+  * Returns false if the peer is gone, or does not read its messages.
+  */
+bool sendMessage(int socket_, const DaemonMessage& message_, int fd_=-1) {
+    const char* data = reinterpret_cast<const char*>(&message_);
+    size_t sent = 0;
+    while (sent < sizeof(message_)) {
+        iovec io;
+        io.iov_base = const_cast<char*>(data + sent);
+        io.iov_len = sizeof(message_) - sent;
+        msghdr header;
+        memset(&header, 0, sizeof(header));
+        header.msg_iov = &io;
+        header.msg_iovlen = 1;
+
+        //The file descriptor goes with the first byte
+        char control[CMSG_SPACE(sizeof(int))];
+        if (fd_ >= 0 && sent == 0) {
+            memset(control, 0, sizeof(control));
+            header.msg_control = control;
+            header.msg_controllen = sizeof(control);
+            cmsghdr* message = CMSG_FIRSTHDR(&header);
+            message->cmsg_level = SOL_SOCKET;
+            message->cmsg_type = SCM_RIGHTS;
+            message->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(message), &fd_, sizeof(int));
+        }
+
+        ssize_t result = sendmsg(socket_, &header, MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+/**
+  * Receives up to size_ bytes. A file descriptor sent along is stored in fd_,
+  * after closing any earlier one. Returns the number of bytes received, 0 if 
+  * the peer is gone, and -1 if no data is available on a non-blocking socket.
+  */
+ssize_t receiveSome(int socket_, unsigned char* data_, size_t size_, int& fd_) {
+    iovec io;
+    io.iov_base = data_;
+    io.iov_len = size_;
+    char control[CMSG_SPACE(sizeof(int))];
+    msghdr header;
+    memset(&header, 0, sizeof(header));
+    header.msg_iov = &io;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+
+    ssize_t result;
+    do {
+        result = recvmsg(socket_, &header, 0);
+    } while (result < 0 && errno == EINTR);
+    if (result < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? -1 : 0;
+    }
+
+    for (cmsghdr* message = CMSG_FIRSTHDR(&header); message; message = CMSG_NXTHDR(&header, message)) {
+        if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SCM_RIGHTS) {
+            if (fd_ >= 0) {
+                close(fd_);
+            }
+            memcpy(&fd_, CMSG_DATA(message), sizeof(int));
+        }
+    }
+    return result;
+}
+
+/**
+  * Receives a whole message on a blocking socket, and throws if the peer is gone
+  */
+void receiveMessage(int socket_, DaemonMessage& message_) {
+    unsigned char* data = reinterpret_cast<unsigned char*>(&message_);
+    size_t received = 0;
+    int fd = -1;
+    while (received < sizeof(message_)) {
+        ssize_t result = receiveSome(socket_, data + received, sizeof(message_) - received, fd);
+        if (result <= 0) {
+            throw std::runtime_error("Daemon: connection closed");
+        }
+        received += static_cast<size_t>(result);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+/**
+  * State of a connected client. Workers keep the client alive while they 
+  * run its requests, so the shared memory stays mapped even if it disconnects.
+  */
+struct DaemonClient {
+    DaemonClient(int socket_) : m_socket(socket_), m_closed(false), m_shared(nullptr), m_ring_size(0),
+        m_num_pending(0), m_bytes_submitted(0), m_num_buffered(0), m_fd(-1) {}
+
+    ~DaemonClient() {
+        if (m_shared) {
+            munmap(m_shared, 2*m_ring_size);
+        }
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    /**
+      * Sends a message unless the client is gone. A client which does not 
+      * read its messages is shut down, and disconnected by the I/O thread.
+      * The caller must hold m_mutex.
+      */
+    void send(const DaemonMessage& message_) {
+        if (!m_closed && !sendMessage(m_socket, message_)) {
+            shutdown(m_socket, SHUT_RDWR);
+        }
+    }
+
+    //Protects everything up to the receive state, which only the I/O thread uses
+    std::mutex m_mutex;
+    int m_socket;
+    bool m_closed;
+    unsigned char* m_shared;
+    size_t m_ring_size;
+    std::unique_ptr<RingAllocator> m_results;
+    unsigned int m_num_pending;
+    uint64_t m_bytes_submitted;
+    DaemonStats m_stats;
+
+    unsigned char m_buffer[sizeof(DaemonMessage)];
+    size_t m_num_buffered;
+    int m_fd;
+};
+
+#endif
+
+} // Namespace
+
+#ifdef DAEMON_HAS_UNIX_SOCKETS
+
+struct CompressionDaemon::Impl {
+    Impl(const std::string& socket_path_, const DaemonOptions& options_) : m_path(socket_path_), m_options(options_), 
+        m_listen(-1), m_pool(options_.m_num_threads, static_cast<size_t>(options_.m_max_clients)*options_.m_max_pending, options_.m_pin_threads) {
+        m_wake[0] = -1;
+        m_wake[1] = -1;
+    }
+
+    ~Impl() {
+        for (size_t i=0; i<m_clients.size(); ++i) {
+            disconnect(*m_clients[i]);
+        }
+        for (int fd : { m_listen, m_wake[0], m_wake[1] }) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    void disconnect(DaemonClient& client_) {
+        std::unique_lock<std::mutex> lock(client_.m_mutex);
+        client_.m_closed = true;
+        close(client_.m_socket);
+    }
+
+    bool receive(const std::shared_ptr<DaemonClient>& client_);
+    bool handleMessage(const std::shared_ptr<DaemonClient>& client_, const DaemonMessage& message_);
+    bool handleHello(DaemonClient& client_, const DaemonMessage& message_);
+    void handleRequest(const std::shared_ptr<DaemonClient>& client_, const DaemonMessage& message_);
+    void process(const std::shared_ptr<DaemonClient>& client_, DaemonMessage message_, std::chrono::steady_clock::time_point start_);
+    void reject(DaemonClient& client_, uint64_t id_, const char* error_);
+
+    std::string m_path;
+    DaemonOptions m_options;
+    int m_listen;
+    int m_wake[2];
+    std::vector<std::shared_ptr<DaemonClient> > m_clients;
+
+    mutable std::mutex m_stats_mutex;
+    DaemonStats m_stats;
+
+    //Queues every request the quotas allow, so that the I/O thread never blocks
+    //on submit. The pool is destroyed first, and finishes all requests while 
+    //the rest is intact.
+    ThreadPool m_pool;
+};
+
+/**
+  * Reads what the client has sent, and handles every whole message. Returns
+  * false if the client is gone or broke the protocol, and must be disconnected.
+  */
+bool CompressionDaemon::Impl::receive(const std::shared_ptr<DaemonClient>& client_) {
+    DaemonClient& client = *client_;
+    while (true) {
+        ssize_t result = receiveSome(client.m_socket, client.m_buffer + client.m_num_buffered, 
+            sizeof(client.m_buffer) - client.m_num_buffered, client.m_fd);
+        if (result < 0) {
+            return true;
+        }
+        if (result == 0) {
+            return false;
+        }
+        client.m_num_buffered += static_cast<size_t>(result);
+        if (client.m_num_buffered == sizeof(DaemonMessage)) {
+            DaemonMessage message;
+            memcpy(&message, client.m_buffer, sizeof(message));
+            client.m_num_buffered = 0;
+            if (!handleMessage(client_, message)) {
+                return false;
+            }
+        }
+    }
+}
+
+bool CompressionDaemon::Impl::handleMessage(const std::shared_ptr<DaemonClient>& client_, const DaemonMessage& message_) {
+    DaemonClient& client = *client_;
+
+    //A file descriptor is only expected with the hello
+    if (message_.m_type != DAEMON_HELLO && client.m_fd >= 0) {
+        close(client.m_fd);
+        client.m_fd = -1;
+    }
+    if (message_.m_type == DAEMON_HELLO) {
+        return handleHello(client, message_);
+    }
+    if (client.m_shared == nullptr) {
+        return false;
+    }
+
+    switch (message_.m_type) {
+    case DAEMON_COMPRESS: 
+    case DAEMON_DECOMPRESS: 
+        handleRequest(client_, message_);
+        return true;
+    case DAEMON_RELEASE: {
+        std::unique_lock<std::mutex> lock(client.m_mutex);
+        return client.m_results->release(static_cast<size_t>(message_.m_offset));
+    }
+    case DAEMON_STATS: {
+        std::unique_lock<std::mutex> lock(client.m_mutex);
+        DaemonMessage reply = makeMessage(DAEMON_STATS, message_.m_id);
+        reply.m_stats = client.m_stats;
+        client.send(reply);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+/**
+  * Maps the shared memory of a new client. The file descriptor is closed
+  * once mapped, and the mapping lives as long as the client.
+  */
+bool CompressionDaemon::Impl::handleHello(DaemonClient& client_, const DaemonMessage& message_) {
+    DaemonMessage reply = makeMessage(DAEMON_HELLO, message_.m_id);
+    int fd = client_.m_fd;
+    client_.m_fd = -1;
+
+    struct stat file_stat;
+    if (client_.m_shared != nullptr || message_.m_codec != daemon_protocol_version || fd < 0) {
+        setError(reply, "Daemon: invalid hello");
+    }
+    else if (message_.m_size == 0 || message_.m_size > m_options.m_max_ring_size) {
+        setError(reply, "Daemon: ring size exceeds quota");
+    }
+    else if (!m_options.m_allow_unsealed && !sealedAgainstShrinking(fd)) {
+        setError(reply, "Daemon: shared memory is not sealed against shrinking");
+    }
+    else if (fstat(fd, &file_stat) != 0 || static_cast<uint64_t>(file_stat.st_size) < 2*message_.m_size) {
+        setError(reply, "Daemon: shared memory is smaller than the rings");
+    }
+    else {
+        size_t ring_size = static_cast<size_t>(message_.m_size);
+        void* shared = mmap(nullptr, 2*ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (shared == MAP_FAILED) {
+            setError(reply, "Daemon: could not map shared memory");
+        }
+        else {
+            std::unique_lock<std::mutex> lock(client_.m_mutex);
+            client_.m_shared = static_cast<unsigned char*>(shared);
+            client_.m_ring_size = ring_size;
+            client_.m_results.reset(new RingAllocator(ring_size));
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    std::unique_lock<std::mutex> lock(client_.m_mutex);
+    client_.send(reply);
+    return reply.m_type == DAEMON_HELLO;
+}
+
+void CompressionDaemon::Impl::reject(DaemonClient& client_, uint64_t id_, const char* error_) {
+    DaemonMessage reply = makeMessage(DAEMON_ERROR, id_);
+    setError(reply, error_);
+    {
+        std::unique_lock<std::mutex> lock(client_.m_mutex);
+        client_.m_stats.m_num_rejected += 1;
+        client_.send(reply);
+    }
+    std::unique_lock<std::mutex> lock(m_stats_mutex);
+    m_stats.m_num_rejected += 1;
+}
+
+/**
+  * Checks a request against the ring and the quotas of the client, and 
+  * queues it on the worker pool
+  */
+void CompressionDaemon::Impl::handleRequest(const std::shared_ptr<DaemonClient>& client_, const DaemonMessage& message_) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    DaemonClient& client = *client_;
+    if (message_.m_codec > LZW_HUFFMAN || message_.m_offset > client.m_ring_size 
+            || message_.m_size > client.m_ring_size - message_.m_offset) {
+        reject(client, message_.m_id, "Daemon: invalid request");
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(client.m_mutex);
+        if (client.m_num_pending >= m_options.m_max_pending) {
+            lock.unlock();
+            reject(client, message_.m_id, "Daemon: too many pending requests");
+            return;
+        }
+        if (m_options.m_max_bytes > 0 && client.m_bytes_submitted + message_.m_size > m_options.m_max_bytes) {
+            lock.unlock();
+            reject(client, message_.m_id, "Daemon: byte quota exceeded");
+            return;
+        }
+        client.m_num_pending += 1;
+        client.m_bytes_submitted += message_.m_size;
+    }
+
+    std::shared_ptr<DaemonClient> client_ptr = client_;
+    m_pool.submit([this, client_ptr, message_, start]() {
+        process(client_ptr, message_, start);
+    });
+}
+
+/**
+  * Runs a request on a worker. The input is copied out of the request ring
+  * first, as the client can write to the ring at any time, and the decoders
+  * must not see their input change between checking and decoding it. The 
+  * codec writes the result straight into the result ring.
+  */
+void CompressionDaemon::Impl::process(const std::shared_ptr<DaemonClient>& client_, DaemonMessage message_, std::chrono::steady_clock::time_point start_) {
+    DaemonClient& client = *client_;
+    const Compress_t type = static_cast<Compress_t>(message_.m_codec);
+    const size_t size = static_cast<size_t>(message_.m_size);
+    const std::vector<unsigned char> request(client.m_shared + message_.m_offset, client.m_shared + message_.m_offset + size);
+    const unsigned char* input = request.data();
+    unsigned char* results = client.m_shared + client.m_ring_size;
+
+    DaemonMessage reply = makeMessage(DAEMON_RESULT, message_.m_id);
+    size_t offset = 0;
+    bool allocated = false;
+    try {
+        size_t capacity = (message_.m_type == DAEMON_COMPRESS) ? compress_bound(type, size) : decompressed_size(type, input, size);
+        {
+            std::unique_lock<std::mutex> lock(client.m_mutex);
+            allocated = client.m_results->allocate(capacity, offset);
+        }
+        if (!allocated) {
+            throw std::length_error("Daemon: result does not fit in the ring");
+        }
+        if (message_.m_type == DAEMON_COMPRESS) {
+            reply.m_size = compress(type, input, size, results + offset);
+        }
+        else {
+            reply.m_size = decompress(type, input, size, results + offset, capacity);
+        }
+        reply.m_offset = offset;
+    }
+    catch (const std::exception& e) {
+        setError(reply, e.what());
+    }
+
+    const bool failed = (reply.m_type == DAEMON_ERROR);
+    uint64_t latency = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_).count());
+    {
+        std::unique_lock<std::mutex> lock(client.m_mutex);
+        if (failed && allocated) {
+            client.m_results->release(offset);
+        }
+        client.m_num_pending -= 1;
+        addRequest(client.m_stats, failed, size, reply.m_size, latency);
+        client.send(reply);
+    }
+    std::unique_lock<std::mutex> lock(m_stats_mutex);
+    addRequest(m_stats, failed, size, reply.m_size, latency);
+}
+
+CompressionDaemon::CompressionDaemon(const std::string& socket_path_, const DaemonOptions& options_) 
+    : m_impl(new Impl(socket_path_, options_)) {
+    sockaddr_un address = socketAddress(socket_path_);
+
+    //Refuse to take over the socket of a running daemon, but replace a stale one
+    int probe = createSocket();
+    bool running = (connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+    close(probe);
+    if (running) {
+        throw std::runtime_error("Daemon: a daemon is already running on '" + socket_path_ + "'");
+    }
+    unlink(socket_path_.c_str());
+
+    m_impl->m_listen = createSocket();
+    if (bind(m_impl->m_listen, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(m_impl->m_listen, 64) != 0) {
+        throw std::runtime_error("Daemon: could not listen on '" + socket_path_ + "': " + std::strerror(errno));
+    }
+    if (pipe(m_impl->m_wake) != 0) {
+        throw std::runtime_error(std::string("Daemon: could not create pipe: ") + std::strerror(errno));
+    }
+}
+
+CompressionDaemon::~CompressionDaemon() {
+    unlink(m_impl->m_path.c_str());
+}
+
+/**
+  * The I/O thread polls the listening socket and the clients, and only 
+  * handles the small messages. The codecs run on the worker pool.
+  */
+void CompressionDaemon::run() {
+    while (true) {
+        std::vector<pollfd> fds(2 + m_impl->m_clients.size());
+        fds[0].fd = m_impl->m_wake[0];
+        fds[1].fd = m_impl->m_listen;
+        for (size_t i=0; i<m_impl->m_clients.size(); ++i) {
+            fds[2+i].fd = m_impl->m_clients[i]->m_socket;
+        }
+        for (size_t i=0; i<fds.size(); ++i) {
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("Daemon: poll failed: ") + std::strerror(errno));
+        }
+
+        if (fds[0].revents) {
+            char byte;
+            ssize_t ignored = read(m_impl->m_wake[0], &byte, 1);
+            (void) ignored;
+            return;
+        }
+
+        //Handle the clients first, as accepting changes the list
+        std::vector<std::shared_ptr<DaemonClient> > remaining;
+        for (size_t i=0; i<m_impl->m_clients.size(); ++i) {
+            if (fds[2+i].revents && !m_impl->receive(m_impl->m_clients[i])) {
+                m_impl->disconnect(*m_impl->m_clients[i]);
+            }
+            else {
+                remaining.push_back(m_impl->m_clients[i]);
+            }
+        }
+        m_impl->m_clients.swap(remaining);
+
+        if (fds[1].revents & POLLIN) {
+            int fd = accept(m_impl->m_listen, nullptr, nullptr);
+            if (fd >= 0 && m_impl->m_clients.size() >= m_impl->m_options.m_max_clients) {
+                close(fd);
+            }
+            else if (fd >= 0) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+                int one = 1;
+                setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+                m_impl->m_clients.push_back(std::make_shared<DaemonClient>(fd));
+            }
+        }
+    }
+}
+
+void CompressionDaemon::stop() {
+    char byte = 0;
+    ssize_t ignored = write(m_impl->m_wake[1], &byte, 1);
+    (void) ignored;
+}
+
+DaemonStats CompressionDaemon::stats() const {
+    std::unique_lock<std::mutex> lock(m_impl->m_stats_mutex);
+    return m_impl->m_stats;
+}
+
+struct CompressionClient::Impl {
+    Impl(size_t ring_size_) : m_socket(-1), m_shared(nullptr), m_ring_size(ring_size_), m_requests(ring_size_), m_next_id(1), m_results_in_flight(0) {}
+
+    ~Impl() {
+        if (m_shared) {
+            munmap(m_shared, 2*m_ring_size);
+        }
+        if (m_socket >= 0) {
+            close(m_socket);
+        }
+    }
+
+    struct Pending {
+        size_t m_offset;
+        size_t m_result_size;
+    };
+
+    struct Result {
+        Result() : m_failed(false) {}
+
+        bool m_failed;
+        std::string m_error;
+        std::vector<unsigned char> m_data;
+    };
+
+    void receive();
+    uint64_t submit(DaemonMessage_t type_, Compress_t codec_, const unsigned char* data_, size_t size_);
+
+    int m_socket;
+    unsigned char* m_shared;
+    size_t m_ring_size;
+    RingAllocator m_requests;
+    uint64_t m_next_id;
+    uint64_t m_results_in_flight;
+    std::map<uint64_t, Pending> m_pending;
+    std::map<uint64_t, Result> m_done;
+    std::map<uint64_t, DaemonStats> m_stats;
+};
+
+/**
+  * Receives one reply. A result is copied out of the result ring, which is 
+  * released at once, together with the input in the request ring.
+  */
+void CompressionClient::Impl::receive() {
+    DaemonMessage message;
+    receiveMessage(m_socket, message);
+    if (message.m_type == DAEMON_STATS) {
+        m_stats[message.m_id] = message.m_stats;
+        return;
+    }
+    std::map<uint64_t, Pending>::iterator pending = m_pending.find(message.m_id);
+    if (pending == m_pending.end() || (message.m_type != DAEMON_RESULT && message.m_type != DAEMON_ERROR)) {
+        throw std::runtime_error("Daemon: unexpected reply");
+    }
+    m_requests.release(pending->second.m_offset);
+    m_results_in_flight -= pending->second.m_result_size;
+    m_pending.erase(pending);
+
+    Result& result = m_done[message.m_id];
+    result.m_failed = (message.m_type == DAEMON_ERROR);
+    if (result.m_failed) {
+        message.m_error[sizeof(message.m_error)-1] = '\0';
+        result.m_error = message.m_error;
+        return;
+    }
+    if (message.m_offset > m_ring_size || message.m_size > m_ring_size - message.m_offset) {
+        throw std::runtime_error("Daemon: result outside the ring");
+    }
+    const unsigned char* data = m_shared + m_ring_size + message.m_offset;
+    result.m_data.assign(data, data + message.m_size);
+
+    DaemonMessage release = makeMessage(DAEMON_RELEASE, message.m_id);
+    release.m_offset = message.m_offset;
+    if (!sendMessage(m_socket, release)) {
+        throw std::runtime_error("Daemon: connection closed");
+    }
+}
+
+/**
+  * Copies the input into the request ring and sends the request. Waits for
+  * earlier requests first while the results in flight could fill more than 
+  * half the result ring, as the daemon fails requests whose result does not fit.
+  */
+uint64_t CompressionClient::Impl::submit(DaemonMessage_t type_, Compress_t codec_, const unsigned char* data_, size_t size_) {
+    size_t result_size = 0;
+    try {
+        result_size = (type_ == DAEMON_COMPRESS) ? compress_bound(codec_, size_) : decompressed_size(codec_, data_, size_);
+    }
+    catch (const std::exception&) {
+        //Let the daemon report invalid input
+    }
+    while (!m_pending.empty() && m_results_in_flight + result_size > m_ring_size/2) {
+        receive();
+    }
+
+    size_t offset;
+    while (!m_requests.allocate(size_, offset)) {
+        if (m_pending.empty()) {
+            throw std::length_error("Daemon: request does not fit in the ring");
+        }
+        receive();
+    }
+    std::copy(data_, data_ + size_, m_shared + offset);
+
+    DaemonMessage message = makeMessage(type_, m_next_id++);
+    message.m_codec = codec_;
+    message.m_offset = offset;
+    message.m_size = size_;
+    Pending pending = { offset, result_size };
+    m_pending[message.m_id] = pending;
+    m_results_in_flight += result_size;
+    if (!sendMessage(m_socket, message)) {
+        throw std::runtime_error("Daemon: connection closed");
+    }
+    return message.m_id;
+}
+
+/**
+  * Connects to the daemon, and hands it the shared memory holding both rings
+  */
+CompressionClient::CompressionClient(const std::string& socket_path_, size_t ring_size_) : m_impl(new Impl(ring_size_)) {
+    sockaddr_un address = socketAddress(socket_path_);
+    m_impl->m_socket = createSocket();
+    if (connect(m_impl->m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        throw std::runtime_error("Daemon: could not connect to '" + socket_path_ + "': " + std::strerror(errno));
+    }
+
+#ifdef MFD_ALLOW_SEALING
+    int fd = memfd_create("compression_rings", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    std::string name = "/compression_rings_" + std::to_string(getpid()) + "_" + std::to_string(reinterpret_cast<uintptr_t>(this));
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+        shm_unlink(name.c_str());
+    }
+#endif
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Daemon: could not create shared memory: ") + std::strerror(errno));
+    }
+    //The daemon only maps memory which cannot shrink under it
+    void* shared = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(2*ring_size_)) == 0) {
+#ifdef F_SEAL_SHRINK
+        if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK) != 0) {
+            int error = errno;
+            close(fd);
+            throw std::runtime_error(std::string("Daemon: could not seal shared memory: ") + std::strerror(error));
+        }
+#endif
+        shared = mmap(nullptr, 2*ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (shared == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error(std::string("Daemon: could not map shared memory: ") + std::strerror(errno));
+    }
+    m_impl->m_shared = static_cast<unsigned char*>(shared);
+
+    DaemonMessage hello = makeMessage(DAEMON_HELLO, 0);
+    hello.m_codec = daemon_protocol_version;
+    hello.m_size = ring_size_;
+    bool sent = sendMessage(m_impl->m_socket, hello, fd);
+    close(fd);
+    if (!sent) {
+        throw std::runtime_error("Daemon: connection closed");
+    }
+    DaemonMessage reply;
+    receiveMessage(m_impl->m_socket, reply);
+    if (reply.m_type != DAEMON_HELLO) {
+        reply.m_error[sizeof(reply.m_error)-1] = '\0';
+        throw std::runtime_error(reply.m_error);
+    }
+}
+
+CompressionClient::~CompressionClient() {
+}
+
+uint64_t CompressionClient::submitCompress(Compress_t type_, const unsigned char* data_, size_t size_) {
+    return m_impl->submit(DAEMON_COMPRESS, type_, data_, size_);
+}
+
+uint64_t CompressionClient::submitDecompress(Compress_t type_, const unsigned char* data_, size_t size_) {
+    return m_impl->submit(DAEMON_DECOMPRESS, type_, data_, size_);
+}
+
+void CompressionClient::wait(uint64_t id_, std::vector<unsigned char>& output_) {
+    if (m_impl->m_done.count(id_) == 0 && m_impl->m_pending.count(id_) == 0) {
+        throw std::invalid_argument("Daemon: unknown request");
+    }
+    while (m_impl->m_done.count(id_) == 0) {
+        m_impl->receive();
+    }
+    Impl::Result result;
+    std::map<uint64_t, Impl::Result>::iterator done = m_impl->m_done.find(id_);
+    std::swap(result, done->second);
+    m_impl->m_done.erase(done);
+    if (result.m_failed) {
+        throw std::runtime_error(result.m_error);
+    }
+    output_.insert(output_.end(), result.m_data.begin(), result.m_data.end());
+}
+
+DaemonStats CompressionClient::stats() {
+    uint64_t id = m_impl->m_next_id++;
+    if (!sendMessage(m_impl->m_socket, makeMessage(DAEMON_STATS, id))) {
+        throw std::runtime_error("Daemon: connection closed");
+    }
+    while (m_impl->m_stats.count(id) == 0) {
+        m_impl->receive();
+    }
+    DaemonStats stats = m_impl->m_stats[id];
+    m_impl->m_stats.erase(id);
+    return stats;
+}
+
+#else
+
+struct CompressionDaemon::Impl {
+};
+
+struct CompressionClient::Impl {
+};
+
+CompressionDaemon::CompressionDaemon(const std::string&, const DaemonOptions&) {
+    throw std::runtime_error("Daemon: Unix domain sockets are not supported on this platform");
+}
+
+CompressionDaemon::~CompressionDaemon() {
+}
+
+void CompressionDaemon::run() {
+}
+
+void CompressionDaemon::stop() {
+}
+
+DaemonStats CompressionDaemon::stats() const {
+    return DaemonStats();
+}
+
+CompressionClient::CompressionClient(const std::string&, size_t) {
+    throw std::runtime_error("Daemon: Unix domain sockets are not supported on this platform");
+}
+
+CompressionClient::~CompressionClient() {
+}
+
+uint64_t CompressionClient::submitCompress(Compress_t, const unsigned char*, size_t) {
+    return 0;
+}
+
+uint64_t CompressionClient::submitDecompress(Compress_t, const unsigned char*, size_t) {
+    return 0;
+}
+
+void CompressionClient::wait(uint64_t, std::vector<unsigned char>&) {
+}
+
+DaemonStats CompressionClient::stats() {
+    return DaemonStats();
+}
+
+#endif
+
+void CompressionClient::compress(Compress_t type_, const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_) {
+    wait(submitCompress(type_, data_, size_), output_);
+}
+
+void CompressionClient::decompress(Compress_t type_, const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_) {
+    wait(submitDecompress(type_, data_, size_), output_);
+}
\ No newline at end of file
@@ -0,0 +1,174 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#pragma once
+
+#include "Codec.h"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+/**
+  * Size of each of the two shared memory rings of a client: one for requests
+  * written by the client, and one for results written by the daemon
+  */
+const size_t daemon_default_ring_size = 16 << 20;
+
+/**
+  * Options of the compression daemon. The quotas apply to each client
+  * connection, and requests beyond them are rejected with an error.
+  */
+struct DaemonOptions {
+    DaemonOptions() : m_num_threads(4), m_pin_threads(false), m_max_clients(64), 
+        m_max_ring_size(256 << 20), m_max_pending(64), m_max_bytes(0), m_allow_unsealed(false) {}
+
+    unsigned int m_num_threads;
+
+    /**
+      * Pin each worker to its own CPU, see ThreadPool
+      */
+    bool m_pin_threads;
+
+    unsigned int m_max_clients;
+
+    /**
+      * Largest ring a client may map into the daemon
+      */
+    size_t m_max_ring_size;
+
+    /**
+      * Number of requests a client may have in flight
+      */
+    unsigned int m_max_pending;
+
+    /**
+      * Number of input bytes a client may submit over its connection, or 0 for no limit
+      */
+    uint64_t m_max_bytes;
+
+    /**
+      * Accept shared memory that is not sealed against shrinking. Only for 
+      * systems without file sealing, as a client that shrinks its shared
+      * memory makes the daemon crash with SIGBUS.
+      */
+    bool m_allow_unsealed;
+};
+
+/**
+  * Request counters of a client, or of the whole daemon. Latencies are 
+  * measured in the daemon from receiving a request to sending its result.
+  */
+struct DaemonStats {
+    DaemonStats() : m_num_requests(0), m_num_failed(0), m_num_rejected(0), 
+        m_bytes_in(0), m_bytes_out(0), m_total_latency_us(0), m_max_latency_us(0) {}
+
+    uint64_t m_num_requests;
+    uint64_t m_num_failed;
+    uint64_t m_num_rejected;
+    uint64_t m_bytes_in;
+    uint64_t m_bytes_out;
+    uint64_t m_total_latency_us;
+    uint64_t m_max_latency_us;
+};
+
+/**
+  * Compression daemon which serves compress and decompress requests from
+  * local processes over a Unix domain socket. Every client maps a shared 
+  * memory area into the daemon when it connects, and the socket only carries
+  * small fixed size messages, while the codecs read their input from and 
+  * write their output to the shared memory. Requests run on a pool of worker
+  * threads that lives as long as the daemon, so the per thread codec contexts 
+  * stay warm between requests and clients. Supported on Linux and other
+  * POSIX systems. Clients must seal their shared memory against shrinking,
+  * which needs memfd_create and file sealing, unless m_allow_unsealed is set.
+  */
+class CompressionDaemon {
+public:
+    CompressionDaemon(const std::string& socket_path_, const DaemonOptions& options_=DaemonOptions());
+
+    /**
+      * Closes the socket and removes its file
+      */
+    ~CompressionDaemon();
+
+    /**
+      * Serves clients until stop() is called
+      */
+    void run();
+
+    /**
+      * Makes run() return. Safe to call from other threads and signal handlers.
+      */
+    void stop();
+
+    DaemonStats stats() const;
+
+    struct Impl;
+
+private:
+    CompressionDaemon(const CompressionDaemon&);
+    CompressionDaemon& operator=(const CompressionDaemon&);
+
+    std::unique_ptr<Impl> m_impl;
+};
+
+/**
+  * Client of the compression daemon. Inputs are copied into the request ring
+  * and results out of the result ring, so no payload is sent over the socket.
+  * Several requests can be in flight by submitting them before waiting. A 
+  * client must only be used by one thread at a time.
+  */
+class CompressionClient {
+public:
+    CompressionClient(const std::string& socket_path_, size_t ring_size_=daemon_default_ring_size);
+    ~CompressionClient();
+
+    /**
+      * Submit a request, and return its id. Blocks while the request ring is
+      * full. Throws std::length_error if size_ does not fit in the ring.
+      */
+    uint64_t submitCompress(Compress_t type_, const unsigned char* data_, size_t size_);
+    uint64_t submitDecompress(Compress_t type_, const unsigned char* data_, size_t size_);
+
+    /**
+      * Waits for request id_, and appends its result to output_. Throws if the
+      * daemon rejected the request, or the codec failed.
+      */
+    void wait(uint64_t id_, std::vector<unsigned char>& output_);
+
+    void compress(Compress_t type_, const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_);
+    void decompress(Compress_t type_, const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_);
+
+    /**
+      * Returns the counters the daemon keeps for this client
+      */
+    DaemonStats stats();
+
+    struct Impl;
+
+private:
+    CompressionClient(const CompressionClient&);
+    CompressionClient& operator=(const CompressionClient&);
+
+    std::unique_ptr<Impl> m_impl;
+};
\ No newline at end of file
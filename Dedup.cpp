@@ -0,0 +1,466 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "Dedup.h"
+#include "Batch.h"
+#include "Varint.h"
+
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace { //Avoid contaminating global namespace
+
+/**
+  * The output starts with the input size and the compression algorithms,
+  * followed by the number of chunks and the digest of the store before the
+  * call, the sizes of the unique chunks the call added to it, and the ids of
+  * all chunks in input order. Then come the raw and compressed size of every block, 
+  * and finally the compressed blocks back to back.
+  */
+
+/**
+  * Table of random values for the gear hash, generated with splitmix64 so
+  * that it is the same everywhere
+  */
+struct GearTable {
+    GearTable() {
+        uint64_t state = 0x9E3779B97F4A7C15ull;
+        for (int i=0; i<256; ++i) {
+            state += 0x9E3779B97F4A7C15ull;
+            uint64_t z = state;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            m_values[i] = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t m_values[256];
+};
+
+const GearTable gear_table;
+
+/**
+  * Returns a mask of the top num_bits_ bits
+  */
+inline uint64_t topBits(unsigned int num_bits_) {
+    return (num_bits_ == 0) ? 0 : ~uint64_t(0) << (64 - num_bits_);
+}
+
+/**
+  * Returns the size of the chunk starting at data_. Boundaries are harder to
+  * hit before the average size and easier after it (normalized chunking), 
+  * which keeps chunk sizes close to the average.
+  */
+inline size_t nextChunk(const unsigned char* data_, size_t size_, const DedupOptions& options_, uint64_t hard_mask_, uint64_t easy_mask_) {
+    if (size_ <= options_.m_min_chunk_size) {
+        return size_;
+    }
+    size_t normal_size = std::min(size_, options_.m_average_chunk_size);
+    size_t max_size = std::min(size_, options_.m_max_chunk_size);
+
+    uint64_t hash = 0;
+    size_t i = options_.m_min_chunk_size;
+    for (; i<normal_size; ++i) {
+        hash = (hash << 1) + gear_table.m_values[data_[i]];
+        if ((hash & hard_mask_) == 0) {
+            return i+1;
+        }
+    }
+    for (; i<max_size; ++i) {
+        hash = (hash << 1) + gear_table.m_values[data_[i]];
+        if ((hash & easy_mask_) == 0) {
+            return i+1;
+        }
+    }
+    return max_size;
+}
+
+inline uint64_t read64(const unsigned char* data_) {
+    uint64_t value;
+    memcpy(&value, data_, sizeof(value));
+    return value;
+}
+
+inline uint64_t mix64(uint64_t value_) {
+    value_ ^= value_ >> 33;
+    value_ *= 0xFF51AFD7ED558CCDull;
+    value_ ^= value_ >> 33;
+    value_ *= 0xC4CEB9FE1A85EC53ull;
+    value_ ^= value_ >> 33;
+    return value_;
+}
+
+inline void writeValue(uint64_t value_, std::vector<unsigned char>& output_) {
+    unsigned char buffer[10];
+    output_.insert(output_.end(), buffer, buffer + writeVarint(value_, buffer));
+}
+
+inline uint64_t readValue(const unsigned char* data_, size_t size_, size_t& offset_) {
+    uint64_t value;
+    if (!readVarint(data_, size_, offset_, value)) {
+        throw std::runtime_error("Dedup: corrupt header");
+    }
+    return value;
+}
+
+/**
+  * Reads a count of items that each take at least one byte of the rest of the data
+  */
+inline size_t readCount(const unsigned char* data_, size_t size_, size_t& offset_) {
+    uint64_t count = readValue(data_, size_, offset_);
+    if (count > size_ - offset_) {
+        throw std::runtime_error("Dedup: corrupt header");
+    }
+    return static_cast<size_t>(count);
+}
+
+/**
+  * Computes the fingerprints of all chunks, split over num_threads_ threads
+  */
+std::vector<uint64_t> fingerprintChunks(const unsigned char* data_, const std::vector<size_t>& chunk_offsets_, unsigned int num_threads_) {
+    size_t num_chunks = chunk_offsets_.size()-1;
+    std::vector<uint64_t> fingerprints(num_chunks);
+    size_t num_threads = std::min<size_t>(std::max(num_threads_, 1u), num_chunks);
+    auto fingerprintRange = [&](size_t begin_, size_t end_) {
+        for (size_t i=begin_; i<end_; ++i) {
+            fingerprints[i] = dedup_fingerprint(data_ + chunk_offsets_[i], chunk_offsets_[i+1] - chunk_offsets_[i]);
+        }
+    };
+    if (num_threads <= 1) {
+        fingerprintRange(0, num_chunks);
+        return fingerprints;
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t t=0; t<num_threads; ++t) {
+        threads.push_back(std::thread(fingerprintRange, num_chunks*t/num_threads, num_chunks*(t+1)/num_threads));
+    }
+    for (size_t t=0; t<num_threads; ++t) {
+        threads[t].join();
+    }
+    return fingerprints;
+}
+
+} // Namespace
+
+
+
+
+std::vector<size_t> dedup_chunk(const unsigned char* data_, size_t size_, const DedupOptions& options_) {
+    size_t average = options_.m_average_chunk_size;
+    if (average < 64 || (average & (average-1)) != 0) {
+        throw std::invalid_argument("Dedup: average chunk size must be a power of two of at least 64");
+    }
+    if (options_.m_min_chunk_size > average || options_.m_max_chunk_size < average) {
+        throw std::invalid_argument("Dedup: chunk sizes must satisfy min <= average <= max");
+    }
+
+    unsigned int average_bits = 0;
+    while ((size_t(1) << average_bits) < average) {
+        ++average_bits;
+    }
+    uint64_t hard_mask = topBits(average_bits+1);
+    uint64_t easy_mask = topBits(average_bits-1);
+
+    std::vector<size_t> sizes;
+    size_t offset = 0;
+    while (offset < size_) {
+        size_t chunk_size = nextChunk(data_+offset, size_-offset, options_, hard_mask, easy_mask);
+        sizes.push_back(chunk_size);
+        offset += chunk_size;
+    }
+    return sizes;
+}
+
+/**
+  * Multiply and rotate hash of eight bytes at a time. It does not need to be
+  * cryptographic, as the store compares the bytes of chunks with equal fingerprints.
+  */
+uint64_t dedup_fingerprint(const unsigned char* data_, size_t size_) {
+    const uint64_t prime_1 = 0x9E3779B185EBCA87ull;
+    const uint64_t prime_2 = 0xC2B2AE3D27D4EB4Full;
+    uint64_t hash = prime_1 ^ (size_ * prime_2);
+    size_t i = 0;
+    for (; i+8<=size_; i+=8) {
+        hash ^= read64(data_+i) * prime_2;
+        hash = ((hash << 31) | (hash >> 33)) * prime_1;
+    }
+    uint64_t tail = 0;
+    for (size_t j=0; i+j<size_; ++j) {
+        tail |= static_cast<uint64_t>(data_[i+j]) << (8*j);
+    }
+    hash ^= tail * prime_2;
+    return mix64(hash);
+}
+
+
+
+
+ChunkStore::ChunkStore() : m_digest(0) {
+    m_offsets.push_back(0);
+}
+
+size_t ChunkStore::insert(const unsigned char* data_, size_t size_, uint64_t fingerprint_) {
+    auto range = m_index.equal_range(fingerprint_);
+    for (auto it=range.first; it!=range.second; ++it) {
+        size_t id = it->second;
+        if (chunkSize(id) == size_ && memcmp(chunk(id), data_, size_) == 0) {
+            return id;
+        }
+    }
+    size_t id = numChunks();
+    m_data.insert(m_data.end(), data_, data_+size_);
+    m_offsets.push_back(m_data.size());
+    m_index.insert(std::make_pair(fingerprint_, id));
+    m_digest = mix64(m_digest ^ fingerprint_) + id;
+    return id;
+}
+
+void ChunkStore::save(std::vector<unsigned char>& output_) const {
+    writeValue(numChunks(), output_);
+    for (size_t i=0; i<numChunks(); ++i) {
+        writeValue(chunkSize(i), output_);
+    }
+    writeValue(m_digest, output_);
+    output_.insert(output_.end(), m_data.begin(), m_data.end());
+}
+
+void ChunkStore::load(const unsigned char* data_, size_t size_) {
+    size_t offset = 0;
+    std::vector<size_t> offsets(readCount(data_, size_, offset)+1, 0);
+    for (size_t i=1; i<offsets.size(); ++i) {
+        uint64_t chunk_size = readValue(data_, size_, offset);
+        if (chunk_size == 0 || chunk_size > size_ - offsets[i-1]) {
+            throw std::runtime_error("Dedup: corrupt chunk store");
+        }
+        offsets[i] = offsets[i-1] + static_cast<size_t>(chunk_size);
+    }
+    uint64_t digest = readValue(data_, size_, offset);
+    if (offsets.back() != size_ - offset) {
+        throw std::runtime_error("Dedup: corrupt chunk store");
+    }
+
+    //Inserting the chunks in order gives them their old ids and digest
+    ChunkStore store;
+    const unsigned char* data = data_ + offset;
+    for (size_t i=0; i+1<offsets.size(); ++i) {
+        if (store.insert(data + offsets[i], offsets[i+1] - offsets[i]) != i) {
+            throw std::runtime_error("Dedup: chunk is stored twice in the chunk store");
+        }
+    }
+    if (store.digest() != digest) {
+        throw std::runtime_error("Dedup: chunk store does not match its digest");
+    }
+    *this = std::move(store);
+}
+
+
+
+
+std::vector<unsigned char> dedup_compress(const unsigned char* data_, size_t size_, const std::vector<Compress_t>& compress_ops_, 
+        const DedupOptions& options_, DedupStats* stats_) {
+    ChunkStore store;
+    return dedup_compress(data_, size_, compress_ops_, store, options_, stats_);
+}
+
+std::vector<unsigned char> dedup_compress(const unsigned char* data_, size_t size_, const std::vector<Compress_t>& compress_ops_, 
+        ChunkStore& store_, const DedupOptions& options_, DedupStats* stats_) {
+    if (options_.m_block_size == 0) {
+        throw std::invalid_argument("Dedup: block size must be positive");
+    }
+
+    //Chunking is sequential, but fingerprinting and compression run in parallel
+    std::vector<size_t> chunk_sizes = dedup_chunk(data_, size_, options_);
+    std::vector<size_t> chunk_offsets(1, 0);
+    for (size_t i=0; i<chunk_sizes.size(); ++i) {
+        chunk_offsets.push_back(chunk_offsets.back() + chunk_sizes[i]);
+    }
+    std::vector<uint64_t> fingerprints = fingerprintChunks(data_, chunk_offsets, options_.m_num_threads);
+
+    //Chunks already in the store are neither stored nor compressed again
+    const size_t base = store_.numChunks();
+    const uint64_t base_digest = store_.digest();
+    const size_t unique_begin = store_.data().size();
+    std::vector<size_t> ids(chunk_sizes.size());
+    for (size_t i=0; i<chunk_sizes.size(); ++i) {
+        ids[i] = store_.insert(data_ + chunk_offsets[i], chunk_sizes[i], fingerprints[i]);
+    }
+
+    //Compress the unique chunks in blocks
+    const unsigned char* unique = store_.data().data() + unique_begin;
+    const size_t unique_size = store_.data().size() - unique_begin;
+    std::vector<BatchInput> blocks;
+    for (size_t i=0; i<unique_size; i+=options_.m_block_size) {
+        blocks.push_back(BatchInput(unique+i, std::min(options_.m_block_size, unique_size-i)));
+    }
+    std::vector<BatchInput> records = blocks;
+    BatchOutput batch;
+    for (size_t i=0; i<compress_ops_.size(); ++i) {
+        batch = batch_compress(compress_ops_[i], records, options_.m_num_threads);
+        records = batch.records();
+    }
+
+    std::vector<unsigned char> output;
+    writeValue(size_, output);
+    writeValue(compress_ops_.size(), output);
+    for (size_t i=0; i<compress_ops_.size(); ++i) {
+        writeValue(compress_ops_[i], output);
+    }
+    writeValue(base, output);
+    writeValue(base_digest, output);
+    writeValue(store_.numChunks() - base, output);
+    for (size_t i=base; i<store_.numChunks(); ++i) {
+        writeValue(store_.chunkSize(i), output);
+    }
+    writeValue(ids.size(), output);
+    for (size_t i=0; i<ids.size(); ++i) {
+        writeValue(ids[i], output);
+    }
+    writeValue(records.size(), output);
+    for (size_t i=0; i<records.size(); ++i) {
+        writeValue(blocks[i].m_size, output);
+        writeValue(records[i].m_size, output);
+    }
+    for (size_t i=0; i<records.size(); ++i) {
+        output.insert(output.end(), records[i].m_data, records[i].m_data + records[i].m_size);
+    }
+
+    if (stats_ != NULL) {
+        stats_->m_num_chunks = ids.size();
+        stats_->m_num_unique_chunks = store_.numChunks() - base;
+        stats_->m_size = size_;
+        stats_->m_unique_size = unique_size;
+        stats_->m_compressed_size = output.size();
+    }
+    return output;
+}
+
+std::vector<unsigned char> dedup_decompress(const unsigned char* data_, size_t size_, unsigned int num_threads_) {
+    ChunkStore store;
+    return dedup_decompress(data_, size_, store, num_threads_);
+}
+
+std::vector<unsigned char> dedup_decompress(const unsigned char* data_, size_t size_, ChunkStore& store_, unsigned int num_threads_) {
+    size_t offset = 0;
+    uint64_t num_bytes = readValue(data_, size_, offset);
+    if (num_bytes > std::numeric_limits<size_t>::max()) {
+        throw std::length_error("Dedup: stored length does not fit in memory");
+    }
+
+    std::vector<Compress_t> compress_ops(readCount(data_, size_, offset));
+    for (size_t i=0; i<compress_ops.size(); ++i) {
+        uint64_t op = readValue(data_, size_, offset);
+        if (op > LZW_HUFFMAN) {
+            throw std::runtime_error("Dedup: unknown compression algorithm");
+        }
+        compress_ops[i] = static_cast<Compress_t>(op);
+    }
+
+    //The stream may only refer to chunks of the store it was compressed against
+    uint64_t base = readValue(data_, size_, offset);
+    uint64_t base_digest = readValue(data_, size_, offset);
+    if (base != store_.numChunks() || base_digest != store_.digest()) {
+        throw std::invalid_argument("Dedup: data was compressed against a different chunk store");
+    }
+
+    std::vector<size_t> unique_offsets(readCount(data_, size_, offset)+1, 0);
+    for (size_t i=1; i<unique_offsets.size(); ++i) {
+        //Every unique chunk occurs in the input, so together they are no larger than it
+        uint64_t chunk_size = readValue(data_, size_, offset);
+        if (chunk_size == 0 || chunk_size > num_bytes - unique_offsets[i-1]) {
+            throw std::runtime_error("Dedup: corrupt header");
+        }
+        unique_offsets[i] = unique_offsets[i-1] + static_cast<size_t>(chunk_size);
+    }
+
+    std::vector<size_t> ids(readCount(data_, size_, offset));
+    uint64_t total_size = 0;
+    for (size_t i=0; i<ids.size(); ++i) {
+        uint64_t id = readValue(data_, size_, offset);
+        if (id >= base + (unique_offsets.size()-1)) {
+            throw std::runtime_error("Dedup: invalid chunk id");
+        }
+        ids[i] = static_cast<size_t>(id);
+        total_size += (id < base) ? store_.chunkSize(ids[i]) : unique_offsets[ids[i]-base+1] - unique_offsets[ids[i]-base];
+        if (total_size > num_bytes) {
+            throw std::runtime_error("Dedup: chunks do not add up to the stored length");
+        }
+    }
+    if (total_size != num_bytes) {
+        throw std::runtime_error("Dedup: chunks do not add up to the stored length");
+    }
+
+    size_t num_blocks = readCount(data_, size_, offset);
+    std::vector<uint64_t> block_sizes(num_blocks);
+    std::vector<BatchInput> records(num_blocks);
+    uint64_t unique_size = 0;
+    uint64_t compressed_size = 0;
+    for (size_t i=0; i<num_blocks; ++i) {
+        block_sizes[i] = readValue(data_, size_, offset);
+        uint64_t block_compressed_size = readValue(data_, size_, offset);
+        if (block_sizes[i] > unique_offsets.back() - unique_size || block_compressed_size > size_ - compressed_size) {
+            throw std::runtime_error("Dedup: blocks do not match the stored sizes");
+        }
+        records[i].m_size = static_cast<size_t>(block_compressed_size);
+        unique_size += block_sizes[i];
+        compressed_size += records[i].m_size;
+    }
+    if (unique_size != unique_offsets.back() || compressed_size != size_ - offset) {
+        throw std::runtime_error("Dedup: blocks do not match the stored sizes");
+    }
+    for (size_t i=0; i<num_blocks; ++i) {
+        records[i].m_data = data_ + offset;
+        offset += records[i].m_size;
+    }
+
+    //Decompress the unique chunks, and copy them into place
+    BatchOutput batch;
+    for (size_t i=compress_ops.size(); i>0; --i) {
+        batch = batch_decompress(compress_ops[i-1], records, num_threads_);
+        records = batch.records();
+    }
+    std::vector<unsigned char> unique;
+    unique.reserve(unique_offsets.back());
+    for (size_t i=0; i<num_blocks; ++i) {
+        if (records[i].m_size != block_sizes[i]) {
+            throw std::runtime_error("Dedup: block decompressed to the wrong size");
+        }
+        unique.insert(unique.end(), records[i].m_data, records[i].m_data + records[i].m_size);
+    }
+
+    //Add the unique chunks to the store, where they get the same ids as when compressing
+    for (size_t i=0; i+1<unique_offsets.size(); ++i) {
+        const unsigned char* chunk = unique.data() + unique_offsets[i];
+        if (store_.insert(chunk, unique_offsets[i+1] - unique_offsets[i]) != base+i) {
+            throw std::runtime_error("Dedup: unique chunk is already stored");
+        }
+    }
+
+    std::vector<unsigned char> output;
+    output.reserve(static_cast<size_t>(num_bytes));
+    for (size_t i=0; i<ids.size(); ++i) {
+        output.insert(output.end(), store_.chunk(ids[i]), store_.chunk(ids[i]) + store_.chunkSize(ids[i]));
+    }
+    return output;
+}
\ No newline at end of file
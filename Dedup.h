@@ -0,0 +1,163 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#pragma once
+
+#include "Codec.h"
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+/**
+  * Options for content defined chunking. Chunk boundaries are placed where a 
+  * rolling gear hash of the preceding 64 bytes has its top bits zero, so 
+  * repeated content splits into the same chunks wherever it occurs, and an
+  * insertion only changes the chunks around it. The average chunk size must 
+  * be a power of two.
+  */
+struct DedupOptions {
+    DedupOptions() : m_min_chunk_size(2048), m_average_chunk_size(8192), m_max_chunk_size(65536), 
+        m_block_size(1 << 20), m_num_threads(1) {}
+
+    size_t m_min_chunk_size;
+    size_t m_average_chunk_size;
+    size_t m_max_chunk_size;
+
+    /**
+      * The unique chunks are compressed back to back in independent blocks of 
+      * this many bytes, which are compressed in parallel
+      */
+    size_t m_block_size;
+
+    unsigned int m_num_threads;
+};
+
+/**
+  * Statistics from dedup_compress. The unique chunks are those the call added to the store.
+  */
+struct DedupStats {
+    DedupStats() : m_num_chunks(0), m_num_unique_chunks(0), m_size(0), m_unique_size(0), m_compressed_size(0) {}
+
+    size_t m_num_chunks;
+    size_t m_num_unique_chunks;
+    uint64_t m_size;
+    uint64_t m_unique_size;
+    uint64_t m_compressed_size;
+};
+
+/**
+  * Returns the sizes of the content defined chunks of data_, which add up to size_
+  */
+std::vector<size_t> dedup_chunk(const unsigned char* data_, size_t size_, const DedupOptions& options_=DedupOptions());
+
+/**
+  * Returns a 64 bit fingerprint of a chunk
+  */
+uint64_t dedup_fingerprint(const unsigned char* data_, size_t size_);
+
+/**
+  * Store which keeps every unique chunk once, back to back. Chunks are looked 
+  * up by fingerprint, and compared byte by byte, so that fingerprint collisions
+  * never merge different chunks. A store can be shared by several calls to 
+  * dedup_compress, so that chunks are deduplicated across inputs. The store
+  * lives in memory, and outlives the process only through save and load.
+  */
+class ChunkStore {
+public:
+    ChunkStore();
+
+    /**
+      * Stores the chunk unless an equal chunk is already stored, and returns the id of the stored chunk
+      */
+    size_t insert(const unsigned char* data_, size_t size_, uint64_t fingerprint_);
+
+    inline size_t insert(const unsigned char* data_, size_t size_) {
+        return insert(data_, size_, dedup_fingerprint(data_, size_));
+    }
+
+    inline size_t numChunks() const {
+        return m_offsets.size()-1;
+    }
+
+    inline const unsigned char* chunk(size_t id_) const {
+        return m_data.data() + m_offsets[id_];
+    }
+
+    inline size_t chunkSize(size_t id_) const {
+        return m_offsets[id_+1] - m_offsets[id_];
+    }
+
+    /**
+      * All unique chunks back to back, in the order they were first inserted
+      */
+    inline const std::vector<unsigned char>& data() const {
+        return m_data;
+    }
+
+    /**
+      * Digest of the fingerprints of all chunks in insertion order, which 
+      * tells stores with different contents apart
+      */
+    inline uint64_t digest() const {
+        return m_digest;
+    }
+
+    /**
+      * Appends the chunk sizes, the digest and the chunk data to output_, so 
+      * that a later process can load the store and keep deduplicating against it
+      */
+    void save(std::vector<unsigned char>& output_) const;
+
+    /**
+      * Replaces the contents of the store with a store written by save. The 
+      * index is rebuilt from the chunks, and a digest that does not match 
+      * them throws std::runtime_error.
+      */
+    void load(const unsigned char* data_, size_t size_);
+
+private:
+    std::vector<unsigned char> m_data;
+    std::vector<size_t> m_offsets;
+    std::unordered_multimap<uint64_t, size_t> m_index;
+    uint64_t m_digest;
+};
+
+/**
+  * Splits data_ into content defined chunks, and compresses each unique chunk
+  * only once using compress_ops_ in order. The output lists the chunks of the 
+  * input by id, so repeats anywhere in the input cost a few bytes each, no 
+  * matter how far apart they are. 
+  */
+std::vector<unsigned char> dedup_compress(const unsigned char* data_, size_t size_, const std::vector<Compress_t>& compress_ops_, 
+        const DedupOptions& options_=DedupOptions(), DedupStats* stats_=NULL);
+std::vector<unsigned char> dedup_decompress(const unsigned char* data_, size_t size_, unsigned int num_threads_=1);
+
+/**
+  * Versions which share store_ between calls, so that a chunk is only stored
+  * and compressed by the first call that sees it, and later outputs refer to
+  * it by id. Outputs must therefore be decompressed in the order they were
+  * compressed, with a store that started out the same as the compressing one. 
+  * Decompressing against any other store throws std::invalid_argument.
+  */
+std::vector<unsigned char> dedup_compress(const unsigned char* data_, size_t size_, const std::vector<Compress_t>& compress_ops_, 
+        ChunkStore& store_, const DedupOptions& options_=DedupOptions(), DedupStats* stats_=NULL);
+std::vector<unsigned char> dedup_decompress(const unsigned char* data_, size_t size_, ChunkStore& store_, unsigned int num_threads_=1);
\ No newline at end of file
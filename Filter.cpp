@@ -0,0 +1,388 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "Filter.h"
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FILTER_HAS_SSE2
+#endif
+
+namespace { //Avoid contaminating global namespace
+
+/**
+  * The header holds the filter and the element width
+  */
+const size_t filter_header_size = 2;
+
+inline bool isDeltaWidth(unsigned int width_) {
+    return width_ == 1 || width_ == 2 || width_ == 4 || width_ == 8;
+}
+
+inline void checkFilter(unsigned int filter_, unsigned int width_) {
+    if (filter_ > FILTER_XOR_DELTA) {
+        throw std::runtime_error("Filter: unknown filter");
+    }
+    if (width_ == 0 || width_ > 255) {
+        throw std::runtime_error("Filter: width must be between 1 and 255");
+    }
+    if (filter_ != FILTER_SHUFFLE && !isDeltaWidth(width_)) {
+        throw std::runtime_error("Filter: delta width must be 1, 2, 4 or 8");
+    }
+}
+
+template <typename T>
+inline T load(const unsigned char* data_) {
+    T value;
+    memcpy(&value, data_, sizeof(T));
+    return value;
+}
+
+template <typename T>
+inline void store(unsigned char* data_, T value_) {
+    memcpy(data_, &value_, sizeof(T));
+}
+
+/**
+  * Scalar shuffle and unshuffle of elements [begin_, num_elements_)
+  */
+void shuffleScalar(const unsigned char* data_, size_t num_elements_, unsigned int width_, size_t begin_, unsigned char* output_) {
+    for (size_t i=begin_; i<num_elements_; ++i) {
+        for (unsigned int k=0; k<width_; ++k) {
+            output_[k*num_elements_ + i] = data_[i*width_ + k];
+        }
+    }
+}
+
+void unshuffleScalar(const unsigned char* data_, size_t num_elements_, unsigned int width_, size_t begin_, unsigned char* output_) {
+    for (size_t i=begin_; i<num_elements_; ++i) {
+        for (unsigned int k=0; k<width_; ++k) {
+            output_[i*width_ + k] = data_[k*num_elements_ + i];
+        }
+    }
+}
+
+#if defined(FILTER_HAS_SSE2)
+/**
+  * Interleaves the first half of the bytes in registers_ with the second half.
+  * Seen as moving the top bit of each byte index to the bottom, the 
+  * transpose of 16 elements of width_ bytes is four interleavings, and the 
+  * inverse is log2(width_) interleavings.
+  */
+template <unsigned int width_>
+inline void interleave(__m128i* registers_) {
+    __m128i result[width_];
+    for (unsigned int j=0; j<width_/2; ++j) {
+        result[2*j] = _mm_unpacklo_epi8(registers_[j], registers_[j+width_/2]);
+        result[2*j+1] = _mm_unpackhi_epi8(registers_[j], registers_[j+width_/2]);
+    }
+    for (unsigned int j=0; j<width_; ++j) {
+        registers_[j] = result[j];
+    }
+}
+
+/**
+  * Shuffles the first multiple of 16 elements, and returns the number of elements done
+  */
+template <unsigned int width_>
+size_t shuffleSSE2(const unsigned char* data_, size_t num_elements_, unsigned char* output_) {
+    size_t i = 0;
+    for (; i+16 <= num_elements_; i+=16) {
+        __m128i registers[width_];
+        for (unsigned int j=0; j<width_; ++j) {
+            registers[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data_ + i*width_ + 16*j));
+        }
+        for (unsigned int round=0; round<4; ++round) {
+            interleave<width_>(registers);
+        }
+        for (unsigned int k=0; k<width_; ++k) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output_ + k*num_elements_ + i), registers[k]);
+        }
+    }
+    return i;
+}
+
+template <unsigned int width_>
+size_t unshuffleSSE2(const unsigned char* data_, size_t num_elements_, unsigned char* output_) {
+    size_t i = 0;
+    for (; i+16 <= num_elements_; i+=16) {
+        __m128i registers[width_];
+        for (unsigned int k=0; k<width_; ++k) {
+            registers[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data_ + k*num_elements_ + i));
+        }
+        for (unsigned int round=1; round<width_; round*=2) {
+            interleave<width_>(registers);
+        }
+        for (unsigned int j=0; j<width_; ++j) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output_ + i*width_ + 16*j), registers[j]);
+        }
+    }
+    return i;
+}
+#endif
+
+void shuffle(const unsigned char* data_, size_t num_elements_, unsigned int width_, unsigned char* output_) {
+    size_t done = 0;
+    if (width_ == 1) {
+        std::copy(data_, data_+num_elements_, output_);
+        return;
+    }
+#if defined(FILTER_HAS_SSE2)
+    switch (width_) {
+    case 2: done = shuffleSSE2<2>(data_, num_elements_, output_); break;
+    case 4: done = shuffleSSE2<4>(data_, num_elements_, output_); break;
+    case 8: done = shuffleSSE2<8>(data_, num_elements_, output_); break;
+    case 16: done = shuffleSSE2<16>(data_, num_elements_, output_); break;
+    default: break;
+    }
+#endif
+    shuffleScalar(data_, num_elements_, width_, done, output_);
+}
+
+void unshuffle(const unsigned char* data_, size_t num_elements_, unsigned int width_, unsigned char* output_) {
+    size_t done = 0;
+    if (width_ == 1) {
+        std::copy(data_, data_+num_elements_, output_);
+        return;
+    }
+#if defined(FILTER_HAS_SSE2)
+    switch (width_) {
+    case 2: done = unshuffleSSE2<2>(data_, num_elements_, output_); break;
+    case 4: done = unshuffleSSE2<4>(data_, num_elements_, output_); break;
+    case 8: done = unshuffleSSE2<8>(data_, num_elements_, output_); break;
+    case 16: done = unshuffleSSE2<16>(data_, num_elements_, output_); break;
+    default: break;
+    }
+#endif
+    unshuffleScalar(data_, num_elements_, width_, done, output_);
+}
+
+#if defined(FILTER_HAS_SSE2)
+/**
+  * Lane wise operations on elements of type T
+  */
+template <typename T> __m128i addLanes(__m128i a_, __m128i b_);
+template <> inline __m128i addLanes<uint8_t>(__m128i a_, __m128i b_) { return _mm_add_epi8(a_, b_); }
+template <> inline __m128i addLanes<uint16_t>(__m128i a_, __m128i b_) { return _mm_add_epi16(a_, b_); }
+template <> inline __m128i addLanes<uint32_t>(__m128i a_, __m128i b_) { return _mm_add_epi32(a_, b_); }
+template <> inline __m128i addLanes<uint64_t>(__m128i a_, __m128i b_) { return _mm_add_epi64(a_, b_); }
+
+template <typename T> __m128i subLanes(__m128i a_, __m128i b_);
+template <> inline __m128i subLanes<uint8_t>(__m128i a_, __m128i b_) { return _mm_sub_epi8(a_, b_); }
+template <> inline __m128i subLanes<uint16_t>(__m128i a_, __m128i b_) { return _mm_sub_epi16(a_, b_); }
+template <> inline __m128i subLanes<uint32_t>(__m128i a_, __m128i b_) { return _mm_sub_epi32(a_, b_); }
+template <> inline __m128i subLanes<uint64_t>(__m128i a_, __m128i b_) { return _mm_sub_epi64(a_, b_); }
+
+/**
+  * Returns a register where every lane holds the last lane of a_
+  */
+template <typename T> __m128i broadcastLast(__m128i a_);
+template <> inline __m128i broadcastLast<uint8_t>(__m128i a_) {
+    __m128i last = _mm_srli_si128(a_, 15);
+    last = _mm_unpacklo_epi8(last, last);
+    last = _mm_unpacklo_epi16(last, last);
+    return _mm_shuffle_epi32(last, 0x00);
+}
+template <> inline __m128i broadcastLast<uint16_t>(__m128i a_) { return _mm_shuffle_epi32(_mm_shufflehi_epi16(a_, 0xFF), 0xFF); }
+template <> inline __m128i broadcastLast<uint32_t>(__m128i a_) { return _mm_shuffle_epi32(a_, 0xFF); }
+template <> inline __m128i broadcastLast<uint64_t>(__m128i a_) { return _mm_unpackhi_epi64(a_, a_); }
+
+template <typename T, bool use_xor_>
+inline __m128i combineLanes(__m128i a_, __m128i b_) {
+    return use_xor_ ? _mm_xor_si128(a_, b_) : addLanes<T>(a_, b_);
+}
+#endif
+
+/**
+  * Replaces every element by its difference (or exclusive or) with the previous element
+  */
+template <typename T, bool use_xor_>
+void deltaEncode(const unsigned char* data_, size_t num_elements_, unsigned char* output_) {
+    if (num_elements_ == 0) {
+        return;
+    }
+    store<T>(output_, load<T>(data_));
+    size_t i = 1;
+#if defined(FILTER_HAS_SSE2)
+    const size_t lanes = 16/sizeof(T);
+    for (; i+lanes <= num_elements_; i+=lanes) {
+        __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data_ + i*sizeof(T)));
+        __m128i previous = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data_ + (i-1)*sizeof(T)));
+        __m128i delta = use_xor_ ? _mm_xor_si128(current, previous) : subLanes<T>(current, previous);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output_ + i*sizeof(T)), delta);
+    }
+#endif
+    for (; i<num_elements_; ++i) {
+        T current = load<T>(data_ + i*sizeof(T));
+        T previous = load<T>(data_ + (i-1)*sizeof(T));
+        store<T>(output_ + i*sizeof(T), use_xor_ ? T(current ^ previous) : T(current - previous));
+    }
+}
+
+/**
+  * Inverse of deltaEncode, which is a prefix sum (or prefix exclusive or). 
+  * The SSE2 version computes the prefix within a register in log2(lanes) 
+  * shifted additions, and adds the last element of the previous register.
+  */
+template <typename T, bool use_xor_>
+void deltaDecode(const unsigned char* data_, size_t num_elements_, unsigned char* output_) {
+    size_t i = 0;
+#if defined(FILTER_HAS_SSE2)
+    const size_t lanes = 16/sizeof(T);
+    __m128i previous = _mm_setzero_si128();
+    for (; i+lanes <= num_elements_; i+=lanes) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data_ + i*sizeof(T)));
+        if (sizeof(T) < 2) {
+            x = combineLanes<T, use_xor_>(x, _mm_slli_si128(x, 1));
+        }
+        if (sizeof(T) < 4) {
+            x = combineLanes<T, use_xor_>(x, _mm_slli_si128(x, 2));
+        }
+        if (sizeof(T) < 8) {
+            x = combineLanes<T, use_xor_>(x, _mm_slli_si128(x, 4));
+        }
+        x = combineLanes<T, use_xor_>(x, _mm_slli_si128(x, 8));
+        x = combineLanes<T, use_xor_>(x, previous);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output_ + i*sizeof(T)), x);
+        previous = broadcastLast<T>(x);
+    }
+#endif
+    T previous_value = (i > 0) ? load<T>(output_ + (i-1)*sizeof(T)) : T(0);
+    for (; i<num_elements_; ++i) {
+        T delta = load<T>(data_ + i*sizeof(T));
+        previous_value = use_xor_ ? T(previous_value ^ delta) : T(previous_value + delta);
+        store<T>(output_ + i*sizeof(T), previous_value);
+    }
+}
+
+template <bool use_xor_>
+void deltaEncode(const unsigned char* data_, size_t num_elements_, unsigned int width_, unsigned char* output_) {
+    switch (width_) {
+    case 1: deltaEncode<uint8_t, use_xor_>(data_, num_elements_, output_); break;
+    case 2: deltaEncode<uint16_t, use_xor_>(data_, num_elements_, output_); break;
+    case 4: deltaEncode<uint32_t, use_xor_>(data_, num_elements_, output_); break;
+    case 8: deltaEncode<uint64_t, use_xor_>(data_, num_elements_, output_); break;
+    }
+}
+
+template <bool use_xor_>
+void deltaDecode(const unsigned char* data_, size_t num_elements_, unsigned int width_, unsigned char* output_) {
+    switch (width_) {
+    case 1: deltaDecode<uint8_t, use_xor_>(data_, num_elements_, output_); break;
+    case 2: deltaDecode<uint16_t, use_xor_>(data_, num_elements_, output_); break;
+    case 4: deltaDecode<uint32_t, use_xor_>(data_, num_elements_, output_); break;
+    case 8: deltaDecode<uint64_t, use_xor_>(data_, num_elements_, output_); break;
+    }
+}
+
+} // Namespace
+
+size_t filter_encode_bound(size_t size_) {
+    return filter_header_size + size_;
+}
+
+/**
+  * Function which filters size_ bytes as elements of width_ bytes
+  */
+size_t filter_encode(Filter_t filter_, unsigned int width_, const unsigned char* data_, size_t size_, unsigned char* output_) {
+    checkFilter(filter_, width_);
+    output_[0] = static_cast<unsigned char>(filter_);
+    output_[1] = static_cast<unsigned char>(width_);
+    unsigned char* output = output_ + filter_header_size;
+
+    size_t num_elements = size_ / width_;
+    switch (filter_) {
+    case FILTER_SHUFFLE: shuffle(data_, num_elements, width_, output); break;
+    case FILTER_DELTA: deltaEncode<false>(data_, num_elements, width_, output); break;
+    case FILTER_XOR_DELTA: deltaEncode<true>(data_, num_elements, width_, output); break;
+    }
+
+    //Bytes after the last whole element are stored as is
+    size_t tail = num_elements*width_;
+    std::copy(data_ + tail, data_ + size_, output + tail);
+
+    return filter_header_size + size_;
+}
+
+void filter_encode(Filter_t filter_, unsigned int width_, const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_) {
+    size_t offset = output_.size();
+    output_.resize(offset + filter_encode_bound(size_));
+    output_.resize(offset + filter_encode(filter_, width_, data_, size_, output_.data()+offset));
+}
+
+std::vector<unsigned char> filter_encode(Filter_t filter_, unsigned int width_, const std::vector<unsigned char>& data_) {
+    std::vector<unsigned char> output;
+    filter_encode(filter_, width_, data_.data(), data_.size(), output);
+    return output;
+}
+
+/**
+  * Function which returns the number of bytes a filtered buffer decodes to
+  */
+size_t filter_decoded_size(const unsigned char* data_, size_t size_) {
+    if (size_ < filter_header_size) {
+        throw std::runtime_error("Filter: truncated header");
+    }
+    checkFilter(data_[0], data_[1]);
+    return size_ - filter_header_size;
+}
+
+/**
+  * Function which undoes the filter recorded in the header
+  */
+size_t filter_decode(const unsigned char* data_, size_t size_, unsigned char* output_, size_t capacity_) {
+    size_t num_bytes = filter_decoded_size(data_, size_);
+    if (num_bytes > capacity_) {
+        throw std::length_error("Filter: output buffer too small");
+    }
+    Filter_t filter = static_cast<Filter_t>(data_[0]);
+    unsigned int width = data_[1];
+    const unsigned char* data = data_ + filter_header_size;
+
+    size_t num_elements = num_bytes / width;
+    switch (filter) {
+    case FILTER_SHUFFLE: unshuffle(data, num_elements, width, output_); break;
+    case FILTER_DELTA: deltaDecode<false>(data, num_elements, width, output_); break;
+    case FILTER_XOR_DELTA: deltaDecode<true>(data, num_elements, width, output_); break;
+    }
+
+    size_t tail = num_elements*width;
+    std::copy(data + tail, data + num_bytes, output_ + tail);
+
+    return num_bytes;
+}
+
+void filter_decode(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_) {
+    size_t offset = output_.size();
+    size_t num_bytes = filter_decoded_size(data_, size_);
+    output_.resize(offset + num_bytes);
+    filter_decode(data_, size_, output_.data()+offset, num_bytes);
+}
+
+std::vector<unsigned char> filter_decode(const std::vector<unsigned char>& data_) {
+    std::vector<unsigned char> output;
+    filter_decode(data_.data(), data_.size(), output);
+    return output;
+}
\ No newline at end of file
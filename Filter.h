@@ -0,0 +1,61 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+/**
+  * Filters which rearrange arrays of fixed width numbers so that the 
+  * compressors see more redundancy. The input is treated as elements of
+  * width_ bytes, and any bytes after the last whole element are kept as is.
+  *  - Shuffle stores the first byte of every element, then the second byte, and so on.
+  *  - Delta stores the difference to the previous element as a little endian integer.
+  *  - XOR delta stores the bitwise exclusive or with the previous element.
+  * Shuffle works for any width from 1 to 255, and the deltas for widths of 1, 2, 4 and 8.
+  * The filter and width are stored in a two byte header.
+  */
+enum Filter_t {
+    FILTER_SHUFFLE,
+    FILTER_DELTA,
+    FILTER_XOR_DELTA
+};
+
+const unsigned int filter_default_width = 4;
+
+std::vector<unsigned char> filter_encode(Filter_t filter_, unsigned int width_, const std::vector<unsigned char>& data_);
+std::vector<unsigned char> filter_decode(const std::vector<unsigned char>& data_);
+
+/**
+  * Versions which read size_ bytes from data_, and append the result to the end of output_
+  */
+void filter_encode(Filter_t filter_, unsigned int width_, const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_);
+void filter_decode(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_);
+
+/**
+  * Versions which work on caller owned memory. filter_encode requires room for
+  * filter_encode_bound(size_) bytes in output_, and filter_decode requires room for
+  * filter_decoded_size(data_, size_) bytes. Both return the number of bytes written.
+  */
+size_t filter_encode_bound(size_t size_);
+size_t filter_encode(Filter_t filter_, unsigned int width_, const unsigned char* data_, size_t size_, unsigned char* output_);
+size_t filter_decoded_size(const unsigned char* data_, size_t size_);
+size_t filter_decode(const unsigned char* data_, size_t size_, unsigned char* output_, size_t capacity_);
\ No newline at end of file
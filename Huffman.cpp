@@ -19,13 +19,26 @@
   ***/
 
 #include "Huffman.h"
+#include "Benchmark.h"
+#include "Varint.h"
 #include <vector>
 #include <queue>
 #include <iostream>
 #include <cstdint>
 #include <cassert>
-#include <memory>
 #include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <thread>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
 
 namespace { //Prevent contaminating global namespace
 
@@ -39,11 +52,6 @@ public:
     HuffmanSymbol(uint64_t symbol_, unsigned int symbol_width_) 
         : m_symbol(symbol_), m_symbol_width(symbol_width_) {
     }
-    
-    HuffmanSymbol(HuffmanSymbol&& rhs) {
-        m_symbol = std::move(rhs.m_symbol);
-        m_symbol_width = std::move(rhs.m_symbol_width);
-    }
 
     HuffmanSymbol rightChild() {
         HuffmanSymbol child;
@@ -76,13 +84,6 @@ public:
         : m_count(count_), m_right(right_), m_left(left_), m_symbol() {
     }
 
-    HuffmanNode(HuffmanNode&& rhs) {
-        m_count = std::move(rhs.m_count);
-        m_right = std::move(rhs.m_right);
-        m_left = std::move(rhs.m_left);
-        m_symbol = std::move(rhs.m_symbol);
-    }
-    
     virtual inline bool operator<(const HuffmanNode& rhs) const {
         if (m_count < rhs.m_count) {
             return true;
@@ -126,26 +127,64 @@ public:
         : HuffmanNode(count_, nullptr, nullptr), m_char(char_) {
     }
 
-    HuffmanLeafNode(HuffmanLeafNode&& rhs) : HuffmanNode(rhs) {
-        m_char = std::move(rhs.m_char);
+    unsigned char m_char;
+};
+
+
+/**
+  * Nodes of the Huffman tree are kept per thread and reused between calls,
+  * so that compressing many small buffers does not allocate a new tree every time
+  */
+class HuffmanTreeScratch {
+public:
+    HuffmanTreeScratch() {
+        for (unsigned int i=0; i<256; ++i) {
+            m_leaf_nodes.push_back(HuffmanLeafNode(static_cast<unsigned char>(i)));
+        }
+        //A tree with 256 leaves has 255 non-leaf nodes, so pointers into this stay valid
+        m_non_leaf_nodes.reserve(256);
     }
 
-    unsigned char m_char;
+    /**
+      * Returns the leaf node of char_ with the given count and an empty symbol
+      */
+    inline HuffmanLeafNode* leaf(unsigned char char_, unsigned int count_) {
+        HuffmanLeafNode& leaf = m_leaf_nodes[char_];
+        leaf.m_count = count_;
+        leaf.m_symbol = HuffmanSymbol();
+        return &leaf;
+    }
+
+    inline HuffmanNode* nonLeaf(unsigned int count_, HuffmanNode* right_, HuffmanNode* left_) {
+        m_non_leaf_nodes.push_back(HuffmanNode(count_, right_, left_));
+        return &m_non_leaf_nodes.back();
+    }
+
+    inline void clear() {
+        m_non_leaf_nodes.clear();
+    }
+
+private:
+    std::vector<HuffmanLeafNode> m_leaf_nodes;
+    std::vector<HuffmanNode> m_non_leaf_nodes;
 };
 
+inline HuffmanTreeScratch& treeScratch() {
+    static thread_local HuffmanTreeScratch scratch;
+    scratch.clear();
+    return scratch;
+}
 
 /**
-  * Function which creates a list of occurances for each character in a vector
+  * Function which counts the occurances of each character in a buffer
   */
-inline std::vector<unsigned int> findCharacterFrequency(const std::vector<unsigned char>& data_) {
-    std::vector<unsigned int> frequencies(256, 0);
+inline void findCharacterFrequency(const unsigned char* data_, size_t size_, unsigned int* frequencies_) {
+    std::fill(frequencies_, frequencies_+256, 0);
 
-    for (size_t i=0; i<data_.size(); ++i) {
+    for (size_t i=0; i<size_; ++i) {
         unsigned int character = data_[i];
-        frequencies[character] += 1;
+        frequencies_[character] += 1;
     }
-
-    return frequencies;
 }
 
 /**
@@ -166,114 +205,789 @@ inline void traverseTree(HuffmanNode* root) {
 }
 
 /**
-  * Function which writes a huffman symbol to a buffered output
+  * Flat table of the code and code width of every character, used by the encoder
+  */
+struct HuffmanCodeTable {
+    uint64_t m_code[256];
+    unsigned char m_width[256];
+    unsigned int m_max_width;
+};
+
+/**
+  * Function which builds the Huffman tree of all characters with a non-zero 
+  * frequency, and returns its root. The leaf of each character is stored in 
+  * leaf_nodes_, and empty input is stored as a single character.
+  */
+inline HuffmanNode* buildHuffmanTree(const unsigned int* frequencies_, HuffmanTreeScratch& scratch_, 
+        HuffmanLeafNode** leaf_nodes_, unsigned int& num_characters_) {
+    //Loop through the frequencies and create a priority queue containing all characters
+    std::priority_queue<HuffmanNode*, std::vector<HuffmanNode*>, HuffmanNodeComparator > queue;
+    num_characters_ = 0;
+    for (size_t i=0; i<256; ++i) {
+        unsigned char c = i;
+        leaf_nodes_[i] = nullptr;
+        if (frequencies_[i] > 0) {
+            leaf_nodes_[i] = scratch_.leaf(c, frequencies_[i]);
+            queue.push(leaf_nodes_[i]);
+            ++num_characters_;
+        }
+    }
+
+    //Empty input is stored as a single character, which is never written
+    if (num_characters_ == 0) {
+        leaf_nodes_[0] = scratch_.leaf(0, 0);
+        queue.push(leaf_nodes_[0]);
+        ++num_characters_;
+    }
+    
+    //Create the tree of nodes
+    while (queue.size() > 1) {
+        HuffmanNode* right = queue.top();
+        queue.pop();
+        HuffmanNode* left = queue.top();
+        queue.pop();
+
+        unsigned int sum = right->m_count + left->m_count;
+        queue.push(scratch_.nonLeaf(sum, right, left));
+    }
+    return queue.top();
+}
+
+/**
+  * Function which flattens the symbols of the leaves into a table
+  */
+inline void buildHuffmanCodeTable(HuffmanLeafNode* const* leaf_nodes_, HuffmanCodeTable& table_) {
+    table_.m_max_width = 0;
+    for (size_t i=0; i<256; ++i) {
+        table_.m_code[i] = leaf_nodes_[i] ? leaf_nodes_[i]->m_symbol.m_symbol : 0;
+        table_.m_width[i] = leaf_nodes_[i] ? leaf_nodes_[i]->m_symbol.m_symbol_width : 0;
+        table_.m_max_width = std::max<unsigned int>(table_.m_max_width, table_.m_width[i]);
+    }
+}
+
+/**
+  * Function which writes the symbol table: the number of characters minus one,
+  * followed by each character, its symbol width, and the symbol in as few
+  * bytes as it fits. Returns the number of bytes written.
+  */
+inline size_t writeHuffmanTable(HuffmanLeafNode* const* leaf_nodes_, unsigned int num_characters_, unsigned char* output_) {
+    size_t offset = 0;
+    output_[offset++] = num_characters_-1;
+    for (size_t i=0; i<256; ++i) {
+        HuffmanLeafNode* node = leaf_nodes_[i];
+        if (node) {
+            unsigned char character = node->m_char;
+            unsigned char symbol_width = node->m_symbol.m_symbol_width;
+            unsigned char* symbol = reinterpret_cast<unsigned char*>(&(node->m_symbol.m_symbol));
+
+            //Write out symbol
+            output_[offset++] = character;
+
+            //Write out symbol length
+            output_[offset++] = symbol_width;
+
+            //Write out symbol itself 
+            for (size_t j=0; j*8<symbol_width; ++j) {
+                output_[offset++] = symbol[j];
+            }
+        }
+    }
+    return offset;
+}
+
+/**
+  * Bit writer which collects bits in a 64 bit accumulator, and writes whole
+  * bytes to the output eight at a time. The output must have eight bytes
+  * of slack after the last byte written.
+  */
+class HuffmanBitWriter {
+public:
+    HuffmanBitWriter(unsigned char* output_) : m_output(output_), m_offset(0), m_bits(0), m_num_bits(0) {}
+
+    /**
+      * Adds width_ bits to the accumulator. At most 56 bits fit after a flush.
+      */
+    inline void put(uint64_t bits_, unsigned int width_) {
+        m_bits |= bits_ << m_num_bits;
+        m_num_bits += width_;
+    }
+
+    /**
+      * Writes all whole bytes in the accumulator to the output
+      */
+    inline void flush() {
+        memcpy(m_output + m_offset, &m_bits, 8);
+        unsigned int num_bytes = m_num_bits >> 3;
+        m_offset += num_bytes;
+        m_bits = (num_bytes == 8) ? 0 : (m_bits >> (num_bytes*8));
+        m_num_bits &= 7;
+    }
+
+    /**
+      * Writes any symbol, also those wider than 56 bits
+      */
+    inline void putSymbol(uint64_t bits_, unsigned int width_) {
+        if (width_ > 32) {
+            put(bits_ & 0xFFFFFFFFull, 32);
+            flush();
+            bits_ >>= 32;
+            width_ -= 32;
+        }
+        put(bits_, width_);
+        flush();
+    }
+
+    /**
+      * Returns the number of bits written so far
+      */
+    inline uint64_t bitOffset() const {
+        return static_cast<uint64_t>(m_offset)*8 + m_num_bits;
+    }
+
+    /**
+      * Writes the last partial byte, and returns the number of bytes written
+      */
+    inline size_t finish() {
+        flush();
+        if (m_num_bits > 0) {
+            m_output[m_offset++] = static_cast<unsigned char>(m_bits);
+            m_bits = 0;
+            m_num_bits = 0;
+        }
+        return m_offset;
+    }
+
+private:
+    unsigned char* m_output;
+    size_t m_offset;
+    uint64_t m_bits;
+    unsigned int m_num_bits;
+};
+
+/**
+  * Function which writes the symbols of size_ characters using the code table
+  */
+inline void writeHuffmanSymbols(const unsigned char* data_, size_t size_, const HuffmanCodeTable& table_, HuffmanBitWriter& writer_) {
+    for (size_t i=0; i<size_; ++i) {
+        unsigned char c = data_[i];
+        writer_.putSymbol(table_.m_code[c], table_.m_width[c]);
+    }
+}
+
+/**
+  * Longest code of which symbols_per_flush_ symbols fit in the accumulator
+  * after a flush, which leaves at most seven bits in it
+  */
+constexpr unsigned int huffmanMaxUnrolledWidth(unsigned int symbols_per_flush_) {
+    return (64-7) / symbols_per_flush_;
+}
+
+/**
+  * Function which writes the symbols of the first multiple of symbols_per_flush_
+  * characters, and returns the number of characters written. The inner loop
+  * has a compile time trip count, so it is fully unrolled, and the writer 
+  * only flushes once per symbols_per_flush_ symbols.
+  */
+template <unsigned int symbols_per_flush_>
+size_t writeHuffmanSymbolsUnrolled(const unsigned char* data_, size_t size_, const HuffmanCodeTable& table_, HuffmanBitWriter& writer_) {
+    size_t i = 0;
+    for (; i+symbols_per_flush_ <= size_; i+=symbols_per_flush_) {
+        for (unsigned int j=0; j<symbols_per_flush_; ++j) {
+            unsigned char c = data_[i+j];
+            writer_.put(table_.m_code[c], table_.m_width[c]);
+        }
+        writer_.flush();
+    }
+    return i;
+}
+
+/**
+  * Dispatches to the unrolled writer specialized for the longest code in the table
+  */
+inline size_t writeHuffmanSymbolsScalar(const unsigned char* data_, size_t size_, const HuffmanCodeTable& table_, HuffmanBitWriter& writer_) {
+    const unsigned int max_width = table_.m_max_width;
+    if (max_width <= huffmanMaxUnrolledWidth(7)) {
+        return writeHuffmanSymbolsUnrolled<7>(data_, size_, table_, writer_);
+    }
+    else if (max_width <= huffmanMaxUnrolledWidth(6)) {
+        return writeHuffmanSymbolsUnrolled<6>(data_, size_, table_, writer_);
+    }
+    else if (max_width <= huffmanMaxUnrolledWidth(5)) {
+        return writeHuffmanSymbolsUnrolled<5>(data_, size_, table_, writer_);
+    }
+    else if (max_width <= huffmanMaxUnrolledWidth(4)) {
+        return writeHuffmanSymbolsUnrolled<4>(data_, size_, table_, writer_);
+    }
+    else if (max_width <= huffmanMaxUnrolledWidth(3)) {
+        return writeHuffmanSymbolsUnrolled<3>(data_, size_, table_, writer_);
+    }
+    else if (max_width <= huffmanMaxUnrolledWidth(2)) {
+        return writeHuffmanSymbolsUnrolled<2>(data_, size_, table_, writer_);
+    }
+    return 0;
+}
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HUFFMAN_HAS_AVX2_KERNEL
+
+/**
+  * Returns true if the CPU and operating system support AVX2
+  */
+inline bool cpuHasAVX2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28));
+    if (!osxsave_avx || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+/**
+  * Function which writes the symbols of the first multiple of eight characters 
+  * using AVX2, and returns the number of characters written. The code and width
+  * of each character is gathered from packed_table_ (code | width << 24) eight
+  * at a time, and neighbouring symbols are merged in registers, so that the 
+  * writer sees one symbol per two (or four if merge_quads) characters. 
+  * Requires a maximum code width of 24 (or 14 if merge_quads) bits.
   */
-void writeHuffmanSymbol(std::vector<unsigned char>& output_, unsigned int& bit_index_, const HuffmanSymbol& symbol_) {
-    const unsigned char bit_masks[] = {
-        1,
-        3,
-        7,
-        15,
-        31,
-        63,
-        127,
-        255,
+template <bool merge_quads>
+#if !defined(_MSC_VER)
+__attribute__((target("avx2")))
+#endif
+size_t writeHuffmanSymbolsAVX2(const unsigned char* data_, size_t size_, const uint32_t* packed_table_, HuffmanBitWriter& writer_) {
+    const __m256i code_mask = _mm256_set1_epi32(0x00FFFFFF);
+    const __m256i low_mask = _mm256_set1_epi64x(0xFFFFFFFF);
+    
+    size_t i = 0;
+    for (; i+8 <= size_; i+=8) {
+        __m128i characters = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data_+i));
+        __m256i entries = _mm256_i32gather_epi32(reinterpret_cast<const int*>(packed_table_), _mm256_cvtepu8_epi32(characters), 4);
+        __m256i codes = _mm256_and_si256(entries, code_mask);
+        __m256i widths = _mm256_srli_epi32(entries, 24);
+
+        //Merge each even symbol with the odd symbol after it into one 64 bit lane
+        __m256i pair_codes = _mm256_or_si256(_mm256_and_si256(codes, low_mask), 
+                _mm256_sllv_epi64(_mm256_srli_epi64(codes, 32), _mm256_and_si256(widths, low_mask)));
+        __m256i pair_widths = _mm256_add_epi64(_mm256_and_si256(widths, low_mask), _mm256_srli_epi64(widths, 32));
+
+        if (merge_quads) {
+            //Merge neighbouring pairs within each 128 bit lane as well
+            __m256i quad_codes = _mm256_or_si256(pair_codes, 
+                    _mm256_sllv_epi64(_mm256_srli_si256(pair_codes, 8), pair_widths));
+            __m256i quad_widths = _mm256_add_epi64(pair_widths, _mm256_srli_si256(pair_widths, 8));
+
+            alignas(32) uint64_t out_codes[4];
+            alignas(32) uint64_t out_widths[4];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(out_codes), quad_codes);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(out_widths), quad_widths);
+            writer_.put(out_codes[0], static_cast<unsigned int>(out_widths[0]));
+            writer_.flush();
+            writer_.put(out_codes[2], static_cast<unsigned int>(out_widths[2]));
+            writer_.flush();
+        }
+        else {
+            alignas(32) uint64_t out_codes[4];
+            alignas(32) uint64_t out_widths[4];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(out_codes), pair_codes);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(out_widths), pair_widths);
+            for (unsigned int j=0; j<4; ++j) {
+                writer_.put(out_codes[j], static_cast<unsigned int>(out_widths[j]));
+                writer_.flush();
+            }
+        }
+    }
+    return i;
+}
+#endif
+
+/**
+  * Function which writes the symbols of size_ characters, using the fastest 
+  * kernel the CPU supports for this code table
+  */
+inline void encodeHuffmanSymbols(const unsigned char* data_, size_t size_, const HuffmanCodeTable& table_, HuffmanBitWriter& writer_) {
+    size_t done = 0;
+#if defined(HUFFMAN_HAS_AVX2_KERNEL)
+    static const bool has_avx2 = cpuHasAVX2();
+    if (has_avx2 && table_.m_max_width <= 24) {
+        uint32_t packed_table[256];
+        for (unsigned int i=0; i<256; ++i) {
+            packed_table[i] = static_cast<uint32_t>(table_.m_code[i]) | (static_cast<uint32_t>(table_.m_width[i]) << 24);
+        }
+        if (table_.m_max_width <= 14) {
+            done = writeHuffmanSymbolsAVX2<true>(data_, size_, packed_table, writer_);
+        }
+        else {
+            done = writeHuffmanSymbolsAVX2<false>(data_, size_, packed_table, writer_);
+        }
+    }
+#endif
+    done += writeHuffmanSymbolsScalar(data_ + done, size_ - done, table_, writer_);
+    writeHuffmanSymbols(data_ + done, size_ - done, table_, writer_);
+}
+
+/**
+  * Flat Huffman tree used by the decoder. Node 1 is the root, and each node
+  * stores the index of its left (0) and right (1) child. Positive values are
+  * internal nodes, negative values are leaves (-1-character), and 0 marks a
+  * missing child, as the root can never be a child.
+  */
+class HuffmanDecodeTree {
+public:
+    HuffmanDecodeTree() : m_nodes(2) {}
+
+    inline void clear() {
+        m_nodes.resize(2);
+        m_nodes[1] = Node();
+    }
+
+    /**
+      * Adds a symbol to the tree. Throws if the symbol collides with an
+      * already added symbol, as the code would no longer be a prefix code.
+      */
+    inline void addSymbol(unsigned char char_, uint64_t symbol_, unsigned int symbol_width_) {
+        int node = 1;
+        for (unsigned int j=0; j+1<symbol_width_; ++j) {
+            unsigned int bit = (symbol_ >> j) & 1;
+            int child = m_nodes[node].m_child[bit];
+            if (child < 0) {
+                throw std::runtime_error("Huffman: symbol table is not a prefix code");
+            }
+            else if (child == 0) {
+                child = static_cast<int>(m_nodes.size());
+                m_nodes[node].m_child[bit] = child;
+                m_nodes.push_back(Node());
+            }
+            node = child;
+        }
+
+        unsigned int bit = (symbol_ >> (symbol_width_-1)) & 1;
+        if (m_nodes[node].m_child[bit] != 0) {
+            throw std::runtime_error("Huffman: symbol table is not a prefix code");
+        }
+        m_nodes[node].m_child[bit] = -1 - static_cast<int>(char_);
+    }
+
+    /**
+      * Returns the child of node_ in direction bit_
+      */
+    inline int child(int node_, unsigned int bit_) const {
+        return m_nodes[node_].m_child[bit_];
+    }
+
+private:
+    struct Node {
+        Node() { m_child[0] = 0; m_child[1] = 0; }
+        int m_child[2];
     };
+    std::vector<Node> m_nodes;
+};
 
-    unsigned int bits_left = symbol_.m_symbol_width;
-    uint64_t bits = symbol_.m_symbol;
+inline HuffmanDecodeTree& decodeTreeScratch() {
+    static thread_local HuffmanDecodeTree tree;
+    tree.clear();
+    return tree;
+}
 
-    while (bits_left) {
-        int bits_written = 0;
+/**
+  * Streams with checkpoints set the top bit of the stored length
+  */
+const uint64_t huffman_checkpoint_flag = 1ull << 63;
 
-        //Do we have to allocate more memory?
-        if (bit_index_ == 0) {
-            output_.push_back(0);
+/**
+  * Number of bytes of each checkpoint. A checkpoint holds a bit offset into
+  * the encoded characters, which take at most eight bits each.
+  */
+inline size_t huffmanCheckpointWidth(uint64_t num_bytes_) {
+    size_t width = 1;
+    while (width < 8 && ((num_bytes_*8) >> (8*width)) > 0) {
+        ++width;
+    }
+    return width;
+}
+
+/**
+  * Header of a Huffman stream. The encoded characters are stored from 
+  * m_data_offset to m_data_end, followed by any checkpoints.
+  */
+struct HuffmanHeader {
+    uint64_t m_num_bytes;
+    size_t m_data_offset;
+    size_t m_data_end;
+    bool m_single_character;
+    unsigned char m_character;
+    uint64_t m_checkpoint_interval;
+    uint64_t m_num_checkpoints;
+    size_t m_checkpoint_width;
+};
+
+/**
+  * Reads and validates a symbol table written by writeHuffmanTable at offset_, 
+  * and moves offset_ past it. The symbols are added to tree_ unless it is null.
+  */
+inline void readHuffmanTable(const unsigned char* data_, size_t size_, size_t& offset_, HuffmanDecodeTree* tree_, HuffmanHeader& header_) {
+    size_t offset = offset_;
+    if (offset >= size_) {
+        throw std::runtime_error("Huffman: truncated header");
+    }
+    size_t num_characters = data_[offset++]+1;
+    bool has_symbol[256] = { false };
+    header_.m_single_character = false;
+    header_.m_character = 0;
+    for (size_t i=0; i<num_characters; ++i) {
+        if (offset+2 > size_) {
+            throw std::runtime_error("Huffman: truncated symbol table");
         }
+        unsigned char character = data_[offset++];
+        unsigned char symbol_width = data_[offset++];
+        if (has_symbol[character]) {
+            throw std::runtime_error("Huffman: duplicate character in symbol table");
+        }
+        has_symbol[character] = true;
 
-        //Will we fill the current byte?
-        if (bit_index_+bits_left >= 8) {
-            //Read from bits
-            unsigned char out = static_cast<unsigned char>(bits);
+        //Symbols are at most 64 bits, and only a lone character can have an empty symbol
+        if (symbol_width > 64 || (symbol_width == 0 && num_characters != 1)) {
+            throw std::runtime_error("Huffman: invalid symbol width");
+        }
+        size_t symbol_bytes = (symbol_width+7)/8;
+        if (offset+symbol_bytes > size_) {
+            throw std::runtime_error("Huffman: truncated symbol table");
+        }
+        uint64_t symbol = 0;
+        unsigned char* symbol_ptr = reinterpret_cast<unsigned char*>(&symbol);
+        for (size_t j=0; j<symbol_bytes; ++j) {
+            symbol_ptr[j] = data_[offset++];
+        }
 
-            //Bit shift to align with existing bits and or
-            output_.back() ^= (out << bit_index_);
+        if (symbol_width == 0) {
+            header_.m_single_character = true;
+            header_.m_character = character;
+        }
+        else if (tree_) {
+            tree_->addSymbol(character, symbol, symbol_width);
+        }
+    }
+    offset_ = offset;
+}
 
-            //Move bit pointers
-            bits_written = 8-bit_index_;
+/**
+  * Reads and validates the header of a Huffman stream. The symbols are
+  * added to tree_ unless it is null.
+  */
+inline HuffmanHeader readHuffmanHeader(const unsigned char* data_, size_t size_, HuffmanDecodeTree* tree_) {
+    HuffmanHeader header;
+    size_t offset = 0;
+    readHuffmanTable(data_, size_, offset, tree_, header);
+
+    //Read number of uncompressed bytes so the decoder knows when to stop
+    if (offset+8 > size_) {
+        throw std::runtime_error("Huffman: truncated header");
+    }
+    header.m_num_bytes = 0;
+    unsigned char* num_bytes_ptr = reinterpret_cast<unsigned char*>(&(header.m_num_bytes));
+    for (size_t j=0; j<8; ++j) {
+        num_bytes_ptr[j] = data_[offset++];
+    }
+
+    //Checkpoints follow the encoded characters, one for every interval
+    //characters after the first interval
+    header.m_checkpoint_interval = 0;
+    header.m_num_checkpoints = 0;
+    header.m_checkpoint_width = 0;
+    if (header.m_num_bytes & huffman_checkpoint_flag) {
+        header.m_num_bytes &= ~huffman_checkpoint_flag;
+        if (!readVarint(data_, size_, offset, header.m_checkpoint_interval) || header.m_checkpoint_interval == 0) {
+            throw std::runtime_error("Huffman: invalid checkpoint interval");
+        }
+        if (header.m_num_bytes > 0) {
+            header.m_num_checkpoints = (header.m_num_bytes-1) / header.m_checkpoint_interval;
+        }
+        header.m_checkpoint_width = huffmanCheckpointWidth(header.m_num_bytes);
+        if (header.m_num_checkpoints > (size_-offset) / header.m_checkpoint_width) {
+            throw std::runtime_error("Huffman: truncated checkpoints");
+        }
+    }
+    header.m_data_offset = offset;
+    header.m_data_end = size_ - static_cast<size_t>(header.m_num_checkpoints)*header.m_checkpoint_width;
+
+    //Unless we have a single character, every character takes at least one bit
+    if (!header.m_single_character && header.m_num_bytes > 8*static_cast<uint64_t>(header.m_data_end-offset)) {
+        throw std::runtime_error("Huffman: stored length exceeds data");
+    }
+
+    return header;
+}
+
+/**
+  * Returns the bit offset where character index_*interval starts
+  */
+inline size_t readHuffmanCheckpoint(const unsigned char* data_, const HuffmanHeader& header_, uint64_t index_) {
+    if (index_ == 0) {
+        return header_.m_data_offset*8;
+    }
+    const unsigned char* checkpoint = data_ + header_.m_data_end + (index_-1)*header_.m_checkpoint_width;
+    uint64_t bit_offset = 0;
+    for (size_t i=0; i<header_.m_checkpoint_width; ++i) {
+        bit_offset |= static_cast<uint64_t>(checkpoint[i]) << (8*i);
+    }
+    if (bit_offset > 8*static_cast<uint64_t>(header_.m_data_end-header_.m_data_offset)) {
+        throw std::runtime_error("Huffman: invalid checkpoint");
+    }
+    return header_.m_data_offset*8 + static_cast<size_t>(bit_offset);
+}
+
+/**
+  * Function which decodes num_bytes_ characters from data_, starting at bit_offset_,
+  * and returns the bit offset after the last one
+  */
+inline size_t decodeHuffmanSymbols(const unsigned char* data_, size_t size_, size_t bit_offset_, const HuffmanDecodeTree& tree_, 
+        unsigned char* output_, size_t num_bytes_) {
+    //Now that we have the tree, lets traverse it as we decompress our data.
+    //As long as a full 64 bit symbol fits before the end of the buffer, we
+    //can decode without checking bounds
+    size_t bit_offset = bit_offset_;
+    const size_t bit_size = size_*8;
+    const size_t fast_bit_end = (size_ >= 8) ? (size_-8)*8 : 0;
+    size_t num_decoded = 0;
+    while (num_decoded < num_bytes_ && bit_offset < fast_bit_end) {
+        int node = 1;
+        do {
+            unsigned int bit = (data_[bit_offset >> 3] >> (bit_offset & 7)) & 1;
+            node = tree_.child(node, bit);
+            ++bit_offset;
+        } while (node > 0);
+
+        if (node == 0) {
+            throw std::runtime_error("Huffman: invalid symbol in data");
+        }
+        output_[num_decoded++] = static_cast<unsigned char>(-1 - node);
+    }
+
+    //Slow path close to the end of the buffer
+    while (num_decoded < num_bytes_) {
+        int node = 1;
+        do {
+            if (bit_offset == bit_size) {
+                throw std::runtime_error("Huffman: truncated data");
+            }
+            unsigned int bit = (data_[bit_offset >> 3] >> (bit_offset & 7)) & 1;
+            node = tree_.child(node, bit);
+            ++bit_offset;
+        } while (node > 0);
+
+        if (node == 0) {
+            throw std::runtime_error("Huffman: invalid symbol in data");
+        }
+        output_[num_decoded++] = static_cast<unsigned char>(-1 - node);
+    }
+    return bit_offset;
+}
+
+/**
+  * Symbols decoded from an arbitrary bit offset by the parallel decoder,
+  * together with the bit offsets where symbols start close to the
+  * beginning (head) and the end (tail) of the chunk
+  */
+struct HuffmanChunk {
+    std::vector<unsigned char> m_symbols;
+    std::vector<size_t> m_head_offsets;
+    std::vector<size_t> m_tail_offsets;
+    size_t m_tail_begin;
+    size_t m_end_bit;
+};
+
+/**
+  * Function which decodes symbols from start_bit_ until the first symbol that 
+  * starts at or after stop_bit_. The start offsets of symbols before head_end_bit_
+  * and after tail_begin_bit_ are recorded. Decoding also stops at the end of the
+  * data or at an invalid symbol, as the start offset may be in the middle of a symbol.
+  */
+void decodeHuffmanChunk(const unsigned char* data_, size_t size_, const HuffmanDecodeTree& tree_, 
+        size_t start_bit_, size_t stop_bit_, size_t head_end_bit_, size_t tail_begin_bit_, HuffmanChunk& chunk_) {
+    const size_t bit_size = size_*8;
+    const size_t fast_bit_end = (size_ >= 8) ? (size_-8)*8 : 0;
+    chunk_.m_tail_begin = 0;
+    size_t bit_offset = start_bit_;
+    while (bit_offset < stop_bit_) {
+        size_t symbol_start = bit_offset;
+        int node = 1;
+        if (bit_offset < fast_bit_end) {
+            do {
+                unsigned int bit = (data_[bit_offset >> 3] >> (bit_offset & 7)) & 1;
+                node = tree_.child(node, bit);
+                ++bit_offset;
+            } while (node > 0);
         }
         else {
-            //Read from bits
-            unsigned char out = static_cast<unsigned char>(bits);
+            do {
+                if (bit_offset == bit_size) {
+                    node = 0;
+                    break;
+                }
+                unsigned int bit = (data_[bit_offset >> 3] >> (bit_offset & 7)) & 1;
+                node = tree_.child(node, bit);
+                ++bit_offset;
+            } while (node > 0);
+        }
 
-            //Discard bits we don't own
-            out &= bit_masks[bits_left];
+        if (node == 0) {
+            bit_offset = symbol_start;
+            break;
+        }
 
-            //Write out
-            output_.back() ^= (out << bit_index_);
-            
-            bits_written = bits_left;
+        if (symbol_start < head_end_bit_) {
+            chunk_.m_head_offsets.push_back(symbol_start);
         }
-        
-        //Move bit pointers
-        bits_left -= bits_written;
-        bit_index_ = (bit_index_ + bits_written) % 8;
+        if (symbol_start >= tail_begin_bit_) {
+            if (chunk_.m_tail_offsets.empty()) {
+                chunk_.m_tail_begin = chunk_.m_symbols.size();
+            }
+            chunk_.m_tail_offsets.push_back(symbol_start);
+        }
+        chunk_.m_symbols.push_back(static_cast<unsigned char>(-1 - node));
+    }
+    if (chunk_.m_tail_offsets.empty()) {
+        chunk_.m_tail_begin = chunk_.m_symbols.size();
+    }
+    chunk_.m_end_bit = bit_offset;
+}
 
-        //Discard bits written from bits
-        bits = bits >> bits_written;
+/**
+  * Function which finds the first bit offset where both chunks have a symbol
+  * boundary. From there on, both decode the same symbols. Returns false if 
+  * the chunks did not synchronise within the overlap.
+  */
+inline bool findHuffmanSync(const HuffmanChunk& chunk_, const HuffmanChunk& next_, size_t& chunk_index_, size_t& next_index_) {
+    size_t i = 0;
+    size_t j = 0;
+    while (i < chunk_.m_tail_offsets.size() && j < next_.m_head_offsets.size()) {
+        if (chunk_.m_tail_offsets[i] == next_.m_head_offsets[j]) {
+            chunk_index_ = chunk_.m_tail_begin + i;
+            next_index_ = j;
+            return true;
+        }
+        else if (chunk_.m_tail_offsets[i] < next_.m_head_offsets[j]) {
+            ++i;
+        }
+        else {
+            ++j;
+        }
     }
+    return false;
 }
 
-} //Namespace
+/**
+  * Code table of a recently used block table, as the block encoder keeps it.
+  * m_present marks the characters the table has a code for.
+  */
+struct HuffmanBlockTable {
+    HuffmanCodeTable m_codes;
+    bool m_present[256];
+    size_t m_header_size;
+};
 
 /**
-  * Function which compresses data using Huffman lossless compression
+  * Symbol table of a recently used block table, as the block decoder keeps it
   */
-std::vector<unsigned char> huffman_compress(const std::vector<unsigned char>& data_, bool compute_entropy_) {
-    //First, find the actual frequency of each character in the stream
-    std::vector<unsigned int> frequencies = findCharacterFrequency(data_);
+struct HuffmanBlockDecodeTable {
+    HuffmanDecodeTree m_tree;
+    HuffmanHeader m_header;
+};
 
-    //Now loop through the map and create a priority queue containing all characters
-    std::priority_queue<HuffmanNode*, std::vector<HuffmanNode*>, HuffmanNodeComparator > queue;
-    std::vector<std::shared_ptr<HuffmanLeafNode> > leaf_nodes(frequencies.size());
+/**
+  * Number of bits needed to encode a block with the given frequencies using 
+  * table_, or the maximum value if the table lacks a character of the block
+  */
+inline uint64_t huffmanBlockCost(const unsigned int* frequencies_, const HuffmanBlockTable& table_) {
+    uint64_t bits = 0;
+    for (size_t i=0; i<256; ++i) {
+        if (frequencies_[i] > 0) {
+            if (!table_.m_present[i]) {
+                return std::numeric_limits<uint64_t>::max();
+            }
+            bits += static_cast<uint64_t>(frequencies_[i]) * table_.m_codes.m_width[i];
+        }
+    }
+    return bits;
+}
+
+/**
+  * Lower bound on the number of bits of a block encoded with a fresh table:
+  * the entropy of the block, plus two bytes per character in the table
+  */
+inline uint64_t huffmanFreshCostBound(const unsigned int* frequencies_, size_t size_) {
+    double bits = 0.0;
     unsigned int num_characters = 0;
-    for (size_t i=0; i<frequencies.size(); ++i) {
-        unsigned char c = i;
-        if (frequencies[i] > 0) {
-            std::shared_ptr<HuffmanLeafNode> leaf(new HuffmanLeafNode(c, frequencies[i]));
-            leaf_nodes[i] = leaf;
-            queue.push(leaf.get());
+    for (size_t i=0; i<256; ++i) {
+        if (frequencies_[i] > 0) {
+            bits -= frequencies_[i] * std::log2(frequencies_[i] / static_cast<double>(size_));
             ++num_characters;
         }
     }
-    
-    //Create the tree of nodes
-    std::vector<std::shared_ptr<HuffmanNode> > non_leaf_nodes;
-    while (queue.size() > 1) {
-        HuffmanNode* right = queue.top();
-        queue.pop();
-        HuffmanNode* left = queue.top();
-        queue.pop();
+    return static_cast<uint64_t>(bits) + 8*(1 + 2*static_cast<uint64_t>(num_characters));
+}
 
-        unsigned int sum = right->m_count + left->m_count;
-        std::shared_ptr<HuffmanNode> non_leaf(new HuffmanNode(sum, right, left));
-        non_leaf_nodes.push_back(non_leaf);
-        queue.push(non_leaf.get());
+/**
+  * Moves entry index_ of the recently used tables to the front
+  */
+inline void moveToFront(std::vector<size_t>& order_, size_t index_) {
+    std::rotate(order_.begin(), order_.begin()+index_, order_.begin()+index_+1);
+}
+
+/**
+  * Returns the slot to store a new table in, and moves it to the front of 
+  * order_. The least recently used table is replaced once all slots are in use.
+  */
+inline size_t newTableSlot(std::vector<size_t>& order_, size_t num_tables_) {
+    if (order_.size() < num_tables_) {
+        order_.push_back(order_.size());
+    }
+    moveToFront(order_, order_.size()-1);
+    return order_.front();
+}
+
+} //Namespace
+
+/**
+  * Huffman never uses more than eight bits per character, and the header
+  * holds at most 256 symbols of up to 2+8 bytes and the length. The bit
+  * writer needs eight bytes of slack.
+  */
+size_t huffman_compress_bound(size_t size_, size_t checkpoint_interval_) {
+    size_t bound = 1 + 256*(2+8) + 8 + size_ + 8;
+    if (checkpoint_interval_ > 0) {
+        bound += 10 + (size_/checkpoint_interval_)*8;
     }
+    return bound;
+}
 
-    //Traverse the tree, and add the code words for each node
-    traverseTree(queue.top());
-    queue.pop();
+/**
+  * Function which compresses data using Huffman lossless compression
+  */
+size_t huffman_compress(const unsigned char* data_, size_t size_, unsigned char* output_, bool compute_entropy_, size_t checkpoint_interval_) {
+    //First, find the actual frequency of each character in the stream
+    unsigned int frequencies[256];
+    findCharacterFrequency(data_, size_, frequencies);
+
+    //Create the tree, then traverse it, and add the code words for each node
+    HuffmanLeafNode* leaf_nodes[256];
+    unsigned int num_characters;
+    traverseTree(buildHuffmanTree(frequencies, treeScratch(), leaf_nodes, num_characters));
     
     if (compute_entropy_) {
         //Compute entropy
         double num_chars = 0.0;
         double theor_entr = 0.0;
         double entr = 0.0f;
-        for (size_t i=0; i<frequencies.size(); ++i) {
+        for (size_t i=0; i<256; ++i) {
             num_chars += frequencies[i];
         }
-        for (size_t i=0; i<frequencies.size(); ++i) {
+        for (size_t i=0; i<256; ++i) {
             if (frequencies[i] > 0) {
                 double freq = frequencies[i] / num_chars;
                 entr += freq * leaf_nodes[i]->m_symbol.m_symbol_width;
@@ -286,149 +1000,532 @@ std::vector<unsigned char> huffman_compress(const std::vector<unsigned char>& da
     }
 
     //Write the symbol table to the character buffer
-    std::vector<unsigned char> output;
-    output.push_back(num_characters-1);
-    for (size_t i=0; i<leaf_nodes.size(); ++i) {
-        std::shared_ptr<HuffmanLeafNode> node = leaf_nodes[i];
-        if (node) {
-            unsigned char character = node->m_char;
-            unsigned char symbol_width = node->m_symbol.m_symbol_width;
-            unsigned char* symbol = reinterpret_cast<unsigned char*>(&(node->m_symbol.m_symbol));
-
-            //Write out symbol
-            output.push_back(character);
-
-            //Write out symbol length
-            output.push_back(symbol_width);
-
-            //Write out symbol itself 
-            for (size_t j=0; j*8<symbol_width; ++j) {
-                output.push_back(symbol[j]);
-            }
-        }
-    }
+    size_t offset = writeHuffmanTable(leaf_nodes, num_characters, output_);
 
     //Write out number of uncompressed bytes so the decoder knows when to stop
-    uint64_t num_bytes = data_.size();
+    uint64_t num_bytes = size_;
+    if (checkpoint_interval_ > 0) {
+        num_bytes |= huffman_checkpoint_flag;
+    }
     unsigned char* num_bytes_ptr = reinterpret_cast<unsigned char*>(&(num_bytes));
     for (size_t j=0; j<8; ++j) {
-        output.push_back(num_bytes_ptr[j]);
+        output_[offset++] = num_bytes_ptr[j];
+    }
+    if (checkpoint_interval_ > 0) {
+        offset += writeVarint(checkpoint_interval_, output_ + offset);
     }
     
+    //Flatten the symbols into a table
+    HuffmanCodeTable table;
+    buildHuffmanCodeTable(leaf_nodes, table);
+
     //Now traverse text, and replace chars with symbols and write to output
-    unsigned int bit_index = 0;
-    for (size_t i=0; i<data_.size(); ++i) {
-        unsigned int index = data_[i];
-        writeHuffmanSymbol(output, bit_index, leaf_nodes[index]->m_symbol);
+    HuffmanBitWriter writer(output_ + offset);
+    if (checkpoint_interval_ == 0) {
+        encodeHuffmanSymbols(data_, size_, table, writer);
+        return offset + writer.finish();
     }
 
+    //Encode one interval at a time, and note where each one starts
+    std::vector<uint64_t> checkpoints;
+    for (size_t begin=0; begin<size_; begin+=checkpoint_interval_) {
+        if (begin > 0) {
+            checkpoints.push_back(writer.bitOffset());
+        }
+        encodeHuffmanSymbols(data_ + begin, std::min(checkpoint_interval_, size_-begin), table, writer);
+    }
+    offset += writer.finish();
+
+    //Then write the checkpoints after the encoded characters
+    const size_t width = huffmanCheckpointWidth(size_);
+    for (size_t i=0; i<checkpoints.size(); ++i) {
+        for (size_t j=0; j<width; ++j) {
+            output_[offset++] = static_cast<unsigned char>(checkpoints[i] >> (8*j));
+        }
+    }
+    return offset;
+}
+
+void huffman_compress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_, bool compute_entropy_, size_t checkpoint_interval_) {
+    size_t offset = output_.size();
+    output_.resize(offset + huffman_compress_bound(size_, checkpoint_interval_));
+    output_.resize(offset + huffman_compress(data_, size_, output_.data()+offset, compute_entropy_, checkpoint_interval_));
+}
+
+std::vector<unsigned char> huffman_compress(const std::vector<unsigned char>& data_, bool compute_entropy_, size_t checkpoint_interval_) {
+    std::vector<unsigned char> output;
+    huffman_compress(data_.data(), data_.size(), output, compute_entropy_, checkpoint_interval_);
     return output;
 }
 
 /**
-  * Function which decompresses a Huffman encoded vector
+  * Function which returns the number of bytes a Huffman encoded buffer decompresses to
+  */
+size_t huffman_decompressed_size(const unsigned char* data_, size_t size_) {
+    HuffmanHeader header = readHuffmanHeader(data_, size_, nullptr);
+    if (header.m_num_bytes > std::numeric_limits<size_t>::max()) {
+        throw std::length_error("Huffman: stored length does not fit in memory");
+    }
+    return static_cast<size_t>(header.m_num_bytes);
+}
+
+/**
+  * Function which decompresses a Huffman encoded buffer. The header is
+  * validated and every read is bounds checked, so that malformed input
+  * results in an exception rather than undefined behaviour.
   */
+size_t huffman_decompress(const unsigned char* data_, size_t size_, unsigned char* output_, size_t capacity_) {
+    HuffmanDecodeTree& tree = decodeTreeScratch();
+    HuffmanHeader header = readHuffmanHeader(data_, size_, &tree);
+    if (header.m_num_bytes > capacity_) {
+        throw std::length_error("Huffman: output buffer too small");
+    }
+    const size_t num_bytes = static_cast<size_t>(header.m_num_bytes);
+
+    //A single character is encoded using zero bits per character
+    if (header.m_single_character) {
+        std::fill(output_, output_+num_bytes, header.m_character);
+        return num_bytes;
+    }
+
+    decodeHuffmanSymbols(data_, header.m_data_end, header.m_data_offset*8, tree, output_, num_bytes);
+    return num_bytes;
+}
+
+void huffman_decompress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_) {
+    size_t offset = output_.size();
+    size_t num_bytes = huffman_decompressed_size(data_, size_);
+    output_.resize(offset + num_bytes);
+    huffman_decompress(data_, size_, output_.data()+offset, num_bytes);
+}
+
 std::vector<unsigned char> huffman_decompress(const std::vector<unsigned char>& data_) {
+    std::vector<unsigned char> output;
+    huffman_decompress(data_.data(), data_.size(), output);
+    return output;
+}
+
+/**
+  * Function which decompresses length_ characters from offset_ on. Decoding
+  * starts at the closest checkpoint before offset_, or at the start of the
+  * data if the stream has no checkpoints.
+  */
+size_t huffman_decompress_range(const unsigned char* data_, size_t size_, uint64_t offset_, size_t length_, unsigned char* output_) {
+    HuffmanDecodeTree& tree = decodeTreeScratch();
+    HuffmanHeader header = readHuffmanHeader(data_, size_, &tree);
+    if (offset_ > header.m_num_bytes || length_ > header.m_num_bytes - offset_) {
+        throw std::invalid_argument("Huffman: range exceeds the decompressed size");
+    }
+    if (header.m_single_character) {
+        std::fill(output_, output_+length_, header.m_character);
+        return length_;
+    }
+
+    uint64_t checkpoint = 0;
+    if (header.m_checkpoint_interval > 0) {
+        checkpoint = std::min(offset_ / header.m_checkpoint_interval, header.m_num_checkpoints);
+    }
+    size_t bit_offset = readHuffmanCheckpoint(data_, header, checkpoint);
+
+    //Skip the characters between the checkpoint and the range
+    uint64_t skip = offset_ - checkpoint*header.m_checkpoint_interval;
+    unsigned char skipped[4096];
+    while (skip > 0) {
+        size_t count = static_cast<size_t>(std::min<uint64_t>(skip, sizeof(skipped)));
+        bit_offset = decodeHuffmanSymbols(data_, header.m_data_end, bit_offset, tree, skipped, count);
+        skip -= count;
+    }
+
+    decodeHuffmanSymbols(data_, header.m_data_end, bit_offset, tree, output_, length_);
+    return length_;
+}
+
+void huffman_decompress_range(const unsigned char* data_, size_t size_, uint64_t offset_, size_t length_, std::vector<unsigned char>& output_) {
+    size_t offset = output_.size();
+    output_.resize(offset + length_);
+    huffman_decompress_range(data_, size_, offset_, length_, output_.data()+offset);
+}
+
+std::vector<unsigned char> huffman_decompress_range(const std::vector<unsigned char>& data_, uint64_t offset_, size_t length_) {
+    std::vector<unsigned char> output;
+    huffman_decompress_range(data_.data(), data_.size(), offset_, length_, output);
+    return output;
+}
+
+/**
+  * Each block takes a mode byte, the payload length, and at most a full 
+  * table and eight bits per character. The bit writer needs eight bytes of slack.
+  */
+size_t huffman_block_compress_bound(size_t size_, size_t block_size_) {
+    if (block_size_ == 0) {
+        throw std::invalid_argument("Huffman: block size must be positive");
+    }
+    size_t num_blocks = (size_ + block_size_ - 1) / block_size_;
+    return 10 + 10 + 1 + num_blocks*(1 + 10 + 1 + 256*(2+8)) + size_ + 8;
+}
+
+/**
+  * Function which compresses data_ using Huffman coding in blocks of block_size_
+  * bytes. The encoder keeps the num_tables_ most recently used tables, and 
+  * encodes each block with whichever of them, or a fresh table with its
+  * header, gives the fewest bytes.
+  */
+size_t huffman_block_compress(const unsigned char* data_, size_t size_, unsigned char* output_, size_t block_size_, unsigned int num_tables_) {
+    if (block_size_ == 0) {
+        throw std::invalid_argument("Huffman: block size must be positive");
+    }
+    if (num_tables_ > 254) {
+        throw std::invalid_argument("Huffman: at most 254 tables can be reused");
+    }
+
     size_t offset = 0;
-    std::shared_ptr<HuffmanNode> root(new HuffmanNode());
-    std::vector<std::shared_ptr<HuffmanNode> > non_leaf_nodes;
-    non_leaf_nodes.push_back(root);
-    
-    //Read the symbol table
-    size_t num_characters = data_[offset++]+1;
-    std::vector<std::shared_ptr<HuffmanLeafNode> > leaf_nodes(256);
-    for (size_t i=0; i<num_characters; ++i) {
-        unsigned char character = data_[offset++];
-        unsigned char symbol_width = data_[offset++];
-            assert(symbol_width < 8*8);
-        uint64_t symbol = 0;
-        unsigned char* symbol_ptr = reinterpret_cast<unsigned char*>(&symbol);
-        for (size_t j=0; j*8<symbol_width; ++j) {
-            symbol_ptr[j] = data_[offset++];
-        }
+    offset += writeVarint(size_, output_+offset);
+    offset += writeVarint(block_size_, output_+offset);
+    output_[offset++] = static_cast<unsigned char>(num_tables_);
 
-        //Now loop through the symbol, and create all non-leaf nodes
-        HuffmanNode* node = root.get();
-        for (unsigned char j=0; j<symbol_width-1; ++j) {
-            //1 signifies right child
-            if ((symbol >> j) & 1) {
-                if (!node->m_right) {
-                    std::shared_ptr<HuffmanNode> child(new HuffmanNode());
-                    non_leaf_nodes.push_back(child);
-                    node->m_right = child.get();
-                }
-                node = node->m_right;
+    //Recently used tables, with the index of the most recent first in order
+    std::vector<HuffmanBlockTable> tables(num_tables_);
+    std::vector<size_t> order;
+    HuffmanBlockTable fresh;
+
+    size_t block_size = 0;
+    for (size_t block_start=0; block_start<size_; block_start+=block_size) {
+        const unsigned char* block = data_ + block_start;
+        block_size = std::min(block_size_, size_-block_start);
+
+        unsigned int frequencies[256];
+        findCharacterFrequency(block, block_size, frequencies);
+
+        //Find the cheapest of the recent tables
+        const uint64_t no_table = std::numeric_limits<uint64_t>::max();
+        size_t best = 0;
+        uint64_t best_bits = no_table;
+        for (size_t i=0; i<order.size(); ++i) {
+            uint64_t bits = huffmanBlockCost(frequencies, tables[order[i]]);
+            if (bits < best_bits) {
+                best = i;
+                best_bits = bits;
             }
-            //0 signifies left
-            else {
-                if (!node->m_left) {
-                    std::shared_ptr<HuffmanNode> child(new HuffmanNode());
-                    non_leaf_nodes.push_back(child);
-                    node->m_left = child.get();
-                }
-                node = node->m_left;
+        }
+
+        //Only build a fresh table when it can beat the best recent table
+        bool reuse = (best_bits != no_table && best_bits <= huffmanFreshCostBound(frequencies, block_size));
+        if (!reuse) {
+            HuffmanLeafNode* leaf_nodes[256];
+            unsigned int num_characters;
+            traverseTree(buildHuffmanTree(frequencies, treeScratch(), leaf_nodes, num_characters));
+            buildHuffmanCodeTable(leaf_nodes, fresh.m_codes);
+            for (size_t i=0; i<256; ++i) {
+                fresh.m_present[i] = (leaf_nodes[i] != nullptr);
             }
+
+            //The table is written straight to the output, and only kept if it is used
+            fresh.m_header_size = writeHuffmanTable(leaf_nodes, num_characters, output_+offset+1);
+            uint64_t fresh_bits = huffmanBlockCost(frequencies, fresh);
+
+            //Compare whole bytes, as each block is padded to a byte boundary
+            reuse = (best_bits != no_table && (best_bits+7)/8 <= fresh.m_header_size + (fresh_bits+7)/8);
         }
 
-        //Finally, add the leaf node
-        if ((symbol >> (symbol_width-1)) & 1) {
-            std::shared_ptr<HuffmanLeafNode> child(new HuffmanLeafNode(character));
-            child->m_symbol.m_symbol = symbol;
-            leaf_nodes.push_back(child);
-            node->m_right = child.get();
+        const HuffmanBlockTable* table;
+        if (reuse) {
+            output_[offset++] = static_cast<unsigned char>(best+1);
+            moveToFront(order, best);
+            table = &tables[order.front()];
         }
         else {
-            std::shared_ptr<HuffmanLeafNode> child(new HuffmanLeafNode(character));
-            child->m_symbol.m_symbol = symbol;
-            leaf_nodes.push_back(child);
-            node->m_left = child.get();
+            output_[offset++] = 0;
+            offset += fresh.m_header_size;
+            table = &fresh;
+            if (num_tables_ > 0) {
+                size_t slot = newTableSlot(order, num_tables_);
+                tables[slot] = fresh;
+                table = &tables[slot];
+            }
         }
-    }
 
-    //Read number of uncompressed bytes so the decoder knows when to stop
-    uint64_t num_bytes = 0;
-    unsigned char* num_bytes_ptr = reinterpret_cast<unsigned char*>(&(num_bytes));
-    for (size_t j=0; j<8; ++j) {
-        num_bytes_ptr[j] = data_[offset++];
+        //Write the number of payload bytes, so that the decoder can check the block
+        uint64_t num_bits = huffmanBlockCost(frequencies, *table);
+        offset += writeVarint((num_bits+7)/8, output_+offset);
+
+        HuffmanBitWriter writer(output_ + offset);
+        encodeHuffmanSymbols(block, block_size, table->m_codes, writer);
+        offset += writer.finish();
     }
+    return offset;
+}
+
+void huffman_block_compress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_, size_t block_size_, unsigned int num_tables_) {
+    size_t offset = output_.size();
+    output_.resize(offset + huffman_block_compress_bound(size_, block_size_));
+    output_.resize(offset + huffman_block_compress(data_, size_, output_.data()+offset, block_size_, num_tables_));
+}
 
-    //Now that we have the tree, lets traverse it as we decompress our data
+std::vector<unsigned char> huffman_block_compress(const std::vector<unsigned char>& data_, size_t block_size_, unsigned int num_tables_) {
     std::vector<unsigned char> output;
-    unsigned int bit_index = 0;
-    unsigned char byte = 0;
-    while (output.size() < num_bytes) {
-        //If we don't have any more data, we have to abort.
-        //However, this should never happen
-        if (offset == data_.size() && bit_index == 0) {
-            break;
-        }
+    huffman_block_compress(data_.data(), data_.size(), output, block_size_, num_tables_);
+    return output;
+}
+
+/**
+  * Function which reads the header of a block Huffman stream, and returns the 
+  * number of bytes it decompresses to
+  */
+size_t huffman_block_decompressed_size(const unsigned char* data_, size_t size_) {
+    size_t offset = 0;
+    uint64_t num_bytes;
+    if (!readVarint(data_, size_, offset, num_bytes)) {
+        throw std::runtime_error("Huffman: truncated header");
+    }
+    if (num_bytes > std::numeric_limits<size_t>::max()) {
+        throw std::length_error("Huffman: stored length does not fit in memory");
+    }
+    return static_cast<size_t>(num_bytes);
+}
 
-        HuffmanNode* node = root.get();
+/**
+  * Function which decompresses a block Huffman stream. The decoder keeps the
+  * same recently used tables as the encoder, so reused tables are neither 
+  * read nor rebuilt.
+  */
+size_t huffman_block_decompress(const unsigned char* data_, size_t size_, unsigned char* output_, size_t capacity_) {
+    const size_t num_bytes = huffman_block_decompressed_size(data_, size_);
+    if (num_bytes > capacity_) {
+        throw std::length_error("Huffman: output buffer too small");
+    }
 
-        //Decode one symbol
-        for (;;) {
-            if (bit_index == 0 && offset < data_.size()) {
-                byte = data_[offset++];
-            }
+    size_t offset = 0;
+    uint64_t ignored, block_size;
+    readVarint(data_, size_, offset, ignored);
+    if (!readVarint(data_, size_, offset, block_size) || offset >= size_) {
+        throw std::runtime_error("Huffman: truncated header");
+    }
+    if (block_size == 0 && num_bytes > 0) {
+        throw std::runtime_error("Huffman: invalid block size");
+    }
+    const size_t num_tables = data_[offset++];
 
-            //Right child
-            if ((byte >> bit_index) & 1) {
-                node = node->m_right;
-            }
-            //Left child
-            else {
-                node = node->m_left;
+    std::vector<HuffmanBlockDecodeTable> tables(std::max<size_t>(num_tables, 1));
+    std::vector<size_t> order;
+
+    size_t block_bytes = 0;
+    for (size_t block_start=0; block_start<num_bytes; block_start+=block_bytes) {
+        block_bytes = static_cast<size_t>(std::min<uint64_t>(block_size, num_bytes-block_start));
+        if (offset >= size_) {
+            throw std::runtime_error("Huffman: truncated block");
+        }
+        size_t mode = data_[offset++];
+
+        const HuffmanBlockDecodeTable* table;
+        if (mode == 0) {
+            //Without any tables to reuse, the single slot is overwritten by every block
+            size_t slot = (num_tables > 0) ? newTableSlot(order, num_tables) : 0;
+            HuffmanBlockDecodeTable& new_table = tables[slot];
+            new_table.m_tree.clear();
+            readHuffmanTable(data_, size_, offset, &new_table.m_tree, new_table.m_header);
+            table = &new_table;
+        }
+        else {
+            if (mode > order.size()) {
+                throw std::runtime_error("Huffman: block reuses a missing table");
             }
+            moveToFront(order, mode-1);
+            table = &tables[order.front()];
+        }
 
-            bit_index = (bit_index+1) % 8;
+        uint64_t payload_size;
+        if (!readVarint(data_, size_, offset, payload_size) || payload_size > size_-offset) {
+            throw std::runtime_error("Huffman: truncated block");
+        }
 
-            HuffmanLeafNode* leaf = dynamic_cast<HuffmanLeafNode*>(node);
-            if (leaf) {
-                output.push_back(leaf->m_char);
-                break;
+        unsigned char* block = output_ + block_start;
+        if (table->m_header.m_single_character) {
+            std::fill(block, block+block_bytes, table->m_header.m_character);
+        }
+        else {
+            //Every character takes at least one bit
+            if (block_bytes > 8*payload_size) {
+                throw std::runtime_error("Huffman: block length exceeds data");
             }
+            decodeHuffmanSymbols(data_+offset, static_cast<size_t>(payload_size), 0, table->m_tree, block, block_bytes);
         }
+        offset += static_cast<size_t>(payload_size);
     }
+    return num_bytes;
+}
 
+void huffman_block_decompress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_) {
+    size_t offset = output_.size();
+    size_t num_bytes = huffman_block_decompressed_size(data_, size_);
+    output_.resize(offset + num_bytes);
+    huffman_block_decompress(data_, size_, output_.data()+offset, num_bytes);
+}
+
+std::vector<unsigned char> huffman_block_decompress(const std::vector<unsigned char>& data_) {
+    std::vector<unsigned char> output;
+    huffman_block_decompress(data_.data(), data_.size(), output);
     return output;
 }
+
+/**
+  * Function which decompresses a Huffman encoded buffer using several threads.
+  * The encoded bits are split into one chunk per thread, and each thread starts
+  * decoding at the start of its chunk, even if that is in the middle of a symbol.
+  * Huffman codes tend to resynchronise after a few symbols, so each thread also
+  * decodes a bit into the next chunk. Where both threads agree on a symbol 
+  * boundary, the output of the next chunk is correct, and the chunks are stitched
+  * together there. If two chunks never agree, the next chunk is decoded again 
+  * from the correct offset.
+  */
+size_t huffman_decompress_parallel(const unsigned char* data_, size_t size_, unsigned char* output_, size_t capacity_, unsigned int num_threads_) {
+    //Bits each chunk decodes into the next to find a synchronisation point
+    const size_t overlap_bits = 16*1024;
+
+    HuffmanDecodeTree& tree = decodeTreeScratch();
+    HuffmanHeader header = readHuffmanHeader(data_, size_, &tree);
+    const size_t start_bit = header.m_data_offset*8;
+    const size_t bit_size = header.m_data_end*8;
+    size_t num_chunks = std::max(num_threads_, 1u);
+    num_chunks = std::min(num_chunks, (bit_size - start_bit) / (4*overlap_bits));
+    if (header.m_single_character || num_chunks <= 1) {
+        return huffman_decompress(data_, size_, output_, capacity_);
+    }
+    if (header.m_num_bytes > capacity_) {
+        throw std::length_error("Huffman: output buffer too small");
+    }
+    const size_t num_bytes = static_cast<size_t>(header.m_num_bytes);
+
+    //Decode all chunks speculatively
+    std::vector<size_t> chunk_begin(num_chunks+1);
+    for (size_t i=0; i<=num_chunks; ++i) {
+        chunk_begin[i] = start_bit + ((bit_size - start_bit) / num_chunks) * i;
+    }
+    chunk_begin[num_chunks] = bit_size;
+
+    std::vector<HuffmanChunk> chunks(num_chunks);
+    std::vector<std::thread> threads;
+    for (size_t i=0; i<num_chunks; ++i) {
+        threads.push_back(std::thread([&, i]() {
+            size_t stop_bit = std::min(chunk_begin[i+1] + overlap_bits, bit_size);
+            decodeHuffmanChunk(data_, header.m_data_end, tree, chunk_begin[i], stop_bit, 
+                    chunk_begin[i] + overlap_bits, chunk_begin[i+1], chunks[i]);
+        }));
+    }
+    for (size_t i=0; i<num_chunks; ++i) {
+        threads[i].join();
+    }
+
+    //Stitch the chunks together. The first chunk starts at a symbol boundary,
+    //so it is correct from its first symbol
+    size_t num_decoded = 0;
+    size_t valid_from = 0;
+    for (size_t i=0; i<num_chunks && num_decoded<num_bytes; ++i) {
+        const HuffmanChunk& chunk = chunks[i];
+        size_t valid_to = chunk.m_symbols.size();
+        size_t next_valid_from = 0;
+
+        if (i+1 < num_chunks && !findHuffmanSync(chunk, chunks[i+1], valid_to, next_valid_from)) {
+            //No synchronisation, so decode the next chunk again from where this one ended
+            valid_to = chunk.m_symbols.size();
+            HuffmanChunk& next = chunks[i+1];
+            size_t stop_bit = std::min(std::max(chunk.m_end_bit, chunk_begin[i+2]) + overlap_bits, bit_size);
+            next.m_symbols.clear();
+            next.m_head_offsets.clear();
+            next.m_tail_offsets.clear();
+            decodeHuffmanChunk(data_, header.m_data_end, tree, chunk.m_end_bit, stop_bit, 
+                    chunk.m_end_bit, chunk_begin[i+2], next);
+            next_valid_from = 0;
+        }
+
+        size_t count = std::min(valid_to - std::min(valid_from, valid_to), num_bytes - num_decoded);
+        std::copy(chunk.m_symbols.begin() + valid_from, chunk.m_symbols.begin() + valid_from + count, output_ + num_decoded);
+        num_decoded += count;
+        valid_from = next_valid_from;
+    }
+
+    //Let the serial decoder report what is wrong with the data
+    if (num_decoded != num_bytes) {
+        return huffman_decompress(data_, size_, output_, capacity_);
+    }
+
+    return num_bytes;
+}
+
+std::vector<unsigned char> huffman_decompress_parallel(const std::vector<unsigned char>& data_, unsigned int num_threads_) {
+    std::vector<unsigned char> output(huffman_decompressed_size(data_.data(), data_.size()));
+    huffman_decompress_parallel(data_.data(), data_.size(), output.data(), output.size(), num_threads_);
+    return output;
+}
+
+/**
+  * Function which benchmarks the kernels of the Huffman coder in isolation
+  */
+void huffman_benchmark(const std::vector<unsigned char>& input_, std::vector<BenchmarkResult>& results_) {
+    const unsigned char* data = input_.data();
+    const size_t size = input_.size();
+
+    unsigned int frequencies[256];
+    results_.push_back(runBenchmark("findCharacterFrequency", size, [&]() {
+        findCharacterFrequency(data, size, frequencies);
+        benchmarkKeep(frequencies);
+    }));
+
+    HuffmanLeafNode* leaf_nodes[256];
+    unsigned int num_characters;
+    results_.push_back(runBenchmark("buildHuffmanTree", 0, [&]() {
+        benchmarkKeep(buildHuffmanTree(frequencies, treeScratch(), leaf_nodes, num_characters));
+    }));
+
+    HuffmanNode* root = buildHuffmanTree(frequencies, treeScratch(), leaf_nodes, num_characters);
+    results_.push_back(runBenchmark("traverseTree", 0, [&]() {
+        traverseTree(root);
+        benchmarkKeep(leaf_nodes);
+    }));
+
+    HuffmanCodeTable table;
+    buildHuffmanCodeTable(leaf_nodes, table);
+    std::vector<unsigned char> output(huffman_compress_bound(size));
+    results_.push_back(runBenchmark("writeHuffmanSymbol", size, [&]() {
+        HuffmanBitWriter writer(output.data());
+        writeHuffmanSymbols(data, size, table, writer);
+        benchmarkKeep(writer.finish());
+    }));
+    results_.push_back(runBenchmark("encodeHuffmanSymbols", size, [&]() {
+        HuffmanBitWriter writer(output.data());
+        encodeHuffmanSymbols(data, size, table, writer);
+        benchmarkKeep(writer.finish());
+    }));
+
+    //Each unrolled writer the longest code allows, with the remainder written symbol by symbol
+    typedef size_t (*UnrolledWriter)(const unsigned char*, size_t, const HuffmanCodeTable&, HuffmanBitWriter&);
+    auto unrolled = [&](const std::string& name_, unsigned int symbols_per_flush_, UnrolledWriter write_) {
+        if (table.m_max_width > huffmanMaxUnrolledWidth(symbols_per_flush_)) {
+            return;
+        }
+        results_.push_back(runBenchmark(name_, size, [&]() {
+            HuffmanBitWriter writer(output.data());
+            size_t done = write_(data, size, table, writer);
+            writeHuffmanSymbols(data + done, size - done, table, writer);
+            benchmarkKeep(writer.finish());
+        }));
+    };
+    unrolled("writeHuffmanSymbolsUnrolled<2>", 2, writeHuffmanSymbolsUnrolled<2>);
+    unrolled("writeHuffmanSymbolsUnrolled<3>", 3, writeHuffmanSymbolsUnrolled<3>);
+    unrolled("writeHuffmanSymbolsUnrolled<4>", 4, writeHuffmanSymbolsUnrolled<4>);
+    unrolled("writeHuffmanSymbolsUnrolled<5>", 5, writeHuffmanSymbolsUnrolled<5>);
+    unrolled("writeHuffmanSymbolsUnrolled<6>", 6, writeHuffmanSymbolsUnrolled<6>);
+    unrolled("writeHuffmanSymbolsUnrolled<7>", 7, writeHuffmanSymbolsUnrolled<7>);
+
+    std::vector<unsigned char> compressed = huffman_compress(input_);
+    std::vector<unsigned char> decompressed(size);
+    results_.push_back(runBenchmark("Huffman decode loop", size, [&]() {
+        benchmarkKeep(huffman_decompress(compressed.data(), compressed.size(), decompressed.data(), size));
+    }));
+
+    //Point lookup of the last 4 KiB, which only decodes from the closest checkpoint
+    std::vector<unsigned char> checkpointed = huffman_compress(input_, false, huffman_default_checkpoint_interval);
+    const size_t range = std::min<size_t>(size, 4096);
+    results_.push_back(runBenchmark("Huffman range decode", range, [&]() {
+        benchmarkKeep(huffman_decompress_range(checkpointed.data(), checkpointed.size(), size-range, range, decompressed.data()));
+    }));
+}
\ No newline at end of file
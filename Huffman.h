@@ -21,6 +21,76 @@
 #pragma once
 
 #include <vector>
+#include <cstddef>
+#include <cstdint>
 
-std::vector<unsigned char> huffman_compress(const std::vector<unsigned char>& data_, bool compute_entropy_=false);
+struct BenchmarkResult;
+
+/**
+  * With a checkpoint_interval_, the bit offset of every checkpoint_interval_ 
+  * characters is stored after the encoded data, so that huffman_decompress_range
+  * can start decoding close to any offset. Each checkpoint takes up to eight bytes.
+  */
+std::vector<unsigned char> huffman_compress(const std::vector<unsigned char>& data_, bool compute_entropy_=false, size_t checkpoint_interval_=0);
 std::vector<unsigned char> huffman_decompress(const std::vector<unsigned char>& data_);
+
+/**
+  * Versions which read size_ bytes from data_, and append the result to the end of output_
+  */
+void huffman_compress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_, bool compute_entropy_=false, size_t checkpoint_interval_=0);
+void huffman_decompress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_);
+
+/**
+  * Versions which work on caller owned memory. huffman_compress requires room for
+  * huffman_compress_bound(size_) bytes in output_, and huffman_decompress requires room for
+  * huffman_decompressed_size(data_, size_) bytes. Both return the number of bytes written.
+  */
+size_t huffman_compress_bound(size_t size_, size_t checkpoint_interval_=0);
+size_t huffman_compress(const unsigned char* data_, size_t size_, unsigned char* output_, bool compute_entropy_=false, size_t checkpoint_interval_=0);
+size_t huffman_decompressed_size(const unsigned char* data_, size_t size_);
+size_t huffman_decompress(const unsigned char* data_, size_t size_, unsigned char* output_, size_t capacity_);
+
+const size_t huffman_default_checkpoint_interval = 1 << 14;
+
+/**
+  * Decompresses the length_ characters starting at offset_ into output_, which
+  * must have room for them. Only the characters from the closest checkpoint 
+  * on are decoded, or all from the start if the stream has no checkpoints.
+  */
+size_t huffman_decompress_range(const unsigned char* data_, size_t size_, uint64_t offset_, size_t length_, unsigned char* output_);
+void huffman_decompress_range(const unsigned char* data_, size_t size_, uint64_t offset_, size_t length_, std::vector<unsigned char>& output_);
+std::vector<unsigned char> huffman_decompress_range(const std::vector<unsigned char>& data_, uint64_t offset_, size_t length_);
+
+const size_t huffman_default_block_size = 1 << 16;
+const unsigned int huffman_default_num_tables = 4;
+
+/**
+  * Block Huffman coding, which splits the input into blocks of block_size_ bytes.
+  * Rather than a new table for every block, a block may reuse one of the 
+  * num_tables_ most recently used tables when that takes fewer bytes, so 
+  * homogeneous data pays for, and builds, few tables.
+  */
+std::vector<unsigned char> huffman_block_compress(const std::vector<unsigned char>& data_, 
+        size_t block_size_=huffman_default_block_size, unsigned int num_tables_=huffman_default_num_tables);
+std::vector<unsigned char> huffman_block_decompress(const std::vector<unsigned char>& data_);
+void huffman_block_compress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_, 
+        size_t block_size_=huffman_default_block_size, unsigned int num_tables_=huffman_default_num_tables);
+void huffman_block_decompress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_);
+size_t huffman_block_compress_bound(size_t size_, size_t block_size_=huffman_default_block_size);
+size_t huffman_block_compress(const unsigned char* data_, size_t size_, unsigned char* output_, 
+        size_t block_size_=huffman_default_block_size, unsigned int num_tables_=huffman_default_num_tables);
+size_t huffman_block_decompressed_size(const unsigned char* data_, size_t size_);
+size_t huffman_block_decompress(const unsigned char* data_, size_t size_, unsigned char* output_, size_t capacity_);
+
+/**
+  * Decompresses using num_threads_ threads which start decoding at arbitrary bit
+  * offsets and rely on Huffman codes resynchronising. Works on any Huffman stream
+  * and gives exactly the same output as huffman_decompress.
+  */
+size_t huffman_decompress_parallel(const unsigned char* data_, size_t size_, unsigned char* output_, size_t capacity_, unsigned int num_threads_);
+std::vector<unsigned char> huffman_decompress_parallel(const std::vector<unsigned char>& data_, unsigned int num_threads_);
+
+/**
+  * Benchmarks each kernel of the Huffman coder on input_, and appends the results
+  */
+void huffman_benchmark(const std::vector<unsigned char>& input_, std::vector<BenchmarkResult>& results_);
\ No newline at end of file
@@ -0,0 +1,657 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "LZ77.h"
+#include "Varint.h"
+#include "Dedup.h"
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+
+namespace { //Avoid contaminating global namespace
+
+/**
+  * The stream is a sequence of (literals, match) pairs. Each starts with a token
+  * holding the number of literals in the high nibble and the match length 
+  * minus lz77_min_match in the low nibble. A nibble of 15 means the rest of the
+  * value follows as a variable length integer. Then come the literals and the 
+  * match offset minus one as a variable length integer. The last sequence 
+  * only has literals.
+  */
+const size_t lz77_min_match = 4;
+const unsigned int lz77_nibble_max = 15;
+
+const unsigned int lz77_min_window_bits = 10;
+const unsigned int lz77_max_window_bits = 24;
+
+/**
+  * Matches against the previous offset at least this long are taken without
+  * searching the hash chains for a longer one
+  */
+const size_t lz77_long_match = 64;
+
+/**
+  * After an insertion or deletion, the data lines up with the dictionary again
+  * at a nearby offset. Up to lz77_max_drift bytes either way are tried for
+  * positions less than lz77_resync_distance bytes after the last match into
+  * the dictionary.
+  */
+const size_t lz77_max_drift = 256;
+const size_t lz77_resync_distance = 4096;
+
+/**
+  * Shortest match into the dictionary which moves the alignment. Shorter ones
+  * are mostly chance repeats, e.g. of common words, in other places.
+  */
+const size_t lz77_min_alignment_match = 32;
+
+/**
+  * Number of bytes the decoder may copy beyond the end of a literal run or
+  * match when there is room for it in the output
+  */
+const size_t lz77_wildcopy_slack = 16;
+
+inline uint32_t read32(const unsigned char* data_) {
+    uint32_t value;
+    memcpy(&value, data_, sizeof(value));
+    return value;
+}
+
+inline uint64_t read64(const unsigned char* data_) {
+    uint64_t value;
+    memcpy(&value, data_, sizeof(value));
+    return value;
+}
+
+/**
+  * Returns the number of equal bytes in match_ and current_, comparing eight bytes at a time
+  */
+inline size_t matchLength(const unsigned char* match_, const unsigned char* current_, const unsigned char* end_) {
+    const unsigned char* start = current_;
+    while (current_+8 <= end_ && read64(match_) == read64(current_)) {
+        match_ += 8;
+        current_ += 8;
+    }
+    while (current_ < end_ && *match_ == *current_) {
+        match_ += 1;
+        current_ += 1;
+    }
+    return current_ - start;
+}
+
+/**
+  * Hash chain match finder. m_head holds the most recent position of each hash
+  * of four bytes, and m_chain holds the previous position with the same hash
+  * for every position in the window. Positions are stored plus one and modulo
+  * 2^32, so that zero means no position. The window is at most 2^24 bytes, so
+  * the distance back to a position inside it is still exact.
+  */
+class LZ77MatchFinder {
+public:
+    /**
+      * Prepares the match finder for an input of size_ bytes
+      */
+    inline void reset(size_t size_, unsigned int window_bits_, unsigned int search_depth_) {
+        m_window_size = size_t(1) << window_bits_;
+        m_search_depth = search_depth_;
+
+        //Small inputs do not need the full tables, which keeps batches of small buffers cheap
+        m_hash_bits = lz77_min_window_bits;
+        while (m_hash_bits < max_hash_bits && (size_t(1) << m_hash_bits) < size_) {
+            m_hash_bits += 1;
+        }
+        m_head.assign(size_t(1) << m_hash_bits, 0);
+
+        //The chain is only read for positions inside the window that have 
+        //been inserted, so it never has to be cleared
+        size_t chain_size = 1;
+        while (chain_size < std::min(size_, m_window_size)) {
+            chain_size <<= 1;
+        }
+        m_chain_mask = chain_size-1;
+        if (m_chain.size() < chain_size) {
+            m_chain.resize(chain_size);
+        }
+    }
+
+    /**
+      * Releases the chain after a large input, so that idle threads do not keep 
+      * up to 64 MiB each. Chains for small inputs are kept for the next call.
+      */
+    inline void trim() {
+        if (m_chain.size() > max_kept_chain_size) {
+            std::vector<uint32_t>().swap(m_chain);
+        }
+    }
+
+    /**
+      * Inserts position pos_, which must have at least four bytes after it
+      */
+    inline void insert(const unsigned char* data_, size_t pos_) {
+        uint32_t h = hash(data_+pos_);
+        m_chain[pos_ & m_chain_mask] = m_head[h];
+        m_head[h] = static_cast<uint32_t>(pos_+1);
+    }
+
+    /**
+      * Finds the longest match for pos_ in the window, and returns its length.
+      * Matches shorter than lz77_min_match are not reported.
+      */
+    inline size_t findMatch(const unsigned char* data_, size_t size_, size_t pos_, size_t& offset_) const {
+        size_t best_length = lz77_min_match-1;
+        uint32_t candidate = m_head[hash(data_+pos_)];
+        for (unsigned int i=0; i<m_search_depth && candidate != 0; ++i) {
+            size_t distance = static_cast<uint32_t>(static_cast<uint32_t>(pos_+1) - candidate);
+            if (distance == 0 || distance > m_window_size) {
+                break;
+            }
+            size_t match = pos_ - distance;
+            //The byte just past the best length must match for this to be longer
+            if (data_[match+best_length] == data_[pos_+best_length]) {
+                size_t length = matchLength(data_+match, data_+pos_, data_+size_);
+                if (length > best_length) {
+                    best_length = length;
+                    offset_ = pos_ - match;
+                    if (pos_ + length == size_) {
+                        break;
+                    }
+                }
+            }
+            candidate = m_chain[match & m_chain_mask];
+        }
+        return (best_length >= lz77_min_match) ? best_length : 0;
+    }
+
+private:
+    static const unsigned int max_hash_bits = 16;
+    static const size_t max_kept_chain_size = size_t(1) << 20;
+
+    inline uint32_t hash(const unsigned char* data_) const {
+        return (read32(data_) * 2654435761u) >> (32-m_hash_bits);
+    }
+
+    size_t m_window_size;
+    unsigned int m_search_depth;
+    unsigned int m_hash_bits;
+    size_t m_chain_mask;
+    std::vector<uint32_t> m_head;
+    std::vector<uint32_t> m_chain;
+};
+
+/**
+  * The match finder is kept per thread and reused between calls, so that
+  * compressing many small buffers does not allocate every time
+  */
+inline LZ77MatchFinder& matchFinder() {
+    static thread_local LZ77MatchFinder finder;
+    return finder;
+}
+
+/**
+  * Writes one sequence of literals followed by a match of length_ bytes at offset_.
+  * A length_ of zero writes the literals only.
+  */
+inline size_t writeSequence(const unsigned char* literals_, size_t num_literals_, size_t offset_, size_t length_, unsigned char* output_) {
+    size_t out = 0;
+    size_t length_code = (length_ > 0) ? length_ - lz77_min_match : 0;
+    unsigned char token = static_cast<unsigned char>(
+        (std::min<size_t>(num_literals_, lz77_nibble_max) << 4) | std::min<size_t>(length_code, lz77_nibble_max));
+    output_[out++] = token;
+    if (num_literals_ >= lz77_nibble_max) {
+        out += writeVarint(num_literals_ - lz77_nibble_max, output_+out);
+    }
+    memcpy(output_+out, literals_, num_literals_);
+    out += num_literals_;
+    if (length_ > 0) {
+        out += writeVarint(offset_-1, output_+out);
+        if (length_code >= lz77_nibble_max) {
+            out += writeVarint(length_code - lz77_nibble_max, output_+out);
+        }
+    }
+    return out;
+}
+
+/**
+  * Reads the rest of a nibble value from data_ if the nibble was saturated
+  */
+inline size_t readNibbleValue(size_t nibble_, const unsigned char* data_, size_t size_, size_t& offset_) {
+    if (nibble_ < lz77_nibble_max) {
+        return nibble_;
+    }
+    uint64_t value;
+    if (!readVarint(data_, size_, offset_, value) || value > std::numeric_limits<size_t>::max() - nibble_) {
+        throw std::runtime_error("LZ77: invalid length");
+    }
+    return nibble_ + static_cast<size_t>(value);
+}
+
+/**
+  * Copies length_ bytes from src_ to dst_ sixteen bytes at a time, which may
+  * write up to 15 bytes past dst_+length_. The ranges must not overlap within 16 bytes.
+  */
+inline void wildCopy16(unsigned char* dst_, const unsigned char* src_, size_t length_) {
+    unsigned char* end = dst_ + length_;
+    do {
+        memcpy(dst_, src_, 16);
+        dst_ += 16;
+        src_ += 16;
+    } while (dst_ < end);
+}
+
+/**
+  * Copies a match of length_ bytes starting offset_ bytes back from dst_. 
+  * The match may overlap itself, in which case it repeats the last offset_ bytes.
+  * The fast paths are used when there are lz77_wildcopy_slack bytes of room after the match.
+  */
+inline void copyMatch(unsigned char* dst_, size_t offset_, size_t length_, const unsigned char* end_) {
+    const unsigned char* src = dst_ - offset_;
+    if (dst_ + length_ + lz77_wildcopy_slack <= end_) {
+        if (offset_ >= 16) {
+            wildCopy16(dst_, src, length_);
+            return;
+        }
+        else if (length_ >= 8) {
+            //Copy the first eight bytes one by one. The output is now periodic
+            //with period offset_, so we may copy from any multiple of offset_ 
+            //back, and use one that is at least eight bytes
+            for (size_t i=0; i<8; ++i) {
+                dst_[i] = src[i];
+            }
+            size_t distance = offset_;
+            while (distance < 8) {
+                distance += offset_;
+            }
+            unsigned char* end = dst_ + length_;
+            dst_ += 8;
+            do {
+                memcpy(dst_, dst_-distance, 8);
+                dst_ += 8;
+            } while (dst_ < end);
+            return;
+        }
+    }
+    for (size_t i=0; i<length_; ++i) {
+        dst_[i] = src[i];
+    }
+}
+
+/**
+  * Compresses data_[start_, size_) into sequences, where the bytes before start_
+  * are a dictionary that matches may refer to, but which is not stored. With
+  * try_last_offset_ two offsets are tried before the hash chains: the one which
+  * lines the input up with the dictionary, and the offset of the previous match.
+  * This quickly finds the long matches against a similar dictionary that the 
+  * chains may be too deep, or the window too small, to reach.
+  */
+size_t compressSequences(const unsigned char* data_, size_t start_, size_t size_, unsigned char* output_, 
+        unsigned int window_bits_, unsigned int search_depth_, bool try_last_offset_) {
+    if (start_ == size_) {
+        return 0;
+    }
+
+    //Only the part of the dictionary inside the window is reachable through the chains
+    LZ77MatchFinder& finder = matchFinder();
+    finder.reset(size_, window_bits_, search_depth_);
+    size_t first_insert = (start_ > (size_t(1) << window_bits_)) ? start_ - (size_t(1) << window_bits_) : 0;
+    size_t last_insert = (size_ >= lz77_min_match) ? std::min(start_, size_ - lz77_min_match + 1) : 0;
+    for (size_t pos=first_insert; pos<last_insert; ++pos) {
+        finder.insert(data_, pos);
+    }
+
+    size_t out = 0;
+    size_t anchor = start_;
+    size_t pos = start_;
+    size_t last_offset = 0;
+
+    //Offset which lines the input up with the dictionary. Only long matches into
+    //the dictionary move it, so that it follows insertions and deletions, while
+    //local repeats in the input, which replace last_offset, do not.
+    size_t dictionary_offset = start_;
+    size_t dictionary_end = start_;
+    while (pos + lz77_min_match <= size_) {
+        size_t offset = 0;
+        size_t length = 0;
+        if (try_last_offset_ && dictionary_offset != 0) {
+            length = matchLength(data_+pos-dictionary_offset, data_+pos, data_+size_);
+            offset = dictionary_offset;
+        }
+        if (try_last_offset_ && length < lz77_min_match && pos - dictionary_end < lz77_resync_distance) {
+            const uint32_t current = read32(data_+pos);
+            for (size_t drift=1; drift<=lz77_max_drift; ++drift) {
+                size_t candidates[2] = { dictionary_offset + drift, dictionary_offset - drift };
+                for (size_t i=0; i<2; ++i) {
+                    size_t candidate = candidates[i];
+                    if (candidate == 0 || candidate > pos || read32(data_+pos-candidate) != current) {
+                        continue;
+                    }
+                    size_t candidate_length = matchLength(data_+pos-candidate, data_+pos, data_+size_);
+                    if (candidate_length > length) {
+                        length = candidate_length;
+                        offset = candidate;
+                    }
+                }
+            }
+        }
+        if (try_last_offset_ && last_offset != 0 && last_offset != offset && length < lz77_long_match) {
+            size_t last_length = matchLength(data_+pos-last_offset, data_+pos, data_+size_);
+            if (last_length > length) {
+                length = last_length;
+                offset = last_offset;
+            }
+        }
+        if (length < lz77_long_match) {
+            size_t chain_offset = 0;
+            size_t chain_length = finder.findMatch(data_, size_, pos, chain_offset);
+            if (chain_length > length) {
+                length = chain_length;
+                offset = chain_offset;
+            }
+        }
+        finder.insert(data_, pos);
+
+        //Only use matches which are shorter to store than the bytes they cover
+        if (length < lz77_min_match || length < varintSize(offset-1) + 2) {
+            pos += 1;
+            continue;
+        }
+
+        out += writeSequence(data_+anchor, pos-anchor, offset, length, output_+out);
+        last_offset = offset;
+        if (pos - offset < start_ && length >= lz77_min_alignment_match) {
+            dictionary_offset = offset;
+            dictionary_end = pos + length;
+        }
+
+        //Insert the positions covered by the match, so that later matches can refer to them
+        size_t end = pos + length;
+        size_t last_match_insert = std::min(end, size_ - lz77_min_match + 1);
+        for (pos = pos+1; pos < last_match_insert; ++pos) {
+            finder.insert(data_, pos);
+        }
+        pos = end;
+        anchor = end;
+    }
+
+    if (anchor < size_) {
+        out += writeSequence(data_+anchor, size_-anchor, 0, 0, output_+out);
+    }
+
+    finder.trim();
+    return out;
+}
+
+/**
+  * Decompresses sequences from data_[in_, size_) into output_, which has room for
+  * exactly num_bytes_ bytes. Matches may reach past the start of output_ into the
+  * last reference_size_ bytes of reference_. Lengths and offsets are validated, 
+  * so that malformed input results in an exception rather than undefined behaviour.
+  */
+void decompressSequences(const unsigned char* input_, size_t size_, size_t in_, 
+        const unsigned char* reference_, size_t reference_size_, unsigned char* output_, size_t num_bytes_) {
+    size_t in = in_;
+    unsigned char* out = output_;
+    unsigned char* out_end = output_ + num_bytes_;
+    while (out < out_end) {
+        if (in == size_) {
+            throw std::runtime_error("LZ77: data shorter than stored length");
+        }
+        unsigned char token = input_[in++];
+
+        //Literals
+        size_t num_literals = readNibbleValue(token >> 4, input_, size_, in);
+        if (num_literals > size_-in || num_literals > static_cast<size_t>(out_end-out)) {
+            throw std::runtime_error("LZ77: literals exceed data");
+        }
+        if (in + num_literals + lz77_wildcopy_slack <= size_ && out + num_literals + lz77_wildcopy_slack <= out_end) {
+            wildCopy16(out, input_+in, num_literals);
+        }
+        else {
+            memcpy(out, input_+in, num_literals);
+        }
+        in += num_literals;
+        out += num_literals;
+
+        //The last sequence has no match
+        if (out == out_end) {
+            break;
+        }
+
+        //Match
+        uint64_t offset;
+        size_t produced = out-output_;
+        if (!readVarint(input_, size_, in, offset) || offset >= static_cast<uint64_t>(produced) + reference_size_) {
+            throw std::runtime_error("LZ77: invalid match offset");
+        }
+        size_t length = readNibbleValue(token & 0x0F, input_, size_, in);
+        size_t remaining = out_end-out;
+        if (remaining < lz77_min_match || length > remaining - lz77_min_match) {
+            throw std::runtime_error("LZ77: data exceeds stored length");
+        }
+        length += lz77_min_match;
+
+        //The part of a match that lies in the reference is copied from there, 
+        //and the rest continues from the start of the output
+        size_t match_offset = static_cast<size_t>(offset)+1;
+        if (match_offset > produced) {
+            size_t num_reference_bytes = std::min(length, match_offset - produced);
+            memcpy(out, reference_ + reference_size_ - (match_offset - produced), num_reference_bytes);
+            out += num_reference_bytes;
+            length -= num_reference_bytes;
+            if (length == 0) {
+                continue;
+            }
+        }
+        copyMatch(out, match_offset, length, out_end);
+        out += length;
+    }
+}
+
+} // Namespace
+
+/**
+  * Every sequence with a match takes up less space than the bytes it covers 
+  * plus one eighth, and so do the literals. The last sequence and header add 
+  * a token and a variable length integer.
+  */
+size_t lz77_compress_bound(size_t size_) {
+    return 16 + size_ + size_/8;
+}
+
+/**
+  * Function which compresses a character stream using LZ77 with greedy parsing
+  */
+size_t lz77_compress(const unsigned char* input_, size_t size_, unsigned char* output_, unsigned int window_bits_, unsigned int search_depth_) {
+    if (window_bits_ < lz77_min_window_bits || window_bits_ > lz77_max_window_bits) {
+        throw std::invalid_argument("LZ77: window bits must be between 10 and 24");
+    }
+
+    //Write out number of uncompressed bytes so the decoder can allocate its output
+    size_t out = writeVarint(size_, output_);
+    return out + compressSequences(input_, 0, size_, output_+out, window_bits_, search_depth_, false);
+}
+
+void lz77_compress(const unsigned char* input_, size_t size_, std::vector<unsigned char>& output_, unsigned int window_bits_, unsigned int search_depth_) {
+    size_t offset = output_.size();
+    output_.resize(offset + lz77_compress_bound(size_));
+    output_.resize(offset + lz77_compress(input_, size_, output_.data()+offset, window_bits_, search_depth_));
+}
+
+std::vector<unsigned char> lz77_compress(const std::vector<unsigned char>& input_, unsigned int window_bits_, unsigned int search_depth_) {
+    std::vector<unsigned char> output;
+    lz77_compress(input_.data(), input_.size(), output, window_bits_, search_depth_);
+    return output;
+}
+
+/**
+  * Function which returns the number of bytes an LZ77 encoded buffer decompresses to
+  */
+size_t lz77_decompressed_size(const unsigned char* input_, size_t size_) {
+    size_t offset = 0;
+    uint64_t num_bytes;
+    if (!readVarint(input_, size_, offset, num_bytes)) {
+        throw std::runtime_error("LZ77: invalid header");
+    }
+    if (num_bytes > std::numeric_limits<size_t>::max()) {
+        throw std::length_error("LZ77: stored length does not fit in memory");
+    }
+    return static_cast<size_t>(num_bytes);
+}
+
+/**
+  * Function which decompresses a character stream using LZ77
+  */
+size_t lz77_decompress(const unsigned char* input_, size_t size_, unsigned char* output_, size_t capacity_) {
+    size_t in = 0;
+    size_t num_bytes = lz77_decompressed_size(input_, size_);
+    uint64_t dummy;
+    readVarint(input_, size_, in, dummy);
+    if (num_bytes > capacity_) {
+        throw std::length_error("LZ77: output buffer too small");
+    }
+
+    decompressSequences(input_, size_, in, NULL, 0, output_, num_bytes);
+    return num_bytes;
+}
+
+void lz77_decompress(const unsigned char* input_, size_t size_, std::vector<unsigned char>& output_) {
+    size_t offset = output_.size();
+    size_t num_bytes = lz77_decompressed_size(input_, size_);
+    output_.resize(offset + num_bytes);
+    lz77_decompress(input_, size_, output_.data()+offset, num_bytes);
+}
+
+std::vector<unsigned char> lz77_decompress(const std::vector<unsigned char>& input_) {
+    std::vector<unsigned char> output;
+    lz77_decompress(input_.data(), input_.size(), output);
+    return output;
+}
+
+
+
+
+/**
+  * The delta header adds the size and the fingerprint of the reference to the LZ77 header
+  */
+size_t lz77_delta_compress_bound(size_t size_) {
+    return lz77_compress_bound(size_) + 10 + 8;
+}
+
+/**
+  * Function which compresses a character stream with LZ77, using reference_ as
+  * a dictionary. The reference is placed in front of the input, and the window 
+  * covers both up to the largest window, so that the input may be encoded as 
+  * copies from anywhere in it. A fingerprint of the reference is stored, so 
+  * that decompressing with a different reference fails.
+  */
+size_t lz77_delta_compress(const unsigned char* reference_, size_t reference_size_, 
+        const unsigned char* input_, size_t size_, unsigned char* output_, unsigned int search_depth_) {
+    size_t out = writeVarint(size_, output_);
+    out += writeVarint(reference_size_, output_+out);
+    uint64_t fingerprint = dedup_fingerprint(reference_, reference_size_);
+    for (size_t i=0; i<8; ++i) {
+        output_[out++] = static_cast<unsigned char>(fingerprint >> (8*i));
+    }
+    if (size_ == 0) {
+        return out;
+    }
+
+    size_t total_size = reference_size_ + size_;
+    unsigned int window_bits = lz77_min_window_bits;
+    while (window_bits < lz77_max_window_bits && (size_t(1) << window_bits) < total_size) {
+        window_bits += 1;
+    }
+
+    //The match finder works on one contiguous buffer
+    std::vector<unsigned char> window(total_size);
+    if (reference_size_ > 0) {
+        memcpy(window.data(), reference_, reference_size_);
+    }
+    memcpy(window.data()+reference_size_, input_, size_);
+
+    out += compressSequences(window.data(), reference_size_, total_size, output_+out, window_bits, search_depth_, true);
+    return out;
+}
+
+void lz77_delta_compress(const std::vector<unsigned char>& reference_, const unsigned char* input_, size_t size_, 
+        std::vector<unsigned char>& output_, unsigned int search_depth_) {
+    size_t offset = output_.size();
+    output_.resize(offset + lz77_delta_compress_bound(size_));
+    output_.resize(offset + lz77_delta_compress(reference_.data(), reference_.size(), input_, size_, output_.data()+offset, search_depth_));
+}
+
+std::vector<unsigned char> lz77_delta_compress(const std::vector<unsigned char>& reference_, 
+        const std::vector<unsigned char>& input_, unsigned int search_depth_) {
+    std::vector<unsigned char> output;
+    lz77_delta_compress(reference_, input_.data(), input_.size(), output, search_depth_);
+    return output;
+}
+
+/**
+  * Function which decompresses a character stream compressed with 
+  * lz77_delta_compress, given the same reference
+  */
+size_t lz77_delta_decompress(const unsigned char* reference_, size_t reference_size_, 
+        const unsigned char* input_, size_t size_, unsigned char* output_, size_t capacity_) {
+    size_t in = 0;
+    size_t num_bytes = lz77_decompressed_size(input_, size_);
+    uint64_t dummy;
+    readVarint(input_, size_, in, dummy);
+    uint64_t stored_reference_size;
+    if (!readVarint(input_, size_, in, stored_reference_size)) {
+        throw std::runtime_error("LZ77: invalid header");
+    }
+    if (stored_reference_size != reference_size_) {
+        throw std::invalid_argument("LZ77: data was compressed against a reference of a different size");
+    }
+    if (in+8 > size_) {
+        throw std::runtime_error("LZ77: invalid header");
+    }
+    uint64_t stored_fingerprint = 0;
+    for (size_t i=0; i<8; ++i) {
+        stored_fingerprint |= static_cast<uint64_t>(input_[in++]) << (8*i);
+    }
+    if (stored_fingerprint != dedup_fingerprint(reference_, reference_size_)) {
+        throw std::invalid_argument("LZ77: data was compressed against a different reference");
+    }
+    if (num_bytes > capacity_) {
+        throw std::length_error("LZ77: output buffer too small");
+    }
+
+    decompressSequences(input_, size_, in, reference_, reference_size_, output_, num_bytes);
+    return num_bytes;
+}
+
+void lz77_delta_decompress(const std::vector<unsigned char>& reference_, const unsigned char* input_, size_t size_, 
+        std::vector<unsigned char>& output_) {
+    size_t offset = output_.size();
+    size_t num_bytes = lz77_decompressed_size(input_, size_);
+    output_.resize(offset + num_bytes);
+    lz77_delta_decompress(reference_.data(), reference_.size(), input_, size_, output_.data()+offset, num_bytes);
+}
+
+std::vector<unsigned char> lz77_delta_decompress(const std::vector<unsigned char>& reference_, 
+        const std::vector<unsigned char>& input_) {
+    std::vector<unsigned char> output;
+    lz77_delta_decompress(reference_, input_.data(), input_.size(), output);
+    return output;
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+/**
+  * LZ77 (LZSS) compression. The window is 1<<window_bits_ bytes, and 
+  * search_depth_ is the number of earlier positions the match finder tries
+  * for every position. Larger values give better compression, but slower 
+  * compression. Decompression speed does not depend on either.
+  */
+const unsigned int lz77_default_window_bits = 16;
+const unsigned int lz77_default_search_depth = 32;
+
+std::vector<unsigned char> lz77_compress(const std::vector<unsigned char>& data_, 
+        unsigned int window_bits_=lz77_default_window_bits, unsigned int search_depth_=lz77_default_search_depth);
+std::vector<unsigned char> lz77_decompress(const std::vector<unsigned char>& data_);
+
+/**
+  * Versions which read size_ bytes from data_, and append the result to the end of output_
+  */
+void lz77_compress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_, 
+        unsigned int window_bits_=lz77_default_window_bits, unsigned int search_depth_=lz77_default_search_depth);
+void lz77_decompress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_);
+
+/**
+  * Versions which work on caller owned memory. lz77_compress requires room for
+  * lz77_compress_bound(size_) bytes in output_, and lz77_decompress requires room for
+  * lz77_decompressed_size(data_, size_) bytes. Both return the number of bytes written.
+  */
+size_t lz77_compress_bound(size_t size_);
+size_t lz77_compress(const unsigned char* data_, size_t size_, unsigned char* output_, 
+        unsigned int window_bits_=lz77_default_window_bits, unsigned int search_depth_=lz77_default_search_depth);
+size_t lz77_decompressed_size(const unsigned char* data_, size_t size_);
+size_t lz77_decompress(const unsigned char* data_, size_t size_, unsigned char* output_, size_t capacity_);
+
+/**
+  * Delta compression, where reference_ (e.g. the previous version of the data)
+  * is used as a dictionary. Matches may refer to any part of the reference, so 
+  * data that is similar to it compresses to little more than the differences. 
+  * Decompression requires the same reference, which is checked against a 
+  * fingerprint stored with the data. Compression copies the reference and data,
+  * and keeps hash chains for at most the last 16 Mi positions before the data,
+  * which take at most 64 MiB while compressing. Further back, matches are only
+  * found where the data lines up with the reference. lz77_decompressed_size 
+  * also works on delta compressed data.
+  */
+std::vector<unsigned char> lz77_delta_compress(const std::vector<unsigned char>& reference_, 
+        const std::vector<unsigned char>& data_, unsigned int search_depth_=lz77_default_search_depth);
+std::vector<unsigned char> lz77_delta_decompress(const std::vector<unsigned char>& reference_, 
+        const std::vector<unsigned char>& data_);
+
+void lz77_delta_compress(const std::vector<unsigned char>& reference_, const unsigned char* data_, size_t size_, 
+        std::vector<unsigned char>& output_, unsigned int search_depth_=lz77_default_search_depth);
+void lz77_delta_decompress(const std::vector<unsigned char>& reference_, const unsigned char* data_, size_t size_, 
+        std::vector<unsigned char>& output_);
+
+size_t lz77_delta_compress_bound(size_t size_);
+size_t lz77_delta_compress(const unsigned char* reference_, size_t reference_size_, 
+        const unsigned char* data_, size_t size_, unsigned char* output_, unsigned int search_depth_=lz77_default_search_depth);
+size_t lz77_delta_decompress(const unsigned char* reference_, size_t reference_size_, 
+        const unsigned char* data_, size_t size_, unsigned char* output_, size_t capacity_);
\ No newline at end of file
@@ -19,280 +19,2047 @@
   ***/
 
 #include "LZW.h"
+#include "Varint.h"
+#include "Benchmark.h"
 
-#include <utility>
-#include <map>
 #include <cstdint>
 #include <cassert>
 #include <algorithm>
+#include <stdexcept>
+#include <limits>
+#include <cstring>
+#include <memory>
 
 namespace { //Avoid contaminating global namespace
 
 /**
-  * An LZW code is 12 bits in our code
+  * An LZW code is between 9 and 16 bits in our code, and is chosen per stream.
+  * All kernels are templates on the code width, and the stream is dispatched 
+  * once to the right specialization.
   */
 typedef uint16_t lzw_code;
 
-inline bool operator<(const std::vector<unsigned char>& lhs, const std::vector<unsigned char>& rhs) {
-    return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+const unsigned int lzw_min_code_bits = 9;
+const unsigned int lzw_max_code_bits = 16;
+
+/**
+  * The header byte holding the code width has this bit set for LZAP streams
+  */
+const unsigned char lzw_lzap_flag = 0x80;
+
+/**
+  * Streams start with a magic and a format version. In version 1 a full
+  * dictionary is reset without adding the string that filled it, the length
+  * is a varint, and codes are code_bits_ wide. The original headerless 12-bit
+  * streams never start with the magic, as their first code is a character, 
+  * which leaves the low nibble of the second byte zero.
+  */
+const unsigned char lzw_magic[2] = { 'L', 'Z' };
+const unsigned char lzw_format_version = 1;
+
+/**
+  * Number of codes that fit in code_bits_ bits
+  */
+constexpr uint32_t lzwMaxCodes(unsigned int code_bits_) {
+    return uint32_t(1) << code_bits_;
+}
+
+constexpr uint64_t lzwCodeMask(unsigned int code_bits_) {
+    return (uint64_t(1) << code_bits_) - 1;
 }
 
 /**
   * An LZW dictionary in which "strings" are the keys, and 
-  * lzw_codes are the values.
+  * lzw_codes are the values. Every string is a string already in the
+  * dictionary extended by one character, so we store it as a hash table
+  * from (prefix code, character) to code. The 256 single characters are
+  * implicit. Each slot is tagged with a generation, which makes resetting
+  * the dictionary a constant time operation.
   */
+template <unsigned int code_bits_>
 class LZWCompressingDictionary {
 public:
-    LZWCompressingDictionary() : m_next_code(0) {
-        init();
-    }
+    LZWCompressingDictionary() : m_next_code(256), m_generation(1), m_slots(num_slots) {}
 
-    inline void init() {
-        //Initialize dictionary with first 256 values
-        for (unsigned int i=0; i<256; ++i) {
-            std::vector<unsigned char> key(1, i);
-            addStringToDict(key);
+    /**
+      * Empties the dictionary so that it only contains the single characters
+      */
+    inline void reset() {
+        m_next_code = 256;
+        m_generation += 1;
+        if (m_generation == 0) {
+            std::fill(m_slots.begin(), m_slots.end(), Slot());
+            m_generation = 1;
         }
     }
 
     /**
-      * Adds w_ to the dictionary using the next unused symbol
+      * Adds prefix_+c_ to the dictionary using the next unused code.
+      * If all codes are used, the dictionary is reset instead, as in
+      * format version 1.
       */
-    inline void addStringToDict(const std::vector<unsigned char>& w_) {
-        //Reset dictionary if over-reaching 12 bits
-        if (m_next_code == 4096) {
-            m_dict.clear();
-            m_next_code = 0;
-            init();
-        }
-        lzw_code value = m_next_code;
-        std::pair<std::vector<unsigned char>, lzw_code> entry(w_, value);
-        m_dict.insert(entry);
+    inline void addString(lzw_code prefix_, unsigned char c_) {
+        if (m_next_code == lzwMaxCodes(code_bits_)) {
+            reset();
+            return;
+        }
+        uint32_t key = makeKey(prefix_, c_);
+        size_t i = slotIndex(key);
+        while (m_slots[i].m_generation == m_generation) {
+            i = (i+1) & (num_slots-1);
+        }
+        m_slots[i].m_generation = m_generation;
+        m_slots[i].m_key = key;
+        m_slots[i].m_code = static_cast<lzw_code>(m_next_code);
         m_next_code += 1;
     }
 
-    inline bool hasString(const std::vector<unsigned char>& s) {
-        return (m_dict.count(s) == 1);
+    /**
+      * Looks up the code of prefix_+c_. Returns false if it is not in the dictionary
+      */
+    inline bool findString(lzw_code prefix_, unsigned char c_, lzw_code& code_) const {
+        uint32_t key = makeKey(prefix_, c_);
+        size_t i = slotIndex(key);
+        while (m_slots[i].m_generation == m_generation) {
+            if (m_slots[i].m_key == key) {
+                code_ = m_slots[i].m_code;
+                return true;
+            }
+            i = (i+1) & (num_slots-1);
+        }
+        return false;
+    }
+
+    inline bool full() const {
+        return m_next_code == lzwMaxCodes(code_bits_);
     }
 
-    inline lzw_code getCode(const std::vector<unsigned char>& s) {
-        assert(hasString(s));
-        return m_dict[s];
+    /**
+      * Looks up the code of prefix_+c_, and adds it using the next unused code
+      * if it is not in the dictionary. Returns false if it had to be added, 
+      * but all codes are used.
+      */
+    inline bool findOrAddString(lzw_code prefix_, unsigned char c_, lzw_code& code_) {
+        uint32_t key = makeKey(prefix_, c_);
+        size_t i = slotIndex(key);
+        while (m_slots[i].m_generation == m_generation) {
+            if (m_slots[i].m_key == key) {
+                code_ = m_slots[i].m_code;
+                return true;
+            }
+            i = (i+1) & (num_slots-1);
+        }
+        if (m_next_code == lzwMaxCodes(code_bits_)) {
+            return false;
+        }
+        m_slots[i].m_generation = m_generation;
+        m_slots[i].m_key = key;
+        m_slots[i].m_code = static_cast<lzw_code>(m_next_code);
+        code_ = static_cast<lzw_code>(m_next_code);
+        m_next_code += 1;
+        return true;
     }
 
 private:
-    lzw_code m_next_code;
-    std::map<std::vector<unsigned char>, lzw_code> m_dict;
+    static const size_t num_slots = 2*lzwMaxCodes(code_bits_);
+
+    struct Slot {
+        Slot() : m_generation(0), m_key(0), m_code(0) {}
+        uint32_t m_generation;
+        uint32_t m_key;
+        lzw_code m_code;
+    };
+
+    static inline uint32_t makeKey(lzw_code prefix_, unsigned char c_) {
+        return (static_cast<uint32_t>(prefix_) << 8) | c_;
+    }
+
+    static inline size_t slotIndex(uint32_t key_) {
+        return (key_ * 2654435761u) >> (32-(code_bits_+1));
+    }
+
+    uint32_t m_next_code;
+    uint32_t m_generation;
+    std::vector<Slot> m_slots;
 };
 
 
 /**
   * An LZW dictionary in which lzw_codes are the keys, and 
-  * strings are the values.
+  * strings are the values. Each string is stored as its prefix code and 
+  * last character, together with its first character and length, so
+  * that it can be written out back to front without any allocations.
   */
+template <unsigned int code_bits_>
 class LZWDecompressingDictionary {
 public:
-    LZWDecompressingDictionary() : m_next_code(0) {
-        init();
-    }
-
-    inline void init() {
+    LZWDecompressingDictionary() : m_next_code(256) {
         //Initialize dictionary with first 256 values
         for (unsigned int i=0; i<256; ++i) {
-            std::vector<unsigned char> key(1, i);
-            addStringToDict(key);
+            m_prefix[i] = 0;
+            m_last[i] = static_cast<unsigned char>(i);
+            m_first[i] = static_cast<unsigned char>(i);
+            m_length[i] = 1;
         }
     }
+
+    /**
+      * Empties the dictionary so that it only contains the single characters
+      */
+    inline void reset() {
+        m_next_code = 256;
+    }
     
     /**
-      * Adds w_ to the dictionary using the next unused symbol
+      * Adds prefix_+c_ to the dictionary using the next unused code.
+      * If all codes are used, the dictionary is reset instead, as in
+      * format version 1.
       */
-    inline void addStringToDict(const std::vector<unsigned char>& w_) {
-        //Reset dictionary if over-reaching 12 bits
-        if (m_next_code == 4096) {
-            m_dict.clear();
-            m_next_code = 0;
-            init();
-        }
-        lzw_code value = m_next_code;
-        std::pair<lzw_code, std::vector<unsigned char> > entry(value, w_);
-        m_dict.insert(entry);
+    inline void addString(lzw_code prefix_, unsigned char c_) {
+        if (m_next_code == lzwMaxCodes(code_bits_)) {
+            reset();
+            return;
+        }
+        m_prefix[m_next_code] = prefix_;
+        m_last[m_next_code] = c_;
+        m_first[m_next_code] = m_first[prefix_];
+        m_length[m_next_code] = m_length[prefix_] + 1;
         m_next_code += 1;
     }
 
-    inline bool hasCode(const lzw_code& c) {
-        if (m_next_code == 4096 && c == 256) {
-            return false;
-        }
-        return (m_dict.count(c) == 1);
+    inline bool hasCode(const lzw_code& c_) const {
+        return c_ < m_next_code;
+    }
+
+    /**
+      * Returns true if c_ is the code the next string will be added as
+      */
+    inline bool isNextCode(const lzw_code& c_) const {
+        return c_ == m_next_code;
     }
 
-    inline const std::vector<unsigned char>& getString(const lzw_code& c) {
-        assert(hasCode(c));
-        return m_dict[c];
+    inline unsigned char firstChar(const lzw_code& c_) const {
+        assert(hasCode(c_));
+        return m_first[c_];
+    }
+
+    inline size_t length(const lzw_code& c_) const {
+        assert(hasCode(c_));
+        return m_length[c_];
+    }
+
+    /**
+      * Writes the string of c_ to out_, which must have room for length(c_) characters
+      */
+    inline void writeString(lzw_code c_, unsigned char* out_) const {
+        assert(hasCode(c_));
+        for (size_t i=m_length[c_]; i>0; --i) {
+            out_[i-1] = m_last[c_];
+            c_ = m_prefix[c_];
+        }
     }
 
 private:
-    lzw_code m_next_code;
-    std::map<lzw_code, std::vector<unsigned char>> m_dict;
+    uint32_t m_next_code;
+    lzw_code m_prefix[lzwMaxCodes(code_bits_)];
+    unsigned char m_last[lzwMaxCodes(code_bits_)];
+    unsigned char m_first[lzwMaxCodes(code_bits_)];
+    uint16_t m_length[lzwMaxCodes(code_bits_)];
 };
 
 /**
-  * An output class which concatenates lzw_codes into the
-  * same vector of chars
+  * The dictionaries are kept per thread and reused between calls, so that
+  * compressing many small buffers does not pay for setting them up every time.
+  * The decompressing dictionary is up to 384 KiB, so it lives on the heap
+  * rather than in thread local storage.
+  */
+template <unsigned int code_bits_>
+inline LZWCompressingDictionary<code_bits_>& compressingDictionary() {
+    static thread_local LZWCompressingDictionary<code_bits_> dict;
+    dict.reset();
+    return dict;
+}
+
+template <unsigned int code_bits_>
+inline LZWDecompressingDictionary<code_bits_>& decompressingDictionary() {
+    static thread_local std::unique_ptr<LZWDecompressingDictionary<code_bits_> > dict(new LZWDecompressingDictionary<code_bits_>());
+    dict->reset();
+    return *dict;
+}
+
+/**
+  * Reads a header value, which is a variable length integer
+  */
+inline uint64_t readLength(const unsigned char* data_, size_t size_, size_t& offset_) {
+    uint64_t value;
+    if (!readVarint(data_, size_, offset_, value)) {
+        throw std::runtime_error("LZW: invalid header");
+    }
+    return value;
+}
+
+/**
+  * Codes are packed least significant bit first in groups of eight, which 
+  * take up exactly code_bits_ bytes. Within a group, code j starts at bit
+  * j*code_bits_, so for a fixed code width every shift is a compile time 
+  * constant, and the loops over a group are fully unrolled without branches.
+  */
+const unsigned int lzw_group_size = 8;
+
+template <unsigned int code_bits_>
+inline void packGroup(const lzw_code* codes_, unsigned char* output_) {
+    uint64_t low = 0;
+    uint64_t high = 0;
+    for (unsigned int j=0; j<lzw_group_size; ++j) {
+        const unsigned int bit = j*code_bits_;
+        uint64_t code = codes_[j];
+        if (bit + code_bits_ <= 64) {
+            low |= code << bit;
+        }
+        else if (bit >= 64) {
+            high |= code << (bit-64);
+        }
+        else {
+            low |= code << bit;
+            high |= code >> (64-bit);
+        }
+    }
+    memcpy(output_, &low, 8);
+    memcpy(output_+8, &high, code_bits_-8);
+}
+
+template <unsigned int code_bits_>
+inline void unpackGroup(const unsigned char* input_, lzw_code* codes_) {
+    uint64_t low;
+    uint64_t high = 0;
+    memcpy(&low, input_, 8);
+    memcpy(&high, input_+8, code_bits_-8);
+    for (unsigned int j=0; j<lzw_group_size; ++j) {
+        const unsigned int bit = j*code_bits_;
+        uint64_t code;
+        if (bit + code_bits_ <= 64) {
+            code = low >> bit;
+        }
+        else if (bit >= 64) {
+            code = high >> (bit-64);
+        }
+        else {
+            code = (low >> bit) | (high << (64-bit));
+        }
+        codes_[j] = static_cast<lzw_code>(code & lzwCodeMask(code_bits_));
+    }
+}
+
+/**
+  * An output class which packs lzw_codes of code_bits_ bits into
+  * a buffer of chars
   */
+template <unsigned int code_bits_>
 class LZWOutput {
 public:
-    LZWOutput() : m_num_elements_written(0) {}
+    LZWOutput(unsigned char* data_) : m_num_buffered(0), m_size(0), m_data(data_) {}
     
     /**
       * Adds the code to the output character buffer
       */
     inline void appendCode(lzw_code c) {
-        if (m_num_elements_written % 2 == 0) {
-            unsigned char low = c & 0x00FF; //First 8 bits
-            unsigned char high = (c >> 8) & 0x000F; //Last 4 bits
-            m_data.emplace_back(low);
-            m_data.emplace_back(high);
-        }
-        else {
-            unsigned char low = (c & 0x000F) << 4; //First 4 bits
-            unsigned char high = (c >> 4) & 0x00FF; //Last 8 bits
-            m_data.back() ^= low; //"Merge" with existing nibble
-            m_data.emplace_back(high);
+        m_buffer[m_num_buffered++] = c;
+        if (m_num_buffered == lzw_group_size) {
+            packGroup<code_bits_>(m_buffer, m_data + m_size);
+            m_size += code_bits_;
+            m_num_buffered = 0;
         }
-        m_num_elements_written += 1;
     }
 
-    inline std::vector<unsigned char> getData() {
-        return m_data;
+    /**
+      * Writes the last partial group, and returns the number of bytes written
+      */
+    inline size_t finish() {
+        if (m_num_buffered > 0) {
+            std::fill(m_buffer + m_num_buffered, m_buffer + lzw_group_size, lzw_code(0));
+            unsigned char group[code_bits_];
+            packGroup<code_bits_>(m_buffer, group);
+            size_t num_bytes = (m_num_buffered*code_bits_ + 7) / 8;
+            memcpy(m_data + m_size, group, num_bytes);
+            m_size += num_bytes;
+            m_num_buffered = 0;
+        }
+        return m_size;
     }
 
 private:
-    size_t m_num_elements_written;
-    std::vector<unsigned char> m_data;
+    lzw_code m_buffer[lzw_group_size];
+    unsigned int m_num_buffered;
+    size_t m_size;
+    unsigned char* m_data;
 };
 
 /**
-  * LZW input stream which reads lzw_codes from a vector of
+  * LZW input stream which reads lzw_codes of code_bits_ bits from a buffer of
   * chars
   */
+template <unsigned int code_bits_>
 class LZWInput {
 public:
-    LZWInput(const std::vector<unsigned char>& data_) : m_num_elements_read(0), m_data(data_), m_even(true) {}
+    LZWInput(const unsigned char* data_, size_t size_) : m_data(data_), m_size(size_), m_offset(0), m_num_buffered(0), m_next(0) {}
 
     /**
       * Reads the next code from the character buffer
       */
     inline lzw_code readCode() {
-        if (m_even) {
-            lzw_code low = m_data[m_num_elements_read++];
-            lzw_code high = m_data[m_num_elements_read];
+        if (m_next == m_num_buffered) {
+            readGroup();
+        }
+        return m_buffer[m_next++];
+    }
+
+private:
+    /**
+      * Unpacks the next group of codes. The last group may be partial, and 
+      * a truncated stream must not make us read past the end
+      */
+    inline void readGroup() {
+        size_t remaining = m_size - m_offset;
+        if (remaining >= code_bits_) {
+            unpackGroup<code_bits_>(m_data + m_offset, m_buffer);
+            m_offset += code_bits_;
+            m_num_buffered = lzw_group_size;
+        }
+        else {
+            unsigned char group[code_bits_] = { 0 };
+            std::copy(m_data + m_offset, m_data + m_size, group);
+            unpackGroup<code_bits_>(group, m_buffer);
+            m_offset = m_size;
+            m_num_buffered = static_cast<unsigned int>((remaining*8) / code_bits_);
+        }
+        m_next = 0;
+        if (m_num_buffered == 0) {
+            throw std::runtime_error("LZW: truncated code stream");
+        }
+    }
 
-            high = (high & 0x000F) << 8;
+    const unsigned char* m_data;
+    size_t m_size;
+    size_t m_offset;
+    lzw_code m_buffer[lzw_group_size];
+    unsigned int m_num_buffered;
+    unsigned int m_next;
+};
+
+/**
+  * Function which compresses a character stream using LZW with codes of code_bits_ bits,
+  * and passes the codes to output_
+  */
+template <unsigned int code_bits_, class Output>
+size_t lzwCompress(const unsigned char* input_, size_t size_, Output& output_) {
+    LZWCompressingDictionary<code_bits_>& dict = compressingDictionary<code_bits_>();
 
-            m_even = false;
+    lzw_code w = input_[0];
+    for (size_t i=1; i<size_; ++i) {
+        //Read character from stream
+        unsigned char k = input_[i];
 
-            return low ^ high;
+        //If wk is in the dictionary, continue reading
+        lzw_code wk;
+        if (dict.findString(w, k, wk)) {
+            w = wk;
         }
+        //Else, output code, and add wk to dictionary
         else {
-            lzw_code low = m_data[m_num_elements_read++];
-            lzw_code high = m_data[m_num_elements_read++];
+            output_.appendCode(w);
+            dict.addString(w, k);
+            w = k;
+        }
+    }
+    output_.appendCode(w);
+
+    return output_.finish();
+}
+
+/**
+  * Function which decompresses num_bytes_ characters using LZW with codes of code_bits_ bits.
+  * The codes are read from input_, and every code is validated against the dictionary, 
+  * so that malformed input results in an exception rather than undefined behaviour.
+  */
+template <unsigned int code_bits_, class Input>
+void lzwDecompress(Input& input_, unsigned char* output_, size_t num_bytes_) {
+    LZWDecompressingDictionary<code_bits_>& dict = decompressingDictionary<code_bits_>();
 
-            low = (low >> 4) & 0x000F;
-            high = (high & 0x00FF) << 4;
+    lzw_code code = input_.readCode();
+    if (code >= 256) {
+        throw std::runtime_error("LZW: invalid first code");
+    }
+    size_t num_decoded = 0;
+    output_[num_decoded++] = static_cast<unsigned char>(code);
 
-            m_even = true;
+    while (num_decoded < num_bytes_) {
+        lzw_code next_code = input_.readCode();
 
-            return low ^ high;
+        //If next_code is in the dictionary, write it out, and add the
+        //previous string extended by its first character
+        if (dict.hasCode(next_code)) {
+            if (dict.length(next_code) > num_bytes_-num_decoded) {
+                throw std::runtime_error("LZW: data exceeds stored length");
+            }
+            dict.writeString(next_code, output_+num_decoded);
+            num_decoded += dict.length(next_code);
+            dict.addString(code, dict.firstChar(next_code));
+        }
+        //Otherwise, next_code is the previous string extended by its own first character
+        else if (dict.isNextCode(next_code)) {
+            dict.addString(code, dict.firstChar(code));
+            if (dict.length(next_code) > num_bytes_-num_decoded) {
+                throw std::runtime_error("LZW: data exceeds stored length");
+            }
+            dict.writeString(next_code, output_+num_decoded);
+            num_decoded += dict.length(next_code);
+        }
+        else {
+            throw std::runtime_error("LZW: invalid code");
         }
+
+        code = next_code;
     }
+}
 
-    bool hasMoreData() {
-        if (m_even) {
-            return m_num_elements_read < m_data.size();
+/**
+  * LZAP adds the previous string extended by every prefix of the current 
+  * string, where LZW only adds it extended by the first character. Long
+  * repeats are then learned in a few steps rather than one character at a 
+  * time. Every added string extends a string already in the dictionary, 
+  * so the same dictionaries are used. Strings already in the dictionary
+  * are not added twice, and nothing is added once the dictionary is full.
+  */
+template <unsigned int code_bits_>
+inline void addLZAPStrings(LZWCompressingDictionary<code_bits_>& dict_, lzw_code previous_, const unsigned char* string_, size_t length_) {
+    lzw_code code = previous_;
+    for (size_t i=0; i<length_; ++i) {
+        if (!dict_.findOrAddString(code, string_[i], code)) {
+            break;
         }
-        else {
-            return m_num_elements_read < m_data.size()-1;
+    }
+}
+
+/**
+  * LZAP fills the dictionary many times faster than LZW, so resetting it
+  * as soon as it is full throws away too much. Instead it is kept while 
+  * it compresses well. The number of characters covered by each window of 
+  * lzap_window_codes codes is measured, and the dictionary is reset when 
+  * a window covers less than 90% of the best window since it became full.
+  * Encoder and decoder both know the codes and their lengths, so they 
+  * reset at the same code.
+  */
+const uint32_t lzap_window_codes = 1024;
+
+class LZAPResetPolicy {
+public:
+    LZAPResetPolicy() : m_num_codes(0), m_num_bytes(0), m_best_num_bytes(0) {}
+
+    /**
+      * Counts a code of length_ characters emitted with a full dictionary.
+      * Returns true if the dictionary should be reset.
+      */
+    inline bool update(size_t length_) {
+        m_num_bytes += length_;
+        if (++m_num_codes < lzap_window_codes) {
+            return false;
         }
+        bool reset = (m_num_bytes*10 < m_best_num_bytes*9);
+        m_best_num_bytes = reset ? 0 : std::max(m_best_num_bytes, m_num_bytes);
+        m_num_codes = 0;
+        m_num_bytes = 0;
+        return reset;
     }
 
 private:
-    size_t m_num_elements_read;
-    const std::vector<unsigned char>& m_data;
-    bool m_even;
+    uint32_t m_num_codes;
+    uint64_t m_num_bytes;
+    uint64_t m_best_num_bytes;
 };
 
-} // Namespace
+/**
+  * Function which compresses a character stream using LZAP with codes of code_bits_ bits,
+  * and passes the codes to output_
+  */
+template <unsigned int code_bits_, class Output>
+size_t lzapCompress(const unsigned char* input_, size_t size_, Output& output_) {
+    LZWCompressingDictionary<code_bits_>& dict = compressingDictionary<code_bits_>();
+    LZAPResetPolicy policy;
+
+    bool has_previous = false;
+    lzw_code previous = 0;
+    size_t i = 0;
+    while (i < size_) {
+        //Find the longest string in the dictionary
+        lzw_code w = input_[i];
+        size_t length = 1;
+        lzw_code wk;
+        while (i+length < size_ && dict.findString(w, input_[i+length], wk)) {
+            w = wk;
+            ++length;
+        }
+        output_.appendCode(w);
+
+        //Then add the previous string extended by its prefixes. After a reset
+        //there is no previous string.
+        if (dict.full() && policy.update(length)) {
+            dict.reset();
+            has_previous = false;
+        }
+        else {
+            if (has_previous) {
+                addLZAPStrings(dict, previous, input_+i, length);
+            }
+            has_previous = true;
+        }
+        previous = w;
+        i += length;
+    }
+
+    return output_.finish();
+}
 
 /**
-  * Function which compresses a character stream using LZW.
+  * Function which decompresses num_bytes_ characters using LZAP with codes of code_bits_ bits.
+  * The decoder keeps a compressing dictionary as well, so that it knows which 
+  * strings the encoder found already in the dictionary.
   */
-std::vector<unsigned char> lzw_compress(const std::vector<unsigned char>& input_) {
-    LZWCompressingDictionary dict;
-    LZWOutput output;
+template <unsigned int code_bits_, class Input>
+void lzapDecompress(Input& input_, unsigned char* output_, size_t num_bytes_) {
+    LZWDecompressingDictionary<code_bits_>& dict = decompressingDictionary<code_bits_>();
+    LZWCompressingDictionary<code_bits_>& index = compressingDictionary<code_bits_>();
+    LZAPResetPolicy policy;
 
-    std::vector<unsigned char> w;
-    for (size_t i=0; i<input_.size(); ++i) {
-        //Read character from stream
-        std::vector<unsigned char> k(1, input_[i]);
-        std::vector<unsigned char> wk = w;
-        wk.insert(wk.end(), k.begin(), k.end());
+    bool has_previous = false;
+    lzw_code previous = 0;
+    size_t num_decoded = 0;
+    while (num_decoded < num_bytes_) {
+        lzw_code code = input_.readCode();
+        if (!dict.hasCode(code)) {
+            throw std::runtime_error("LZW: invalid code");
+        }
+        size_t length = dict.length(code);
+        if (length > num_bytes_-num_decoded) {
+            throw std::runtime_error("LZW: data exceeds stored length");
+        }
+        unsigned char* string = output_+num_decoded;
+        dict.writeString(code, string);
 
-        //If wk is in the dictionary, continue reading
-        if (dict.hasString(wk)) {
-            w = wk;
-            continue;
+        //Add the same strings as the encoder. A string the index has not 
+        //seen before gets the next code in both dictionaries.
+        if (index.full() && policy.update(length)) {
+            index.reset();
+            dict.reset();
+            has_previous = false;
         }
-        //Else, output code, and add wk to dictionary
         else {
-            output.appendCode(dict.getCode(w));
-            dict.addStringToDict(wk);
-            w = k;
+            if (has_previous) {
+                lzw_code prefix = previous;
+                lzw_code extended;
+                for (size_t i=0; i<length && index.findOrAddString(prefix, string[i], extended); ++i) {
+                    if (!dict.hasCode(extended)) {
+                        dict.addString(prefix, string[i]);
+                    }
+                    prefix = extended;
+                }
+            }
+            has_previous = true;
         }
+        previous = code;
+        num_decoded += length;
+    }
+}
+
+/**
+  * Functions which run the compressor or decompressor of the variant on any 
+  * code output or input
+  */
+template <unsigned int code_bits_, class Output>
+inline size_t lzwCompressCodes(LZWVariant_t variant_, const unsigned char* input_, size_t size_, Output& output_) {
+    if (variant_ == LZW_LZAP) {
+        return lzapCompress<code_bits_>(input_, size_, output_);
     }
-    output.appendCode(dict.getCode(w));
+    return lzwCompress<code_bits_>(input_, size_, output_);
+}
 
-    return output.getData();
+template <unsigned int code_bits_, class Input>
+inline void lzwDecompressCodes(LZWVariant_t variant_, Input& input_, unsigned char* output_, size_t num_bytes_) {
+    if (variant_ == LZW_LZAP) {
+        lzapDecompress<code_bits_>(input_, output_, num_bytes_);
+    }
+    else {
+        lzwDecompress<code_bits_>(input_, output_, num_bytes_);
+    }
 }
 
 /**
-  * Function which decompresses a character stream using LZW.
+  * Functions which run the compressor or decompressor of the variant on packed codes
   */
-std::vector<unsigned char> lzw_decompress(const std::vector<unsigned char>& input_) {
-    LZWDecompressingDictionary dict;
-    LZWInput input(input_);
-    std::vector<unsigned char> output;
+template <unsigned int code_bits_>
+inline size_t lzwCompressVariant(LZWVariant_t variant_, const unsigned char* input_, size_t size_, unsigned char* output_) {
+    LZWOutput<code_bits_> output(output_);
+    return lzwCompressCodes<code_bits_>(variant_, input_, size_, output);
+}
 
-    lzw_code code = input.readCode();
-    std::vector<unsigned char> w = dict.getString(code);
-    output.insert(output.end(), w.begin(), w.end());
+template <unsigned int code_bits_>
+inline void lzwDecompressVariant(LZWVariant_t variant_, const unsigned char* input_, size_t size_, unsigned char* output_, size_t num_bytes_) {
+    LZWInput<code_bits_> input(input_, size_);
+    lzwDecompressCodes<code_bits_>(variant_, input, output_, num_bytes_);
+}
 
-    while(input.hasMoreData()) {
-        lzw_code next_code = input.readCode();
+/**
+  * LZW codes are Huffman coded as an alphabet of lzwMaxCodes(code_bits_) 
+  * symbols. Codes are limited to lzw_huffman_max_bits bits, which fits any 
+  * alphabet of up to 16 bit codes, and lets the decoder find every code with 
+  * a single lookup in a table of at most 64Ki entries.
+  */
+const unsigned int lzw_huffman_max_bits = 16;
 
-        //If next_code is in the dictionary, write out
-        if (dict.hasCode(next_code)) {
-            std::vector<unsigned char> k = dict.getString(next_code);
-            output.insert(output.end(), k.begin(), k.end());
-            std::vector<unsigned char> wk = w;
-            wk.emplace_back(k[0]);
-            dict.addStringToDict(wk);
-            w = k;
+/**
+  * Tracks the size of a classic LZW dictionary, which grows by one string per
+  * code and is reset when full, so that codes are Huffman coded with a table for
+  * the codes that can occur. The context of a code is the width of the largest
+  * code the dictionary holds, from 8 to code_bits_ bits. LZAP adds a varying 
+  * number of strings per code and fills the dictionary quickly, so all of its 
+  * codes use the widest context.
+  */
+class LZWCodeContext {
+public:
+    LZWCodeContext(unsigned int code_bits_, bool track_dictionary_) 
+        : m_code_bits(code_bits_), m_track_dictionary(track_dictionary_), m_next_code(256) {
+        m_width = m_track_dictionary ? 8 : m_code_bits;
+    }
+
+    /**
+      * Returns the context of the next code, between 0 and numContexts()-1
+      */
+    inline unsigned int context() const {
+        return m_width - 8;
+    }
+
+    inline unsigned int numContexts() const {
+        return m_code_bits - 7;
+    }
+
+    /**
+      * Moves past a code, as the compressor adds a string after every code
+      */
+    inline void advance() {
+        if (!m_track_dictionary) {
+            return;
+        }
+        if (m_next_code == lzwMaxCodes(m_code_bits)) {
+            m_next_code = 256;
+            m_width = 8;
         }
-        //Otherwise, deduce what the next_code is
         else {
-            std::vector<unsigned char> k = dict.getString(code);
-            unsigned char k_start = k[0];
-            k.emplace_back(k_start);
-            output.insert(output.end(), k.begin(), k.end());
-            std::vector<unsigned char> wk = w;
-            wk.emplace_back(k[0]);
-            dict.addStringToDict(wk);
-            w = k;
+            m_next_code += 1;
+            if (m_next_code-1 == (uint32_t(1) << m_width)) {
+                m_width += 1;
+            }
         }
-        code = next_code;
     }
 
-    return output;
+private:
+    unsigned int m_code_bits;
+    bool m_track_dictionary;
+    uint32_t m_next_code;
+    unsigned int m_width;
+};
+
+/**
+  * Function which computes Huffman code lengths from the frequencies of
+  * num_symbols_ symbols. If a code is longer than lzw_huffman_max_bits, the 
+  * frequencies are flattened and the code rebuilt until it fits. A lone 
+  * symbol gets a one bit code.
+  */
+inline void buildLZWHuffmanLengths(const uint32_t* frequencies_, size_t num_symbols_, unsigned char* lengths_) {
+    std::fill(lengths_, lengths_+num_symbols_, 0);
+
+    //Symbols in order of increasing frequency
+    std::vector<std::pair<uint64_t, uint32_t> > leaves;
+    for (size_t i=0; i<num_symbols_; ++i) {
+        if (frequencies_[i] > 0) {
+            leaves.push_back(std::make_pair(static_cast<uint64_t>(frequencies_[i]), static_cast<uint32_t>(i)));
+        }
+    }
+    if (leaves.size() == 1) {
+        lengths_[leaves[0].second] = 1;
+    }
+    if (leaves.size() <= 1) {
+        return;
+    }
+    std::sort(leaves.begin(), leaves.end());
+
+    //Leaves are nodes 0 to n-1, and joined nodes n to 2n-2. Joined nodes are 
+    //created in order of increasing weight, so two queues replace a heap.
+    const size_t n = leaves.size();
+    std::vector<uint64_t> weight(2*n-1);
+    std::vector<uint32_t> parent(2*n-1);
+    std::vector<unsigned char> depth(2*n-1);
+    while (true) {
+        for (size_t i=0; i<n; ++i) {
+            weight[i] = leaves[i].first;
+        }
+        size_t next_leaf = 0;
+        size_t next_joined = n;
+        for (size_t node=n; node<2*n-1; ++node) {
+            weight[node] = 0;
+            for (unsigned int j=0; j<2; ++j) {
+                size_t child;
+                if (next_leaf < n && (next_joined == node || weight[next_leaf] <= weight[next_joined])) {
+                    child = next_leaf++;
+                }
+                else {
+                    child = next_joined++;
+                }
+                parent[child] = static_cast<uint32_t>(node);
+                weight[node] += weight[child];
+            }
+        }
+
+        //The root is the last node, and every parent comes after its children
+        unsigned int max_depth = 0;
+        depth[2*n-2] = 0;
+        for (size_t i=2*n-2; i>0; --i) {
+            depth[i-1] = static_cast<unsigned char>(std::min<unsigned int>(depth[parent[i-1]] + 1, 255));
+            max_depth = std::max<unsigned int>(max_depth, depth[i-1]);
+        }
+        if (max_depth <= lzw_huffman_max_bits) {
+            break;
+        }
+        for (size_t i=0; i<n; ++i) {
+            leaves[i].first = 1 + leaves[i].first/2;
+        }
+    }
+
+    for (size_t i=0; i<n; ++i) {
+        lengths_[leaves[i].second] = depth[i];
+    }
+}
+
+/**
+  * Function which assigns canonical codes to the code lengths. The codes are 
+  * bit reversed, as they are written least significant bit first.
+  */
+inline void buildLZWHuffmanCodes(const unsigned char* lengths_, size_t num_symbols_, uint32_t* codes_) {
+    uint32_t count[lzw_huffman_max_bits+1] = { 0 };
+    for (size_t i=0; i<num_symbols_; ++i) {
+        count[lengths_[i]] += 1;
+    }
+    count[0] = 0;
+    uint32_t next[lzw_huffman_max_bits+1] = { 0 };
+    for (unsigned int len=1; len<=lzw_huffman_max_bits; ++len) {
+        next[len] = (next[len-1] + count[len-1]) << 1;
+    }
+    for (size_t i=0; i<num_symbols_; ++i) {
+        unsigned int len = lengths_[i];
+        uint32_t code = (len > 0) ? next[len]++ : 0;
+        uint32_t reversed = 0;
+        for (unsigned int j=0; j<len; ++j) {
+            reversed = (reversed << 1) | ((code >> j) & 1);
+        }
+        codes_[i] = reversed;
+    }
 }
+
+/**
+  * Code output which keeps the codes and counts them per context, so that
+  * they can be Huffman coded once all codes are known
+  */
+class LZWCodeBuffer {
+public:
+    LZWCodeBuffer(std::vector<lzw_code>& codes_, std::vector<std::vector<uint32_t> >& frequencies_, const LZWCodeContext& context_) 
+        : m_codes(codes_), m_frequencies(frequencies_), m_context(context_) {}
+
+    inline void appendCode(lzw_code c) {
+        m_codes.push_back(c);
+        m_frequencies[m_context.context()][c] += 1;
+        m_context.advance();
+    }
+
+    inline size_t finish() {
+        return m_codes.size();
+    }
+
+private:
+    std::vector<lzw_code>& m_codes;
+    std::vector<std::vector<uint32_t> >& m_frequencies;
+    LZWCodeContext m_context;
+};
+
+/**
+  * Bit writer for codes of up to 32 bits, which writes four bytes at a time
+  */
+class LZWBitWriter {
+public:
+    LZWBitWriter(unsigned char* output_) : m_output(output_), m_offset(0), m_bits(0), m_num_bits(0) {}
+
+    inline void put(uint32_t bits_, unsigned int width_) {
+        m_bits |= static_cast<uint64_t>(bits_) << m_num_bits;
+        m_num_bits += width_;
+        if (m_num_bits >= 32) {
+            uint32_t word = static_cast<uint32_t>(m_bits);
+            memcpy(m_output + m_offset, &word, 4);
+            m_offset += 4;
+            m_bits >>= 32;
+            m_num_bits -= 32;
+        }
+    }
+
+    /**
+      * Writes the last partial bytes, and returns the number of bytes written
+      */
+    inline size_t finish() {
+        for (; m_num_bits > 0; m_num_bits -= std::min(m_num_bits, 8u)) {
+            m_output[m_offset++] = static_cast<unsigned char>(m_bits);
+            m_bits >>= 8;
+        }
+        return m_offset;
+    }
+
+private:
+    unsigned char* m_output;
+    size_t m_offset;
+    uint64_t m_bits;
+    unsigned int m_num_bits;
+};
+
+/**
+  * Code lengths of neighbouring codes are mostly equal, so each length is 
+  * written as the change from the previous one: 0 for none, 10s for one up 
+  * or down, and 11 followed by the length in five bits otherwise. Returns 
+  * the number of bits written, and only counts them if writer_ is null.
+  */
+inline uint64_t writeLZWHuffmanLengths(const unsigned char* lengths_, size_t num_symbols_, LZWBitWriter* writer_) {
+    uint64_t num_bits = 0;
+    unsigned int previous = 0;
+    for (size_t i=0; i<num_symbols_; ++i) {
+        unsigned int length = lengths_[i];
+        uint32_t bits = 3 | (length << 2);
+        unsigned int width = 7;
+        if (length == previous) {
+            bits = 0;
+            width = 1;
+        }
+        else if (length == previous+1 || length+1 == previous) {
+            bits = 1 | ((length < previous) ? 4 : 0);
+            width = 3;
+        }
+        if (writer_) {
+            writer_->put(bits, width);
+        }
+        num_bits += width;
+        previous = length;
+    }
+    return num_bits;
+}
+
+/**
+  * Function which writes the Huffman coded codes. For every context, it writes
+  * the number of symbols up to the last one used and their code lengths, and
+  * then all the codes. A context where the table would cost more than it saves
+  * is flagged as raw instead, and its codes are written using the width of 
+  * the context, as in LZW with variable width codes.
+  */
+inline size_t writeLZWHuffmanCodes(const std::vector<lzw_code>& codes_, const std::vector<std::vector<uint32_t> >& frequencies_, 
+        LZWCodeContext context_, unsigned char* output_) {
+    size_t offset = 0;
+    std::vector<std::vector<unsigned char> > lengths(frequencies_.size());
+    std::vector<std::vector<uint32_t> > symbols(frequencies_.size());
+    std::vector<bool> raw(frequencies_.size());
+    for (size_t i=0; i<frequencies_.size(); ++i) {
+        const unsigned int width = 8 + static_cast<unsigned int>(i);
+        size_t num_symbols = frequencies_[i].size();
+        while (num_symbols > 0 && frequencies_[i][num_symbols-1] == 0) {
+            --num_symbols;
+        }
+        lengths[i].resize(num_symbols);
+        buildLZWHuffmanLengths(frequencies_[i].data(), num_symbols, lengths[i].data());
+
+        uint64_t table_bits = writeLZWHuffmanLengths(lengths[i].data(), num_symbols, nullptr);
+        uint64_t raw_bits = 0;
+        for (size_t j=0; j<num_symbols; ++j) {
+            table_bits += static_cast<uint64_t>(frequencies_[i][j]) * lengths[i][j];
+            raw_bits += static_cast<uint64_t>(frequencies_[i][j]) * width;
+        }
+        raw[i] = (num_symbols > 0 && raw_bits <= table_bits);
+        if (raw[i]) {
+            num_symbols = frequencies_[i].size();
+            lengths[i].assign(num_symbols, static_cast<unsigned char>(width));
+        }
+        symbols[i].resize(num_symbols);
+        buildLZWHuffmanCodes(lengths[i].data(), num_symbols, symbols[i].data());
+        offset += writeVarint(raw[i] ? 1 : (num_symbols << 1), output_+offset);
+    }
+
+    LZWBitWriter table_writer(output_ + offset);
+    for (size_t i=0; i<lengths.size(); ++i) {
+        if (!raw[i]) {
+            writeLZWHuffmanLengths(lengths[i].data(), lengths[i].size(), &table_writer);
+        }
+    }
+    offset += table_writer.finish();
+
+    LZWBitWriter writer(output_ + offset);
+    for (size_t i=0; i<codes_.size(); ++i) {
+        unsigned int context = context_.context();
+        lzw_code c = codes_[i];
+        writer.put(symbols[context][c], lengths[context][c]);
+        context_.advance();
+    }
+    return offset + writer.finish();
+}
+
+/**
+  * LZW input stream which reads Huffman coded lzw_codes. For every context,
+  * the code lengths are read and turned into a table from the next max_bits 
+  * bits of the stream to the code and its length, where max_bits is the 
+  * longest code length in use.
+  */
+class LZWHuffmanInput {
+public:
+    LZWHuffmanInput(const unsigned char* data_, size_t size_, const LZWCodeContext& context_) 
+        : m_data(data_), m_size(size_), m_offset(0), m_bits(0), m_num_bits(0), m_context(context_), m_tables(context_.numContexts()) {
+        //Context i holds codes of up to 8+i bits. The lowest bit flags raw contexts.
+        std::vector<uint64_t> num_symbols(m_tables.size());
+        for (size_t i=0; i<m_tables.size(); ++i) {
+            if (!readVarint(m_data, m_size, m_offset, num_symbols[i]) || num_symbols[i] > (uint64_t(2) << (8+i))) {
+                throw std::runtime_error("LZW: invalid Huffman table");
+            }
+        }
+        for (size_t i=0; i<m_tables.size(); ++i) {
+            std::vector<unsigned char> lengths;
+            if (num_symbols[i] & 1) {
+                lengths.assign(size_t(1) << (8+i), static_cast<unsigned char>(8+i));
+            }
+            else {
+                readLengths(lengths, static_cast<size_t>(num_symbols[i] >> 1));
+            }
+            buildTable(m_tables[i], lengths);
+        }
+
+        //The codes start at the next byte
+        unsigned int partial_bits = m_num_bits & 7;
+        m_bits >>= partial_bits;
+        m_num_bits -= partial_bits;
+    }
+
+    /**
+      * Reads the next code from the character buffer
+      */
+    inline lzw_code readCode() {
+        const Table& table = m_tables[m_context.context()];
+        m_context.advance();
+        if (m_num_bits < table.m_max_bits) {
+            refill();
+        }
+        uint32_t entry = table.m_entries[static_cast<size_t>(m_bits & table.m_mask)];
+        unsigned int len = entry >> 16;
+        if (len == 0 || len > m_num_bits) {
+            throw std::runtime_error(len == 0 ? "LZW: invalid Huffman code" : "LZW: truncated code stream");
+        }
+        m_bits >>= len;
+        m_num_bits -= len;
+        return static_cast<lzw_code>(entry & 0xFFFF);
+    }
+
+private:
+    /**
+      * Every entry holds the code in the low 16 bits and its length above.
+      * Entries no code maps to have length zero, and a table without codes
+      * has a single such entry.
+      */
+    struct Table {
+        std::vector<uint32_t> m_entries;
+        unsigned int m_max_bits;
+        uint64_t m_mask;
+    };
+
+    /**
+      * Reads the code lengths of num_symbols_ symbols, as written by writeLZWHuffmanLengths
+      */
+    void readLengths(std::vector<unsigned char>& lengths_, size_t num_symbols_) {
+        lengths_.resize(num_symbols_);
+        unsigned int previous = 0;
+        for (size_t i=0; i<num_symbols_; ++i) {
+            unsigned int length = previous;
+            if (readBits(1)) {
+                if (readBits(1) == 0) {
+                    length = readBits(1) ? previous-1 : previous+1;
+                }
+                else {
+                    length = readBits(5);
+                }
+            }
+            if (length > lzw_huffman_max_bits) {
+                throw std::runtime_error("LZW: invalid Huffman code length");
+            }
+            lengths_[i] = static_cast<unsigned char>(length);
+            previous = length;
+        }
+    }
+
+    /**
+      * Checks that the code lengths form a prefix code, and builds the table
+      */
+    void buildTable(Table& table_, const std::vector<unsigned char>& lengths_) {
+        uint64_t kraft = 0;
+        table_.m_max_bits = 0;
+        for (size_t i=0; i<lengths_.size(); ++i) {
+            if (lengths_[i] > 0) {
+                kraft += uint64_t(1) << (lzw_huffman_max_bits - lengths_[i]);
+                table_.m_max_bits = std::max<unsigned int>(table_.m_max_bits, lengths_[i]);
+            }
+        }
+        if (kraft > (uint64_t(1) << lzw_huffman_max_bits)) {
+            throw std::runtime_error("LZW: Huffman table is not a prefix code");
+        }
+
+        std::vector<uint32_t> symbols(lengths_.size());
+        buildLZWHuffmanCodes(lengths_.data(), lengths_.size(), symbols.data());
+        table_.m_entries.assign(size_t(1) << table_.m_max_bits, 0);
+        for (size_t i=0; i<lengths_.size(); ++i) {
+            unsigned int len = lengths_[i];
+            if (len > 0) {
+                uint32_t entry = static_cast<uint32_t>(i) | (len << 16);
+                for (size_t j=symbols[i]; j<table_.m_entries.size(); j+=(size_t(1) << len)) {
+                    table_.m_entries[j] = entry;
+                }
+            }
+        }
+        table_.m_mask = (uint64_t(1) << table_.m_max_bits) - 1;
+    }
+
+    /**
+      * Fills the bit buffer with whole bytes. Eight bytes are read at a time 
+      * until close to the end of the buffer.
+      */
+    inline void refill() {
+        if (m_offset + 8 <= m_size) {
+            uint64_t bits;
+            memcpy(&bits, m_data + m_offset, 8);
+            unsigned int num_bytes = (63 - m_num_bits) >> 3;
+            m_bits |= (bits << m_num_bits);
+            m_num_bits += num_bytes*8;
+            m_bits &= (uint64_t(1) << m_num_bits) - 1;
+            m_offset += num_bytes;
+        }
+        else {
+            while (m_num_bits <= 56 && m_offset < m_size) {
+                m_bits |= static_cast<uint64_t>(m_data[m_offset++]) << m_num_bits;
+                m_num_bits += 8;
+            }
+        }
+    }
+
+    inline unsigned int readBits(unsigned int width_) {
+        if (m_num_bits < width_) {
+            refill();
+            if (m_num_bits < width_) {
+                throw std::runtime_error("LZW: truncated Huffman table");
+            }
+        }
+        unsigned int bits = static_cast<unsigned int>(m_bits & ((uint64_t(1) << width_) - 1));
+        m_bits >>= width_;
+        m_num_bits -= width_;
+        return bits;
+    }
+
+    const unsigned char* m_data;
+    size_t m_size;
+    size_t m_offset;
+    uint64_t m_bits;
+    unsigned int m_num_bits;
+    LZWCodeContext m_context;
+    std::vector<Table> m_tables;
+};
+
+/**
+  * Function which compresses a character stream using LZW with codes of code_bits_ bits,
+  * and Huffman codes the LZW codes. The input is only parsed once, and the codes are 
+  * kept and counted so that they can be coded with tables for this input.
+  */
+template <unsigned int code_bits_>
+size_t lzwHuffmanCompress(LZWVariant_t variant_, const unsigned char* input_, size_t size_, unsigned char* output_) {
+    LZWCodeContext context(code_bits_, variant_ == LZW_CLASSIC);
+    std::vector<std::vector<uint32_t> > frequencies(context.numContexts());
+    for (size_t i=0; i<frequencies.size(); ++i) {
+        frequencies[i].resize(size_t(1) << (8+i), 0);
+    }
+    std::vector<lzw_code> codes;
+    codes.reserve(size_/4 + 1);
+    LZWCodeBuffer buffer(codes, frequencies, context);
+    lzwCompressCodes<code_bits_>(variant_, input_, size_, buffer);
+    return writeLZWHuffmanCodes(codes, frequencies, context, output_);
+}
+
+/**
+  * Function which decompresses num_bytes_ characters of Huffman coded LZW codes.
+  * The codes are decoded as the LZW decoder reads them, in a single pass.
+  */
+template <unsigned int code_bits_>
+void lzwHuffmanDecompress(LZWVariant_t variant_, const unsigned char* input_, size_t size_, unsigned char* output_, size_t num_bytes_) {
+    LZWHuffmanInput input(input_, size_, LZWCodeContext(code_bits_, variant_ == LZW_CLASSIC));
+    lzwDecompressCodes<code_bits_>(variant_, input, output_, num_bytes_);
+}
+
+/**
+  * Writes the header, which holds the magic, the format version, the number 
+  * of uncompressed bytes, the code width and the variant.
+  */
+inline size_t writeLZWHeader(size_t size_, unsigned int code_bits_, LZWVariant_t variant_, unsigned char* output_) {
+    output_[0] = lzw_magic[0];
+    output_[1] = lzw_magic[1];
+    output_[2] = lzw_format_version;
+    size_t offset = 3 + writeVarint(size_, output_+3);
+    output_[offset++] = static_cast<unsigned char>(code_bits_ | (variant_ == LZW_LZAP ? lzw_lzap_flag : 0));
+    return offset;
+}
+
+/**
+  * Streams in the original format have no header, and the low nibble of
+  * their second byte is zero, which it never is in the magic
+  */
+inline bool isLegacyLZWStream(const unsigned char* input_, size_t size_) {
+    return size_ >= 2 && (input_[1] & 0x0F) == 0;
+}
+
+/**
+  * Reads the header written by writeLZWHeader. Codes take code_bits_ bits 
+  * each, or at least one bit if they are Huffman coded.
+  */
+inline size_t readLZWHeader(const unsigned char* input_, size_t size_, size_t& offset_, unsigned int& code_bits_, LZWVariant_t& variant_, bool huffman_=false) {
+    if (size_ - offset_ < 3 || input_[offset_] != lzw_magic[0] || input_[offset_+1] != lzw_magic[1]) {
+        throw std::runtime_error("LZW: not an LZW stream");
+    }
+    if (input_[offset_+2] != lzw_format_version) {
+        throw std::runtime_error("LZW: unsupported format version");
+    }
+    offset_ += 3;
+
+    uint64_t num_bytes = readLength(input_, size_, offset_);
+    if (offset_ == size_) {
+        throw std::runtime_error("LZW: invalid header");
+    }
+    variant_ = (input_[offset_] & lzw_lzap_flag) ? LZW_LZAP : LZW_CLASSIC;
+    code_bits_ = input_[offset_++] & ~lzw_lzap_flag;
+    if (code_bits_ < lzw_min_code_bits || code_bits_ > lzw_max_code_bits) {
+        throw std::runtime_error("LZW: invalid code width");
+    }
+
+    //Every code expands to at most one full dictionary of characters
+    uint64_t max_codes = (static_cast<uint64_t>(size_-offset_)*8)/(huffman_ ? 1 : code_bits_);
+    if (num_bytes > max_codes*lzwMaxCodes(code_bits_)) {
+        throw std::runtime_error("LZW: stored length exceeds data");
+    }
+    if (num_bytes > std::numeric_limits<size_t>::max()) {
+        throw std::length_error("LZW: stored length does not fit in memory");
+    }
+    return static_cast<size_t>(num_bytes);
+}
+
+/**
+  * Patterns longer than this are rejected by lzw_search, which bounds the
+  * automaton to (lzw_max_pattern_size+1)*256 states and transitions
+  */
+const size_t lzw_max_pattern_size = 4096;
+
+/**
+  * KMP automaton of a search pattern. State i means that the last i characters 
+  * read are the first i characters of the pattern, and the pattern size is the
+  * state of a match.
+  */
+class PatternAutomaton {
+public:
+    PatternAutomaton(const unsigned char* pattern_, size_t size_) : m_size(static_cast<uint32_t>(size_)), m_next((size_+1)*256, 0) {
+        m_next[pattern_[0]] = 1;
+        uint32_t fallback = 0;
+        for (uint32_t j=1; j<=m_size; ++j) {
+            for (unsigned int c=0; c<256; ++c) {
+                m_next[j*256+c] = m_next[fallback*256+c];
+            }
+            if (j < m_size) {
+                m_next[j*256+pattern_[j]] = j+1;
+                fallback = m_next[fallback*256+pattern_[j]];
+            }
+        }
+    }
+
+    inline uint32_t step(uint32_t state_, unsigned char c_) const {
+        return m_next[state_*256+c_];
+    }
+
+    inline uint32_t size() const {
+        return m_size;
+    }
+
+private:
+    uint32_t m_size;
+    std::vector<uint16_t> m_next;
+};
+
+/**
+  * LZW decompressing dictionary which also tracks, for every string, the 
+  * automaton state after reading it from the start state, whether it contains
+  * the pattern, and the code of its first min(length, pattern size) 
+  * characters. All three follow from the prefix in constant time when a 
+  * string is added, so strings never have to be written out to search them.
+  */
+template <unsigned int code_bits_>
+class LZWSearchDictionary {
+public:
+    LZWSearchDictionary() : m_next_code(256), m_automaton(NULL) {}
+
+    /**
+      * Empties the dictionary, and sets up the single characters for a new pattern
+      */
+    inline void reset(const PatternAutomaton& automaton_) {
+        m_automaton = &automaton_;
+        for (unsigned int i=0; i<256; ++i) {
+            m_prefix[i] = 0;
+            m_last[i] = static_cast<unsigned char>(i);
+            m_first[i] = static_cast<unsigned char>(i);
+            m_length[i] = 1;
+            m_state[i] = static_cast<uint16_t>(automaton_.step(0, static_cast<unsigned char>(i)));
+            m_contains[i] = (m_state[i] == automaton_.size());
+            m_head[i] = static_cast<lzw_code>(i);
+        }
+        m_next_code = 256;
+    }
+
+    /**
+      * Adds prefix_+c_ like LZWDecompressingDictionary::addString
+      */
+    inline void addString(lzw_code prefix_, unsigned char c_) {
+        if (m_next_code == lzwMaxCodes(code_bits_)) {
+            m_next_code = 256;
+            return;
+        }
+        lzw_code code = static_cast<lzw_code>(m_next_code);
+        m_prefix[code] = prefix_;
+        m_last[code] = c_;
+        m_first[code] = m_first[prefix_];
+        m_length[code] = m_length[prefix_] + 1;
+        m_state[code] = static_cast<uint16_t>(m_automaton->step(m_state[prefix_], c_));
+        m_contains[code] = m_contains[prefix_] || m_state[code] == m_automaton->size();
+        m_head[code] = (m_length[code] <= m_automaton->size()) ? code : m_head[prefix_];
+        m_next_code += 1;
+    }
+
+    inline bool hasCode(const lzw_code& c_) const {
+        return c_ < m_next_code;
+    }
+
+    inline bool isNextCode(const lzw_code& c_) const {
+        return c_ == m_next_code;
+    }
+
+    inline unsigned char firstChar(const lzw_code& c_) const {
+        return m_first[c_];
+    }
+
+    inline size_t length(const lzw_code& c_) const {
+        return m_length[c_];
+    }
+
+    /**
+      * Returns the automaton state after reading the string of c_ from the start state
+      */
+    inline uint32_t state(const lzw_code& c_) const {
+        return m_state[c_];
+    }
+
+    inline bool contains(const lzw_code& c_) const {
+        return m_contains[c_];
+    }
+
+    /**
+      * Writes the first min(length(c_), pattern size) characters of c_ to 
+      * out_, and returns how many were written
+      */
+    inline size_t writeHead(lzw_code c_, unsigned char* out_) const {
+        lzw_code head = m_head[c_];
+        size_t length = m_length[head];
+        for (size_t i=length; i>0; --i) {
+            out_[i-1] = m_last[head];
+            head = m_prefix[head];
+        }
+        return length;
+    }
+
+    inline void writeString(lzw_code c_, unsigned char* out_) const {
+        for (size_t i=m_length[c_]; i>0; --i) {
+            out_[i-1] = m_last[c_];
+            c_ = m_prefix[c_];
+        }
+    }
+
+private:
+    uint32_t m_next_code;
+    const PatternAutomaton* m_automaton;
+    lzw_code m_prefix[lzwMaxCodes(code_bits_)];
+    unsigned char m_last[lzwMaxCodes(code_bits_)];
+    unsigned char m_first[lzwMaxCodes(code_bits_)];
+    uint16_t m_length[lzwMaxCodes(code_bits_)];
+    uint16_t m_state[lzwMaxCodes(code_bits_)];
+    bool m_contains[lzwMaxCodes(code_bits_)];
+    lzw_code m_head[lzwMaxCodes(code_bits_)];
+};
+
+template <unsigned int code_bits_>
+inline LZWSearchDictionary<code_bits_>& searchDictionary(const PatternAutomaton& automaton_) {
+    static thread_local std::unique_ptr<LZWSearchDictionary<code_bits_> > dict(new LZWSearchDictionary<code_bits_>());
+    dict->reset(automaton_);
+    return *dict;
+}
+
+/**
+  * Runs the automaton from state_ over string_, and appends the offset of 
+  * every match to results_. offset_ is the offset of string_ in the data.
+  */
+inline uint32_t scanString(const PatternAutomaton& automaton_, uint32_t state_, const unsigned char* string_, size_t length_, 
+        uint64_t offset_, std::vector<uint64_t>& results_) {
+    for (size_t i=0; i<length_; ++i) {
+        state_ = automaton_.step(state_, string_[i]);
+        if (state_ == automaton_.size()) {
+            results_.push_back(offset_ + i + 1 - automaton_.size());
+        }
+    }
+    return state_;
+}
+
+/**
+  * Advances the automaton from state_ over the string of code_, which starts 
+  * at offset_ in the data, and appends the offsets of matches to results_.
+  * Only matches that start before the string need its characters: once the 
+  * state is no larger than the number of characters read, the matched part 
+  * lies inside the string, and the state is the one stored for the code.
+  * The characters are then only read while the state is above zero, and 
+  * usually just the first one, unless the string contains the pattern.
+  */
+template <unsigned int code_bits_>
+inline uint32_t searchCode(const LZWSearchDictionary<code_bits_>& dict_, const PatternAutomaton& automaton_, uint32_t state_, 
+        lzw_code code_, uint64_t offset_, unsigned char* scratch_, std::vector<uint64_t>& results_) {
+    size_t length = dict_.length(code_);
+    if (dict_.contains(code_)) {
+        dict_.writeString(code_, scratch_);
+        return scanString(automaton_, state_, scratch_, length, offset_, results_);
+    }
+    if (state_ == 0) {
+        return dict_.state(code_);
+    }
+
+    //Matches which start before the string end within its first pattern size characters
+    state_ = automaton_.step(state_, dict_.firstChar(code_));
+    if (state_ == automaton_.size()) {
+        results_.push_back(offset_ + 1 - automaton_.size());
+    }
+    size_t num_read = 1;
+    if (state_ > num_read && length > num_read) {
+        size_t head_length = dict_.writeHead(code_, scratch_);
+        while (num_read < head_length && state_ > num_read) {
+            state_ = automaton_.step(state_, scratch_[num_read]);
+            num_read += 1;
+            if (state_ == automaton_.size()) {
+                results_.push_back(offset_ + num_read - automaton_.size());
+            }
+        }
+    }
+    return (state_ <= num_read) ? dict_.state(code_) : state_;
+}
+
+/**
+  * Function which searches num_bytes_ characters of LZW codes for the pattern.
+  * The codes are validated like in lzwDecompress.
+  */
+template <unsigned int code_bits_>
+void lzwSearch(const unsigned char* input_, size_t size_, size_t num_bytes_, const PatternAutomaton& automaton_, std::vector<uint64_t>& results_) {
+    LZWSearchDictionary<code_bits_>& dict = searchDictionary<code_bits_>(automaton_);
+    LZWInput<code_bits_> input(input_, size_);
+    static thread_local std::vector<unsigned char> scratch;
+    scratch.resize(lzwMaxCodes(code_bits_));
+
+    lzw_code code = input.readCode();
+    if (code >= 256) {
+        throw std::runtime_error("LZW: invalid first code");
+    }
+    uint32_t state = searchCode(dict, automaton_, 0, code, 0, scratch.data(), results_);
+    size_t num_decoded = 1;
+
+    while (num_decoded < num_bytes_) {
+        lzw_code next_code = input.readCode();
+        if (dict.hasCode(next_code)) {
+            dict.addString(code, dict.firstChar(next_code));
+        }
+        else if (dict.isNextCode(next_code)) {
+            dict.addString(code, dict.firstChar(code));
+        }
+        else {
+            throw std::runtime_error("LZW: invalid code");
+        }
+        if (dict.length(next_code) > num_bytes_-num_decoded) {
+            throw std::runtime_error("LZW: data exceeds stored length");
+        }
+        state = searchCode(dict, automaton_, state, next_code, num_decoded, scratch.data(), results_);
+        num_decoded += dict.length(next_code);
+        code = next_code;
+    }
+}
+
+/**
+  * Function which searches num_bytes_ characters of LZAP codes for the pattern.
+  * LZAP adds strings that depend on every character of the current string, so
+  * each string is written to a scratch buffer and scanned, which saves the
+  * output but not the work of decompression.
+  */
+template <unsigned int code_bits_>
+void lzapSearch(const unsigned char* input_, size_t size_, size_t num_bytes_, const PatternAutomaton& automaton_, std::vector<uint64_t>& results_) {
+    LZWDecompressingDictionary<code_bits_>& dict = decompressingDictionary<code_bits_>();
+    LZWCompressingDictionary<code_bits_>& index = compressingDictionary<code_bits_>();
+    LZWInput<code_bits_> input(input_, size_);
+    LZAPResetPolicy policy;
+    static thread_local std::vector<unsigned char> scratch;
+    scratch.resize(lzwMaxCodes(code_bits_));
+    unsigned char* string = scratch.data();
+
+    bool has_previous = false;
+    lzw_code previous = 0;
+    uint32_t state = 0;
+    size_t num_decoded = 0;
+    while (num_decoded < num_bytes_) {
+        lzw_code code = input.readCode();
+        if (!dict.hasCode(code)) {
+            throw std::runtime_error("LZW: invalid code");
+        }
+        size_t length = dict.length(code);
+        if (length > num_bytes_-num_decoded) {
+            throw std::runtime_error("LZW: data exceeds stored length");
+        }
+        dict.writeString(code, string);
+        state = scanString(automaton_, state, string, length, num_decoded, results_);
+
+        //Add the same strings as lzapDecompress
+        if (index.full() && policy.update(length)) {
+            index.reset();
+            dict.reset();
+            has_previous = false;
+        }
+        else {
+            if (has_previous) {
+                lzw_code prefix = previous;
+                lzw_code extended;
+                for (size_t i=0; i<length && index.findOrAddString(prefix, string[i], extended); ++i) {
+                    if (!dict.hasCode(extended)) {
+                        dict.addString(prefix, string[i]);
+                    }
+                    prefix = extended;
+                }
+            }
+            has_previous = true;
+        }
+        previous = code;
+        num_decoded += length;
+    }
+}
+
+template <unsigned int code_bits_>
+inline void lzwSearchVariant(LZWVariant_t variant_, const unsigned char* input_, size_t size_, size_t num_bytes_, 
+        const PatternAutomaton& automaton_, std::vector<uint64_t>& results_) {
+    if (variant_ == LZW_LZAP) {
+        lzapSearch<code_bits_>(input_, size_, num_bytes_, automaton_, results_);
+    }
+    else {
+        lzwSearch<code_bits_>(input_, size_, num_bytes_, automaton_, results_);
+    }
+}
+
+/**
+  * LZW input stream which reads the 12-bit codes of the original headerless 
+  * format. A pair of codes takes three bytes: the low byte of the first code,
+  * the high nibble of the first code with the low nibble of the second above
+  * it, and the high byte of the second code.
+  */
+class LZWLegacyInput {
+public:
+    LZWLegacyInput(const unsigned char* data_, size_t size_) : m_data(data_), m_size(size_), m_offset(0), m_even(true) {}
+
+    inline lzw_code readCode() {
+        lzw_code code;
+        if (m_even) {
+            code = static_cast<lzw_code>(m_data[m_offset] | ((m_data[m_offset+1] & 0x0F) << 8));
+            m_offset += 1;
+        }
+        else {
+            code = static_cast<lzw_code>((m_data[m_offset] >> 4) | (m_data[m_offset+1] << 4));
+            m_offset += 2;
+        }
+        m_even = !m_even;
+        return code;
+    }
+
+    /**
+      * Every code needs two bytes from the current one, which also
+      * skips the unused nibble after an odd number of codes
+      */
+    inline bool hasMoreData() const {
+        return m_offset+1 < m_size;
+    }
+
+private:
+    const unsigned char* m_data;
+    size_t m_size;
+    size_t m_offset;
+    bool m_even;
+};
+
+/**
+  * Decodes the original headerless format, and appends the result to output_.
+  * Its dictionary was reset when full, and then given the string that filled
+  * it as code 256. That string is not built from codes in the new dictionary,
+  * so strings are stored as the offset and length of their first occurrence 
+  * in the output instead.
+  */
+inline void lzwLegacyDecompress(const unsigned char* input_, size_t size_, std::vector<unsigned char>& output_) {
+    const uint32_t max_codes = lzwMaxCodes(12);
+    std::vector<size_t> start(max_codes);
+    std::vector<size_t> length(max_codes);
+    uint32_t next_code = 256;
+
+    LZWLegacyInput input(input_, size_);
+    if (!input.hasMoreData()) {
+        throw std::runtime_error("LZW: invalid stream");
+    }
+    lzw_code code = input.readCode();
+    if (code >= 256) {
+        throw std::runtime_error("LZW: invalid code");
+    }
+    size_t w_start = output_.size();
+    size_t w_length = 1;
+    output_.push_back(static_cast<unsigned char>(code));
+
+    while (input.hasMoreData()) {
+        code = input.readCode();
+        const bool full = (next_code == max_codes);
+        const size_t k_start = output_.size();
+        size_t k_length;
+
+        //Once the dictionary is full, the next code added is 256 again
+        if (code < next_code && !(full && code == 256)) {
+            if (code < 256) {
+                k_length = 1;
+                output_.push_back(static_cast<unsigned char>(code));
+            }
+            else {
+                k_length = length[code];
+                output_.resize(k_start + k_length);
+                std::copy(output_.begin()+start[code], output_.begin()+start[code]+k_length, output_.begin()+k_start);
+            }
+        }
+        //The code being added is w extended by its own first character
+        else if (code == (full ? 256 : next_code)) {
+            k_length = w_length + 1;
+            output_.resize(k_start + k_length);
+            std::copy(output_.begin()+w_start, output_.begin()+w_start+w_length, output_.begin()+k_start);
+            output_[k_start+w_length] = output_[w_start];
+        }
+        else {
+            throw std::runtime_error("LZW: invalid code");
+        }
+
+        //Add w extended by the first character of k, which follows w in the output
+        if (full) {
+            next_code = 256;
+        }
+        start[next_code] = w_start;
+        length[next_code] = w_length + 1;
+        next_code += 1;
+
+        w_start = k_start;
+        w_length = k_length;
+    }
+}
+
+/**
+  * Benchmarks the dictionary and the code packing with codes of code_bits_ bits
+  */
+template <unsigned int code_bits_>
+void lzwBenchmarkWidth(const unsigned char* data_, size_t size_, std::vector<BenchmarkResult>& results_) {
+    const std::string width = "<" + std::to_string(code_bits_) + ">";
+
+    //Dictionary lookups and inserts as done while compressing, without output
+    std::vector<lzw_code> codes;
+    auto parse = [&](bool keep_codes_) {
+        LZWCompressingDictionary<code_bits_>& dict = compressingDictionary<code_bits_>();
+        size_t num_codes = 0;
+        lzw_code w = data_[0];
+        for (size_t i=1; i<size_; ++i) {
+            lzw_code wk;
+            if (dict.findString(w, data_[i], wk)) {
+                w = wk;
+            }
+            else {
+                if (keep_codes_) {
+                    codes.push_back(w);
+                }
+                ++num_codes;
+                dict.addString(w, data_[i]);
+                w = data_[i];
+            }
+        }
+        if (keep_codes_) {
+            codes.push_back(w);
+        }
+        return num_codes + 1;
+    };
+    parse(true);
+    results_.push_back(runBenchmark("LZWCompressingDictionary" + width, size_, [&]() {
+        benchmarkKeep(parse(false));
+    }));
+
+    std::vector<unsigned char> packed(lzw_compress_bound(size_, code_bits_));
+    results_.push_back(runBenchmark("LZWOutput::appendCode" + width, size_, [&]() {
+        LZWOutput<code_bits_> output(packed.data());
+        for (size_t i=0; i<codes.size(); ++i) {
+            output.appendCode(codes[i]);
+        }
+        benchmarkKeep(output.finish());
+    }));
+
+    size_t packed_size = (codes.size()*code_bits_ + 7)/8;
+    results_.push_back(runBenchmark("LZWInput::readCode" + width, size_, [&]() {
+        LZWInput<code_bits_> input(packed.data(), packed_size);
+        lzw_code sum = 0;
+        for (size_t i=0; i<codes.size(); ++i) {
+            sum += input.readCode();
+        }
+        benchmarkKeep(sum);
+    }));
+}
+
+} // Namespace
+
+/**
+  * Every character produces at most one code, and the header holds the
+  * magic, the version, the length as a variable length integer and the code width
+  */
+size_t lzw_compress_bound(size_t size_, unsigned int code_bits_) {
+    return 14 + (size_/8)*code_bits_ + ((size_%8)*code_bits_ + 7)/8;
+}
+
+/**
+  * Function which compresses a character stream using LZW.
+  */
+size_t lzw_compress(const unsigned char* input_, size_t size_, unsigned char* output_, unsigned int code_bits_, LZWVariant_t variant_) {
+    if (code_bits_ < lzw_min_code_bits || code_bits_ > lzw_max_code_bits) {
+        throw std::invalid_argument("LZW: code width must be between 9 and 16 bits");
+    }
+
+    //Write out number of uncompressed bytes so the decoder can allocate its output
+    size_t offset = writeLZWHeader(size_, code_bits_, variant_, output_);
+    if (size_ == 0) {
+        return offset;
+    }
+
+    unsigned char* output = output_ + offset;
+    switch (code_bits_) {
+    case 9: return offset + lzwCompressVariant<9>(variant_, input_, size_, output);
+    case 10: return offset + lzwCompressVariant<10>(variant_, input_, size_, output);
+    case 11: return offset + lzwCompressVariant<11>(variant_, input_, size_, output);
+    case 12: return offset + lzwCompressVariant<12>(variant_, input_, size_, output);
+    case 13: return offset + lzwCompressVariant<13>(variant_, input_, size_, output);
+    case 14: return offset + lzwCompressVariant<14>(variant_, input_, size_, output);
+    case 15: return offset + lzwCompressVariant<15>(variant_, input_, size_, output);
+    default: return offset + lzwCompressVariant<16>(variant_, input_, size_, output);
+    }
+}
+
+void lzw_compress(const unsigned char* input_, size_t size_, std::vector<unsigned char>& output_, unsigned int code_bits_, LZWVariant_t variant_) {
+    size_t offset = output_.size();
+    output_.resize(offset + lzw_compress_bound(size_, code_bits_));
+    output_.resize(offset + lzw_compress(input_, size_, output_.data()+offset, code_bits_, variant_));
+}
+
+std::vector<unsigned char> lzw_compress(const std::vector<unsigned char>& input_, unsigned int code_bits_, LZWVariant_t variant_) {
+    std::vector<unsigned char> output;
+    lzw_compress(input_.data(), input_.size(), output, code_bits_, variant_);
+    return output;
+}
+
+/**
+  * Function which returns the number of bytes an LZW encoded buffer decompresses to
+  */
+size_t lzw_decompressed_size(const unsigned char* input_, size_t size_) {
+    //The original format does not store its length, so it has to be decoded
+    if (isLegacyLZWStream(input_, size_)) {
+        std::vector<unsigned char> output;
+        lzwLegacyDecompress(input_, size_, output);
+        return output.size();
+    }
+
+    size_t offset = 0;
+    unsigned int code_bits;
+    LZWVariant_t variant;
+    return readLZWHeader(input_, size_, offset, code_bits, variant);
+}
+
+/**
+  * Function which decompresses a character stream using LZW, with the 
+  * kernel specialized for the code width of the stream
+  */
+size_t lzw_decompress(const unsigned char* input_, size_t size_, unsigned char* output_, size_t capacity_) {
+    if (isLegacyLZWStream(input_, size_)) {
+        std::vector<unsigned char> output;
+        lzwLegacyDecompress(input_, size_, output);
+        if (output.size() > capacity_) {
+            throw std::length_error("LZW: output buffer too small");
+        }
+        std::copy(output.begin(), output.end(), output_);
+        return output.size();
+    }
+
+    size_t offset = 0;
+    unsigned int code_bits;
+    LZWVariant_t variant;
+    size_t num_bytes = readLZWHeader(input_, size_, offset, code_bits, variant);
+    if (num_bytes > capacity_) {
+        throw std::length_error("LZW: output buffer too small");
+    }
+    if (num_bytes == 0) {
+        return 0;
+    }
+
+    const unsigned char* input = input_ + offset;
+    size_t size = size_ - offset;
+    switch (code_bits) {
+    case 9: lzwDecompressVariant<9>(variant, input, size, output_, num_bytes); break;
+    case 10: lzwDecompressVariant<10>(variant, input, size, output_, num_bytes); break;
+    case 11: lzwDecompressVariant<11>(variant, input, size, output_, num_bytes); break;
+    case 12: lzwDecompressVariant<12>(variant, input, size, output_, num_bytes); break;
+    case 13: lzwDecompressVariant<13>(variant, input, size, output_, num_bytes); break;
+    case 14: lzwDecompressVariant<14>(variant, input, size, output_, num_bytes); break;
+    case 15: lzwDecompressVariant<15>(variant, input, size, output_, num_bytes); break;
+    default: lzwDecompressVariant<16>(variant, input, size, output_, num_bytes); break;
+    }
+
+    return num_bytes;
+}
+
+void lzw_decompress(const unsigned char* input_, size_t size_, std::vector<unsigned char>& output_) {
+    if (isLegacyLZWStream(input_, size_)) {
+        lzwLegacyDecompress(input_, size_, output_);
+        return;
+    }
+
+    size_t offset = output_.size();
+    size_t num_bytes = lzw_decompressed_size(input_, size_);
+    output_.resize(offset + num_bytes);
+    lzw_decompress(input_, size_, output_.data()+offset, num_bytes);
+}
+
+std::vector<unsigned char> lzw_decompress(const std::vector<unsigned char>& input_) {
+    std::vector<unsigned char> output;
+    lzw_decompress(input_.data(), input_.size(), output);
+    return output;
+}
+
+/**
+  * The header is the same as for LZW. Every code takes at most lzw_huffman_max_bits
+  * bits, and the tables hold up to twice as many code lengths as there are codes,
+  * of at most seven bits each.
+  */
+size_t lzw_huffman_compress_bound(size_t size_, unsigned int code_bits_) {
+    if (code_bits_ < lzw_min_code_bits || code_bits_ > lzw_max_code_bits) {
+        throw std::invalid_argument("LZW: code width must be between 9 and 16 bits");
+    }
+    return 14 + 3*(code_bits_-7) + (2*lzwMaxCodes(code_bits_)*7 + 7)/8 + (size_*lzw_huffman_max_bits + 7)/8;
+}
+
+/**
+  * Function which compresses a character stream using LZW, and Huffman codes the LZW codes
+  */
+size_t lzw_huffman_compress(const unsigned char* input_, size_t size_, unsigned char* output_, unsigned int code_bits_, LZWVariant_t variant_) {
+    if (code_bits_ < lzw_min_code_bits || code_bits_ > lzw_max_code_bits) {
+        throw std::invalid_argument("LZW: code width must be between 9 and 16 bits");
+    }
+
+    size_t offset = writeLZWHeader(size_, code_bits_, variant_, output_);
+    if (size_ == 0) {
+        return offset;
+    }
+
+    unsigned char* output = output_ + offset;
+    switch (code_bits_) {
+    case 9: return offset + lzwHuffmanCompress<9>(variant_, input_, size_, output);
+    case 10: return offset + lzwHuffmanCompress<10>(variant_, input_, size_, output);
+    case 11: return offset + lzwHuffmanCompress<11>(variant_, input_, size_, output);
+    case 12: return offset + lzwHuffmanCompress<12>(variant_, input_, size_, output);
+    case 13: return offset + lzwHuffmanCompress<13>(variant_, input_, size_, output);
+    case 14: return offset + lzwHuffmanCompress<14>(variant_, input_, size_, output);
+    case 15: return offset + lzwHuffmanCompress<15>(variant_, input_, size_, output);
+    default: return offset + lzwHuffmanCompress<16>(variant_, input_, size_, output);
+    }
+}
+
+void lzw_huffman_compress(const unsigned char* input_, size_t size_, std::vector<unsigned char>& output_, unsigned int code_bits_, LZWVariant_t variant_) {
+    size_t offset = output_.size();
+    output_.resize(offset + lzw_huffman_compress_bound(size_, code_bits_));
+    output_.resize(offset + lzw_huffman_compress(input_, size_, output_.data()+offset, code_bits_, variant_));
+}
+
+std::vector<unsigned char> lzw_huffman_compress(const std::vector<unsigned char>& input_, unsigned int code_bits_, LZWVariant_t variant_) {
+    std::vector<unsigned char> output;
+    lzw_huffman_compress(input_.data(), input_.size(), output, code_bits_, variant_);
+    return output;
+}
+
+size_t lzw_huffman_decompressed_size(const unsigned char* input_, size_t size_) {
+    size_t offset = 0;
+    unsigned int code_bits;
+    LZWVariant_t variant;
+    return readLZWHeader(input_, size_, offset, code_bits, variant, true);
+}
+
+/**
+  * Function which decompresses a character stream of Huffman coded LZW codes
+  */
+size_t lzw_huffman_decompress(const unsigned char* input_, size_t size_, unsigned char* output_, size_t capacity_) {
+    size_t offset = 0;
+    unsigned int code_bits;
+    LZWVariant_t variant;
+    size_t num_bytes = readLZWHeader(input_, size_, offset, code_bits, variant, true);
+    if (num_bytes > capacity_) {
+        throw std::length_error("LZW: output buffer too small");
+    }
+    if (num_bytes == 0) {
+        return 0;
+    }
+
+    const unsigned char* input = input_ + offset;
+    size_t size = size_ - offset;
+    switch (code_bits) {
+    case 9: lzwHuffmanDecompress<9>(variant, input, size, output_, num_bytes); break;
+    case 10: lzwHuffmanDecompress<10>(variant, input, size, output_, num_bytes); break;
+    case 11: lzwHuffmanDecompress<11>(variant, input, size, output_, num_bytes); break;
+    case 12: lzwHuffmanDecompress<12>(variant, input, size, output_, num_bytes); break;
+    case 13: lzwHuffmanDecompress<13>(variant, input, size, output_, num_bytes); break;
+    case 14: lzwHuffmanDecompress<14>(variant, input, size, output_, num_bytes); break;
+    case 15: lzwHuffmanDecompress<15>(variant, input, size, output_, num_bytes); break;
+    default: lzwHuffmanDecompress<16>(variant, input, size, output_, num_bytes); break;
+    }
+
+    return num_bytes;
+}
+
+void lzw_huffman_decompress(const unsigned char* input_, size_t size_, std::vector<unsigned char>& output_) {
+    size_t offset = output_.size();
+    size_t num_bytes = lzw_huffman_decompressed_size(input_, size_);
+    output_.resize(offset + num_bytes);
+    lzw_huffman_decompress(input_, size_, output_.data()+offset, num_bytes);
+}
+
+std::vector<unsigned char> lzw_huffman_decompress(const std::vector<unsigned char>& input_) {
+    std::vector<unsigned char> output;
+    lzw_huffman_decompress(input_.data(), input_.size(), output);
+    return output;
+}
+
+/**
+  * Function which searches LZW compressed data for a pattern by following the
+  * codes and the dictionary, without writing out the decompressed data
+  */
+std::vector<uint64_t> lzw_search(const unsigned char* input_, size_t size_, const unsigned char* pattern_, size_t pattern_size_) {
+    if (pattern_size_ == 0 || pattern_size_ > lzw_max_pattern_size) {
+        throw std::invalid_argument("LZW: search pattern must be between 1 and 4096 bytes");
+    }
+
+    PatternAutomaton automaton(pattern_, pattern_size_);
+    std::vector<uint64_t> results;
+
+    //Strings of the original format are copies of earlier output, so it is decompressed and scanned
+    if (isLegacyLZWStream(input_, size_)) {
+        std::vector<unsigned char> output;
+        lzwLegacyDecompress(input_, size_, output);
+        uint32_t state = 0;
+        for (size_t i=0; i<output.size(); ++i) {
+            state = automaton.step(state, output[i]);
+            if (state == automaton.size()) {
+                results.push_back(i+1-automaton.size());
+            }
+        }
+        return results;
+    }
+
+    size_t offset = 0;
+    unsigned int code_bits;
+    LZWVariant_t variant;
+    size_t num_bytes = readLZWHeader(input_, size_, offset, code_bits, variant);
+    if (num_bytes == 0) {
+        return results;
+    }
+
+    const unsigned char* input = input_ + offset;
+    size_t size = size_ - offset;
+    switch (code_bits) {
+    case 9: lzwSearchVariant<9>(variant, input, size, num_bytes, automaton, results); break;
+    case 10: lzwSearchVariant<10>(variant, input, size, num_bytes, automaton, results); break;
+    case 11: lzwSearchVariant<11>(variant, input, size, num_bytes, automaton, results); break;
+    case 12: lzwSearchVariant<12>(variant, input, size, num_bytes, automaton, results); break;
+    case 13: lzwSearchVariant<13>(variant, input, size, num_bytes, automaton, results); break;
+    case 14: lzwSearchVariant<14>(variant, input, size, num_bytes, automaton, results); break;
+    case 15: lzwSearchVariant<15>(variant, input, size, num_bytes, automaton, results); break;
+    default: lzwSearchVariant<16>(variant, input, size, num_bytes, automaton, results); break;
+    }
+    return results;
+}
+
+std::vector<uint64_t> lzw_search(const std::vector<unsigned char>& input_, const std::vector<unsigned char>& pattern_) {
+    return lzw_search(input_.data(), input_.size(), pattern_.data(), pattern_.size());
+}
+
+/**
+  * Function which benchmarks the kernels of the LZW coder in isolation, once
+  * for every code width from 9 to 16. All counters are per byte of input. 
+  * The whole codec is then run with classic and LZAP dictionaries, which also
+  * reports the ratio each achieves.
+  */
+void lzw_benchmark(const std::vector<unsigned char>& input_, std::vector<BenchmarkResult>& results_) {
+    const unsigned char* data = input_.data();
+    const size_t size = input_.size();
+    if (size == 0) {
+        return;
+    }
+
+    lzwBenchmarkWidth<9>(data, size, results_);
+    lzwBenchmarkWidth<10>(data, size, results_);
+    lzwBenchmarkWidth<11>(data, size, results_);
+    lzwBenchmarkWidth<12>(data, size, results_);
+    lzwBenchmarkWidth<13>(data, size, results_);
+    lzwBenchmarkWidth<14>(data, size, results_);
+    lzwBenchmarkWidth<15>(data, size, results_);
+    lzwBenchmarkWidth<16>(data, size, results_);
+
+    const unsigned int codec_code_bits[] = { 12, 16 };
+    const LZWVariant_t variants[] = { LZW_CLASSIC, LZW_LZAP };
+    for (unsigned int code_bits : codec_code_bits) {
+        for (LZWVariant_t variant : variants) {
+            const std::string name = std::string(variant == LZW_LZAP ? "LZAP" : "classic") + "<" + std::to_string(code_bits) + ">";
+            std::vector<unsigned char> compressed(lzw_compress_bound(size, code_bits));
+            size_t compressed_size = 0;
+            BenchmarkResult compress = runBenchmark("lzw_compress " + name, size, [&]() {
+                compressed_size = lzw_compress(data, size, compressed.data(), code_bits, variant);
+                benchmarkKeep(compressed_size);
+            });
+
+            std::vector<unsigned char> decompressed(size);
+            BenchmarkResult decompress = runBenchmark("lzw_decompress " + name, size, [&]() {
+                benchmarkKeep(lzw_decompress(compressed.data(), compressed_size, decompressed.data(), size));
+            });
+
+            compress.m_ratio = static_cast<double>(compressed_size) / static_cast<double>(size);
+            decompress.m_ratio = compress.m_ratio;
+            results_.push_back(compress);
+            results_.push_back(decompress);
+        }
+    }
+}
\ No newline at end of file
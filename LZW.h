@@ -21,6 +21,83 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
+#include <cstddef>
 
-std::vector<unsigned char> lzw_compress(const std::vector<unsigned char>& data_);
+struct BenchmarkResult;
+
+/**
+  * LZW compression with codes of code_bits_ bits, between 9 and 16. Wider
+  * codes give a larger dictionary, which suits larger inputs. The code width
+  * is stored in the stream, so decompression needs no parameters. Streams
+  * start with a magic and a format version, and decoders reject versions
+  * they do not know. lzw_decompress also reads the original headerless 
+  * format with 12-bit codes, but has to decode it to find its size.
+  */
+const unsigned int lzw_default_code_bits = 12;
+
+/**
+  * Classic LZW adds the previous string extended by one character to the
+  * dictionary. LZAP adds it extended by every prefix of the current string,
+  * which learns long repeats much faster. The variant is a flag in the 
+  * stream header.
+  */
+enum LZWVariant_t {
+    LZW_CLASSIC,
+    LZW_LZAP
+};
+
+std::vector<unsigned char> lzw_compress(const std::vector<unsigned char>& data_, unsigned int code_bits_=lzw_default_code_bits, LZWVariant_t variant_=LZW_CLASSIC);
 std::vector<unsigned char> lzw_decompress(const std::vector<unsigned char>& data_);
+
+/**
+  * Versions which read size_ bytes from data_, and append the result to the end of output_
+  */
+void lzw_compress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_, unsigned int code_bits_=lzw_default_code_bits, LZWVariant_t variant_=LZW_CLASSIC);
+void lzw_decompress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_);
+
+/**
+  * Versions which work on caller owned memory. lzw_compress requires room for
+  * lzw_compress_bound(size_, code_bits_) bytes in output_, and lzw_decompress requires room for
+  * lzw_decompressed_size(data_, size_) bytes. Both return the number of bytes written.
+  */
+size_t lzw_compress_bound(size_t size_, unsigned int code_bits_=lzw_default_code_bits);
+size_t lzw_compress(const unsigned char* data_, size_t size_, unsigned char* output_, unsigned int code_bits_=lzw_default_code_bits, LZWVariant_t variant_=LZW_CLASSIC);
+size_t lzw_decompressed_size(const unsigned char* data_, size_t size_);
+size_t lzw_decompress(const unsigned char* data_, size_t size_, unsigned char* output_, size_t capacity_);
+
+
+/**
+  * LZW where the codes are Huffman coded, rather than packed and then Huffman 
+  * coded byte by byte, which splits codes across bytes and hides their 
+  * statistics. The codes form an alphabet of 2^code_bits_ symbols, coded with
+  * a length limited canonical Huffman code, and the decoder looks up each 
+  * code in a single table as the LZW decoder reads it.
+  */
+std::vector<unsigned char> lzw_huffman_compress(const std::vector<unsigned char>& data_, unsigned int code_bits_=lzw_default_code_bits, LZWVariant_t variant_=LZW_CLASSIC);
+std::vector<unsigned char> lzw_huffman_decompress(const std::vector<unsigned char>& data_);
+void lzw_huffman_compress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_, unsigned int code_bits_=lzw_default_code_bits, LZWVariant_t variant_=LZW_CLASSIC);
+void lzw_huffman_decompress(const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_);
+size_t lzw_huffman_compress_bound(size_t size_, unsigned int code_bits_=lzw_default_code_bits);
+size_t lzw_huffman_compress(const unsigned char* data_, size_t size_, unsigned char* output_, unsigned int code_bits_=lzw_default_code_bits, LZWVariant_t variant_=LZW_CLASSIC);
+size_t lzw_huffman_decompressed_size(const unsigned char* data_, size_t size_);
+size_t lzw_huffman_decompress(const unsigned char* data_, size_t size_, unsigned char* output_, size_t capacity_);
+
+/**
+  * Searches LZW compressed data for pattern_ without decompressing it, and
+  * returns the offsets in the decompressed data where pattern_ starts, in 
+  * increasing order and including overlapping matches. Classic LZW streams 
+  * are searched code by code, mostly without looking at the characters, and
+  * memory use depends on the code width and pattern size, not the data.
+  * LZAP streams are searched string by string. Streams in the original 
+  * headerless format are decompressed into memory and then scanned, as their
+  * dictionary cannot be followed without the output. Patterns may be up to 
+  * 4096 bytes.
+  */
+std::vector<uint64_t> lzw_search(const std::vector<unsigned char>& data_, const std::vector<unsigned char>& pattern_);
+std::vector<uint64_t> lzw_search(const unsigned char* data_, size_t size_, const unsigned char* pattern_, size_t pattern_size_);
+
+/**
+  * Benchmarks each kernel of the LZW coder on input_, and appends the results
+  */
+void lzw_benchmark(const std::vector<unsigned char>& input_, std::vector<BenchmarkResult>& results_);
\ No newline at end of file
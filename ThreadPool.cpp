@@ -0,0 +1,168 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+ThreadPool::ThreadPool(unsigned int num_threads_, size_t max_queued_, bool pin_threads_) 
+    : m_next_sequence(0), m_max_queued(std::max<size_t>(max_queued_, 1)), 
+    m_num_queued(0), m_num_running(0), m_stopping(false) {
+    num_threads_ = std::max(num_threads_, 1u);
+    for (unsigned int i=0; i<num_threads_; ++i) {
+        m_workers.push_back(std::unique_ptr<Worker>(new Worker()));
+    }
+    for (unsigned int i=0; i<num_threads_; ++i) {
+        m_threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+
+#ifdef __linux__
+    //Pinning is a hint, so a failure, e.g. from a restricted CPU set, is ignored
+    unsigned int num_cpus = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned int i=0; i<num_threads_ && pin_threads_; ++i) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(i % num_cpus, &cpus);
+        pthread_setaffinity_np(m_threads[i].native_handle(), sizeof(cpus), &cpus);
+    }
+#else
+    (void) pin_threads_;
+#endif
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_work_available.notify_all();
+    m_not_full.notify_all();
+    for (size_t i=0; i<m_threads.size(); ++i) {
+        m_threads[i].join();
+    }
+}
+
+void ThreadPool::submit(Task task_, int priority_) {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_full.wait(lock, [this]() { return m_num_queued < m_max_queued || m_stopping; });
+        if (m_stopping) {
+            throw std::runtime_error("ThreadPool: submit after shutdown");
+        }
+        ++m_num_queued;
+    }
+    push(task_, priority_);
+}
+
+bool ThreadPool::trySubmit(Task task_, int priority_) {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_num_queued >= m_max_queued || m_stopping) {
+            return false;
+        }
+        ++m_num_queued;
+    }
+    push(task_, priority_);
+    return true;
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_all_done.wait(lock, [this]() { return m_num_queued == 0 && m_num_running == 0; });
+}
+
+/**
+  * Hands the job to the workers in a round robin fashion. The caller has
+  * already counted it in m_num_queued.
+  */
+void ThreadPool::push(Task task_, int priority_) {
+    Job job;
+    job.m_priority = priority_;
+    job.m_sequence = m_next_sequence++;
+    job.m_task = task_;
+
+    Worker& worker = *m_workers[job.m_sequence % m_workers.size()];
+    {
+        std::unique_lock<std::mutex> lock(worker.m_mutex);
+        worker.m_jobs.push(job);
+    }
+    m_work_available.notify_one();
+}
+
+/**
+  * Pops the next job from the worker's own queue, or steals one from another worker
+  */
+bool ThreadPool::pop(size_t worker_, Job& job_) {
+    for (size_t i=0; i<m_workers.size(); ++i) {
+        Worker& worker = *m_workers[(worker_ + i) % m_workers.size()];
+        std::unique_lock<std::mutex> lock(worker.m_mutex);
+        if (!worker.m_jobs.empty()) {
+            job_ = worker.m_jobs.top();
+            worker.m_jobs.pop();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t worker_) {
+    for (;;) {
+        Job job;
+        if (pop(worker_, job)) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                --m_num_queued;
+                ++m_num_running;
+            }
+            m_not_full.notify_one();
+
+            //Tasks report their own errors, an escaping exception must not take down the worker
+            try {
+                job.m_task();
+            }
+            catch (...) {
+            }
+
+            bool all_done = false;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                --m_num_running;
+                all_done = (m_num_queued == 0 && m_num_running == 0);
+            }
+            if (all_done) {
+                m_all_done.notify_all();
+            }
+            continue;
+        }
+
+        //A job may be counted before it is pushed, in which case we simply try again
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stopping && m_num_queued == 0) {
+            return;
+        }
+        m_work_available.wait(lock, [this]() { return m_num_queued > 0 || m_stopping; });
+    }
+}
\ No newline at end of file
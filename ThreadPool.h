@@ -0,0 +1,114 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+/**
+  * Work stealing thread pool. Every worker has its own priority queue of 
+  * tasks, and idle workers steal from the others. At most max_queued_ tasks
+  * can wait at any time, after which submit() blocks to apply back-pressure.
+  * With pin_threads_, worker i is pinned to CPU i modulo the number of CPUs,
+  * which is supported on Linux and ignored elsewhere.
+  */
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+    ThreadPool(unsigned int num_threads_, size_t max_queued_, bool pin_threads_=false);
+
+    /**
+      * Runs all queued tasks to completion before joining the workers
+      */
+    ~ThreadPool();
+
+    /**
+      * Queues a task, blocking while the queue is full. Tasks with a higher
+      * priority_ are run first by the worker the task is queued on, but the
+      * order is not kept across the pool: another worker may run, or steal,
+      * a lower priority task before it.
+      */
+    void submit(Task task_, int priority_=0);
+
+    /**
+      * Queues a task unless the queue is full, and returns whether it was queued
+      */
+    bool trySubmit(Task task_, int priority_=0);
+
+    /**
+      * Blocks until every submitted task has finished
+      */
+    void wait();
+
+    inline unsigned int numThreads() const {
+        return static_cast<unsigned int>(m_threads.size());
+    }
+
+private:
+    struct Job {
+        int m_priority;
+        uint64_t m_sequence;
+        Task m_task;
+
+        //Highest priority first, then first in first out
+        inline bool operator<(const Job& rhs) const {
+            if (m_priority != rhs.m_priority) {
+                return m_priority < rhs.m_priority;
+            }
+            return m_sequence > rhs.m_sequence;
+        }
+    };
+
+    struct Worker {
+        std::mutex m_mutex;
+        std::priority_queue<Job> m_jobs;
+    };
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void push(Task task_, int priority_);
+    bool pop(size_t worker_, Job& job_);
+    void workerLoop(size_t worker_);
+
+    std::vector<std::unique_ptr<Worker> > m_workers;
+    std::vector<std::thread> m_threads;
+    std::atomic<uint64_t> m_next_sequence;
+
+    //Protects the counters below
+    std::mutex m_mutex;
+    std::condition_variable m_work_available;
+    std::condition_variable m_not_full;
+    std::condition_variable m_all_done;
+    size_t m_max_queued;
+    size_t m_num_queued;
+    size_t m_num_running;
+    bool m_stopping;
+};
\ No newline at end of file
@@ -0,0 +1,69 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+  * Writes value_ to output_ as a variable length integer with seven bits per
+  * byte, and returns the number of bytes written (at most 10)
+  */
+inline size_t writeVarint(uint64_t value_, unsigned char* output_) {
+    size_t offset = 0;
+    while (value_ >= 0x80) {
+        output_[offset++] = static_cast<unsigned char>(value_ | 0x80);
+        value_ >>= 7;
+    }
+    output_[offset++] = static_cast<unsigned char>(value_);
+    return offset;
+}
+
+/**
+  * Returns the number of bytes writeVarint uses for value_
+  */
+inline size_t varintSize(uint64_t value_) {
+    size_t bytes = 1;
+    while (value_ >= 0x80) {
+        value_ >>= 7;
+        bytes += 1;
+    }
+    return bytes;
+}
+
+/**
+  * Reads a variable length integer from data_ at offset_ into value_.
+  * Returns false if the data ends before the integer, or if it does not fit in 64 bits
+  */
+inline bool readVarint(const unsigned char* data_, size_t size_, size_t& offset_, uint64_t& value_) {
+    value_ = 0;
+    for (unsigned int shift=0; shift<64; shift+=7) {
+        if (offset_ == size_) {
+            return false;
+        }
+        unsigned char byte = data_[offset_++];
+        value_ |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "../LZW.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+/**
+  * libFuzzer target for the LZW decoders, with packed and with Huffman coded
+  * codes. Malformed input must be rejected with an exception, and never read
+  * or write out of bounds. See README.md for how to build and run it.
+  */
+
+namespace { //Avoid contaminating global namespace
+
+/**
+  * Larger stored lengths are skipped, so that the fuzzer does not spend
+  * its time allocating output for lengths the data cannot hold
+  */
+const size_t max_output_size = 1 << 24;
+
+} // Namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data_, size_t size_) {
+    try {
+        size_t num_bytes = lzw_decompressed_size(data_, size_);
+        if (num_bytes <= max_output_size) {
+            std::vector<unsigned char> output(num_bytes);
+            lzw_decompress(data_, size_, output.data(), output.size());
+        }
+    }
+    catch (const std::exception&) {
+        //Rejected input
+    }
+
+    try {
+        size_t num_bytes = lzw_huffman_decompressed_size(data_, size_);
+        if (num_bytes <= max_output_size) {
+            std::vector<unsigned char> output(num_bytes);
+            lzw_huffman_decompress(data_, size_, output.data(), output.size());
+        }
+    }
+    catch (const std::exception&) {
+        //Rejected input
+    }
+    return 0;
+}
\ No newline at end of file
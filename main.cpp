@@ -18,8 +18,18 @@
   *
   ***/
 
-#include "LZW.h"
+#include "Codec.h"
+#include "Batch.h"
 #include "Huffman.h"
+#include "BWT.h"
+#include "LZW.h"
+#include "LZ77.h"
+#include "Archive.h"
+#include "Benchmark.h"
+#include "AsyncIO.h"
+#include "Varint.h"
+#include "Dedup.h"
+#include "Daemon.h"
 
 #include <fstream>
 #include <iostream>
@@ -29,6 +39,10 @@
 #include <sstream>
 #include <vector>
 #include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <chrono>
+#include <csignal>
 
 /**
   * Test data set if we don't have a file at hand
@@ -36,23 +50,6 @@
 extern const unsigned char test_data[];
 extern const unsigned int test_data_size;
 
-/**
-  * Enum to keep track of which algorithms to perform
-  */
-enum Compress_t {
-    LZW,
-    HUFFMAN
-};
-
-std::ostream& operator<<(std::ostream& os_, const Compress_t& t_) {
-    switch (t_) {
-    case LZW: os_ << "LZW"; break;
-    case HUFFMAN: os_ << "Huffman"; break;
-    default: os_ << "UNKNOWN_COMPRESS_T"; break;
-    }
-    return os_;
- }
-
 /**
   * Helper function to print out contents of vector as to screen
   */
@@ -81,37 +78,432 @@ std::ostream& operator<<(std::ostream& out, const std::vector<T>& v_) {
 /**
   * function which reads a whole file into memory
   */
-inline std::vector<unsigned char> readFile(std::string filename_) {
+inline std::vector<unsigned char> readFile(std::string filename_, const AsyncIOOptions& options_=AsyncIOOptions()) {
     std::vector<unsigned char> output;
-    std::ifstream file(filename_, std::ios::binary);
-    if (file.good()) {
-        file.seekg(0, std::ios::end);
-        size_t bytes = file.tellg();
-        file.seekg(0, std::ios::beg);
-        output.resize(bytes);
-        char* ptr = reinterpret_cast<char*>(&output[0]);
-        size_t bytes_read = 0;
-        while (bytes_read != bytes ) {
-            file.read(ptr + bytes_read, bytes-bytes_read);
-            size_t bytes_read_this_iter = file.gcount();
-            bytes_read += bytes_read_this_iter;
-            if (bytes_read_this_iter == 0) {
-                break;
+    try {
+        AsyncFileReader file(filename_, options_);
+        output.reserve(static_cast<size_t>(file.size()));
+        const unsigned char* block;
+        size_t block_size;
+        while (file.next(block, block_size)) {
+            output.insert(output.end(), block, block+block_size);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Could not open '" << filename_ << "' as a regular file... (" << e.what() << ")" << std::endl;
+        exit(-1);
+    }
+    return output;
+}
+
+/**
+  * Settings of the algorithms from the command line, which the compress 
+  * functions in Codec.h do not take. The streams store them, so 
+  * decompression does not need them.
+  */
+struct AlgorithmOptions {
+    AlgorithmOptions() : m_filter_width(filter_default_width), m_lzw_code_bits(lzw_default_code_bits), 
+        m_lzw_variant(LZW_CLASSIC), m_checkpoint_interval(0) {}
+
+    /**
+      * Returns true if any setting differs from the defaults used by Codec.h
+      */
+    inline bool custom() const {
+        return m_filter_width != filter_default_width || m_lzw_code_bits != lzw_default_code_bits
+            || m_lzw_variant != LZW_CLASSIC || m_checkpoint_interval != 0;
+    }
+
+    unsigned int m_filter_width;
+    unsigned int m_lzw_code_bits;
+    LZWVariant_t m_lzw_variant;
+    size_t m_checkpoint_interval;
+};
+
+/**
+  * Function which compresses size_ bytes from data_ with one algorithm and 
+  * its settings, and appends the result to output_
+  */
+void compressWith(Compress_t type_, const AlgorithmOptions& algorithm_options_, const unsigned char* data_, size_t size_, std::vector<unsigned char>& output_) {
+    Filter_t filter;
+    if (type_ == LZW) {
+        lzw_compress(data_, size_, output_, algorithm_options_.m_lzw_code_bits, algorithm_options_.m_lzw_variant);
+    }
+    else if (type_ == LZW_HUFFMAN) {
+        lzw_huffman_compress(data_, size_, output_, algorithm_options_.m_lzw_code_bits, algorithm_options_.m_lzw_variant);
+    }
+    else if (type_ == HUFFMAN && algorithm_options_.m_checkpoint_interval > 0) {
+        huffman_compress(data_, size_, output_, false, algorithm_options_.m_checkpoint_interval);
+    }
+    else if (is_filter(type_, filter)) {
+        filter_encode(filter, algorithm_options_.m_filter_width, data_, size_, output_);
+    }
+    else {
+        compress(type_, data_, size_, output_);
+    }
+}
+
+/**
+  * Function which streams input_file_ block by block through the algorithms into
+  * output_file_, and then back through the algorithms in reverse into 
+  * output_file_.out. Reads and writes are asynchronous, so the disk works while 
+  * the codecs do. Each block is stored as its size and its compressed size as 
+  * varints, followed by the compressed data.
+  */
+void runStream(const std::string& input_file_, const std::string& output_file_, 
+        std::vector<Compress_t> compress_ops_, const AlgorithmOptions& algorithm_options_, const AsyncIOOptions& options_) {
+    const unsigned char* block;
+    size_t block_size;
+    std::vector<unsigned char> data;
+    std::vector<unsigned char> output;
+
+    try {
+        AsyncFileReader reader(input_file_, options_);
+        AsyncFileWriter writer(output_file_, options_);
+        std::cout << "Streaming '" << input_file_ << "' into '" << output_file_ << "' in blocks of " 
+            << options_.m_block_size << " bytes using " << ((reader.usesIOUring()) ? "io_uring" : "a worker thread")
+            << ((options_.m_direct) ? " and direct I/O" : "") << std::endl;
+        size_t num_blocks = 0;
+        while (reader.next(block, block_size)) {
+            data.assign(block, block+block_size);
+            for (size_t i=0; i<compress_ops_.size(); ++i) {
+                output.clear();
+                compressWith(compress_ops_[i], algorithm_options_, data.data(), data.size(), output);
+                data.swap(output);
             }
+            unsigned char header[20];
+            size_t header_size = writeVarint(block_size, header);
+            header_size += writeVarint(data.size(), header+header_size);
+            writer.write(header, header_size);
+            writer.write(data.data(), data.size());
+            ++num_blocks;
+        }
+        writer.close();
+        std::cout << "Compressed " << reader.size() << " bytes in " << num_blocks << " blocks into " << writer.size() << " bytes" << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Compression failed: " << e.what() << std::endl;
+        exit(-1);
+    }
+
+    std::reverse(compress_ops_.begin(), compress_ops_.end());
+    try {
+        AsyncFileReader reader(output_file_, options_);
+        AsyncFileWriter writer(output_file_ + ".out", options_);
+        std::vector<unsigned char> pending;
+        while (reader.next(block, block_size)) {
+            pending.insert(pending.end(), block, block+block_size);
+
+            //Decompress all complete blocks, and keep the rest for the next read
+            size_t consumed = 0;
+            while (true) {
+                size_t offset = consumed;
+                uint64_t raw_size;
+                uint64_t compressed_size;
+                if (!readVarint(pending.data(), pending.size(), offset, raw_size) 
+                        || !readVarint(pending.data(), pending.size(), offset, compressed_size)
+                        || pending.size() - offset < compressed_size) {
+                    break;
+                }
+                data.assign(pending.begin()+offset, pending.begin()+offset+static_cast<size_t>(compressed_size));
+                for (size_t i=0; i<compress_ops_.size(); ++i) {
+                    output.clear();
+                    decompress(compress_ops_[i], data.data(), data.size(), output);
+                    data.swap(output);
+                }
+                if (data.size() != raw_size) {
+                    throw std::runtime_error("Stream: block decompressed to the wrong size");
+                }
+                writer.write(data.data(), data.size());
+                consumed = offset + static_cast<size_t>(compressed_size);
+            }
+            pending.erase(pending.begin(), pending.begin()+consumed);
+        }
+        if (!pending.empty()) {
+            throw std::runtime_error("Stream: file ends inside a block");
+        }
+        writer.close();
+        std::cout << "Decompressed " << reader.size() << " bytes into " << writer.size() << " bytes in '" << output_file_ << ".out'" << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Decompression failed: " << e.what() << std::endl;
+        exit(-1);
+    }
+    std::cout << std::endl;
+}
+
+/**
+  * Function which splits the input into records of record_size_ bytes, and runs 
+  * the algorithms over all records using the batch API. Returns the decompressed
+  * records concatenated.
+  */
+std::vector<unsigned char> runBatch(const std::vector<unsigned char>& input_, std::vector<Compress_t> compress_ops_, size_t record_size_, unsigned int num_threads_) {
+    std::vector<BatchInput> records;
+    for (size_t i=0; i<input_.size(); i+=record_size_) {
+        records.push_back(BatchInput(input_.data()+i, std::min(record_size_, input_.size()-i)));
+    }
+    std::cout << "Batch of " << records.size() << " records on " << num_threads_ << " threads" << std::endl;
+
+    BatchOutput batch;
+    std::cout << "Compressing:" << std::endl;
+    std::cout << "Input: " << input_.size() << " bytes" << std::endl;
+    for (size_t i=0; i<compress_ops_.size(); ++i) {
+        std::cout << " +" << compress_ops_[i] << ":";
+        batch = batch_compress(compress_ops_[i], records, num_threads_);
+        records = batch.records();
+        std::cout << batch.m_arena.size() << " bytes" << std::endl;
+    }
+    std::cout << std::endl;
+
+    std::reverse(compress_ops_.begin(), compress_ops_.end());
+    std::cout << "Decompressing:" << std::endl;
+    std::cout << "Input: " << batch.m_arena.size() << " bytes" << std::endl;
+    for (size_t i=0; i<compress_ops_.size(); ++i) {
+        std::cout << " -" << compress_ops_[i] << ":";
+        try {
+            batch = batch_decompress(compress_ops_[i], records, num_threads_);
         }
-        if (bytes_read != bytes) {
-            std::cerr << "Tried reading " << bytes << " bytes from file, and got " << bytes_read << std::endl;
+        catch (const std::exception& e) {
+            std::cerr << "Decompression failed: " << e.what() << std::endl;
             exit(-1);
         }
-        file.close();
+        records = batch.records();
+        std::cout << batch.m_arena.size() << " bytes" << std::endl;
     }
-    else {
-        std::cerr << "Could not open '" << filename_ << "' as a regular file..." << std::endl;
+    std::cout << std::endl;
+
+    return batch.m_arena;
+}
+
+/**
+  * Function which deduplicates the input into chunks, compresses the unique
+  * chunks with the algorithms, and decompresses it again. Prints the dedup
+  * ratio and throughput, and returns the decompressed data. With a store_file_,
+  * the chunk store is loaded from it if it exists, so only chunks that earlier 
+  * runs have not seen are stored, and the grown store is saved back to it.
+  */
+std::vector<unsigned char> runDedup(const std::vector<unsigned char>& input_, const std::vector<Compress_t>& compress_ops_, 
+        unsigned int num_threads_, const std::string& store_file_) {
+    DedupOptions options;
+    options.m_num_threads = num_threads_;
+    DedupStats stats;
+    ChunkStore store;
+    std::vector<unsigned char> compressed;
+    std::vector<unsigned char> output;
+
+    if (store_file_ != "" && std::ifstream(store_file_, std::ios::binary).good()) {
+        std::vector<unsigned char> saved = readFile(store_file_);
+        try {
+            store.load(saved.data(), saved.size());
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Could not load the chunk store '" << store_file_ << "': " << e.what() << std::endl;
+            exit(-1);
+        }
+        std::cout << "Loaded " << store.numChunks() << " chunks (" << store.data().size() << " bytes) from '" << store_file_ << "'" << std::endl;
+    }
+    //Decompression starts from the same store as compression
+    ChunkStore decompress_store = store;
+
+    std::cout << "Deduplicating on " << num_threads_ << " threads:" << std::endl;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    try {
+        compressed = dedup_compress(input_.data(), input_.size(), compress_ops_, store, options, &stats);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Compression failed: " << e.what() << std::endl;
         exit(-1);
     }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    try {
+        output = dedup_decompress(compressed.data(), compressed.size(), decompress_store, num_threads_);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Decompression failed: " << e.what() << std::endl;
+        exit(-1);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    double compress_seconds = std::chrono::duration<double>(middle - start).count();
+    double decompress_seconds = std::chrono::duration<double>(end - middle).count();
+    double ratio = (stats.m_unique_size > 0) ? static_cast<double>(stats.m_size) / stats.m_unique_size : 1.0;
+    std::cout << "Input: " << stats.m_size << " bytes in " << stats.m_num_chunks << " chunks" << std::endl;
+    std::cout << "Unique: " << stats.m_unique_size << " bytes in " << stats.m_num_unique_chunks << " chunks (dedup ratio " 
+        << std::fixed << std::setprecision(2) << ratio << ")" << std::endl;
+    std::cout << "Compressed: " << stats.m_compressed_size << " bytes" << std::endl;
+    std::cout << "Compression: " << stats.m_size / (compress_seconds * 1.0e6) << " MB/s, decompression: " 
+        << stats.m_size / (decompress_seconds * 1.0e6) << " MB/s" << std::defaultfloat << std::endl;
+
+    if (store_file_ != "") {
+        std::vector<unsigned char> saved;
+        store.save(saved);
+        std::ofstream file(store_file_, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(saved.data()), saved.size());
+        if (!file) {
+            std::cerr << "Could not save the chunk store to '" << store_file_ << "'" << std::endl;
+            exit(-1);
+        }
+        std::cout << "Saved " << store.numChunks() << " chunks (" << saved.size() << " bytes) to '" << store_file_ << "'" << std::endl;
+    }
+    std::cout << std::endl;
     return output;
 }
 
+/**
+  * Function which compresses the input with LZW, and searches the compressed 
+  * data for pattern_. Prints where the pattern occurs, and exits with an error 
+  * if the result differs from searching the input.
+  */
+void runSearch(const std::vector<unsigned char>& input_, const std::string& pattern_, unsigned int lzw_code_bits_, LZWVariant_t lzw_variant_) {
+    std::vector<unsigned char> pattern(pattern_.begin(), pattern_.end());
+    std::vector<unsigned char> compressed;
+    std::vector<uint64_t> offsets;
+    try {
+        lzw_compress(input_.data(), input_.size(), compressed, lzw_code_bits_, lzw_variant_);
+        offsets = lzw_search(compressed, pattern);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Search failed: " << e.what() << std::endl;
+        exit(-1);
+    }
+    std::cout << "Searching " << compressed.size() << " bytes of LZW for '" << pattern_ << "': " << offsets.size() << " matches" << std::endl;
+    for (size_t i=0; i<std::min<size_t>(offsets.size(), 10); ++i) {
+        std::cout << " at byte " << offsets[i] << std::endl;
+    }
+
+    std::vector<uint64_t> expected;
+    std::vector<unsigned char>::const_iterator it = input_.begin();
+    while ((it = std::search(it, input_.end(), pattern.begin(), pattern.end())) != input_.end()) {
+        expected.push_back(it - input_.begin());
+        ++it;
+    }
+    if (offsets != expected) {
+        std::cerr << "Search found " << offsets.size() << " matches, but expected " << expected.size() << std::endl;
+        exit(-1);
+    }
+    std::cout << "Search equal to uncompressed search: Success!" << std::endl;
+}
+
+/**
+  * The running daemon, so that the signal handler can stop it
+  */
+CompressionDaemon* running_daemon = nullptr;
+
+extern "C" void stopDaemon(int) {
+    if (running_daemon) {
+        running_daemon->stop();
+    }
+}
+
+/**
+  * Function which runs the compression daemon on socket_ until interrupted,
+  * and prints what it has served
+  */
+void runDaemon(const std::string& socket_, unsigned int num_threads_, bool pin_threads_, bool allow_unsealed_) {
+    try {
+        DaemonOptions options;
+        options.m_num_threads = num_threads_;
+        options.m_pin_threads = pin_threads_;
+        options.m_allow_unsealed = allow_unsealed_;
+        CompressionDaemon daemon(socket_, options);
+        running_daemon = &daemon;
+        signal(SIGINT, stopDaemon);
+        signal(SIGTERM, stopDaemon);
+        std::cout << "Serving on '" << socket_ << "' with " << num_threads_ << " threads, press Ctrl-C to stop" << std::endl;
+        daemon.run();
+        running_daemon = nullptr;
+
+        DaemonStats stats = daemon.stats();
+        std::cout << std::endl << "Served " << stats.m_num_requests << " requests (" << stats.m_num_failed << " failed, " 
+            << stats.m_num_rejected << " rejected), " << stats.m_bytes_in << " bytes in, " << stats.m_bytes_out << " bytes out" << std::endl;
+        if (stats.m_num_requests > 0) {
+            std::cout << "Latency: " << stats.m_total_latency_us / stats.m_num_requests << " us average, " 
+                << stats.m_max_latency_us << " us max" << std::endl;
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Daemon failed: " << e.what() << std::endl;
+        exit(-1);
+    }
+}
+
+/**
+  * Function which compresses the input through the algorithms, and then 
+  * decompresses it, in the daemon listening on socket_. The algorithms use 
+  * their default settings.
+  */
+std::vector<unsigned char> runClient(const std::vector<unsigned char>& input_, std::vector<Compress_t> compress_ops_, const std::string& socket_) {
+    std::vector<unsigned char> data = input_;
+    std::vector<unsigned char> output;
+    try {
+        //Leave room for inputs and results which grow
+        CompressionClient client(socket_, std::max(daemon_default_ring_size, 2*input_.size() + (1 << 20)));
+        std::cout << "Compressing in the daemon on '" << socket_ << "':" << std::endl;
+        std::cout << "Input: " << data.size() << " bytes" << std::endl;
+        for (size_t i=0; i<compress_ops_.size(); ++i) {
+            std::cout << " +" << compress_ops_[i] << ":";
+            output.clear();
+            client.compress(compress_ops_[i], data.data(), data.size(), output);
+            std::cout << output.size() << " bytes" << std::endl;
+            data.swap(output);
+        }
+        std::cout << std::endl;
+
+        std::reverse(compress_ops_.begin(), compress_ops_.end());
+        std::cout << "Decompressing in the daemon:" << std::endl;
+        std::cout << "Input: " << data.size() << " bytes" << std::endl;
+        for (size_t i=0; i<compress_ops_.size(); ++i) {
+            std::cout << " -" << compress_ops_[i] << ":";
+            output.clear();
+            client.decompress(compress_ops_[i], data.data(), data.size(), output);
+            std::cout << output.size() << " bytes" << std::endl;
+            data.swap(output);
+        }
+        std::cout << std::endl;
+
+        DaemonStats stats = client.stats();
+        std::cout << "Daemon served " << stats.m_num_requests << " requests in " << stats.m_total_latency_us 
+            << " us (max " << stats.m_max_latency_us << " us)" << std::endl;
+        std::cout << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Daemon request failed: " << e.what() << std::endl;
+        exit(-1);
+    }
+    return data;
+}
+
+/**
+  * Function which archives all files below directory_ into archive_, or
+  * extracts archive_ into directory_
+  */
+void runArchive(const std::string& directory_, const std::string& archive_, bool extract_, 
+        const std::vector<Compress_t>& compress_ops_, const ArchiveOptions& options_) {
+    try {
+        if (extract_) {
+            std::cout << "Extracting '" << archive_ << "' into '" << directory_ << "' on " << options_.m_num_threads << " threads" << std::endl;
+            std::vector<ArchiveEntry> entries = archive_list(archive_);
+            archive_extract(archive_, directory_, options_.m_num_threads);
+            std::cout << "Extracted " << entries.size() << " files" << std::endl;
+        }
+        else {
+            std::cout << "Archiving '" << directory_ << "' into '" << archive_ << "' on " << options_.m_num_threads << " threads" << std::endl;
+            std::vector<ArchiveEntry> entries = archive_create(directory_, archive_, compress_ops_, options_);
+            uint64_t total_size = 0;
+            for (size_t i=0; i<entries.size(); ++i) {
+                total_size += entries[i].m_size;
+            }
+            size_t num_blocks = entries.empty() ? 0 : entries.back().m_block+1;
+            std::ifstream archive(archive_, std::ios::binary | std::ios::ate);
+            std::cout << "Archived " << entries.size() << " files (" << total_size << " bytes) in " 
+                << num_blocks << " blocks into " << archive.tellg() << " bytes" << std::endl;
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Archive failed: " << e.what() << std::endl;
+        exit(-1);
+    }
+}
+
 /**
   * Main entry point
   */
@@ -120,28 +512,207 @@ int main(int argc, char** argv) {
     std::vector<unsigned char> output;
     std::vector<Compress_t> compress_ops;
     std::string filename;
+    size_t record_size = 0;
+    unsigned int num_threads = 1;
+    AlgorithmOptions algorithm_options;
+    std::string archive_directory;
+    bool extract = false;
+    size_t solid_block_size = 0;
+    bool benchmark = false;
+    bool dedup = false;
+    std::string dedup_store_file;
+    std::string search_pattern;
+    std::string output_file;
+    AsyncIOOptions io_options;
+    std::string reference_file;
+    std::vector<unsigned char> reference;
+    std::string daemon_socket;
+    std::string client_socket;
+    bool pin_threads = false;
+    bool allow_unsealed = false;
 
     //Get options from commandline
-    std::cout << "Compression demo of LZW and Huffman" << std::endl;
+    std::cout << "Compression demo of LZW, LZ77, BWT and Huffman with filters" << std::endl;
     std::cout << "Usage: <program> [options] <filename>" << std::endl;
     std::cout << "Options: " << std::endl;
     std::cout << " -lzw        Enable LZW compression" << std::endl;
     std::cout << " -huffman    Enable Huffman compression" << std::endl;
+    std::cout << " -adaptive   Enable one pass adaptive Huffman compression" << std::endl;
+    std::cout << " -blockhuffman Enable Huffman compression in blocks which may reuse recent tables" << std::endl;
+    std::cout << " -lz77       Enable LZ77 compression" << std::endl;
+    std::cout << " -bwt        Enable Burrows-Wheeler transform (follow with -huffman)" << std::endl;
+    std::cout << " -shuffle    Enable byte shuffle filter" << std::endl;
+    std::cout << " -delta      Enable delta filter" << std::endl;
+    std::cout << " -xordelta   Enable XOR delta filter" << std::endl;
+    std::cout << " -width <n>  Element width in bytes used by the filters (default 4)" << std::endl;
+    std::cout << " -checkpoints <n> Store a checkpoint every n bytes in Huffman data, for decoding ranges" << std::endl;
+    std::cout << " -lzwhuffman Enable LZW compression with Huffman coded LZW codes" << std::endl;
+    std::cout << " -lzwbits <n> LZW code width in bits, between 9 and 16 (default 12)" << std::endl;
+    std::cout << " -lzap       Use the LZAP dictionary variant for LZW" << std::endl;
+    std::cout << " -reference <file> Delta compress against file, e.g. a previous version (first algorithm must be -lz77)" << std::endl;
+    std::cout << " -search <text> Search the LZW compressed input for text without decompressing it" << std::endl;
+    std::cout << " -archive <dir> Archive all files below dir into <filename>" << std::endl;
+    std::cout << " -extract <dir> Extract the archive <filename> into dir" << std::endl;
+    std::cout << " -solid <n>  Group files smaller than n bytes into solid blocks when archiving" << std::endl;
+    std::cout << " -dedup      Deduplicate content defined chunks before compressing the unique ones" << std::endl;
+    std::cout << " -dedupstore <file> Deduplicate against the chunk store in file, and save the grown store to it" << std::endl;
+    std::cout << " -batch <n>  Compress the input as independent records of n bytes" << std::endl;
+    std::cout << " -threads <n> Number of threads used for batches, BWT blocks and Huffman decompression" << std::endl;
+    std::cout << " -output <file> Stream <filename> block by block into file, and decompress it into file.out" << std::endl;
+    std::cout << " -block <n>  Block size in bytes used for streaming (default 1048576)" << std::endl;
+    std::cout << " -direct     Bypass the page cache when streaming (Linux O_DIRECT)" << std::endl;
+    std::cout << " -daemon <socket> Serve compression requests from local processes on a Unix domain socket" << std::endl;
+    std::cout << " -client <socket> Compress and decompress in the daemon on socket, through shared memory" << std::endl;
+    std::cout << " -pin        Pin each daemon thread to its own CPU (Linux)" << std::endl;
+    std::cout << " -unsealed   Let the daemon map shared memory that is not sealed, on systems without file sealing" << std::endl;
+    std::cout << " -benchmark  Benchmark the Huffman, adaptive Huffman and LZW kernels on synthetic data, and <filename> if given" << std::endl;
     std::cout << "You may enter the same flag multiple times" << std::endl;
     std::cout << std::endl;
     for (int i=1; i<argc; ++i) {
         if (strcmp(argv[i], "-lzw") == 0) {
             compress_ops.push_back(LZW);
         }
+        else if (strcmp(argv[i], "-lzwhuffman") == 0) {
+            compress_ops.push_back(LZW_HUFFMAN);
+        }
         else if (strcmp(argv[i], "-huffman") == 0) {
             compress_ops.push_back(HUFFMAN);
         }
+        else if (strcmp(argv[i], "-adaptive") == 0) {
+            compress_ops.push_back(ADAPTIVE_HUFFMAN);
+        }
+        else if (strcmp(argv[i], "-blockhuffman") == 0) {
+            compress_ops.push_back(HUFFMAN_BLOCKS);
+        }
+        else if (strcmp(argv[i], "-lz77") == 0) {
+            compress_ops.push_back(LZ77);
+        }
+        else if (strcmp(argv[i], "-bwt") == 0) {
+            compress_ops.push_back(BWT);
+        }
+        else if (strcmp(argv[i], "-shuffle") == 0) {
+            compress_ops.push_back(SHUFFLE);
+        }
+        else if (strcmp(argv[i], "-delta") == 0) {
+            compress_ops.push_back(DELTA);
+        }
+        else if (strcmp(argv[i], "-xordelta") == 0) {
+            compress_ops.push_back(XOR_DELTA);
+        }
+        else if (strcmp(argv[i], "-width") == 0 && i+1 < argc) {
+            algorithm_options.m_filter_width = std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-checkpoints") == 0 && i+1 < argc) {
+            algorithm_options.m_checkpoint_interval = std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-lzwbits") == 0 && i+1 < argc) {
+            algorithm_options.m_lzw_code_bits = std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-lzap") == 0) {
+            algorithm_options.m_lzw_variant = LZW_LZAP;
+        }
+        else if (strcmp(argv[i], "-reference") == 0 && i+1 < argc) {
+            reference_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "-search") == 0 && i+1 < argc) {
+            search_pattern = argv[++i];
+        }
+        else if (strcmp(argv[i], "-archive") == 0 && i+1 < argc) {
+            archive_directory = argv[++i];
+        }
+        else if (strcmp(argv[i], "-extract") == 0 && i+1 < argc) {
+            archive_directory = argv[++i];
+            extract = true;
+        }
+        else if (strcmp(argv[i], "-solid") == 0 && i+1 < argc) {
+            solid_block_size = std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-dedup") == 0) {
+            dedup = true;
+        }
+        else if (strcmp(argv[i], "-dedupstore") == 0 && i+1 < argc) {
+            dedup_store_file = argv[++i];
+            dedup = true;
+        }
+        else if (strcmp(argv[i], "-batch") == 0 && i+1 < argc) {
+            record_size = std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-threads") == 0 && i+1 < argc) {
+            num_threads = std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-output") == 0 && i+1 < argc) {
+            output_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "-block") == 0 && i+1 < argc) {
+            io_options.m_block_size = std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-direct") == 0) {
+            io_options.m_direct = true;
+        }
+        else if (strcmp(argv[i], "-daemon") == 0 && i+1 < argc) {
+            daemon_socket = argv[++i];
+        }
+        else if (strcmp(argv[i], "-client") == 0 && i+1 < argc) {
+            client_socket = argv[++i];
+        }
+        else if (strcmp(argv[i], "-pin") == 0) {
+            pin_threads = true;
+        }
+        else if (strcmp(argv[i], "-unsealed") == 0) {
+            allow_unsealed = true;
+        }
+        else if (strcmp(argv[i], "-benchmark") == 0) {
+            benchmark = true;
+        }
         else {
             filename = argv[i];
         }
     }
 
-    if (compress_ops.size() == 0) {
+    if (benchmark) {
+        std::vector<unsigned char> file_input;
+        if (filename != "") {
+            file_input = readFile(filename);
+        }
+        run_benchmarks(std::cout, benchmark_default_size, file_input);
+        return 0;
+    }
+
+    //The other modes compress through Codec.h, which only knows the default settings
+    if (algorithm_options.custom() && (daemon_socket != "" || client_socket != "" || archive_directory != "" || dedup || record_size > 0)) {
+        std::cerr << "-width, -checkpoints, -lzwbits and -lzap do not work with -daemon, -client, -archive, -dedup or -batch." << std::endl;
+        exit(-1);
+    }
+
+    if (daemon_socket != "") {
+        runDaemon(daemon_socket, num_threads, pin_threads, allow_unsealed);
+        return 0;
+    }
+
+    if (archive_directory != "") {
+        if (filename == "") {
+            std::cerr << "Please enter the file name of the archive." << std::endl;
+            exit(-1);
+        }
+        ArchiveOptions options;
+        options.m_num_threads = num_threads;
+        options.m_solid_block_size = solid_block_size;
+        runArchive(archive_directory, filename, extract, compress_ops, options);
+        return 0;
+    }
+
+    if (search_pattern != "") {
+        if (filename == "") {
+            input.insert(input.begin(), test_data, test_data+test_data_size);
+        }
+        else {
+            input = readFile(filename);
+        }
+        runSearch(input, search_pattern, algorithm_options.m_lzw_code_bits, algorithm_options.m_lzw_variant);
+        return 0;
+    }
+
+    if (compress_ops.size() == 0 && !dedup) {
         std::cerr << "Please enter at least one compression algorithm." << std::endl;
         std::cerr << "Example: <program> -lzw -huffman -lzw -huffman" << std::endl;
         exit(-1);
@@ -157,6 +728,15 @@ int main(int argc, char** argv) {
         input = readFile(filename);
     }
 
+    if (reference_file != "") {
+        if (compress_ops.empty() || compress_ops[0] != LZ77 || dedup || record_size > 0 || output_file != "") {
+            std::cerr << "Delta compression needs -lz77 as the first algorithm, and does not work with -dedup, -batch or -output." << std::endl;
+            exit(-1);
+        }
+        std::cout << "Using '" << reference_file << "' as reference." << std::endl;
+        reference = readFile(reference_file);
+    }
+
     //Print out what we are about to do
     if (compress_ops.size() > 0) {
         std::cout << compress_ops[0];
@@ -166,37 +746,81 @@ int main(int argc, char** argv) {
         std::cout << std::endl;
     }
 
-    //Now perform actual compression
-    std::cout << "Compressing:" << std::endl;
-    std::cout << "Input: " << input.size() << " bytes" << std::endl;
-    std::vector<unsigned char> data = input;
-    for (size_t i=0; i<compress_ops.size(); ++i) {
-        std::cout << " +" << compress_ops[i] << ":";
-        switch(compress_ops[i]) {
-        case LZW: output = lzw_compress(data); break;
-        case HUFFMAN: output = huffman_compress(data); break;
-        default: output = data; break;
-        }
-        std::cout << output.size() << " bytes" << std::endl;
-        data = output;
+    if (output_file != "") {
+        if (filename == "") {
+            std::cerr << "Please enter the file name of the input to stream." << std::endl;
+            exit(-1);
+        }
+        runStream(filename, output_file, compress_ops, algorithm_options, io_options);
+        output = readFile(output_file + ".out");
     }
-    std::cout << std::endl;
+    else if (client_socket != "") {
+        output = runClient(input, compress_ops, client_socket);
+    }
+    else if (dedup) {
+        output = runDedup(input, compress_ops, num_threads, dedup_store_file);
+    }
+    else if (record_size > 0) {
+        output = runBatch(input, compress_ops, record_size, num_threads);
+    }
+    else {
+        //Now perform actual compression
+        std::cout << "Compressing:" << std::endl;
+        std::cout << "Input: " << input.size() << " bytes" << std::endl;
+        std::vector<unsigned char> data = input;
+        for (size_t i=0; i<compress_ops.size(); ++i) {
+            std::cout << " +" << compress_ops[i] << ":";
+            output.clear();
+            try {
+                if (compress_ops[i] == BWT) {
+                    bwt_compress(data.data(), data.size(), output, bwt_default_block_size, num_threads);
+                }
+                else if (compress_ops[i] == LZ77 && i == 0 && reference_file != "") {
+                    lz77_delta_compress(reference, data.data(), data.size(), output);
+                }
+                else {
+                    compressWith(compress_ops[i], algorithm_options, data.data(), data.size(), output);
+                }
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Compression failed: " << e.what() << std::endl;
+                exit(-1);
+            }
+            std::cout << output.size() << " bytes" << std::endl;
+            data = output;
+        }
+        std::cout << std::endl;
 
-    //Then decompress
-    std::reverse(compress_ops.begin(), compress_ops.end());
-    std::cout << "Decompressing:" << std::endl;
-    std::cout << "Input: " << data.size() << " bytes" << std::endl;
-    for (size_t i=0; i<compress_ops.size(); ++i) {
-        std::cout << " -" << compress_ops[i] << ":";
-        switch(compress_ops[i]) {
-        case LZW: output = lzw_decompress(data); break;
-        case HUFFMAN: output = huffman_decompress(data); break;
-        default: output = data; break;
+        //Then decompress
+        std::reverse(compress_ops.begin(), compress_ops.end());
+        std::cout << "Decompressing:" << std::endl;
+        std::cout << "Input: " << data.size() << " bytes" << std::endl;
+        for (size_t i=0; i<compress_ops.size(); ++i) {
+            std::cout << " -" << compress_ops[i] << ":";
+            output.clear();
+            try {
+                if (compress_ops[i] == HUFFMAN && num_threads > 1) {
+                    output = huffman_decompress_parallel(data, num_threads);
+                }
+                else if (compress_ops[i] == LZ77 && i+1 == compress_ops.size() && reference_file != "") {
+                    lz77_delta_decompress(reference, data.data(), data.size(), output);
+                }
+                else if (compress_ops[i] == BWT) {
+                    bwt_decompress(data.data(), data.size(), output, num_threads);
+                }
+                else {
+                    decompress(compress_ops[i], data.data(), data.size(), output);
+                }
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Decompression failed: " << e.what() << std::endl;
+                exit(-1);
+            }
+            std::cout << output.size() << " bytes" << std::endl;
+            data = output;
         }
-        std::cout << output.size() << " bytes" << std::endl;
-        data = output;
+        std::cout << std::endl;
     }
-    std::cout << std::endl;
 
     //Compare original with decompressed
     if (input.size() != output.size()) {
@@ -0,0 +1,123 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+
+/**
+  * Helpers shared by the standalone tests in this directory. Every test is 
+  * a single program, so they are defined here rather than in a library.
+  */
+
+/**
+  * Number of failed checks so far
+  */
+inline int& numFailures() {
+    static int num_failures = 0;
+    return num_failures;
+}
+
+inline void check(bool condition_, const std::string& message_) {
+    std::cout << (condition_ ? "Passed: " : "FAILED: ") << message_ << std::endl;
+    if (!condition_) {
+        ++numFailures();
+    }
+}
+
+/**
+  * Checks that function_ throws an Exception_
+  */
+template <typename Exception_, typename Function_>
+void checkThrows(Function_ function_, const std::string& message_) {
+    try {
+        function_();
+        check(false, message_);
+    }
+    catch (const Exception_&) {
+        check(true, message_);
+    }
+}
+
+/**
+  * Prints the summary, and returns the exit code of the test
+  */
+inline int testResult() {
+    if (numFailures() > 0) {
+        std::cout << numFailures() << " tests failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "All tests passed" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+/**
+  * size_ bytes of pseudo random text, which only repeats where we copy it
+  */
+inline std::vector<unsigned char> randomText(size_t size_, unsigned int seed_) {
+    std::vector<unsigned char> output(size_);
+    unsigned int state = seed_;
+    for (size_t i=0; i<size_; ++i) {
+        state = state * 1103515245u + 12345u;
+        output[i] = static_cast<unsigned char>('a' + (state >> 16) % 26);
+    }
+    return output;
+}
+
+/**
+  * size_ pseudo random bytes
+  */
+inline std::vector<unsigned char> randomBytes(size_t size_, unsigned int seed_) {
+    std::vector<unsigned char> output(size_);
+    unsigned int state = seed_;
+    for (size_t i=0; i<size_; ++i) {
+        state = state * 1103515245u + 12345u;
+        output[i] = static_cast<unsigned char>(state >> 16);
+    }
+    return output;
+}
+
+/**
+  * About size_ bytes of words from a small vocabulary, where half the words
+  * repeat one of the last few words
+  */
+inline std::vector<unsigned char> wordSoup(size_t size_, unsigned int seed_) {
+    const char* words[] = { "error", "warn", "info", "request", "id", "user", "ok", "failed", 
+        "timeout", "retry", "db", "cache", "miss", "hit", "GET", "POST" };
+    const size_t num_words = sizeof(words) / sizeof(words[0]);
+    unsigned int state = seed_;
+    std::vector<size_t> recent;
+    std::vector<unsigned char> output;
+    while (output.size() < size_) {
+        state = state * 1103515245u + 12345u;
+        size_t word = (state >> 16) % num_words;
+        if (recent.size() > 8 && (state >> 8) % 2 == 0) {
+            word = recent[recent.size() - 1 - (state >> 20) % 8];
+        }
+        recent.push_back(word);
+        output.insert(output.end(), words[word], words[word] + std::string(words[word]).size());
+        output.push_back(((state >> 4) % 16 == 0) ? '\n' : ' ');
+    }
+    output.resize(size_);
+    return output;
+}
\ No newline at end of file
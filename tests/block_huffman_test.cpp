@@ -0,0 +1,110 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "../Huffman.h"
+#include "Check.h"
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+/**
+  * Test of block Huffman coding: round trips over block boundaries, and
+  * that blocks reuse recent tables rather than storing a new one each. 
+  * See README.md for how to build and run it.
+  */
+
+namespace { //Avoid contaminating global namespace
+
+/**
+  * Blocks of block_size_ bytes which alternate between text and random bytes
+  */
+std::vector<unsigned char> alternatingBlocks(size_t num_blocks_, size_t block_size_) {
+    std::vector<unsigned char> output;
+    for (size_t i=0; i<num_blocks_; ++i) {
+        std::vector<unsigned char> block = (i % 2 == 0) ? randomText(block_size_, static_cast<unsigned int>(i+1)) 
+            : randomBytes(block_size_, static_cast<unsigned int>(i+1));
+        output.insert(output.end(), block.begin(), block.end());
+    }
+    return output;
+}
+
+} // Namespace
+
+int main() {
+    const size_t block_size = 4096;
+    const unsigned int num_tables[] = { 0, 1, 4, 254 };
+    const size_t sizes[] = { 0, 1, block_size-1, block_size, block_size+1, 10*block_size+17 };
+
+    //Every number of tables round trips text, bytes, words and a single character
+    size_t num_mismatches = 0;
+    size_t num_cases = 0;
+    for (unsigned int tables : num_tables) {
+        for (size_t size : sizes) {
+            std::vector<std::vector<unsigned char>> inputs;
+            inputs.push_back(randomText(size, static_cast<unsigned int>(size+1)));
+            inputs.push_back(randomBytes(size, static_cast<unsigned int>(size+2)));
+            inputs.push_back(wordSoup(size, static_cast<unsigned int>(size+3)));
+            inputs.push_back(std::vector<unsigned char>(size, 'x'));
+            for (size_t i=0; i<inputs.size(); ++i) {
+                std::vector<unsigned char> compressed = huffman_block_compress(inputs[i], block_size, tables);
+                if (huffman_block_decompress(compressed) != inputs[i]) {
+                    num_mismatches += 1;
+                }
+                num_cases += 1;
+            }
+        }
+    }
+    check(num_mismatches == 0, "round trips in " + std::to_string(num_cases) + " cases");
+
+    //Homogeneous blocks share one table, which saves most of a table per block
+    std::vector<unsigned char> text = randomText(64*block_size, 1);
+    std::vector<unsigned char> shared = huffman_block_compress(text, block_size, 4);
+    std::vector<unsigned char> unshared = huffman_block_compress(text, block_size, 0);
+    check(shared.size() + 63*40 < unshared.size(), "text compresses to " + std::to_string(shared.size()) 
+        + " bytes with reuse, " + std::to_string(unshared.size()) + " without");
+
+    //Alternating blocks reuse both of their tables when two are kept, but not with one
+    std::vector<unsigned char> alternating = alternatingBlocks(32, block_size);
+    std::vector<unsigned char> two_tables = huffman_block_compress(alternating, block_size, 2);
+    std::vector<unsigned char> one_table = huffman_block_compress(alternating, block_size, 1);
+    check(huffman_block_decompress(two_tables) == alternating && huffman_block_decompress(one_table) == alternating, 
+        "alternating blocks round trip");
+    check(two_tables.size() + 30*40 < one_table.size(), "alternating blocks compress to " + std::to_string(two_tables.size()) 
+        + " bytes with two tables, " + std::to_string(one_table.size()) + " with one");
+
+    //Invalid parameters and malformed streams are rejected
+    checkThrows<std::invalid_argument>([&]() { huffman_block_compress(text, 0, 4); }, "block size of 0 is rejected");
+    checkThrows<std::invalid_argument>([&]() { huffman_block_compress(text, block_size, 255); }, "255 tables are rejected");
+    std::vector<unsigned char> small = randomText(100, 2);
+    std::vector<unsigned char> compressed = huffman_block_compress(small, block_size, 4);
+    std::vector<unsigned char> output(99);
+    checkThrows<std::length_error>([&]() { huffman_block_decompress(compressed.data(), compressed.size(), output.data(), output.size()); }, 
+        "too small output is rejected");
+    checkThrows<std::runtime_error>([&]() { huffman_block_decompress(std::vector<unsigned char>(compressed.begin(), compressed.end()-10)); }, 
+        "truncated stream is rejected");
+
+    //The first block has no recent table to reuse. Its mode byte follows the length, block size and number of tables.
+    std::vector<unsigned char> missing = compressed;
+    missing[4] = 1;
+    checkThrows<std::runtime_error>([&]() { huffman_block_decompress(missing); }, "reuse of a missing table is rejected");
+
+    return testResult();
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "../BWT.h"
+#include "../Huffman.h"
+#include "Check.h"
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+/**
+  * Test of the Burrows-Wheeler transform stage: round trips of edge cases and
+  * of several blocks on several threads, the gain in front of Huffman coding,
+  * and rejection of truncated streams. See README.md for how to build and run it.
+  */
+
+int main() {
+    //Edge cases: empty, a single character, runs, and every byte value
+    std::vector<std::vector<unsigned char> > inputs;
+    inputs.push_back(std::vector<unsigned char>());
+    inputs.push_back(std::vector<unsigned char>(1, 'x'));
+    inputs.push_back(std::vector<unsigned char>(100000, 0));
+    inputs.push_back(std::vector<unsigned char>(100000, 255));
+    std::string banana = "banana";
+    inputs.push_back(std::vector<unsigned char>(banana.begin(), banana.end()));
+    inputs.push_back(randomBytes(100000, 1));
+    std::vector<unsigned char> all_bytes;
+    for (unsigned int i=0; i<256*16; ++i) {
+        all_bytes.push_back(static_cast<unsigned char>(i % 256));
+    }
+    inputs.push_back(all_bytes);
+    for (size_t i=0; i<inputs.size(); ++i) {
+        check(bwt_decompress(bwt_compress(inputs[i])) == inputs[i], "round trip of input " + std::to_string(i) 
+            + " (" + std::to_string(inputs[i].size()) + " bytes)");
+    }
+
+    //Many small blocks give the same stream and output on any number of threads
+    std::vector<unsigned char> text = wordSoup(1 << 20, 1);
+    std::vector<unsigned char> serial = bwt_compress(text, 4096, 1);
+    for (unsigned int threads=2; threads<=8; threads*=2) {
+        std::vector<unsigned char> parallel = bwt_compress(text, 4096, threads);
+        check(parallel == serial, "stream with " + std::to_string(threads) + " threads matches one thread");
+        check(bwt_decompress(parallel, threads) == text, "round trip with " + std::to_string(threads) + " threads");
+    }
+
+    //The transform groups the repeated contexts, which Huffman coding then exploits
+    size_t huffman_size = huffman_compress(text).size();
+    size_t bwt_huffman_size = huffman_compress(bwt_compress(text)).size();
+    check(bwt_huffman_size < huffman_size / 2, "BWT before Huffman gives " + std::to_string(bwt_huffman_size) 
+        + " bytes (" + std::to_string(huffman_size) + " without)");
+
+    //Every truncation of a stream is rejected
+    std::vector<unsigned char> compressed = bwt_compress(std::vector<unsigned char>(text.begin(), text.begin()+10000), 4096);
+    size_t num_accepted = 0;
+    for (size_t size=0; size<compressed.size(); ++size) {
+        try {
+            std::vector<unsigned char> output;
+            bwt_decompress(compressed.data(), size, output);
+            num_accepted += 1;
+        }
+        catch (const std::exception&) {
+        }
+    }
+    check(num_accepted == 0, "all " + std::to_string(compressed.size()) + " truncations are rejected");
+
+    return testResult();
+}
\ No newline at end of file
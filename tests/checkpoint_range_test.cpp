@@ -0,0 +1,125 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "../Huffman.h"
+#include "Check.h"
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+/**
+  * Test of decoding ranges of Huffman streams with checkpoints, around and 
+  * between checkpoints, and of streams without checkpoints. See README.md 
+  * for how to build and run it.
+  */
+
+namespace { //Avoid contaminating global namespace
+
+/**
+  * Returns true if every range in ranges_ decodes to the same characters as in data_
+  */
+bool rangesMatch(const std::vector<unsigned char>& data_, const std::vector<unsigned char>& compressed_, 
+        const std::vector<std::pair<size_t, size_t>>& ranges_) {
+    for (size_t i=0; i<ranges_.size(); ++i) {
+        size_t offset = ranges_[i].first;
+        size_t length = ranges_[i].second;
+        std::vector<unsigned char> range = huffman_decompress_range(compressed_, offset, length);
+        if (range != std::vector<unsigned char>(data_.begin()+offset, data_.begin()+offset+length)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+  * Ranges which start just before, at and just after every checkpoint, 
+  * cross checkpoints, and cover the whole input
+  */
+std::vector<std::pair<size_t, size_t>> testRanges(size_t size_, size_t interval_) {
+    std::vector<std::pair<size_t, size_t>> ranges;
+    ranges.push_back(std::make_pair(0, 0));
+    ranges.push_back(std::make_pair(0, size_));
+    ranges.push_back(std::make_pair(size_, 0));
+    for (size_t checkpoint=0; checkpoint<=size_; checkpoint+=interval_) {
+        for (size_t offset=(checkpoint > 0) ? checkpoint-1 : 0; offset<=checkpoint+1 && offset<size_; ++offset) {
+            ranges.push_back(std::make_pair(offset, 1));
+            ranges.push_back(std::make_pair(offset, std::min(interval_+2, size_-offset)));
+        }
+    }
+    ranges.push_back(std::make_pair(size_-1, 1));
+    return ranges;
+}
+
+} // Namespace
+
+int main() {
+    const size_t intervals[] = { 1, 7, 4096, huffman_default_checkpoint_interval };
+    const size_t sizes[] = { 1, 6, 7, 8, 4095, 4096, 4097, 100003 };
+
+    //Every interval and size, for text and for a single character
+    size_t num_mismatches = 0;
+    size_t num_cases = 0;
+    for (size_t interval : intervals) {
+        for (size_t size : sizes) {
+            if (interval == 1 && size > 5000) {
+                continue;
+            }
+            std::vector<std::vector<unsigned char>> inputs;
+            inputs.push_back(wordSoup(size, static_cast<unsigned int>(size+interval)));
+            inputs.push_back(std::vector<unsigned char>(size, 'x'));
+            for (size_t i=0; i<inputs.size(); ++i) {
+                std::vector<unsigned char> compressed = huffman_compress(inputs[i], false, interval);
+                if (huffman_decompress(compressed) != inputs[i] || !rangesMatch(inputs[i], compressed, testRanges(size, interval))) {
+                    num_mismatches += 1;
+                }
+                num_cases += 1;
+            }
+        }
+    }
+    check(num_mismatches == 0, "ranges match the input in " + std::to_string(num_cases) + " cases");
+
+    //Streams without checkpoints decode ranges from the start
+    std::vector<unsigned char> text = wordSoup(100003, 1);
+    std::vector<unsigned char> plain = huffman_compress(text);
+    check(rangesMatch(text, plain, testRanges(text.size(), 4096)), "ranges of a stream without checkpoints");
+
+    //Checkpoints cost at most one checkpoint width per interval
+    std::vector<unsigned char> checkpointed = huffman_compress(text, false, 4096);
+    check(checkpointed.size() <= plain.size() + 10 + (text.size()/4096)*3, "checkpoints add " 
+        + std::to_string(checkpointed.size() - plain.size()) + " bytes");
+
+    //Decoding starts at the closest checkpoint, so damage before it goes unnoticed
+    std::vector<unsigned char> early_damage = checkpointed;
+    early_damage[early_damage.size()/4] ^= 0xFF;
+    std::vector<std::pair<size_t, size_t>> last_interval(1, std::make_pair(text.size()-100, size_t(100)));
+    check(rangesMatch(text, early_damage, last_interval), "range after a checkpoint decodes without the data before it");
+
+    //Ranges outside the input and damaged checkpoints are rejected
+    checkThrows<std::invalid_argument>([&]() { huffman_decompress_range(checkpointed, text.size()-10, 11); }, "range past the end is rejected");
+    checkThrows<std::invalid_argument>([&]() { huffman_decompress_range(checkpointed, text.size()+1, 0); }, "offset past the end is rejected");
+    std::vector<unsigned char> damaged = checkpointed;
+    damaged[damaged.size()-1] = 0xFF;
+    damaged[damaged.size()-2] = 0xFF;
+    damaged[damaged.size()-3] = 0xFF;
+    checkThrows<std::runtime_error>([&]() { huffman_decompress_range(damaged, text.size()-1, 1); }, "checkpoint past the data is rejected");
+
+    return testResult();
+}
\ No newline at end of file
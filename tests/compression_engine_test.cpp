@@ -0,0 +1,191 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "../CompressionEngine.h"
+#include "../ThreadPool.h"
+#include "Check.h"
+
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <atomic>
+#include <stdexcept>
+
+/**
+  * Test of the asynchronous compression engine, driven by an in-process 
+  * stand-in for a storage service with several concurrent clients. See 
+  * README.md for how to build and run it.
+  */
+
+namespace { //Avoid contaminating global namespace
+
+/**
+  * Stand-in for a storage service. put() compresses an object on the engine
+  * and stores it from the completion callback, so the caller never blocks on
+  * compression, and get() decompresses it through a future.
+  */
+class StorageService {
+public:
+    StorageService(CompressionEngine& engine_) : m_engine(engine_), m_num_failed_puts(0) {}
+
+    void put(const std::string& key_, Compress_t type_, std::vector<unsigned char> data_, int priority_) {
+        m_engine.compress(type_, data_, [this, key_, type_](std::vector<unsigned char>& result_, std::exception_ptr error_) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (error_) {
+                m_num_failed_puts += 1;
+                return;
+            }
+            Object& object = m_objects[key_];
+            object.m_type = type_;
+            object.m_data.swap(result_);
+        }, priority_);
+    }
+
+    std::future<std::vector<unsigned char> > get(const std::string& key_) {
+        Object object;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            object = m_objects.at(key_);
+        }
+        return m_engine.decompress(object.m_type, object.m_data);
+    }
+
+    /**
+      * Overwrites a stored object, to simulate corruption on disk
+      */
+    void corrupt(const std::string& key_) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<unsigned char>& data = m_objects.at(key_).m_data;
+        data.assign(data.size(), 0xFF);
+    }
+
+    inline size_t numObjects() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_objects.size();
+    }
+
+    inline size_t numFailedPuts() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_num_failed_puts;
+    }
+
+private:
+    struct Object {
+        Compress_t m_type;
+        std::vector<unsigned char> m_data;
+    };
+
+    CompressionEngine& m_engine;
+    std::mutex m_mutex;
+    std::map<std::string, Object> m_objects;
+    size_t m_num_failed_puts;
+};
+
+/**
+  * Object number i_ of client client_: text, random bytes or empty
+  */
+std::vector<unsigned char> makeObject(unsigned int client_, unsigned int i_) {
+    unsigned int seed = client_ * 7919u + i_;
+    size_t size = (i_ % 10 == 0) ? 0 : (seed * 2654435761u) % 50000;
+    return (i_ % 3 == 0) ? randomBytes(size, seed) : randomText(size, seed);
+}
+
+} // Namespace
+
+int main() {
+    const Compress_t types[] = { LZW, HUFFMAN, LZ77, ADAPTIVE_HUFFMAN, HUFFMAN_BLOCKS, LZW_HUFFMAN };
+    const unsigned int num_types = sizeof(types) / sizeof(types[0]);
+    const unsigned int num_clients = 8;
+    const unsigned int num_objects = 60;
+
+    //A short queue, so that bursts from the clients are held back by back-pressure
+    CompressionEngine engine(4, 8);
+    StorageService service(engine);
+
+    //Bursts of puts from concurrent request threads, with mixed priorities
+    std::vector<std::thread> clients;
+    for (unsigned int c=0; c<num_clients; ++c) {
+        clients.push_back(std::thread([&, c]() {
+            for (unsigned int i=0; i<num_objects; ++i) {
+                service.put(std::to_string(c) + "/" + std::to_string(i), types[(c+i) % num_types], makeObject(c, i), i % 3);
+            }
+        }));
+    }
+    for (size_t c=0; c<clients.size(); ++c) {
+        clients[c].join();
+    }
+    engine.wait();
+    check(service.numObjects() == num_clients*num_objects && service.numFailedPuts() == 0, 
+        "all " + std::to_string(num_clients*num_objects) + " puts completed");
+
+    //Concurrent gets, which must all return the original objects
+    std::atomic<unsigned int> num_mismatches(0);
+    clients.clear();
+    for (unsigned int c=0; c<num_clients; ++c) {
+        clients.push_back(std::thread([&, c]() {
+            std::vector<std::future<std::vector<unsigned char> > > results;
+            for (unsigned int i=0; i<num_objects; ++i) {
+                results.push_back(service.get(std::to_string(c) + "/" + std::to_string(i)));
+            }
+            for (unsigned int i=0; i<num_objects; ++i) {
+                if (results[i].get() != makeObject(c, i)) {
+                    num_mismatches += 1;
+                }
+            }
+        }));
+    }
+    for (size_t c=0; c<clients.size(); ++c) {
+        clients[c].join();
+    }
+    check(num_mismatches == 0, "all gets return the stored objects");
+
+    //A corrupt object fails its get, and the engine keeps serving the others
+    service.corrupt("0/1");
+    checkThrows<std::exception>([&]() { service.get("0/1").get(); }, "corrupt object is reported through the future");
+    check(service.get("0/2").get() == makeObject(0, 2), "engine keeps working after a failed job");
+
+    //Errors also reach callbacks
+    std::promise<bool> callback_error;
+    engine.decompress(LZW, std::vector<unsigned char>(100, 0xFF), [&](std::vector<unsigned char>&, std::exception_ptr error_) {
+        callback_error.set_value(static_cast<bool>(error_));
+    });
+    check(callback_error.get_future().get(), "failed job is reported through the callback");
+
+    //A full queue refuses new tasks until a worker takes one
+    {
+        ThreadPool pool(1, 1);
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        std::promise<void> started;
+        pool.submit([&]() { started.set_value(); released.wait(); });
+        started.get_future().wait();
+        pool.submit([]() {});
+        check(!pool.trySubmit([]() {}), "full queue applies back-pressure");
+        release.set_value();
+        pool.wait();
+        check(pool.trySubmit([]() {}), "drained queue accepts tasks");
+        pool.wait();
+    }
+
+    return testResult();
+}
\ No newline at end of file
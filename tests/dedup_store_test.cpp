@@ -0,0 +1,95 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "../Dedup.h"
+#include "Check.h"
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+/**
+  * Test of deduplication across inputs with a chunk store shared between 
+  * calls. See README.md for how to build and run it.
+  */
+
+int main() {
+    const std::vector<Compress_t> compress_ops(1, HUFFMAN);
+
+    //The second input is the first with a few bytes inserted in the middle
+    std::vector<unsigned char> first = randomText(1 << 20, 1);
+    std::vector<unsigned char> second = first;
+    const char* insertion = "inserted text";
+    second.insert(second.begin() + second.size()/2, insertion, insertion + 13);
+
+    ChunkStore compress_store;
+    DedupStats first_stats;
+    DedupStats second_stats;
+    std::vector<unsigned char> first_compressed = dedup_compress(first.data(), first.size(), compress_ops, compress_store, DedupOptions(), &first_stats);
+    std::vector<unsigned char> second_compressed = dedup_compress(second.data(), second.size(), compress_ops, compress_store, DedupOptions(), &second_stats);
+    std::vector<unsigned char> alone = dedup_compress(second.data(), second.size(), compress_ops);
+    check(second_stats.m_unique_size < second.size() / 20, "second input adds " + std::to_string(second_stats.m_unique_size) 
+        + " of " + std::to_string(second.size()) + " bytes to the store");
+    check(second_compressed.size() < alone.size() / 10, "second input compresses to " + std::to_string(second_compressed.size()) 
+        + " bytes (" + std::to_string(alone.size()) + " without the shared store)");
+
+    //Decompressing in the same order rebuilds the same store
+    ChunkStore decompress_store;
+    check(dedup_decompress(first_compressed.data(), first_compressed.size(), decompress_store) == first, "first input round trip");
+    check(dedup_decompress(second_compressed.data(), second_compressed.size(), decompress_store) == second, "second input round trip");
+    check(decompress_store.digest() == compress_store.digest(), "stores match after decompressing");
+
+    //The second output refers to chunks of the first, so it cannot be decoded on its own
+    checkThrows<std::invalid_argument>([&]() { dedup_decompress(second_compressed.data(), second_compressed.size()); }, 
+        "output is rejected without its store");
+
+    //Nor against a store with the same number of different chunks
+    ChunkStore other_store;
+    for (size_t i=0; i<first_stats.m_num_unique_chunks; ++i) {
+        std::vector<unsigned char> chunk = randomText(100, static_cast<unsigned int>(i+2));
+        other_store.insert(chunk.data(), chunk.size());
+    }
+    checkThrows<std::invalid_argument>([&]() { dedup_decompress(second_compressed.data(), second_compressed.size(), other_store); }, 
+        "output is rejected against a different store");
+
+    //A saved store continues where the first process stopped
+    std::vector<unsigned char> saved;
+    compress_store.save(saved);
+    ChunkStore loaded_store;
+    loaded_store.load(saved.data(), saved.size());
+    check(loaded_store.numChunks() == compress_store.numChunks() && loaded_store.data() == compress_store.data()
+        && loaded_store.digest() == compress_store.digest(), "loaded store matches the saved one");
+    DedupStats loaded_stats;
+    std::vector<unsigned char> third_compressed = dedup_compress(second.data(), second.size(), compress_ops, loaded_store, DedupOptions(), &loaded_stats);
+    check(loaded_stats.m_num_unique_chunks == 0, "loaded store already holds every chunk of the second input");
+    ChunkStore reloaded_store;
+    reloaded_store.load(saved.data(), saved.size());
+    check(dedup_decompress(third_compressed.data(), third_compressed.size(), reloaded_store) == second, "round trip against a loaded store");
+
+    //Damaged stores are rejected
+    std::vector<unsigned char> damaged = saved;
+    damaged.back() ^= 1;
+    checkThrows<std::runtime_error>([&]() { ChunkStore store; store.load(damaged.data(), damaged.size()); }, 
+        "store with damaged data is rejected");
+    checkThrows<std::runtime_error>([&]() { ChunkStore store; store.load(saved.data(), saved.size()-1); }, 
+        "truncated store is rejected");
+
+    return testResult();
+}
\ No newline at end of file
@@ -0,0 +1,124 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "../Filter.h"
+#include "Check.h"
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+
+/**
+  * Test of the byte shuffle, delta and XOR delta filters against plain scalar
+  * versions, for sizes which exercise both the vector kernels and the tails.
+  * See README.md for how to build and run it.
+  */
+
+namespace { //Avoid contaminating global namespace
+
+/**
+  * The filtered data without header, computed one element at a time
+  */
+std::vector<unsigned char> referenceFilter(Filter_t filter_, unsigned int width_, const std::vector<unsigned char>& data_) {
+    std::vector<unsigned char> output(data_);
+    const size_t num_elements = data_.size() / width_;
+    if (filter_ == FILTER_SHUFFLE) {
+        for (size_t i=0; i<num_elements; ++i) {
+            for (unsigned int b=0; b<width_; ++b) {
+                output[b*num_elements + i] = data_[i*width_ + b];
+            }
+        }
+        return output;
+    }
+
+    uint64_t previous = 0;
+    for (size_t i=0; i<num_elements; ++i) {
+        uint64_t value = 0;
+        for (unsigned int b=0; b<width_; ++b) {
+            value |= static_cast<uint64_t>(data_[i*width_ + b]) << (8*b);
+        }
+        uint64_t filtered = (filter_ == FILTER_DELTA) ? value - previous : value ^ previous;
+        for (unsigned int b=0; b<width_; ++b) {
+            output[i*width_ + b] = static_cast<unsigned char>(filtered >> (8*b));
+        }
+        previous = value;
+    }
+    return output;
+}
+
+} // Namespace
+
+int main() {
+    const Filter_t filters[] = { FILTER_SHUFFLE, FILTER_DELTA, FILTER_XOR_DELTA };
+    const char* names[] = { "shuffle", "delta", "XOR delta" };
+    const unsigned int widths[] = { 1, 2, 3, 4, 5, 8, 16, 255 };
+    const size_t sizes[] = { 0, 1, 7, 15, 16, 17, 63, 64, 65, 1000, 4099, 100003 };
+
+    //Every filter and width against the scalar version, and back
+    for (unsigned int f=0; f<3; ++f) {
+        size_t num_mismatches = 0;
+        size_t num_cases = 0;
+        for (unsigned int width : widths) {
+            if (filters[f] != FILTER_SHUFFLE && width != 1 && width != 2 && width != 4 && width != 8) {
+                continue;
+            }
+            for (size_t size : sizes) {
+                std::vector<unsigned char> data = randomBytes(size, static_cast<unsigned int>(size + width));
+                std::vector<unsigned char> encoded = filter_encode(filters[f], width, data);
+                std::vector<unsigned char> expected = referenceFilter(filters[f], width, data);
+                bool matches = encoded.size() == expected.size() + 2 && std::equal(expected.begin(), expected.end(), encoded.begin() + 2);
+                if (!matches || filter_decode(encoded) != data) {
+                    num_mismatches += 1;
+                }
+                num_cases += 1;
+            }
+        }
+        check(num_mismatches == 0, std::string(names[f]) + " matches the scalar version and round trips in " 
+            + std::to_string(num_cases) + " cases");
+    }
+
+    //Delta turns a counter into a constant
+    std::vector<unsigned char> counter(4000);
+    for (uint32_t i=0; i<1000; ++i) {
+        uint32_t value = 1000000 + 7*i;
+        for (unsigned int b=0; b<4; ++b) {
+            counter[4*i + b] = static_cast<unsigned char>(value >> (8*b));
+        }
+    }
+    std::vector<unsigned char> delta = filter_encode(FILTER_DELTA, 4, counter);
+    bool constant = true;
+    for (size_t i=2+4; i<delta.size(); ++i) {
+        constant = constant && delta[i] == ((i-2) % 4 == 0 ? 7 : 0);
+    }
+    check(constant, "delta of a counter is constant");
+
+    //Unsupported widths and malformed headers are rejected
+    std::vector<unsigned char> data = randomBytes(100, 1);
+    checkThrows<std::runtime_error>([&]() { filter_encode(FILTER_DELTA, 3, data); }, "delta rejects a width of 3");
+    checkThrows<std::runtime_error>([&]() { filter_encode(FILTER_SHUFFLE, 0, data); }, "shuffle rejects a width of 0");
+    checkThrows<std::runtime_error>([&]() { filter_decode(std::vector<unsigned char>(1, 0)); }, "truncated header is rejected");
+    std::vector<unsigned char> unknown = filter_encode(FILTER_SHUFFLE, 4, data);
+    unknown[0] = 3;
+    checkThrows<std::runtime_error>([&]() { filter_decode(unknown); }, "unknown filter is rejected");
+
+    return testResult();
+}
\ No newline at end of file
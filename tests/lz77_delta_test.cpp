@@ -0,0 +1,73 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "../LZ77.h"
+#include "Check.h"
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+/**
+  * Test of LZ77 delta compression on log-like text with a lot of local 
+  * repetition, where local matches fill the hash chains and hide the matches
+  * into the reference. See README.md for how to build and run it.
+  */
+
+int main() {
+    std::vector<unsigned char> reference = wordSoup(1 << 20, 1);
+    size_t plain_size = lz77_compress(reference).size();
+
+    //An identical reference leaves nothing but one long match
+    std::vector<unsigned char> compressed = lz77_delta_compress(reference, reference);
+    check(lz77_delta_decompress(reference, compressed) == reference, "identical reference round trip");
+    check(compressed.size() < 64, "identical reference compresses to " + std::to_string(compressed.size()) 
+        + " bytes (plain LZ77 " + std::to_string(plain_size) + ")");
+
+    //Insertions, deletions and replacements shift the data against the reference
+    std::vector<unsigned char> edited = reference;
+    for (size_t i=0; i<100; ++i) {
+        size_t pos = (i * 104729) % (edited.size() - 16);
+        if (i % 3 == 0) {
+            const char* insertion = "inserted text";
+            edited.insert(edited.begin() + pos, insertion, insertion + 13);
+        }
+        else if (i % 3 == 1) {
+            edited.erase(edited.begin() + pos, edited.begin() + pos + 7);
+        }
+        else {
+            edited[pos] = '#';
+        }
+    }
+    compressed = lz77_delta_compress(reference, edited);
+    check(lz77_delta_decompress(reference, compressed) == edited, "edited data round trip");
+    check(compressed.size() < plain_size / 50, "edited data compresses to " + std::to_string(compressed.size()) + " bytes");
+
+    //A different reference of the same size must be rejected rather than decode to garbage
+    std::vector<unsigned char> other = wordSoup(reference.size(), 2);
+    checkThrows<std::invalid_argument>([&]() { lz77_delta_decompress(other, compressed); }, "different reference is rejected");
+
+    //Empty reference and empty data
+    std::vector<unsigned char> empty;
+    check(lz77_delta_decompress(empty, lz77_delta_compress(empty, reference)) == reference, "empty reference round trip");
+    check(lz77_delta_decompress(reference, lz77_delta_compress(reference, empty)) == empty, "empty data round trip");
+
+    return testResult();
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+/**
+  *
+  * Compression demos - shows how some classical compression techniques
+  * can be implemented in C++. Copyright (C) 2014 Andr R. Brodtkorb
+  * 
+  * This program is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  * 
+  * This program is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  * 
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  *
+  ***/
+
+#include "../LZW.h"
+#include "../Huffman.h"
+#include "Check.h"
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+/**
+  * Test of LZW with Huffman coded codes: round trips for every code width and
+  * variant, the gain over Huffman coding the packed codes, and rejection of 
+  * malformed streams. See README.md for how to build and run it.
+  */
+
+int main() {
+    const LZWVariant_t variants[] = { LZW_CLASSIC, LZW_LZAP };
+    const char* names[] = { "classic", "LZAP" };
+    const size_t sizes[] = { 0, 1, 2, 100, 70000 };
+
+    //Every code width and variant round trips text, bytes, words and a single character
+    for (unsigned int v=0; v<2; ++v) {
+        size_t num_mismatches = 0;
+        size_t num_cases = 0;
+        for (unsigned int code_bits=9; code_bits<=16; ++code_bits) {
+            for (size_t size : sizes) {
+                std::vector<std::vector<unsigned char>> inputs;
+                inputs.push_back(randomText(size, static_cast<unsigned int>(size+1)));
+                inputs.push_back(randomBytes(size, static_cast<unsigned int>(size+2)));
+                inputs.push_back(wordSoup(size, static_cast<unsigned int>(size+3)));
+                inputs.push_back(std::vector<unsigned char>(size, 'x'));
+                for (size_t i=0; i<inputs.size(); ++i) {
+                    std::vector<unsigned char> compressed = lzw_huffman_compress(inputs[i], code_bits, variants[v]);
+                    if (lzw_huffman_decompressed_size(compressed.data(), compressed.size()) != inputs[i].size() 
+                            || lzw_huffman_decompress(compressed) != inputs[i]) {
+                        num_mismatches += 1;
+                    }
+                    num_cases += 1;
+                }
+            }
+        }
+        check(num_mismatches == 0, std::string(names[v]) + " round trips in " + std::to_string(num_cases) + " cases");
+    }
+
+    //Coding the codes themselves beats Huffman coding the bytes of packed codes
+    std::vector<unsigned char> words = wordSoup(1 << 20, 1);
+    std::vector<unsigned char> coded = lzw_huffman_compress(words);
+    std::vector<unsigned char> packed = huffman_compress(lzw_compress(words));
+    check(coded.size() < packed.size(), "words compress to " + std::to_string(coded.size()) + " bytes, " 
+        + std::to_string(packed.size()) + " with -lzw -huffman");
+
+    //Invalid parameters and malformed streams are rejected
+    checkThrows<std::invalid_argument>([&]() { lzw_huffman_compress(words, 8); }, "too narrow code width is rejected");
+    checkThrows<std::invalid_argument>([&]() { lzw_huffman_compress(words, 17); }, "too wide code width is rejected");
+    std::vector<unsigned char> output(words.size()-1);
+    checkThrows<std::length_error>([&]() { lzw_huffman_decompress(coded.data(), coded.size(), output.data(), output.size()); }, 
+        "too small output is rejected");
+    checkThrows<std::runtime_error>([&]() { lzw_huffman_decompress(std::vector<unsigned char>(coded.begin(), coded.begin()+coded.size()/2)); }, 
+        "truncated stream is rejected");
+    std::vector<unsigned char> unknown = coded;
+    unknown[0] ^= 1;
+    checkThrows<std::runtime_error>([&]() { lzw_huffman_decompress(unknown); }, "stream without the magic is rejected");
+
+    //Damaged streams either decode to something or throw, but never read or write out of bounds
+    std::vector<unsigned char> small = lzw_huffman_compress(wordSoup(5000, 2), 10, LZW_LZAP);
+    size_t num_rejected = 0;
+    for (size_t i=0; i<small.size(); i+=7) {
+        std::vector<unsigned char> damaged = small;
+        damaged[i] ^= 0x5A;
+        try {
+            lzw_huffman_decompress(damaged);
+        }
+        catch (const std::exception&) {
+            num_rejected += 1;
+        }
+    }
+    check(num_rejected > 0, "damaged streams are decoded or rejected (" + std::to_string(num_rejected) + " rejected)");
+
+    return testResult();
+}
\ No newline at end of file